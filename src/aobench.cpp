@@ -0,0 +1,251 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <libgen.h>
+
+#include "bench/flagwritebenchmark.h"
+#include "bench/kernelbenchmark.h"
+#include "bench/replaybenchmark.h"
+#include "bench/svdbenchmark.h"
+#include "bench/uvfitsbenchmark.h"
+
+#include "structures/system.h"
+
+#include "util/aologger.h"
+
+int main(int argc, char *argv[])
+{
+	AOLogger::Init(basename(argv[0]));
+	BenchConfiguration config;
+	config.width = 1000;
+	config.height = 256;
+	config.polarizationCount = 4;
+	config.threadCount = System::ProcessorCount();
+	config.repeatCount = 1;
+	config.seed = 42;
+	std::string outputFilename, kernelSelection;
+	ReplayConfiguration replayConfig;
+	replayConfig.chunkSize = 32;
+	replayConfig.contextSize = 128;
+	replayConfig.maxBaselines = 10;
+	replayConfig.tolerance = 0.01;
+	UVFitsScalingConfiguration uvfitsConfig;
+	uvfitsConfig.timestepCount = 100;
+	uvfitsConfig.channelCount = 64;
+	FlagWriteConfiguration flagWriteConfig;
+	flagWriteConfig.antennaCount = 16;
+	SVDConfiguration svdConfig;
+	svdConfig.signalRank = 3;
+
+	int argi = 1;
+	while(argi < argc && argv[argi][0] == '-')
+	{
+		const std::string p(argv[argi]+1);
+		if(p == "width" && argi+1 < argc)
+			config.width = atoi(argv[++argi]);
+		else if(p == "height" && argi+1 < argc)
+			config.height = atoi(argv[++argi]);
+		else if(p == "pol" && argi+1 < argc)
+			config.polarizationCount = atoi(argv[++argi]);
+		else if(p == "j" && argi+1 < argc)
+			config.threadCount = atoi(argv[++argi]);
+		else if(p == "repeat" && argi+1 < argc)
+			config.repeatCount = atoi(argv[++argi]);
+		else if(p == "seed" && argi+1 < argc)
+			config.seed = atoi(argv[++argi]);
+		else if(p == "kernel" && argi+1 < argc)
+			kernelSelection = argv[++argi];
+		else if(p == "o" && argi+1 < argc)
+			outputFilename = argv[++argi];
+		else if(p == "replay" && argi+1 < argc)
+			replayConfig.filename = argv[++argi];
+		else if(p == "strategy" && argi+1 < argc)
+			replayConfig.strategyFilename = argv[++argi];
+		else if(p == "chunk" && argi+1 < argc)
+			replayConfig.chunkSize = atoi(argv[++argi]);
+		else if(p == "context" && argi+1 < argc)
+			replayConfig.contextSize = atoi(argv[++argi]);
+		else if(p == "baselines" && argi+1 < argc)
+			replayConfig.maxBaselines = atoi(argv[++argi]);
+		else if(p == "tolerance" && argi+1 < argc)
+			replayConfig.tolerance = atof(argv[++argi]);
+		else if(p == "uvfits" && argi+1 < argc)
+			uvfitsConfig.filename = argv[++argi];
+		else if(p == "antennas" && argi+1 < argc)
+		{
+			std::istringstream list(argv[++argi]);
+			std::string antennaCount;
+			while(std::getline(list, antennaCount, ','))
+				uvfitsConfig.antennaCounts.push_back(atoi(antennaCount.c_str()));
+		}
+		else if(p == "timesteps" && argi+1 < argc)
+			uvfitsConfig.timestepCount = atoi(argv[++argi]);
+		else if(p == "channels" && argi+1 < argc)
+			uvfitsConfig.channelCount = atoi(argv[++argi]);
+		else if(p == "flag-write" && argi+1 < argc)
+			flagWriteConfig.filename = argv[++argi];
+		else if(p == "ms-antennas" && argi+1 < argc)
+			flagWriteConfig.antennaCount = atoi(argv[++argi]);
+		else if(p == "svd" && argi+1 < argc)
+		{
+			std::istringstream list(argv[++argi]);
+			std::string removeCount;
+			while(std::getline(list, removeCount, ','))
+				svdConfig.removeCounts.push_back(atoi(removeCount.c_str()));
+		}
+		else if(p == "signal-rank" && argi+1 < argc)
+			svdConfig.signalRank = atoi(argv[++argi]);
+		else {
+			std::cerr << "Usage: " << argv[0] << " [options]\n"
+				"Times the flagging kernels, the default strategy and a Python strategy together with\n"
+				"its native equivalent on synthetic data, and writes the throughput as JSON.\n"
+				"  -width <n>     number of timesteps per baseline (default 1000)\n"
+				"  -height <n>    number of channels per baseline (default 256)\n"
+				"  -pol <n>       number of polarizations: 1, 2 or 4 (default 4)\n"
+				"  -j <n>         number of baselines that are processed in parallel (default: nr. of cpus)\n"
+				"  -repeat <n>    number of times each baseline is processed (default 1)\n"
+				"  -seed <n>      seed for the data generator (default 42)\n"
+				"  -kernel <name> only run the given kernel; one of:\n"
+				"                 ";
+			KernelBenchmark::ListKernels(std::cerr);
+			std::cerr << "\n"
+				"  -o <file>      write JSON to file instead of stdout\n"
+				"\n"
+				"Replay mode: flag the baselines of a measurement set in one go and with a streaming\n"
+				"flagging session, one timestep at a time, and compare the flags. Returns a non-zero\n"
+				"exit code when the flags differ by more than the tolerance.\n"
+				"  -replay <ms>      measurement set to replay\n"
+				"  -strategy <file>  strategy to use (default: generic strategy)\n"
+				"  -chunk <n>        number of timesteps finalized at once (default 32)\n"
+				"  -context <n>      number of context timesteps around a chunk (default 128)\n"
+				"  -baselines <n>    number of baselines to replay (default 10)\n"
+				"  -tolerance <f>    maximum fraction of samples with different flags (default 0.01)\n"
+				"\n"
+				"UVFITS mode: write synthetic UVFITS files with an increasing number of antennas, read\n"
+				"all their baselines and write the reading time against the number of baselines.\n"
+				"  -uvfits <file>    name of the temporary UVFITS file\n"
+				"  -antennas <list>  comma-separated numbers of antennas (default 4,8,16,32)\n"
+				"  -timesteps <n>    number of timesteps (default 100)\n"
+				"  -channels <n>     number of channels (default 64)\n"
+				"\n"
+				"Flag writing mode: write a synthetic measurement set, write random flags for all its\n"
+				"baselines as the strategy does, then write the same flags again, and write the times.\n"
+				"Uses -timesteps, -channels and -seed.\n"
+				"  -flag-write <ms>  name of the temporary measurement set\n"
+				"  -ms-antennas <n>  number of antennas (default 16)\n"
+				"\n"
+				"SVD mode: remove components from low-rank-plus-noise data of the given width and height\n"
+				"with the full and the truncated SVD, and write the times and accuracy.\n"
+				"  -svd <list>       comma-separated numbers of removed components, e.g. 3,10,30\n"
+				"  -signal-rank <n>  number of strong components in the data (default 3)\n";
+			return 1;
+		}
+		++argi;
+	}
+	if(!replayConfig.filename.empty())
+	{
+		if(replayConfig.chunkSize == 0)
+		{
+			std::cerr << "Invalid chunk size.\n";
+			return 1;
+		}
+		bool isWithinTolerance;
+		if(outputFilename.empty())
+			isWithinTolerance = ReplayBenchmark::Run(replayConfig, std::cout);
+		else {
+			std::ofstream file(outputFilename.c_str());
+			isWithinTolerance = ReplayBenchmark::Run(replayConfig, file);
+		}
+		return isWithinTolerance ? 0 : 2;
+	}
+
+	if(!uvfitsConfig.filename.empty())
+	{
+		if(uvfitsConfig.antennaCounts.empty())
+		{
+			const size_t defaultCounts[] = { 4, 8, 16, 32 };
+			uvfitsConfig.antennaCounts.assign(defaultCounts, defaultCounts + 4);
+		}
+		for(size_t i=0; i!=uvfitsConfig.antennaCounts.size(); ++i)
+		{
+			if(uvfitsConfig.antennaCounts[i] < 2 || uvfitsConfig.antennaCounts[i] > 255)
+			{
+				std::cerr << "Invalid number of antennas: should be between 2 and 255.\n";
+				return 1;
+			}
+		}
+		if(uvfitsConfig.timestepCount == 0 || uvfitsConfig.channelCount == 0)
+		{
+			std::cerr << "Invalid benchmark dimensions.\n";
+			return 1;
+		}
+		if(outputFilename.empty())
+			UVFitsBenchmark::Run(uvfitsConfig, std::cout);
+		else {
+			std::ofstream file(outputFilename.c_str());
+			UVFitsBenchmark::Run(uvfitsConfig, file);
+		}
+		return 0;
+	}
+
+	if(!flagWriteConfig.filename.empty())
+	{
+		flagWriteConfig.timestepCount = uvfitsConfig.timestepCount;
+		flagWriteConfig.channelCount = uvfitsConfig.channelCount;
+		flagWriteConfig.seed = config.seed;
+		if(flagWriteConfig.antennaCount < 2 || flagWriteConfig.timestepCount == 0 || flagWriteConfig.channelCount == 0)
+		{
+			std::cerr << "Invalid benchmark dimensions.\n";
+			return 1;
+		}
+		if(outputFilename.empty())
+			FlagWriteBenchmark::Run(flagWriteConfig, std::cout);
+		else {
+			std::ofstream file(outputFilename.c_str());
+			FlagWriteBenchmark::Run(flagWriteConfig, file);
+		}
+		return 0;
+	}
+
+	if(!svdConfig.removeCounts.empty())
+	{
+		svdConfig.width = config.width;
+		svdConfig.height = config.height;
+		svdConfig.seed = config.seed;
+		if(svdConfig.width == 0 || svdConfig.height == 0)
+		{
+			std::cerr << "Invalid benchmark dimensions.\n";
+			return 1;
+		}
+		if(outputFilename.empty())
+			SVDBenchmark::Run(svdConfig, std::cout);
+		else {
+			std::ofstream file(outputFilename.c_str());
+			SVDBenchmark::Run(svdConfig, file);
+		}
+		return 0;
+	}
+
+	if(config.width == 0 || config.height == 0 || config.threadCount == 0 || config.repeatCount == 0)
+	{
+		std::cerr << "Invalid benchmark dimensions.\n";
+		return 1;
+	}
+	if(config.polarizationCount != 1 && config.polarizationCount != 2 && config.polarizationCount != 4)
+	{
+		std::cerr << "Invalid number of polarizations: should be 1, 2 or 4.\n";
+		return 1;
+	}
+
+	if(outputFilename.empty())
+		KernelBenchmark::Run(config, kernelSelection, std::cout);
+	else {
+		std::ofstream file(outputFilename.c_str());
+		KernelBenchmark::Run(config, kernelSelection, file);
+	}
+	return 0;
+}
@@ -1,3 +1,4 @@
+#include <fstream>
 #include <iostream>
 #include <string>
 
@@ -13,10 +14,12 @@
 #include "strategy/plots/frequencyflagcountplot.h"
 #include "strategy/plots/timeflagcountplot.h"
 
+#include "strategy/control/actionprofiler.h"
 #include "strategy/control/artifactset.h"
 #include "strategy/control/strategyreader.h"
 #include "strategy/control/defaultstrategy.h"
 
+#include "structures/imagebufferpool.h"
 #include "structures/system.h"
 
 #include "util/aologger.h"
@@ -117,6 +120,8 @@ int main(int argc, char **argv)
 		"  -column <name> specify column to flag\n"
 		"  -bands <list> comma separated list of (zero-indexed) band ids to process\n"
 		"  -fields <list> comma separated list of (zero-indexed) field ids to process\n"
+		"  -profile <prefix> measure the time and memory used by each action of the strategy, and\n"
+		"     write the results to <prefix>.txt and <prefix>.json\n"
 		"\n"
 		"This tool supports at least the Casa measurement set, the SDFITS and Filterbank formats. See\n"
 		"the documentation for support of other file types.\n";
@@ -137,6 +142,7 @@ int main(int argc, char **argv)
 	Parameter<bool> logVerbose;
 	Parameter<bool> skipFlagged;
 	Parameter<std::string> dataColumn;
+	Parameter<std::string> profilePrefix;
 	std::set<size_t> bands, fields;
 
 	size_t parameterIndex = 1;
@@ -208,6 +214,11 @@ int main(int argc, char **argv)
 			++parameterIndex;
 			NumberList::ParseIntList(argv[parameterIndex], fields);
 		}
+		else if(flag == "profile" && parameterIndex < (size_t) (argc-1))
+		{
+			++parameterIndex;
+			profilePrefix = std::string(argv[parameterIndex]);
+		}
 		else
 		{
 			AOLogger::Init(basename(argv[0]));
@@ -306,6 +317,9 @@ int main(int argc, char **argv)
 		artifacts.SetBaselineSelectionInfo(new rfiStrategy::BaselineSelector());
 		
 		ConsoleProgressHandler progress;
+		
+		if(profilePrefix.IsSet())
+			rfiStrategy::ActionProfiler::SetEnabled(true);
 
 		AOLogger::Info << "Starting strategy on " << to_simple_string(boost::posix_time::microsec_clock::local_time()) << '\n';
 		
@@ -313,6 +327,15 @@ int main(int argc, char **argv)
 		overallStrategy.StartPerformThread(artifacts, progress);
 		rfiStrategy::ArtifactSet *set = overallStrategy.JoinThread();
 		overallStrategy.FinishAll();
+		
+		if(profilePrefix.IsSet())
+		{
+			std::ofstream textFile((profilePrefix.Value() + ".txt").c_str());
+			rfiStrategy::ActionProfiler::WriteTextReport(textFile);
+			std::ofstream jsonFile((profilePrefix.Value() + ".json").c_str());
+			rfiStrategy::ActionProfiler::WriteJSONReport(jsonFile);
+			AOLogger::Info << "Wrote profile to " << profilePrefix.Value() << ".txt and " << profilePrefix.Value() << ".json.\n";
+		}
 
 		set->AntennaFlagCountPlot()->Report();
 		set->FrequencyFlagCountPlot()->Report();
@@ -327,6 +350,10 @@ int main(int argc, char **argv)
 		delete set;
 
 		AOLogger::Debug << "Time: " << watch.ToString() << "\n";
+		ImageBufferPool::Statistics poolStatistics = ImageBufferPool::GetStatistics();
+		AOLogger::Debug << "Image buffers: " << poolStatistics.allocationCount << " allocations, "
+			<< round(poolStatistics.HitRate()*1000.0)/10.0 << "% reused, peak usage "
+			<< round(poolStatistics.peakBytesInUse/(1024.0*1024.0)) << " MB.\n";
 		
 		return RETURN_SUCCESS;
 	} catch(std::exception &exception)
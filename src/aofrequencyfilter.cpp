@@ -1,4 +1,5 @@
 #include <iostream>
+#include <map>
 
 #include <fftw3.h>
 
@@ -17,13 +18,24 @@
 using namespace std;
 using namespace aoRemote;
 
-lane<ObservationTimerange*> *readLane;
-lane<ObservationTimerange*> *writeLane;
+/**
+ * A batch of rows, as read by one read request. The index is used to write
+ * the batches back in the same order as they were read.
+ */
+struct FilterBatch
+{
+	size_t index;
+	ObservationTimerange *timerange;
+};
+
+lane<FilterBatch> *readLane;
+lane<FilterBatch> *writeLane;
 
 boost::mutex commanderMutex;
 ProcessCommander *commander;
 
-fftw_plan fftPlanForward, fftPlanBackward;
+// The fftw planner is not thread safe, so plans are created under this mutex
+boost::mutex fftwPlannerMutex;
 const size_t rowCountPerRequest = 128;
 
 // fringe size is given in units of wavelength / fringe. Fringes smaller than that will be filtered.
@@ -45,20 +57,29 @@ double uvDist(double u, double v, double frequencyWidth)
 
 void workThread()
 {
-	ObservationTimerange *timerange;
+	FilterBatch batch;
 	
 	// These are for diagnostic info
 	double maxFilterSizeInChannels = 0.0, minFilterSizeInChannels = 1e100;
 	
-	if(readLane->read(timerange))
+	if(readLane->read(batch))
 	{
-		const size_t channelCount = timerange->ChannelCount();
-		const unsigned polarizationCount = timerange->PolarizationCount();
-		fftw_complex
-			*fftIn = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * channelCount),
-			*fftOut = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * channelCount);
+		const size_t channelCount = batch.timerange->ChannelCount();
+		const unsigned polarizationCount = batch.timerange->PolarizationCount();
+		
+		// Each worker has its own buffers and plans, so that workers never share fftw state
+		fftwf_complex
+			*fftIn = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * channelCount),
+			*fftOut = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * channelCount);
+		fftwf_plan fftPlanForward, fftPlanBackward;
+		{
+			boost::mutex::scoped_lock lock(fftwPlannerMutex);
+			fftPlanForward = fftwf_plan_dft_1d(channelCount, fftIn, fftOut, FFTW_FORWARD, FFTW_MEASURE);
+			fftPlanBackward = fftwf_plan_dft_1d(channelCount, fftOut, fftIn, FFTW_BACKWARD, FFTW_MEASURE);
+		}
 		do
 		{
+			ObservationTimerange *timerange = batch.timerange;
 			for(size_t t=0;t<timerange->TimestepCount();++t)
 			{
 				if(timerange->Antenna1(t) != timerange->Antenna2(t))
@@ -87,7 +108,7 @@ void workThread()
 								imagPtr += polarizationCount;
 							}
 							
-							fftw_execute_dft(fftPlanForward, fftIn, fftOut);
+							fftwf_execute(fftPlanForward);
 							size_t filterIndexSize = (limitFrequency > 1.0) ? (size_t) ceil(limitFrequency/2.0) : 1;
 							// Remove the high frequencies [filterIndexSize : n-filterIndexSize]
 							for(size_t f=filterIndexSize;f<channelCount - filterIndexSize;++f)
@@ -95,10 +116,10 @@ void workThread()
 								fftOut[f][0] = 0.0;
 								fftOut[f][1] = 0.0;
 							}
-							fftw_execute_dft(fftPlanBackward, fftOut, fftIn);
+							fftwf_execute(fftPlanBackward);
 
 							// Copy data back; fftw multiplies data with n, so divide by n.
-							double factor = 1.0 / (double) channelCount;
+							float factor = 1.0 / (float) channelCount;
 							realPtr = timerange->RealData(t) + p;
 							imagPtr = timerange->ImagData(t) + p;
 							for(size_t c=0;c<channelCount;++c)
@@ -112,10 +133,16 @@ void workThread()
 					}
 				}
 			}
-			writeLane->write(timerange);
-		} while(readLane->read(timerange));
-		fftw_free(fftIn);
-		fftw_free(fftOut);
+			writeLane->write(batch);
+		} while(readLane->read(batch));
+		
+		{
+			boost::mutex::scoped_lock lock(fftwPlannerMutex);
+			fftwf_destroy_plan(fftPlanForward);
+			fftwf_destroy_plan(fftPlanBackward);
+		}
+		fftwf_free(fftIn);
+		fftwf_free(fftOut);
 	}
 	std::cout << "Worker finished. Filtersize range in channel: " << minFilterSizeInChannels << "-" << maxFilterSizeInChannels << '\n';
 }
@@ -126,7 +153,7 @@ void readThreadFunction(ObservationTimerange &timerange, const size_t &totalRows
 	for(size_t i=0;i<commander->Observation().Size();++i)
 		rowBuffer[i] = new MSRowDataExt[rowCountPerRequest];
 
-	size_t currentRow = 0;
+	size_t currentRow = 0, batchIndex = 0;
 	while(currentRow < totalRows)
 	{
 		size_t currentRowCount = rowCountPerRequest;
@@ -144,7 +171,11 @@ void readThreadFunction(ObservationTimerange &timerange, const size_t &totalRows
 		
 		currentRow += currentRowCount;
 		cout << "Read " << currentRow << '/' << totalRows << '\n';
-		readLane->write(new ObservationTimerange(timerange));
+		FilterBatch batch;
+		batch.index = batchIndex;
+		batch.timerange = new ObservationTimerange(timerange);
+		readLane->write(batch);
+		++batchIndex;
 	}
 	for(size_t i=0;i<commander->Observation().Size();++i)
 		delete[] rowBuffer[i];
@@ -156,16 +187,31 @@ void writeThreadFunction()
 	std::vector<MSRowDataExt*> rowBuffer(obs.Size());
 	for(size_t i=0;i<obs.Size();++i)
 		rowBuffer[i] = new MSRowDataExt[rowCountPerRequest];
-		
-	ObservationTimerange *timerange;
-	if(writeLane->read(timerange))
+	
+	// Workers finish their batches in arbitrary order. Batches that arrive early are
+	// kept here until all batches before them have been written.
+	std::map<size_t, ObservationTimerange*> pendingBatches;
+	size_t nextBatchIndex = 0;
+	bool isInitialized = false;
+	
+	FilterBatch batch;
+	while(writeLane->read(batch))
 	{
-		for(size_t i=0;i<obs.Size();++i)
+		pendingBatches.insert(std::make_pair(batch.index, batch.timerange));
+		std::map<size_t, ObservationTimerange*>::iterator next = pendingBatches.find(nextBatchIndex);
+		while(next != pendingBatches.end())
 		{
-			for(size_t row=0;row<rowCountPerRequest;++row)
-				rowBuffer[i][row] = MSRowDataExt(timerange->PolarizationCount(), timerange->Band(i).channels.size());
-		}
-		do {
+			ObservationTimerange *timerange = next->second;
+			if(!isInitialized)
+			{
+				for(size_t i=0;i<obs.Size();++i)
+				{
+					for(size_t row=0;row<rowCountPerRequest;++row)
+						rowBuffer[i][row] = MSRowDataExt(timerange->PolarizationCount(), timerange->Band(i).channels.size());
+				}
+				isInitialized = true;
+			}
+			
 			boost::mutex::scoped_lock lock(commanderMutex);
 			std::cout << "Writing... " << std::flush;
 			commander->PushWriteDataRowsTask(*timerange, &rowBuffer[0]);
@@ -175,48 +221,55 @@ void writeThreadFunction()
 			lock.unlock();
 			
 			delete timerange;
-		} while(writeLane->read(timerange));
+			pendingBatches.erase(next);
+			++nextBatchIndex;
+			next = pendingBatches.find(nextBatchIndex);
+		}
 	}
+	for(size_t i=0;i<obs.Size();++i)
+		delete[] rowBuffer[i];
 	std::cout << "Writer thread finished.\n";
 }
 
-void initializeFFTW(size_t channelCount)
-{
-	fftw_complex *fftIn, *fftOut;
-	
-	fftIn = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * channelCount);
-	fftOut = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * channelCount);
-	fftPlanForward = fftw_plan_dft_1d(channelCount, fftIn, fftOut, FFTW_FORWARD, FFTW_MEASURE);
-	fftPlanBackward = fftw_plan_dft_1d(channelCount, fftIn, fftOut, FFTW_BACKWARD, FFTW_MEASURE);
-
-	fftw_free(fftIn);
-	fftw_free(fftOut);
-}
-
-void deinitializeFFTW()
-{
-	fftw_destroy_plan(fftPlanForward);
-	fftw_destroy_plan(fftPlanBackward);
-}
-
 int main(int argc, char *argv[])
 {
-	if(argc != 4)
+	int argi = 1;
+	bool compressRows = false;
+	unsigned threadCount = System::ProcessorCount();
+	while(argi < argc && argv[argi][0] == '-')
 	{
-		cerr << "Usage: aofrequencyfilter <reffile> <mode> <filterfringesize>\n"
-		"\tmode can be 'inChannels' (CH) or in uv wavelengths (UV)\n";
+		string p(argv[argi]+1);
+		if(p == "compress")
+			compressRows = true;
+		else if(p == "j" && argi+1 < argc)
+		{
+			++argi;
+			threadCount = atoi(argv[argi]);
+			if(threadCount == 0)
+				throw std::runtime_error("Bad number of threads");
+		}
+		else throw std::runtime_error("Bad parameter");
+		++argi;
+	}
+	if(argc - argi != 3)
+	{
+		cerr << "Usage: aofrequencyfilter [-compress] [-j <threads>] <reffile> <mode> <filterfringesize>\n"
+		"\tmode can be 'inChannels' (CH) or in uv wavelengths (UV)\n"
+		"\t-compress will compress the data rows that are sent over the network\n"
+		"\t-j sets the number of filter threads (default: number of cpus)\n";
 	}
 	else {
-		string modeStr(argv[2]);
+		string modeStr(argv[argi+1]);
 		if(modeStr == "CH")
 			isFilterSizeInChannels = true;
 		else if(modeStr == "UV")
 			isFilterSizeInChannels = false;
 		else throw std::runtime_error("Bad mode");
 		
-		filterFringeSize = atof(argv[3]);
-		ClusteredObservation *obs = ClusteredObservation::Load(argv[1]);
+		filterFringeSize = atof(argv[argi+2]);
+		ClusteredObservation *obs = ClusteredObservation::Load(argv[argi]);
 		commander = new ProcessCommander(*obs);
+		commander->SetCompressRows(compressRows);
 		commander->PushReadAntennaTablesTask();
 		commander->PushReadBandTablesTask();
 		commander->Run(false);
@@ -227,17 +280,12 @@ int main(int argc, char *argv[])
 		for(size_t i=0; i!=bands.size(); ++i)
 			timerange.SetBandInfo(i, bands[i]);
 		
-		const unsigned processorCount = System::ProcessorCount();
-		cout << "CPUs: " << processorCount << '\n';
+		cout << "CPUs: " << System::ProcessorCount() << ", filter threads: " << threadCount << '\n';
 		unsigned polarizationCount = commander->PolarizationCount();
 		cout << "Polarization count: " << polarizationCount << '\n';
 		
 		timerange.Initialize(polarizationCount, rowCountPerRequest);
 		
-		cout << "Initializing FFTW..." << std::flush;
-		initializeFFTW(timerange.ChannelCount());
-		cout << " Done.\n";
-		
 		// We ask for "0" rows, which means we will ask for the total number of rows
 		commander->PushReadDataRowsTask(timerange, 0, 0, 0);
 		commander->Run(false);
@@ -245,12 +293,12 @@ int main(int argc, char *argv[])
 		const size_t totalRows = commander->RowsTotal();
 		cout << "Total rows to filter: " << totalRows << '\n';
 		
-		readLane = new lane<ObservationTimerange*>(processorCount);
-		writeLane = new lane<ObservationTimerange*>(processorCount);
+		readLane = new lane<FilterBatch>(threadCount);
+		writeLane = new lane<FilterBatch>(threadCount);
 		
 		// Start worker threads
-		std::vector<boost::thread*> threads(processorCount);
-		for(size_t i=0; i<processorCount; ++i)
+		std::vector<boost::thread*> threads(threadCount);
+		for(size_t i=0; i<threadCount; ++i)
 		{
 			threads[i] = new boost::thread(&workThread);
 		}
@@ -260,9 +308,10 @@ int main(int argc, char *argv[])
 		
 		// Shut down read workers
 		readLane->write_end();
-		for(size_t i=0; i<processorCount; ++i)
+		for(size_t i=0; i<threadCount; ++i)
 		{
 			threads[i]->join();
+			delete threads[i];
 		}
 		delete readLane;
 		
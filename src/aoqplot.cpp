@@ -1,10 +1,14 @@
 #include "gui/quality/aoqplotwindow.h"
 
+#include <cstdlib>
+
 #include <gtkmm/main.h>
 #include <gtkmm/filechooserdialog.h>
 
 #include "version.h"
 
+#include "util/stopwatch.h"
+
 int main(int argc, char *argv[])
 {
 	// We have to 'lie' about argc to create(..), because of a bug in older gtkmms.
@@ -13,6 +17,7 @@ int main(int argc, char *argv[])
 	AOQPlotWindow window;
 	bool openGUI = true;
 	int argi = 1;
+	bool printTiming = false;
 	std::vector<AOQPlotWindow::PlotSavingData> savedPlots;
 	while(argi < argc && argv[argi][0]=='-')
 	{
@@ -40,6 +45,13 @@ int main(int argc, char *argv[])
 				"  multiple kinds at once. A list of allowed names can be retrieved with\n"
 				"  'aoquality liststats'. Some common ones are: StandardDeviation, Variance, Mean,\n"
 				"  RFIPercentage, RFIRatio, Count.\n"
+				"-timing\n"
+				"  Together with -save, print how long it takes to open the observation and\n"
+				"  to render each plot.\n"
+				"-timerange <start> <end>\n"
+				"  Only show the time statistics between the given times, in the units of\n"
+				"  the TIME column of the measurement set. A short range is shown at full\n"
+				"  resolution.\n"
 				"\n"
 				"AOQPlot is part of the AOFlagger software package, written by André Offringa\n"
 				"  (offringa@gmail.com). This AOQPlot belongs to AOFlagger " << AOFLAGGER_VERSION_STR << " (" << AOFLAGGER_VERSION_DATE_STR << ")\n";
@@ -54,6 +66,20 @@ int main(int argc, char *argv[])
 			openGUI = false;
 			savedPlots.push_back(newPlot);
 		}
+		else if(p=="timing")
+		{
+			printTiming = true;
+		}
+		else if(p=="timerange")
+		{
+			if(argi+2 >= argc)
+			{
+				std::cout << "-timerange requires a start and end time.\n";
+				return 1;
+			}
+			window.SetTimeRange(atof(argv[argi+1]), atof(argv[argi+2]));
+			argi += 2;
+		}
 		else if(p == "version")
 		{
 			std::cout << "AOQplot " << AOFLAGGER_VERSION_STR << " (" << AOFLAGGER_VERSION_DATE_STR << ")\n";
@@ -75,8 +101,12 @@ int main(int argc, char *argv[])
 			files.push_back(argv[i]);
 		if(openGUI)
 			window.Open(files);
-		else
+		else {
+			Stopwatch watch(true);
 			window.OpenWithoutGUI(files);
+			if(printTiming)
+				std::cout << "Opening took " << watch.ToString() << '\n';
+		}
 	} else {
 		if(!openGUI)
 		{
@@ -104,6 +134,7 @@ int main(int argc, char *argv[])
 		else return 0;
 	}
 	
+	window.SetPrintTiming(printTiming);
 	for(std::vector<AOQPlotWindow::PlotSavingData>::const_iterator plot=savedPlots.begin(); plot!=savedPlots.end(); ++plot)
 	{
 		window.Save(*plot);
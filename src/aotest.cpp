@@ -1,9 +1,15 @@
 #include <iostream>
 
 #include "test/strategy/algorithms/algorithmstestgroup.h"
+#include "test/strategy/control/controltestgroup.h"
 #include "test/experiments/experimentstestgroup.h"
+#include "test/imaging/imagingtestgroup.h"
 #include "test/msio/msiotestgroup.h"
 #include "test/quality/qualitytestgroup.h"
+#ifdef HAVE_AOREMOTE
+#include "test/remote/remotetestgroup.h"
+#endif
+#include "test/structures/structurestestgroup.h"
 #include "test/util/utiltestgroup.h"
 
 int main(int argc, char *argv[])
@@ -24,6 +30,16 @@ int main(int argc, char *argv[])
 		successes += mainGroup.Successes();
 		failures += mainGroup.Failures();
 
+		ControlTestGroup controlGroup;
+		controlGroup.Run();
+		successes += controlGroup.Successes();
+		failures += controlGroup.Failures();
+
+		ImagingTestGroup imagingGroup;
+		imagingGroup.Run();
+		successes += imagingGroup.Successes();
+		failures += imagingGroup.Failures();
+		
 		MSIOTestGroup msioGroup;
 		msioGroup.Run();
 		successes += msioGroup.Successes();
@@ -34,6 +50,18 @@ int main(int argc, char *argv[])
 		successes += qualityGroup.Successes();
 		failures += qualityGroup.Failures();
 		
+#ifdef HAVE_AOREMOTE
+		RemoteTestGroup remoteGroup;
+		remoteGroup.Run();
+		successes += remoteGroup.Successes();
+		failures += remoteGroup.Failures();
+#endif
+		
+		StructuresTestGroup structuresGroup;
+		structuresGroup.Run();
+		successes += structuresGroup.Successes();
+		failures += structuresGroup.Failures();
+		
 		UtilTestGroup utilGroup;
 		utilGroup.Run();
 		successes += utilGroup.Successes();
@@ -0,0 +1,205 @@
+#include "flagwritebenchmark.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#include <casacore/ms/MeasurementSets/MeasurementSet.h>
+#include <casacore/tables/Tables/ArrColDesc.h>
+#include <casacore/tables/Tables/ArrayColumn.h>
+#include <casacore/tables/Tables/ScalarColumn.h>
+#include <casacore/tables/Tables/SetupNewTab.h>
+
+#include <boost/thread/mutex.hpp>
+
+#include "../strategy/actions/writeflagsaction.h"
+
+#include "../strategy/control/artifactset.h"
+
+#include "../strategy/imagesets/imageset.h"
+
+#include "../structures/timefrequencydata.h"
+#include "../structures/types.h"
+
+#include "../util/progresslistener.h"
+#include "../util/rng.h"
+#include "../util/stopwatch.h"
+
+#include "../version.h"
+
+namespace {
+	/**
+	 * Writes a measurement set with one spectral window, four polarizations and one row per
+	 * baseline and timestep, ordered by time as correlators write them. All flags are unset.
+	 */
+	void writeSyntheticMS(const std::string &filename, size_t antennaCount, size_t timestepCount, size_t channelCount)
+	{
+		casacore::TableDesc tableDesc = casacore::MS::requiredTableDesc();
+		casacore::ArrayColumnDesc<casacore::Complex> dataColumnDesc(casacore::MS::columnName(casacore::MSMainEnums::DATA));
+		tableDesc.addColumn(dataColumnDesc);
+		casacore::SetupNewTable newTable(filename, tableDesc, casacore::Table::New);
+		casacore::MeasurementSet ms(newTable);
+		ms.createDefaultSubtables(casacore::Table::New);
+
+		casacore::MSAntenna antennaTable = ms.antenna();
+		casacore::ScalarColumn<casacore::String> antennaNameCol(antennaTable, antennaTable.columnName(casacore::MSAntennaEnums::NAME));
+		casacore::ArrayColumn<double> positionCol(antennaTable, antennaTable.columnName(casacore::MSAntennaEnums::POSITION));
+		antennaTable.addRow(antennaCount);
+		for(size_t a=0; a!=antennaCount; ++a)
+		{
+			std::ostringstream name;
+			name << "ANT" << a;
+			antennaNameCol.put(a, name.str());
+			casacore::Vector<double> position(3);
+			position[0] = 100.0 * a; position[1] = 50.0 * (a % 3); position[2] = 0.0;
+			positionCol.put(a, position);
+		}
+
+		casacore::MSSpectralWindow spwTable = ms.spectralWindow();
+		casacore::ScalarColumn<int> numChanCol(spwTable, spwTable.columnName(casacore::MSSpectralWindowEnums::NUM_CHAN));
+		casacore::ArrayColumn<double> chanFreqCol(spwTable, spwTable.columnName(casacore::MSSpectralWindowEnums::CHAN_FREQ));
+		spwTable.addRow(1);
+		numChanCol.put(0, channelCount);
+		casacore::Vector<double> frequencies(channelCount);
+		for(size_t c=0; c!=channelCount; ++c)
+			frequencies[c] = 150e6 + 0.1e6 * c;
+		chanFreqCol.put(0, frequencies);
+
+		casacore::MSPolarization polTable = ms.polarization();
+		casacore::ScalarColumn<int> numCorrCol(polTable, polTable.columnName(casacore::MSPolarizationEnums::NUM_CORR));
+		casacore::ArrayColumn<int> corrTypeCol(polTable, polTable.columnName(casacore::MSPolarizationEnums::CORR_TYPE));
+		polTable.addRow(1);
+		numCorrCol.put(0, 4);
+		casacore::Vector<int> corrTypes(4);
+		corrTypes[0] = 9; corrTypes[1] = 10; corrTypes[2] = 11; corrTypes[3] = 12;
+		corrTypeCol.put(0, corrTypes);
+
+		casacore::MSDataDescription dataDescTable = ms.dataDescription();
+		casacore::ScalarColumn<int>
+			spwIdCol(dataDescTable, dataDescTable.columnName(casacore::MSDataDescriptionEnums::SPECTRAL_WINDOW_ID)),
+			polIdCol(dataDescTable, dataDescTable.columnName(casacore::MSDataDescriptionEnums::POLARIZATION_ID));
+		dataDescTable.addRow(1);
+		spwIdCol.put(0, 0);
+		polIdCol.put(0, 0);
+
+		casacore::MSField fieldTable = ms.field();
+		casacore::ScalarColumn<casacore::String> fieldNameCol(fieldTable, fieldTable.columnName(casacore::MSFieldEnums::NAME));
+		casacore::ArrayColumn<double> delayDirCol(fieldTable, fieldTable.columnName(casacore::MSFieldEnums::DELAY_DIR));
+		fieldTable.addRow(1);
+		fieldNameCol.put(0, "SYNTHETIC");
+		delayDirCol.put(0, casacore::Array<double>(casacore::IPosition(2, 2, 1), 0.0));
+
+		casacore::ScalarColumn<double> timeCol(ms, casacore::MS::columnName(casacore::MSMainEnums::TIME));
+		casacore::ScalarColumn<int>
+			antenna1Col(ms, casacore::MS::columnName(casacore::MSMainEnums::ANTENNA1)),
+			antenna2Col(ms, casacore::MS::columnName(casacore::MSMainEnums::ANTENNA2)),
+			dataDescIdCol(ms, casacore::MS::columnName(casacore::MSMainEnums::DATA_DESC_ID)),
+			fieldIdCol(ms, casacore::MS::columnName(casacore::MSMainEnums::FIELD_ID)),
+			scanNumberCol(ms, casacore::MS::columnName(casacore::MSMainEnums::SCAN_NUMBER));
+		casacore::ArrayColumn<double> uvwCol(ms, casacore::MS::columnName(casacore::MSMainEnums::UVW));
+		casacore::ArrayColumn<bool> flagCol(ms, casacore::MS::columnName(casacore::MSMainEnums::FLAG));
+		casacore::ArrayColumn<casacore::Complex> dataCol(ms, casacore::MS::columnName(casacore::MSMainEnums::DATA));
+
+		const casacore::IPosition shape(2, 4, channelCount);
+		const casacore::Array<bool> flags(shape, false);
+		casacore::Array<casacore::Complex> data(shape);
+		size_t row = ms.nrow();
+		ms.addRow(timestepCount * antennaCount * (antennaCount-1) / 2);
+		for(size_t t=0; t!=timestepCount; ++t)
+		{
+			for(size_t a1=0; a1!=antennaCount; ++a1)
+			{
+				for(size_t a2=a1+1; a2!=antennaCount; ++a2)
+				{
+					timeCol.put(row, 4.8e9 + 10.0 * t);
+					antenna1Col.put(row, a1);
+					antenna2Col.put(row, a2);
+					dataDescIdCol.put(row, 0);
+					fieldIdCol.put(row, 0);
+					scanNumberCol.put(row, 0);
+					casacore::Vector<double> uvw(3);
+					uvw[0] = 100.0 * (a2 - a1); uvw[1] = 50.0 * ((a2 % 3) - (a1 % 3)); uvw[2] = 0.0;
+					uvwCol.put(row, uvw);
+					for(casacore::Array<casacore::Complex>::iterator i=data.begin(); i!=data.end(); ++i)
+						*i = casacore::Complex(RNG::Gaussian(), RNG::Gaussian());
+					dataCol.put(row, data);
+					flagCol.put(row, flags);
+					++row;
+				}
+			}
+		}
+	}
+
+	/**
+	 * Writes random flags for all baselines of the measurement set through a WriteFlagsAction,
+	 * as the strategy does. Returns the time spent in the action by the caller, which is
+	 * the time a worker thread would be blocked.
+	 */
+	double writeFlags(rfiStrategy::ImageSet &imageSet, size_t timestepCount, size_t channelCount, unsigned seed)
+	{
+		boost::mutex ioMutex;
+		rfiStrategy::ArtifactSet artifacts(&ioMutex);
+		artifacts.SetImageSet(&imageSet);
+		DummyProgressListener listener;
+		rfiStrategy::WriteFlagsAction writeAction;
+		Image2DPtr zero = Image2D::CreateZeroImagePtr(timestepCount, channelCount);
+		srand(seed);
+		double blockedSeconds = 0.0;
+		std::unique_ptr<rfiStrategy::ImageSetIndex> index(imageSet.StartIndex());
+		while(index->IsValid())
+		{
+			Mask2DPtr mask = Mask2D::CreateSetMaskPtr<false>(timestepCount, channelCount);
+			for(size_t y=0; y!=channelCount; ++y)
+			{
+				for(size_t x=0; x!=timestepCount; ++x)
+				{
+					if(rand() % 10 == 0)
+						mask->SetValue(x, y, true);
+				}
+			}
+			TimeFrequencyData data(TimeFrequencyData::AmplitudePart, Polarization::StokesI, zero);
+			data.SetGlobalMask(mask);
+			artifacts.SetContaminatedData(data);
+			artifacts.SetImageSetIndex(index.get());
+			Stopwatch watch(true);
+			writeAction.Perform(artifacts, listener);
+			blockedSeconds += watch.Seconds();
+			index->Next();
+		}
+		writeAction.Finish();
+		return blockedSeconds;
+	}
+}
+
+void FlagWriteBenchmark::Run(const FlagWriteConfiguration &config, std::ostream &output)
+{
+	std::cerr << "Writing synthetic measurement set with " << config.antennaCount << " antennas...\n";
+	writeSyntheticMS(config.filename, config.antennaCount, config.timestepCount, config.channelCount);
+	{
+		std::unique_ptr<rfiStrategy::ImageSet> imageSet(rfiStrategy::ImageSet::Create(config.filename, DirectReadMode));
+		imageSet->Initialize();
+		output <<
+			"{\n"
+			"  \"version\": \"" << AOFLAGGER_VERSION_STR << "\",\n"
+			"  \"flag_writing\": {\n"
+			"    \"antennas\": " << config.antennaCount << ",\n"
+			"    \"timesteps\": " << config.timestepCount << ",\n"
+			"    \"channels\": " << config.channelCount << ",\n"
+			"    \"results\": [";
+		const char *passNames[2] = { "changed", "unchanged" };
+		for(size_t pass=0; pass!=2; ++pass)
+		{
+			Stopwatch watch(true);
+			const double blockedSeconds = writeFlags(*imageSet, config.timestepCount, config.channelCount, config.seed);
+			const double seconds = watch.Seconds();
+			std::cerr << "Writing " << passNames[pass] << " flags: " << watch.ToString() << ".\n";
+			output << (pass==0 ? "\n" : ",\n") <<
+				"      { \"flags\": \"" << passNames[pass] << "\", "
+				"\"seconds\": " << seconds << ", "
+				"\"blocked_seconds\": " << blockedSeconds << " }";
+		}
+		output << "\n    ]\n  }\n}\n";
+	}
+	casacore::Table::deleteTable(config.filename);
+}
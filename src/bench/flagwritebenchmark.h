@@ -0,0 +1,25 @@
+#ifndef BENCH_FLAG_WRITE_BENCHMARK_H
+#define BENCH_FLAG_WRITE_BENCHMARK_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+struct FlagWriteConfiguration
+{
+	std::string filename;
+	size_t antennaCount, timestepCount, channelCount;
+	unsigned seed;
+};
+
+class FlagWriteBenchmark
+{
+	public:
+		/**
+		 * Writes a synthetic measurement set and times writing flags for all its baselines: first
+		 * with new flags, and then with the same flags again, which leaves all rows unchanged.
+		 */
+		static void Run(const FlagWriteConfiguration &config, std::ostream &output);
+};
+
+#endif
@@ -0,0 +1,349 @@
+#include "kernelbenchmark.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "../strategy/actions/foreachcomplexcomponentaction.h"
+#include "../strategy/actions/foreachpolarisationaction.h"
+#include "../strategy/actions/highpassfilteraction.h"
+#include "../strategy/actions/strategy.h"
+#include "../strategy/actions/sumthresholdaction.h"
+
+#include "../strategy/algorithms/highpassfilter.h"
+#include "../strategy/algorithms/mitigationtester.h"
+#include "../strategy/algorithms/siroperator.h"
+#include "../strategy/algorithms/statisticalflagger.h"
+#include "../strategy/algorithms/thresholdconfig.h"
+
+#include "../strategy/control/artifactset.h"
+#include "../strategy/control/defaultstrategy.h"
+#include "../strategy/control/pythonstrategy.h"
+
+#include "../structures/imagebufferpool.h"
+#include "../structures/timefrequencydata.h"
+
+#include "../util/parallelfor.h"
+#include "../util/progresslistener.h"
+#include "../util/stopwatch.h"
+
+#include "../version.h"
+
+namespace {
+	/**
+	 * One synthetic baseline: complex visibilities for each polarization, with noise
+	 * and several kinds of RFI added.
+	 */
+	struct BenchBaseline
+	{
+		TimeFrequencyData data;
+		std::vector<Image2DCPtr> amplitudes;
+		Mask2DPtr rfi;
+	};
+
+	typedef void (*BenchKernel)(BenchBaseline &baseline);
+
+	struct BenchResult
+	{
+		std::string name;
+		double seconds;
+		size_t samples;
+		double bufferReuseRate;
+	};
+
+	/**
+	 * Generates a reproducible baseline. MitigationTester uses rand(), so the
+	 * generator is seeded per baseline and the baselines are created one at a time.
+	 */
+	void generateBaseline(BenchBaseline &baseline, const BenchConfiguration &config, size_t index)
+	{
+		srand(config.seed + index);
+		const size_t width = config.width, height = config.height;
+		baseline.rfi = Mask2D::CreateSetMaskPtr<false>(width, height);
+		std::vector<Image2DCPtr> realImages(config.polarizationCount), imagImages(config.polarizationCount);
+		for(size_t p=0; p!=config.polarizationCount; ++p)
+		{
+			for(size_t part=0; part!=2; ++part)
+			{
+				Image2DPtr image = MitigationTester::CreateTestSet(2, baseline.rfi, width, height);
+				MitigationTester::AddGaussianBroadbandToTestSet(image, baseline.rfi);
+				MitigationTester::AddSlewedGaussianBroadbandToTestSet(image, baseline.rfi);
+				for(size_t line=0; line!=3; ++line)
+					MitigationTester::AddRfiPos(image, baseline.rfi, 5.0, 0, width, (line+1) * height / 4);
+				if(part == 0)
+					realImages[p] = image;
+				else
+					imagImages[p] = image;
+			}
+		}
+		baseline.data = TimeFrequencyData::FromLinear(config.polarizationCount, &realImages[0], &imagImages[0]);
+		baseline.data.SetGlobalMask(Mask2D::CreateSetMaskPtr<false>(width, height));
+
+		baseline.amplitudes.clear();
+		for(size_t p=0; p!=config.polarizationCount; ++p)
+		{
+			TimeFrequencyData polData = baseline.data.Make(baseline.data.GetPolarization(p));
+			baseline.amplitudes.push_back(polData.Make(TimeFrequencyData::AmplitudePart).GetSingleImage());
+		}
+	}
+
+	void sumThresholdKernel(BenchBaseline &baseline)
+	{
+		for(std::vector<Image2DCPtr>::const_iterator i=baseline.amplitudes.begin(); i!=baseline.amplitudes.end(); ++i)
+		{
+			ThresholdConfig config;
+			config.InitializeLengthsDefault();
+			config.InitializeThresholdsFromFirstThreshold(6.0 * (*i)->GetStdDev(), ThresholdConfig::Rayleigh);
+			Mask2DPtr mask = Mask2D::CreateSetMaskPtr<false>((*i)->Width(), (*i)->Height());
+			config.Execute(*i, mask, false, 1.0);
+		}
+	}
+
+	void sirOperatorKernel(BenchBaseline &baseline)
+	{
+		for(size_t p=0; p!=baseline.amplitudes.size(); ++p)
+		{
+			Mask2DPtr mask = Mask2D::CreateCopy(baseline.rfi);
+			SIROperator::OperateHorizontally(mask, 0.2);
+			SIROperator::OperateVertically(mask, 0.2);
+		}
+	}
+
+	void dilationKernel(BenchBaseline &baseline)
+	{
+		for(size_t p=0; p!=baseline.amplitudes.size(); ++p)
+		{
+			Mask2DPtr mask = Mask2D::CreateCopy(baseline.rfi);
+			StatisticalFlagger::DilateFlags(mask, 3, 3);
+			StatisticalFlagger::LineRemover(mask, mask->Width() / 2, mask->Height() / 2);
+		}
+	}
+
+	void densityFlaggerKernel(BenchBaseline &baseline)
+	{
+		for(size_t p=0; p!=baseline.amplitudes.size(); ++p)
+		{
+			Mask2DPtr mask = Mask2D::CreateCopy(baseline.rfi);
+			StatisticalFlagger::DensityTimeFlagger(mask, 0.5);
+			StatisticalFlagger::DensityFrequencyFlagger(mask, 0.5);
+		}
+	}
+
+	void highPassFilterKernel(BenchBaseline &baseline)
+	{
+		for(std::vector<Image2DCPtr>::const_iterator i=baseline.amplitudes.begin(); i!=baseline.amplitudes.end(); ++i)
+		{
+			HighPassFilter filter;
+			filter.ApplyHighPass(*i, baseline.rfi);
+		}
+	}
+
+	void defaultStrategyKernel(BenchBaseline &baseline)
+	{
+		std::unique_ptr<rfiStrategy::Strategy> strategy(rfiStrategy::DefaultStrategy::CreateStrategy(
+			rfiStrategy::DefaultStrategy::GENERIC_TELESCOPE, rfiStrategy::DefaultStrategy::FLAG_NONE));
+		rfiStrategy::ArtifactSet artifacts(0);
+		artifacts.SetOriginalData(baseline.data);
+		artifacts.SetContaminatedData(baseline.data);
+		TimeFrequencyData zero(baseline.data);
+		zero.SetImagesToZero();
+		artifacts.SetRevisedData(zero);
+		DummyProgressListener listener;
+		strategy->Perform(artifacts, listener);
+	}
+
+	/**
+	 * The Python strategy that is timed by the python-strategy kernel. It runs the
+	 * same steps as the strategy created by createNativeEquivalentStrategy().
+	 */
+	const char *benchPythonCode =
+		"import aoflagger\n"
+		"\n"
+		"def flag(data):\n"
+		"  for polarization in data.polarizations():\n"
+		"    pol_data = data.convert_to_polarization(polarization)\n"
+		"    amplitudes = pol_data.convert_to_complex(aoflagger.ComplexRepresentation.AmplitudePart)\n"
+		"    aoflagger.sumthreshold(amplitudes, 1.0, True, True)\n"
+		"    aoflagger.high_pass_filter(amplitudes, 22, 45, 7.5, 15.0)\n"
+		"    aoflagger.sumthreshold(amplitudes, 1.0, True, True)\n"
+		"    pol_data.join_mask(amplitudes)\n"
+		"    data.set_polarization_data(polarization, pol_data)\n"
+		"\n"
+		"aoflagger.set_flag_function(flag)\n";
+
+	/**
+	 * Creates the strategy that one would write in XML for the steps of benchPythonCode.
+	 */
+	rfiStrategy::Strategy *createNativeEquivalentStrategy()
+	{
+		std::unique_ptr<rfiStrategy::Strategy> strategy(new rfiStrategy::Strategy());
+		rfiStrategy::ForEachPolarisationBlock *polarisationBlock = new rfiStrategy::ForEachPolarisationBlock();
+		strategy->Add(polarisationBlock);
+		rfiStrategy::ForEachComplexComponentAction *complexBlock = new rfiStrategy::ForEachComplexComponentAction();
+		complexBlock->SetOnAmplitude(true);
+		complexBlock->SetOnImaginary(false);
+		complexBlock->SetOnReal(false);
+		complexBlock->SetOnPhase(false);
+		polarisationBlock->Add(complexBlock);
+		complexBlock->Add(new rfiStrategy::SumThresholdAction());
+		complexBlock->Add(new rfiStrategy::HighPassFilterAction());
+		complexBlock->Add(new rfiStrategy::SumThresholdAction());
+		return strategy.release();
+	}
+
+	void nativeEquivalentStrategyKernel(BenchBaseline &baseline)
+	{
+		std::unique_ptr<rfiStrategy::Strategy> strategy(createNativeEquivalentStrategy());
+		rfiStrategy::ArtifactSet artifacts(0);
+		artifacts.SetOriginalData(baseline.data);
+		artifacts.SetContaminatedData(baseline.data);
+		TimeFrequencyData zero(baseline.data);
+		zero.SetImagesToZero();
+		artifacts.SetRevisedData(zero);
+		DummyProgressListener listener;
+		strategy->Perform(artifacts, listener);
+	}
+
+	void runKernelThread(BenchKernel kernel, BenchBaseline *baseline, size_t repeatCount)
+	{
+		// Like the per-baseline workers of the flagger, kernels run single threaded
+		ParallelFor::Limit limit(1);
+		for(size_t i=0; i!=repeatCount; ++i)
+			kernel(*baseline);
+	}
+
+	/**
+	 * Run a kernel on all baselines concurrently, one thread per baseline.
+	 */
+	BenchResult runKernel(const std::string &name, BenchKernel kernel, std::vector<BenchBaseline> &baselines, const BenchConfiguration &config)
+	{
+		std::cerr << "Running " << name << "...\n";
+		const ImageBufferPool::Statistics poolStart = ImageBufferPool::GetStatistics();
+		Stopwatch watch(true);
+		boost::thread_group threads;
+		for(size_t i=0; i!=baselines.size(); ++i)
+			threads.create_thread(boost::bind(&runKernelThread, kernel, &baselines[i], config.repeatCount));
+		threads.join_all();
+
+		BenchResult result;
+		result.name = name;
+		result.seconds = watch.Seconds();
+		result.samples = config.width * config.height * config.polarizationCount * baselines.size() * config.repeatCount;
+		const ImageBufferPool::Statistics poolEnd = ImageBufferPool::GetStatistics();
+		const size_t
+			allocations = poolEnd.allocationCount - poolStart.allocationCount,
+			reused = (poolEnd.threadCacheHits + poolEnd.globalPoolHits) - (poolStart.threadCacheHits + poolStart.globalPoolHits);
+		result.bufferReuseRate = allocations == 0 ? 0.0 : double(reused) / double(allocations);
+		std::cerr << name << ": " << watch.ToString() << ", " << (result.samples / result.seconds) << " samples/s.\n";
+		return result;
+	}
+
+	/**
+	 * Run the Python strategy on all baselines with PythonStrategy::ExecuteParallel(), which
+	 * divides the baselines over as many threads as runKernel() uses. The interpreter
+	 * can only be started once, and has to be started and stopped by the main thread,
+	 * so the strategy is created by KernelBenchmark::Run().
+	 */
+	BenchResult runPythonStrategy(PythonStrategy &pythonStrategy, const std::vector<BenchBaseline> &baselines, const BenchConfiguration &config)
+	{
+		const std::string name = "python-strategy";
+		std::cerr << "Running " << name << "...\n";
+		const ImageBufferPool::Statistics poolStart = ImageBufferPool::GetStatistics();
+		Stopwatch watch(true);
+		for(size_t i=0; i!=config.repeatCount; ++i)
+		{
+			std::vector<TimeFrequencyData> data;
+			for(size_t b=0; b!=baselines.size(); ++b)
+				data.push_back(baselines[b].data);
+			pythonStrategy.ExecuteParallel(data, config.threadCount);
+		}
+
+		BenchResult result;
+		result.name = name;
+		result.seconds = watch.Seconds();
+		result.samples = config.width * config.height * config.polarizationCount * baselines.size() * config.repeatCount;
+		const ImageBufferPool::Statistics poolEnd = ImageBufferPool::GetStatistics();
+		const size_t
+			allocations = poolEnd.allocationCount - poolStart.allocationCount,
+			reused = (poolEnd.threadCacheHits + poolEnd.globalPoolHits) - (poolStart.threadCacheHits + poolStart.globalPoolHits);
+		result.bufferReuseRate = allocations == 0 ? 0.0 : double(reused) / double(allocations);
+		std::cerr << name << ": " << watch.ToString() << ", " << (result.samples / result.seconds) << " samples/s.\n";
+		return result;
+	}
+
+	void writeJSON(std::ostream &stream, const BenchConfiguration &config, const std::vector<BenchResult> &results)
+	{
+		stream <<
+			"{\n"
+			"  \"version\": \"" << AOFLAGGER_VERSION_STR << "\",\n"
+			"  \"configuration\": {\n"
+			"    \"width\": " << config.width << ",\n"
+			"    \"height\": " << config.height << ",\n"
+			"    \"polarizations\": " << config.polarizationCount << ",\n"
+			"    \"threads\": " << config.threadCount << ",\n"
+			"    \"repeats\": " << config.repeatCount << ",\n"
+			"    \"seed\": " << config.seed << "\n"
+			"  },\n"
+			"  \"results\": [";
+		for(size_t i=0; i!=results.size(); ++i)
+		{
+			const BenchResult &result = results[i];
+			stream << (i==0 ? "\n" : ",\n") <<
+				"    { \"name\": \"" << result.name << "\", "
+				"\"seconds\": " << result.seconds << ", "
+				"\"samples\": " << result.samples << ", "
+				"\"samples_per_second\": " << (result.samples / result.seconds) << ", "
+				"\"buffer_reuse_rate\": " << result.bufferReuseRate << " }";
+		}
+		stream << "\n  ]\n}\n";
+	}
+
+	struct NamedKernel
+	{
+		const char *name;
+		BenchKernel kernel;
+	};
+
+	const NamedKernel kernels[] = {
+		{ "sumthreshold", &sumThresholdKernel },
+		{ "sir-operator", &sirOperatorKernel },
+		{ "dilation", &dilationKernel },
+		{ "density-flagger", &densityFlaggerKernel },
+		{ "highpass-filter", &highPassFilterKernel },
+		{ "default-strategy", &defaultStrategyKernel },
+		{ "native-equivalent-strategy", &nativeEquivalentStrategyKernel }
+	};
+}
+
+void KernelBenchmark::Run(const BenchConfiguration &config, const std::string &kernelSelection, std::ostream &output)
+{
+	std::cerr << "Generating " << config.threadCount << " baselines of " << config.width << " x " << config.height << " x " << config.polarizationCount << " samples...\n";
+	std::vector<BenchBaseline> baselines(config.threadCount);
+	for(size_t i=0; i!=baselines.size(); ++i)
+		generateBaseline(baselines[i], config, i);
+
+	std::vector<BenchResult> results;
+	for(size_t k=0; k!=sizeof(kernels)/sizeof(NamedKernel); ++k)
+	{
+		if(kernelSelection.empty() || kernelSelection == kernels[k].name)
+			results.push_back(runKernel(kernels[k].name, kernels[k].kernel, baselines, config));
+	}
+	if(kernelSelection.empty() || kernelSelection == "python-strategy")
+	{
+		PythonStrategy pythonStrategy(benchPythonCode);
+		results.push_back(runPythonStrategy(pythonStrategy, baselines, config));
+	}
+
+	writeJSON(output, config, results);
+}
+
+void KernelBenchmark::ListKernels(std::ostream &stream)
+{
+	for(size_t k=0; k!=sizeof(kernels)/sizeof(NamedKernel); ++k)
+		stream << kernels[k].name << ' ';
+	stream << "python-strategy ";
+}
@@ -0,0 +1,34 @@
+#ifndef BENCH_KERNEL_BENCHMARK_H
+#define BENCH_KERNEL_BENCHMARK_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+struct BenchConfiguration
+{
+	size_t width, height, polarizationCount, threadCount, repeatCount;
+	unsigned seed;
+};
+
+/**
+ * Times the flagging kernels, the default strategy and a Python strategy together with
+ * its native equivalent on synthetic baselines, and writes the throughput as JSON.
+ */
+class KernelBenchmark
+{
+	public:
+		/**
+		 * Runs all kernels, or only the given kernel when the selection is not empty.
+		 * Should be called by the main thread, because the Python interpreter has to be
+		 * started and stopped by it.
+		 */
+		static void Run(const BenchConfiguration &config, const std::string &kernelSelection, std::ostream &output);
+
+		/**
+		 * Writes the names of all kernels, each followed by a space.
+		 */
+		static void ListKernels(std::ostream &stream);
+};
+
+#endif
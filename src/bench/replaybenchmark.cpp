@@ -0,0 +1,141 @@
+#include "replaybenchmark.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "../interface/aoflagger.h"
+
+#include "../strategy/imagesets/imageset.h"
+
+#include "../structures/timefrequencydata.h"
+#include "../structures/types.h"
+
+#include "../util/stopwatch.h"
+
+#include "../version.h"
+
+namespace {
+	/**
+	 * Copies a baseline into an image set of the flagging interface. Returns false if the
+	 * polarizations can not be represented by an image set.
+	 */
+	bool makeInterfaceImageSet(aoflagger::AOFlagger &flagger, const TimeFrequencyData &data, aoflagger::ImageSet *&imageSet)
+	{
+		const size_t polarizationCount = data.PolarizationCount();
+		if(data.ComplexRepresentation() != TimeFrequencyData::ComplexParts || (polarizationCount != 1 && polarizationCount != 2 && polarizationCount != 4))
+			return false;
+		const size_t width = data.ImageWidth(), height = data.ImageHeight();
+		imageSet = new aoflagger::ImageSet(flagger.MakeImageSet(width, height, polarizationCount * 2));
+		for(size_t p=0; p!=polarizationCount; ++p)
+		{
+			const TimeFrequencyData polData = data.Make(data.GetPolarization(p));
+			const Image2DCPtr images[2] = { polData.GetRealPart(), polData.GetImaginaryPart() };
+			for(size_t part=0; part!=2; ++part)
+			{
+				float *buffer = imageSet->ImageBuffer(p*2 + part);
+				for(size_t y=0; y!=height; ++y)
+					std::copy(images[part]->ValuePtr(0, y), images[part]->ValuePtr(0, y) + width, buffer + y * imageSet->HorizontalStride());
+			}
+		}
+		return true;
+	}
+}
+
+bool ReplayBenchmark::Run(const ReplayConfiguration &config, std::ostream &output)
+{
+	aoflagger::AOFlagger flagger;
+	aoflagger::Strategy strategy = config.strategyFilename.empty() ?
+		flagger.MakeStrategy() : flagger.LoadStrategy(config.strategyFilename);
+	std::unique_ptr<rfiStrategy::ImageSet> imageSet(rfiStrategy::ImageSet::Create(config.filename, DirectReadMode));
+	imageSet->Initialize();
+
+	size_t baselineCount = 0, samples = 0, batchFlagged = 0, streamFlagged = 0, differences = 0, maxLatency = 0;
+	double batchSeconds = 0.0, streamSeconds = 0.0;
+	std::unique_ptr<rfiStrategy::ImageSetIndex> index(imageSet->StartIndex());
+	while(index->IsValid() && baselineCount != config.maxBaselines)
+	{
+		imageSet->AddReadRequest(*index);
+		imageSet->PerformReadRequests();
+		std::unique_ptr<rfiStrategy::BaselineData> baseline(imageSet->GetNextRequested());
+		aoflagger::ImageSet *input;
+		if(makeInterfaceImageSet(flagger, baseline->Data(), input))
+		{
+			std::unique_ptr<aoflagger::ImageSet> inputPtr(input);
+			const size_t width = input->Width(), height = input->Height();
+			std::cerr << "Replaying " << index->Description() << "...\n";
+
+			Stopwatch batchWatch(true);
+			const aoflagger::FlagMask batchFlags = flagger.Run(strategy, *input);
+			batchSeconds += batchWatch.Seconds();
+
+			Stopwatch streamWatch(true);
+			aoflagger::FlaggingSession session = flagger.MakeFlaggingSession(strategy, height, input->ImageCount(), config.chunkSize, config.contextSize);
+			aoflagger::ImageSet timestep = flagger.MakeImageSet(1, height, input->ImageCount());
+			std::vector<bool> streamFlags(width * height);
+			size_t finalized = 0;
+			for(size_t x=0; x!=width+1; ++x)
+			{
+				if(x == width)
+					session.Finish();
+				else {
+					for(size_t i=0; i!=input->ImageCount(); ++i)
+					{
+						for(size_t y=0; y!=height; ++y)
+							timestep.ImageBuffer(i)[y * timestep.HorizontalStride()] = input->ImageBuffer(i)[x + y * input->HorizontalStride()];
+					}
+					session.AddTimesteps(timestep);
+				}
+				const aoflagger::FlagMask flags = session.TakeFlags();
+				for(size_t y=0; y!=height; ++y)
+				{
+					for(size_t fx=0; fx!=flags.Width(); ++fx)
+						streamFlags[finalized + fx + y * width] = flags.Buffer()[fx + y * flags.HorizontalStride()];
+				}
+				finalized += flags.Width();
+				if(x != width)
+					maxLatency = std::max(maxLatency, x + 1 - finalized);
+			}
+			streamSeconds += streamWatch.Seconds();
+
+			for(size_t y=0; y!=height; ++y)
+			{
+				for(size_t x=0; x!=width; ++x)
+				{
+					const bool batchFlag = batchFlags.Buffer()[x + y * batchFlags.HorizontalStride()];
+					if(batchFlag) ++batchFlagged;
+					if(streamFlags[x + y * width]) ++streamFlagged;
+					if(batchFlag != streamFlags[x + y * width]) ++differences;
+				}
+			}
+			samples += width * height;
+			++baselineCount;
+		}
+		index->Next();
+	}
+
+	const double differenceFraction = samples == 0 ? 0.0 : double(differences) / double(samples);
+	output <<
+		"{\n"
+		"  \"version\": \"" << AOFLAGGER_VERSION_STR << "\",\n"
+		"  \"replay\": {\n"
+		"    \"file\": \"" << config.filename << "\",\n"
+		"    \"chunk_size\": " << config.chunkSize << ",\n"
+		"    \"context_size\": " << config.contextSize << ",\n"
+		"    \"baselines\": " << baselineCount << ",\n"
+		"    \"samples\": " << samples << ",\n"
+		"    \"batch_flagged\": " << batchFlagged << ",\n"
+		"    \"stream_flagged\": " << streamFlagged << ",\n"
+		"    \"different_flags\": " << differences << ",\n"
+		"    \"difference_fraction\": " << differenceFraction << ",\n"
+		"    \"max_latency_timesteps\": " << maxLatency << ",\n"
+		"    \"batch_seconds\": " << batchSeconds << ",\n"
+		"    \"stream_seconds\": " << streamSeconds << "\n"
+		"  }\n"
+		"}\n";
+	const bool isWithinTolerance = differenceFraction <= config.tolerance;
+	if(!isWithinTolerance)
+		std::cerr << "Streaming flags differ from batch flags for " << (differenceFraction*100.0) << "% of the samples, which exceeds the tolerance of " << (config.tolerance*100.0) << "%.\n";
+	return isWithinTolerance;
+}
@@ -0,0 +1,26 @@
+#ifndef BENCH_REPLAY_BENCHMARK_H
+#define BENCH_REPLAY_BENCHMARK_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+struct ReplayConfiguration
+{
+	std::string filename, strategyFilename;
+	size_t chunkSize, contextSize, maxBaselines;
+	double tolerance;
+};
+
+class ReplayBenchmark
+{
+	public:
+		/**
+		 * Flags the baselines of a measurement set both at once and by feeding them one
+		 * timestep at a time to a flagging session, and reports how well the flags agree.
+		 * @returns Whether the fraction of samples with different flags is within the tolerance.
+		 */
+		static bool Run(const ReplayConfiguration &config, std::ostream &output);
+};
+
+#endif
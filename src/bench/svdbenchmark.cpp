@@ -0,0 +1,74 @@
+#include "svdbenchmark.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "../strategy/algorithms/mitigationtester.h"
+#include "../strategy/algorithms/svdmitigater.h"
+
+#include "../structures/timefrequencydata.h"
+
+#include "../util/stopwatch.h"
+
+#include "../version.h"
+
+namespace {
+	double frobeniusNorm(const TimeFrequencyData &data)
+	{
+		Image2DCPtr
+			real = data.GetRealPart(),
+			imaginary = data.GetImaginaryPart();
+		double sum = 0.0;
+		for(size_t y=0; y!=data.ImageHeight(); ++y)
+		{
+			for(size_t x=0; x!=data.ImageWidth(); ++x)
+				sum += real->Value(x, y)*real->Value(x, y) + imaginary->Value(x, y)*imaginary->Value(x, y);
+		}
+		return sqrt(sum);
+	}
+}
+
+void SVDBenchmark::Run(const SVDConfiguration &config, std::ostream &output)
+{
+	// Strong rank-one components on unit noise, as a model for broadband RFI
+	std::vector<double> amplitudes(config.signalRank);
+	for(size_t i=0; i!=config.signalRank; ++i)
+		amplitudes[i] = 10.0 / (i+1);
+	srand(config.seed);
+	const TimeFrequencyData data = MitigationTester::CreateLowRankData(config.width, config.height, amplitudes);
+	output <<
+		"{\n"
+		"  \"version\": \"" << AOFLAGGER_VERSION_STR << "\",\n"
+		"  \"svd_comparison\": {\n"
+		"    \"width\": " << config.width << ",\n"
+		"    \"height\": " << config.height << ",\n"
+		"    \"signal_rank\": " << config.signalRank << ",\n"
+		"    \"results\": [";
+	for(size_t i=0; i!=config.removeCounts.size(); ++i)
+	{
+		double seconds[2], residual[2];
+		bool isTruncated = false;
+		for(size_t method=0; method!=2; ++method)
+		{
+			Stopwatch watch(true);
+			SVDMitigater svd;
+			svd.SetRemoveCount(config.removeCounts[i]);
+			svd.SetAllowTruncation(method == 1);
+			svd.Initialize(data);
+			svd.PerformFit(0);
+			seconds[method] = watch.Seconds();
+			residual[method] = frobeniusNorm(svd.Background());
+			if(method == 1)
+				isTruncated = svd.IsTruncated();
+		}
+		std::cerr << "Removing " << config.removeCounts[i] << " components: full " << seconds[0] << " s, truncated " << seconds[1] << " s.\n";
+		output << (i==0 ? "\n" : ",\n") <<
+			"      { \"remove_count\": " << config.removeCounts[i] << ", "
+			"\"truncated\": " << (isTruncated ? "true" : "false") << ", "
+			"\"full_seconds\": " << seconds[0] << ", "
+			"\"truncated_seconds\": " << seconds[1] << ", "
+			"\"residual_ratio\": " << (residual[1] / residual[0]) << " }";
+	}
+	output << "\n    ]\n  }\n}\n";
+}
@@ -0,0 +1,26 @@
+#ifndef BENCH_SVD_BENCHMARK_H
+#define BENCH_SVD_BENCHMARK_H
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+struct SVDConfiguration
+{
+	size_t width, height, signalRank;
+	std::vector<unsigned> removeCounts;
+	unsigned seed;
+};
+
+class SVDBenchmark
+{
+	public:
+		/**
+		 * Removes an increasing number of components from low-rank-plus-noise data with the full
+		 * and with the truncated SVD, and writes the times and the norm of the truncated residual
+		 * relative to the optimal residual of the full decomposition as JSON.
+		 */
+		static void Run(const SVDConfiguration &config, std::ostream &output);
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include "uvfitsbenchmark.h"
+
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+#include <fitsio.h>
+
+#include "../strategy/imagesets/imageset.h"
+
+#include "../structures/types.h"
+
+#include "../util/rng.h"
+#include "../util/stopwatch.h"
+
+#include "../version.h"
+
+namespace {
+	/**
+	 * Writes a random-groups UVFITS file with one group per baseline and timestep, ordered
+	 * by time as correlators write them, with Gaussian noise as visibilities.
+	 */
+	void writeSyntheticUVFits(const std::string &filename, size_t antennaCount, size_t timestepCount, size_t channelCount)
+	{
+		const char *parameterNames[] = { "UU", "VV", "WW", "BASELINE", "DATE" };
+		const size_t parameterCount = 5, complexCount = 3;
+		const size_t groupCount = timestepCount * antennaCount * (antennaCount-1) / 2;
+		long axes[7] = { 0, (long) complexCount, 1, (long) channelCount, 1, 1, 1 };
+		int status = 0;
+		fitsfile *fptr;
+		fits_create_file(&fptr, ("!" + filename).c_str(), &status);
+		fits_write_grphdr(fptr, 1, FLOAT_IMG, 7, axes, parameterCount, groupCount, 1, &status);
+		for(size_t p=0; p!=parameterCount; ++p)
+		{
+			std::ostringstream name;
+			name << "PTYPE" << (p+1);
+			fits_write_key_str(fptr, name.str().c_str(), parameterNames[p], "", &status);
+		}
+
+		std::vector<double> parameters(parameterCount), data(complexCount * channelCount);
+		size_t group = 0;
+		for(size_t t=0; t!=timestepCount; ++t)
+		{
+			for(size_t a1=0; a1!=antennaCount; ++a1)
+			{
+				for(size_t a2=a1+1; a2!=antennaCount; ++a2)
+				{
+					parameters[0] = 1e-6 * (a2 - a1);
+					parameters[1] = 1e-6 * t;
+					parameters[2] = 0.0;
+					parameters[3] = (a1+1) + ((a2+1) << 8);
+					parameters[4] = 2456000.5 + t / 86400.0;
+					for(size_t ch=0; ch!=channelCount; ++ch)
+					{
+						data[ch*complexCount] = RNG::Gaussian();
+						data[ch*complexCount+1] = RNG::Gaussian();
+						data[ch*complexCount+2] = 1.0;
+					}
+					++group;
+					fits_write_grppar_dbl(fptr, group, 1, parameterCount, &parameters[0], &status);
+					fits_write_img_dbl(fptr, group, 1, data.size(), &data[0], &status);
+				}
+			}
+		}
+		fits_close_file(fptr, &status);
+		if(status != 0)
+		{
+			char message[FLEN_STATUS];
+			fits_get_errstatus(status, message);
+			throw std::runtime_error(std::string("Could not write synthetic UVFITS file: ") + message);
+		}
+	}
+}
+
+void UVFitsBenchmark::Run(const UVFitsScalingConfiguration &config, std::ostream &output)
+{
+	output <<
+		"{\n"
+		"  \"version\": \"" << AOFLAGGER_VERSION_STR << "\",\n"
+		"  \"uvfits_scaling\": {\n"
+		"    \"timesteps\": " << config.timestepCount << ",\n"
+		"    \"channels\": " << config.channelCount << ",\n"
+		"    \"results\": [";
+	for(size_t i=0; i!=config.antennaCounts.size(); ++i)
+	{
+		const size_t antennaCount = config.antennaCounts[i];
+		std::cerr << "Writing synthetic UVFITS file with " << antennaCount << " antennas...\n";
+		writeSyntheticUVFits(config.filename, antennaCount, config.timestepCount, config.channelCount);
+
+		Stopwatch watch(true);
+		std::unique_ptr<rfiStrategy::ImageSet> imageSet(rfiStrategy::ImageSet::Create(config.filename, DirectReadMode));
+		imageSet->Initialize();
+		const double indexSeconds = watch.Seconds();
+		size_t baselineCount = 0, samples = 0;
+		std::unique_ptr<rfiStrategy::ImageSetIndex> index(imageSet->StartIndex());
+		while(index->IsValid())
+		{
+			imageSet->AddReadRequest(*index);
+			imageSet->PerformReadRequests();
+			std::unique_ptr<rfiStrategy::BaselineData> baseline(imageSet->GetNextRequested());
+			samples += baseline->Data().ImageWidth() * baseline->Data().ImageHeight();
+			++baselineCount;
+			index->Next();
+		}
+		const double seconds = watch.Seconds();
+		std::cerr << baselineCount << " baselines: " << watch.ToString() << ".\n";
+		output << (i==0 ? "\n" : ",\n") <<
+			"      { \"antennas\": " << antennaCount << ", "
+			"\"baselines\": " << baselineCount << ", "
+			"\"samples\": " << samples << ", "
+			"\"index_seconds\": " << indexSeconds << ", "
+			"\"seconds\": " << seconds << ", "
+			"\"seconds_per_baseline\": " << (seconds / baselineCount) << " }";
+	}
+	output << "\n    ]\n  }\n}\n";
+	remove(config.filename.c_str());
+}
@@ -0,0 +1,28 @@
+#ifndef BENCH_UVFITS_BENCHMARK_H
+#define BENCH_UVFITS_BENCHMARK_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct UVFitsScalingConfiguration
+{
+	std::string filename;
+	std::vector<size_t> antennaCounts;
+	size_t timestepCount, channelCount;
+};
+
+class UVFitsBenchmark
+{
+	public:
+		/**
+		 * Reads all baselines of synthetic UVFITS files with increasing numbers of antennas,
+		 * and writes the reading time per baseline count as JSON. When the groups of a baseline
+		 * are located by scanning the file, the time grows quadratically with the number of
+		 * baselines; with a single pass it grows linearly.
+		 */
+		static void Run(const UVFitsScalingConfiguration &config, std::ostream &output);
+};
+
+#endif
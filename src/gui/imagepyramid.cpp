@@ -0,0 +1,152 @@
+#include "imagepyramid.h"
+
+#include "../util/parallelfor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace {
+	unsigned char toFraction(size_t count, size_t total)
+	{
+		return (unsigned char) ((count * 255 + total/2) / total);
+	}
+}
+
+ImagePyramid::ImagePyramid(const Image2DCPtr &image, const Mask2DCPtr &originalMask, const Mask2DCPtr &alternativeMask) :
+	_image(image),
+	_originalMask(originalMask),
+	_alternativeMask(alternativeMask)
+{
+	const size_t
+		width = image->Width(),
+		height = image->Height(),
+		firstFactor = size_t(1) << FirstLevel;
+	if(width > firstFactor)
+	{
+		size_t levelWidth = (width + firstFactor - 1) / firstFactor;
+		while(true)
+		{
+			_levels.push_back(Level());
+			Level &level = _levels.back();
+			level.width = levelWidth;
+			level.height = height;
+			level.mean.resize(levelWidth * height);
+			level.originalFraction.resize(levelWidth * height);
+			level.alternativeFraction.resize(levelWidth * height);
+			level.bothFraction.resize(levelWidth * height);
+			if(levelWidth == 1)
+				break;
+			levelWidth = (levelWidth + 1) / 2;
+		}
+	}
+
+	// Every thread reduces its own rows, first from the image into the first level, then
+	// level by level, so that no synchronisation is needed between the levels.
+	_minValue = std::numeric_limits<num_t>::max();
+	_maxValue = -std::numeric_limits<num_t>::max();
+	boost::mutex mutex;
+	ParallelFor::Run(height, boost::bind(&ImagePyramid::buildRows, this, _1, _2, &mutex));
+}
+
+void ImagePyramid::buildRows(size_t rowStart, size_t rowEnd, boost::mutex *mutex)
+{
+	num_t
+		minValue = std::numeric_limits<num_t>::max(),
+		maxValue = -std::numeric_limits<num_t>::max();
+	buildFirstLevel(rowStart, rowEnd, minValue, maxValue);
+	for(size_t i=1; i<_levels.size(); ++i)
+		buildLevel(_levels[i-1], _levels[i], rowStart, rowEnd);
+
+	boost::mutex::scoped_lock lock(*mutex);
+	_minValue = std::min(_minValue, minValue);
+	_maxValue = std::max(_maxValue, maxValue);
+}
+
+void ImagePyramid::buildFirstLevel(size_t rowStart, size_t rowEnd, num_t &minValue, num_t &maxValue)
+{
+	const size_t
+		width = _image->Width(),
+		factor = size_t(1) << FirstLevel;
+	const bool
+		hasOriginal = _originalMask != 0,
+		hasAlternative = _alternativeMask != 0;
+	for(size_t y=rowStart; y!=rowEnd; ++y)
+	{
+		const num_t *values = _image->ValuePtr(0, y);
+		const bool
+			*original = hasOriginal ? _originalMask->ValuePtr(0, y) : 0,
+			*alternative = hasAlternative ? _alternativeMask->ValuePtr(0, y) : 0;
+		if(_levels.empty())
+		{
+			for(size_t x=0; x!=width; ++x)
+			{
+				if(std::isfinite(values[x]))
+				{
+					minValue = std::min(minValue, values[x]);
+					maxValue = std::max(maxValue, values[x]);
+				}
+			}
+		}
+		else {
+			Level &level = _levels.front();
+			for(size_t cell=0; cell!=level.width; ++cell)
+			{
+				const size_t
+					xStart = cell * factor,
+					xEnd = std::min(xStart + factor, width);
+				num_t sum = 0.0;
+				size_t finiteCount = 0, originalCount = 0, alternativeCount = 0, bothCount = 0;
+				for(size_t x=xStart; x!=xEnd; ++x)
+				{
+					if(std::isfinite(values[x]))
+					{
+						sum += values[x];
+						++finiteCount;
+						minValue = std::min(minValue, values[x]);
+						maxValue = std::max(maxValue, values[x]);
+					}
+					const bool
+						isOriginal = hasOriginal && original[x],
+						isAlternative = hasAlternative && alternative[x];
+					originalCount += isOriginal;
+					alternativeCount += isAlternative;
+					bothCount += isOriginal && isAlternative;
+				}
+				const size_t index = y * level.width + cell, count = xEnd - xStart;
+				level.mean[index] = finiteCount == 0 ? std::numeric_limits<num_t>::quiet_NaN() : sum / finiteCount;
+				level.originalFraction[index] = toFraction(originalCount, count);
+				level.alternativeFraction[index] = toFraction(alternativeCount, count);
+				level.bothFraction[index] = toFraction(bothCount, count);
+			}
+		}
+	}
+}
+
+void ImagePyramid::buildLevel(const Level &source, Level &dest, size_t rowStart, size_t rowEnd)
+{
+	for(size_t y=rowStart; y!=rowEnd; ++y)
+	{
+		const size_t sourceRow = y * source.width, destRow = y * dest.width;
+		for(size_t cell=0; cell!=dest.width; ++cell)
+		{
+			const size_t
+				a = sourceRow + cell*2,
+				b = (cell*2 + 1 < source.width) ? a + 1 : a,
+				index = destRow + cell;
+			const num_t meanA = source.mean[a], meanB = source.mean[b];
+			if(std::isfinite(meanA) && std::isfinite(meanB))
+				dest.mean[index] = (meanA + meanB) * 0.5;
+			else if(std::isfinite(meanA))
+				dest.mean[index] = meanA;
+			else
+				dest.mean[index] = meanB;
+			dest.originalFraction[index] = (source.originalFraction[a] + source.originalFraction[b] + 1) / 2;
+			dest.alternativeFraction[index] = (source.alternativeFraction[a] + source.alternativeFraction[b] + 1) / 2;
+			dest.bothFraction[index] = (source.bothFraction[a] + source.bothFraction[b] + 1) / 2;
+		}
+	}
+}
@@ -0,0 +1,81 @@
+#ifndef IMAGE_PYRAMID_H
+#define IMAGE_PYRAMID_H
+
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+#include "../structures/image2d.h"
+#include "../structures/mask2d.h"
+
+/**
+ * Precomputed, horizontally reduced versions of an image and its masks, used by
+ * the ImageWidget to render zoomed-out views without visiting every sample.
+ *
+ * Each level halves the number of time steps of the previous level; the frequency
+ * axis is not reduced, because it is normally much shorter than the time axis. The
+ * first stored level combines 2^FirstLevel time steps: for smaller reductions, the
+ * image itself is cheap enough to use, and starting the pyramid there limits its
+ * size to less than half the size of the image.
+ *
+ * For each cell, the pyramid stores the mean of the finite values and the fraction
+ * of samples that are flagged in the original mask, in the alternative mask and in
+ * both, so that the mask overlays can be blended for every combination of shown
+ * masks. The pyramid also stores the finite extremes of the whole image.
+ */
+class ImagePyramid
+{
+	public:
+		enum { FirstLevel = 3 };
+
+		struct Level
+		{
+			size_t width, height;
+			std::vector<num_t> mean;
+			std::vector<unsigned char> originalFraction, alternativeFraction, bothFraction;
+		};
+
+		/**
+		 * Builds the pyramid, splitting the rows over threads. The masks can be null.
+		 */
+		ImagePyramid(const Image2DCPtr &image, const Mask2DCPtr &originalMask, const Mask2DCPtr &alternativeMask);
+
+		bool IsBuiltFor(const Image2DCPtr &image, const Mask2DCPtr &originalMask, const Mask2DCPtr &alternativeMask) const
+		{
+			return image == _image && originalMask == _originalMask && alternativeMask == _alternativeMask;
+		}
+
+		/**
+		 * Index of the last level, or zero if the pyramid has no levels
+		 * because the image is too small.
+		 */
+		size_t MaxLevel() const { return _levels.empty() ? 0 : FirstLevel + _levels.size() - 1; }
+
+		/**
+		 * Returns the level in which each cell combines 2^level time steps.
+		 * @param level Level index, between FirstLevel and MaxLevel().
+		 */
+		const Level &GetLevel(size_t level) const { return _levels[level - FirstLevel]; }
+
+		/**
+		 * Minimum over all finite values of the image.
+		 */
+		num_t MinValue() const { return _minValue; }
+
+		/**
+		 * Maximum over all finite values of the image.
+		 */
+		num_t MaxValue() const { return _maxValue; }
+
+	private:
+		void buildRows(size_t rowStart, size_t rowEnd, boost::mutex *mutex);
+		void buildFirstLevel(size_t rowStart, size_t rowEnd, num_t &minValue, num_t &maxValue);
+		static void buildLevel(const Level &source, Level &dest, size_t rowStart, size_t rowEnd);
+
+		Image2DCPtr _image;
+		Mask2DCPtr _originalMask, _alternativeMask;
+		std::vector<Level> _levels;
+		num_t _minValue, _maxValue;
+};
+
+#endif
@@ -0,0 +1,235 @@
+#include "imagerenderer.h"
+
+#include "../structures/colormap.h"
+
+#include "../util/parallelfor.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <boost/bind.hpp>
+
+ImageRenderer::ImageRenderer(const Parameters &parameters, size_t width, size_t height, const boost::function<void()> &onFinished) :
+	_parameters(parameters),
+	_width(width),
+	_height(height),
+	_onFinished(onFinished),
+	_data(width * height * 4),
+	_level(selectLevel(parameters, width)),
+	_tileCount((height + TileHeight - 1) / TileHeight),
+	_nextTile(0),
+	_finishedTileCount(0),
+	_isCancelled(false),
+	_isJoined(false)
+{
+	_minLog10 = _parameters.min>0.0 ? log10(_parameters.min) : 0.0;
+	_maxLog10 = _parameters.max>0.0 ? log10(_parameters.max) : 0.0;
+	initializeColumns();
+
+	const size_t threadCount = ParallelFor::ThreadCount(_tileCount);
+	for(size_t i=0; i!=threadCount; ++i)
+		_threads.create_thread(boost::bind(&ImageRenderer::workThread, this));
+}
+
+ImageRenderer::~ImageRenderer()
+{
+	Cancel();
+	Wait();
+}
+
+void ImageRenderer::Wait()
+{
+	if(!_isJoined)
+	{
+		_threads.join_all();
+		_isJoined = true;
+	}
+}
+
+size_t ImageRenderer::selectLevel(const Parameters &parameters, size_t width)
+{
+	if(parameters.pyramid == 0 || parameters.highlightMask != 0 || parameters.segmentedImage != 0 || width == 0)
+		return 0;
+	const size_t samplesPerPixel = (parameters.endX - parameters.startX) / width;
+	size_t level = 0;
+	while((size_t(2) << level) <= samplesPerPixel)
+		++level;
+	if(level < ImagePyramid::FirstLevel || parameters.pyramid->MaxLevel() == 0)
+		return 0;
+	return std::min(level, parameters.pyramid->MaxLevel());
+}
+
+size_t ImageRenderer::CellCount(const Parameters &parameters, size_t width, size_t height)
+{
+	if(width == 0 || height == 0)
+		return 0;
+	const size_t
+		level = selectLevel(parameters, width),
+		columnCells = std::max<size_t>(((parameters.endX - parameters.startX) / width) >> level, 1),
+		rowCells = std::max<size_t>((parameters.endY - parameters.startY) / height, 1);
+	return width * height * columnCells * rowCells;
+}
+
+void ImageRenderer::initializeColumns()
+{
+	const size_t imageWidth = _parameters.endX - _parameters.startX;
+	_columnStart.resize(_width);
+	_columnEnd.resize(_width);
+	for(size_t x=0; x!=_width; ++x)
+	{
+		const size_t
+			sampleStart = _parameters.startX + x * imageWidth / _width,
+			sampleEnd = _parameters.startX + (x+1) * imageWidth / _width;
+		if(_level == 0)
+		{
+			_columnStart[x] = sampleStart;
+			_columnEnd[x] = std::max(sampleEnd, sampleStart + 1);
+		}
+		else {
+			// Take the cells whose centre lies inside the pixel
+			const size_t
+				half = size_t(1) << (_level - 1),
+				levelWidth = _parameters.pyramid->GetLevel(_level).width;
+			size_t
+				cellStart = (sampleStart + half) >> _level,
+				cellEnd = (sampleEnd + half) >> _level;
+			cellEnd = std::min(std::max(cellEnd, cellStart + 1), levelWidth);
+			cellStart = std::min(cellStart, cellEnd - 1);
+			_columnStart[x] = cellStart;
+			_columnEnd[x] = cellEnd;
+		}
+	}
+}
+
+void ImageRenderer::workThread()
+{
+	while(true)
+	{
+		const size_t tile = _nextTile.fetch_add(1);
+		if(tile >= _tileCount)
+			break;
+		if(!_isCancelled)
+			renderTile(tile * TileHeight, std::min<size_t>((tile+1) * TileHeight, _height));
+		if(_finishedTileCount.fetch_add(1) + 1 == _tileCount && _onFinished)
+			_onFinished();
+	}
+}
+
+void ImageRenderer::renderTile(size_t rowStart, size_t rowEnd)
+{
+	const size_t imageHeight = _parameters.endY - _parameters.startY;
+	for(size_t y=rowStart; y!=rowEnd; ++y)
+	{
+		// The first row of the buffer shows the highest channels
+		const size_t
+			fromBottom = _height - y - 1,
+			yStart = _parameters.startY + fromBottom * imageHeight / _height,
+			yEnd = std::max(_parameters.startY + (fromBottom+1) * imageHeight / _height, yStart + 1);
+		unsigned char *row = &_data[y * Stride()];
+		if(_level == 0)
+			renderRowFromImage(row, yStart, yEnd);
+		else
+			renderRowFromPyramid(row, yStart, yEnd);
+	}
+}
+
+const unsigned char *ImageRenderer::valueColor(num_t value) const
+{
+	num_t val;
+	if(_parameters.isLogScale)
+	{
+		if(value <= 0.0)
+			val = -1.0;
+		else
+			val = (log10(value) - _minLog10) * 2.0 / (_maxLog10 - _minLog10) - 1.0;
+	}
+	else
+		val = (value - _parameters.min) * 2.0 / (_parameters.max - _parameters.min) - 1.0;
+	// Also catches NaNs
+	if(!(val >= -1.0)) val = -1.0;
+	else if(val > 1.0) val = 1.0;
+	const size_t index = (size_t) ((val + 1.0) * 0.5 * (ColorTableSize - 1) + 0.5);
+	return &_parameters.colorTable[index * 4];
+}
+
+void ImageRenderer::renderRowFromImage(unsigned char *row, size_t yStart, size_t yEnd) const
+{
+	static const unsigned char highlightColor[4] = { 0, 0, 255, 255 };
+	const Image2D &image = *_parameters.image;
+	const Mask2D
+		*originalMask = _parameters.originalMask.get(),
+		*alternativeMask = _parameters.alternativeMask.get(),
+		*highlightMask = _parameters.highlightMask.get();
+	const SegmentedImage *segmentedImage = _parameters.segmentedImage.get();
+	for(size_t x=0; x!=_width; ++x)
+	{
+		unsigned sum[4] = { 0, 0, 0, 0 };
+		for(size_t y=yStart; y!=yEnd; ++y)
+		{
+			for(size_t sx=_columnStart[x]; sx!=_columnEnd[x]; ++sx)
+			{
+				const unsigned char *color;
+				if(highlightMask != 0 && highlightMask->Value(sx, y))
+					color = highlightColor;
+				else if(originalMask != 0 && originalMask->Value(sx, y))
+					color = _parameters.originalColor;
+				else if(alternativeMask != 0 && alternativeMask->Value(sx, y))
+					color = _parameters.alternativeColor;
+				else
+					color = valueColor(image.Value(sx, y));
+				unsigned char segmentColor[4];
+				if(segmentedImage != 0 && segmentedImage->Value(sx, y) != 0)
+				{
+					const int segment = segmentedImage->Value(sx, y);
+					segmentColor[0] = IntMap::B(segment);
+					segmentColor[1] = IntMap::G(segment);
+					segmentColor[2] = IntMap::R(segment);
+					segmentColor[3] = IntMap::A(segment);
+					color = segmentColor;
+				}
+				for(size_t c=0; c!=4; ++c)
+					sum[c] += color[c];
+			}
+		}
+		const unsigned count = (yEnd - yStart) * (_columnEnd[x] - _columnStart[x]);
+		for(size_t c=0; c!=4; ++c)
+			row[x*4 + c] = (unsigned char) ((sum[c] + count/2) / count);
+	}
+}
+
+void ImageRenderer::renderRowFromPyramid(unsigned char *row, size_t yStart, size_t yEnd) const
+{
+	const ImagePyramid::Level &level = _parameters.pyramid->GetLevel(_level);
+	const bool
+		showOriginal = _parameters.originalMask != 0,
+		showAlternative = _parameters.alternativeMask != 0;
+	for(size_t x=0; x!=_width; ++x)
+	{
+		unsigned sum[4] = { 0, 0, 0, 0 };
+		for(size_t y=yStart; y!=yEnd; ++y)
+		{
+			for(size_t cell=_columnStart[x]; cell!=_columnEnd[x]; ++cell)
+			{
+				// The original mask is drawn on top of the alternative mask, so the
+				// samples that are in both masks are drawn in the original colour.
+				const size_t index = y * level.width + cell;
+				const int originalPart = showOriginal ? level.originalFraction[index] : 0;
+				int alternativePart = 0;
+				if(showAlternative)
+				{
+					alternativePart = level.alternativeFraction[index];
+					if(showOriginal)
+						alternativePart = std::max(alternativePart - int(level.bothFraction[index]), 0);
+					alternativePart = std::min(alternativePart, 255 - originalPart);
+				}
+				const int valuePart = 255 - originalPart - alternativePart;
+				const unsigned char *color = valueColor(level.mean[index]);
+				for(size_t c=0; c!=4; ++c)
+					sum[c] += originalPart * _parameters.originalColor[c] + alternativePart * _parameters.alternativeColor[c] + valuePart * color[c];
+			}
+		}
+		const unsigned count = (yEnd - yStart) * (_columnEnd[x] - _columnStart[x]) * 255;
+		for(size_t c=0; c!=4; ++c)
+			row[x*4 + c] = (unsigned char) ((sum[c] + count/2) / count);
+	}
+}
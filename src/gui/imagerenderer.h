@@ -0,0 +1,120 @@
+#ifndef IMAGE_RENDERER_H
+#define IMAGE_RENDERER_H
+
+#include <atomic>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "../structures/image2d.h"
+#include "../structures/mask2d.h"
+#include "../structures/segmentedimage.h"
+
+#include "imagepyramid.h"
+
+/**
+ * Renders (part of) an image with its mask overlays into a 32-bit BGRA buffer, as
+ * used by Cairo image surfaces, in the background.
+ *
+ * The buffer is divided into tiles of rows, which are rendered by ParallelFor::ThreadCount() worker
+ * threads. Each output pixel is the box average of the colours of the samples that
+ * it covers. When a pixel covers many time steps, the colours are determined from
+ * the coarsest ImagePyramid level that still has at least one cell per pixel,
+ * instead of from the samples themselves.
+ *
+ * The renderer only reads the images that are given in its parameters, so the
+ * caller can continue while it runs. The result is valid once IsFinished() returns
+ * true or Wait() has returned. Destructing the renderer cancels and waits for it.
+ */
+class ImageRenderer
+{
+	public:
+		enum { ColorTableSize = 1024, TileHeight = 16 };
+
+		struct Parameters
+		{
+			Parameters() : startX(0), endX(0), startY(0), endY(0), isLogScale(false), min(0.0), max(1.0)
+			{ }
+
+			Image2DCPtr image;
+			/**
+			 * Masks that are drawn on top of the image. Masks that are not shown
+			 * should be null.
+			 */
+			Mask2DCPtr originalMask, alternativeMask, highlightMask;
+			SegmentedImageCPtr segmentedImage;
+			/**
+			 * Pyramid of the image and its masks, or null to always render from the
+			 * samples. It is not used when a highlight mask or segmented image is given.
+			 */
+			boost::shared_ptr<const ImagePyramid> pyramid;
+			/**
+			 * The area of the image that is rendered, in samples.
+			 */
+			size_t startX, endX, startY, endY;
+			bool isLogScale;
+			num_t min, max;
+			/**
+			 * BGRA colours for ColorTableSize values, evenly spaced between -1 and 1.
+			 */
+			std::vector<unsigned char> colorTable;
+			unsigned char originalColor[4], alternativeColor[4];
+		};
+
+		ImageRenderer(const Parameters &parameters, size_t width, size_t height, const boost::function<void()> &onFinished = boost::function<void()>());
+
+		~ImageRenderer();
+
+		/**
+		 * Stops rendering as soon as possible; the result is not valid afterwards.
+		 */
+		void Cancel() { _isCancelled = true; }
+
+		/**
+		 * Blocks until all tiles have been rendered or skipped.
+		 */
+		void Wait();
+
+		bool IsFinished() const { return !_isCancelled && _finishedTileCount == _tileCount; }
+
+		size_t Width() const { return _width; }
+		size_t Height() const { return _height; }
+		size_t Stride() const { return _width * 4; }
+		const unsigned char *Data() const { return _data.data(); }
+
+		/**
+		 * Estimates the number of samples or pyramid cells that are visited when
+		 * rendering the given parameters into a buffer of the given size.
+		 */
+		static size_t CellCount(const Parameters &parameters, size_t width, size_t height);
+
+	private:
+		ImageRenderer(const ImageRenderer&) = delete;
+		ImageRenderer& operator=(const ImageRenderer&) = delete;
+
+		static size_t selectLevel(const Parameters &parameters, size_t width);
+		void initializeColumns();
+		void workThread();
+		void renderTile(size_t rowStart, size_t rowEnd);
+		void renderRowFromImage(unsigned char *row, size_t yStart, size_t yEnd) const;
+		void renderRowFromPyramid(unsigned char *row, size_t yStart, size_t yEnd) const;
+		const unsigned char *valueColor(num_t value) const;
+
+		const Parameters _parameters;
+		const size_t _width, _height;
+		boost::function<void()> _onFinished;
+		std::vector<unsigned char> _data;
+		size_t _level;
+		std::vector<size_t> _columnStart, _columnEnd;
+		num_t _minLog10, _maxLog10;
+
+		const size_t _tileCount;
+		std::atomic<size_t> _nextTile, _finishedTileCount;
+		std::atomic<bool> _isCancelled;
+		boost::thread_group _threads;
+		bool _isJoined;
+};
+
+#endif
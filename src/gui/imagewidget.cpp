@@ -13,10 +13,25 @@
 #include "plot/verticalplotscale.h"
 #include "plot/title.h"
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+
+namespace {
+	/**
+	 * Number of visited samples or pyramid cells above which a render in the GUI first
+	 * shows a preview of reduced resolution, while the full resolution is rendered in
+	 * the background.
+	 */
+	const size_t ProgressiveCellCount = 1 << 22;
+	/**
+	 * Reduction of the width and height of the preview.
+	 */
+	const unsigned PreviewReduction = 4;
+}
 
 ImageWidget::ImageWidget() :
 	_isInitialized(false),
@@ -61,6 +76,7 @@ ImageWidget::ImageWidget() :
 	signal_leave_notify_event().connect(sigc::mem_fun(*this, &ImageWidget::onLeave));
 	signal_button_release_event().connect(sigc::mem_fun(*this, &ImageWidget::onButtonReleased));
 	signal_draw().connect(sigc::mem_fun(*this, &ImageWidget::onDraw) );
+	_renderFinishedSignal.connect(sigc::mem_fun(*this, &ImageWidget::onRenderFinished));
 }
 
 ImageWidget::~ImageWidget()
@@ -71,6 +87,9 @@ ImageWidget::~ImageWidget()
 
 void ImageWidget::Clear()
 {
+	cancelRendering();
+	_pyramid.reset();
+	_rangeCache = RangeCache();
   if(HasImage())
 	{
 		_originalMask.reset();
@@ -193,7 +212,7 @@ void ImageWidget::Update()
 	{
 		if(HasImage())
 		{
-			update(window->create_cairo_context(), get_width(), get_height());
+			update(window->create_cairo_context(), get_width(), get_height(), true);
 			window->invalidate(false);
 		}
 		else {
@@ -320,38 +339,29 @@ void ImageWidget::SaveText(const std::string &filename)
 	}
 }
 
-void ImageWidget::update(Cairo::RefPtr<Cairo::Context> cairo, unsigned width, unsigned height)
+void ImageWidget::update(Cairo::RefPtr<Cairo::Context> cairo, unsigned width, unsigned height, bool isProgressive)
 {
 	Image2DCPtr image = _image;
-	Mask2DCPtr mask = GetActiveMask(), originalMask = _originalMask, alternativeMask = _alternativeMask;
 	
-	unsigned int
+	const unsigned int
 		startX = (unsigned int) round(_startHorizontal * image->Width()),
 		startY = (unsigned int) round(_startVertical * image->Height()),
 		endX = (unsigned int) round(_endHorizontal * image->Width()),
-		endY = (unsigned int) round(_endVertical * image->Height()),
-		startTimestep = startX,
-		endTimestep = endX;
-	size_t
+		endY = (unsigned int) round(_endVertical * image->Height());
+	const size_t
 		imageWidth = endX - startX,
 		imageHeight = endY - startY;
-		
-	if(imageWidth > 30000)
+
+	// The pyramid only depends on the image and masks, so it is kept while zooming
+	// or changing the colour map.
+	if(_pyramid == 0 || !_pyramid->IsBuiltFor(image, _originalMask, _alternativeMask))
 	{
-		int shrinkFactor = (imageWidth + 29999) / 30000;
-		image = image->ShrinkHorizontally(shrinkFactor);
-		mask = mask->ShrinkHorizontally(shrinkFactor);
-		if(originalMask != 0)
-			originalMask = originalMask->ShrinkHorizontally(shrinkFactor);
-		if(alternativeMask != 0)
-			alternativeMask = alternativeMask->ShrinkHorizontally(shrinkFactor);
-		startX /= shrinkFactor;
-		endX /= shrinkFactor;
-		imageWidth = endX - startX;
+		cancelRendering();
+		_pyramid.reset(new ImagePyramid(image, _originalMask, _alternativeMask));
 	}
 
 	num_t min, max;
-	findMinMax(image, mask, min, max);
+	findMinMax(min, max);
 	
 	// If these are not yet created, they are 0, so ok to delete.
 	delete _horiScale;
@@ -386,10 +396,10 @@ void ImageWidget::update(Cairo::RefPtr<Cairo::Context> cairo, unsigned width, un
 		}
 		if(_metaData != 0 && _metaData->HasObservationTimes())
 		{
-			_horiScale->InitializeTimeTicks(_metaData->ObservationTimes()[startTimestep], _metaData->ObservationTimes()[endTimestep-1]);
+			_horiScale->InitializeTimeTicks(_metaData->ObservationTimes()[startX], _metaData->ObservationTimes()[endX-1]);
 			_horiScale->SetUnitsCaption("Time (UTC, hh:mm:ss)");
 		} else {
-			_horiScale->InitializeNumericTicks(-0.5 + startTimestep, 0.5 + endTimestep - 1.0);
+			_horiScale->InitializeNumericTicks(-0.5 + startX, 0.5 + endX - 1.0);
 		}
 		if(_manualXAxisDescription)
 			_horiScale->SetUnitsCaption(_xAxisDescription);
@@ -452,9 +462,7 @@ void ImageWidget::update(Cairo::RefPtr<Cairo::Context> cairo, unsigned width, un
 
 	class ColorMap *colorMap = createColorMap();
 	
-	const double
-		minLog10 = min>0.0 ? log10(min) : 0.0,
-		maxLog10 = max>0.0 ? log10(max) : 0.0;
+	const double minLog10 = min>0.0 ? log10(min) : 0.0;
 	if(_showColorScale)
 	{
 		for(unsigned x=0;x<256;++x)
@@ -473,98 +481,66 @@ void ImageWidget::update(Cairo::RefPtr<Cairo::Context> cairo, unsigned width, un
 		}
 	}
 	
-	_imageSurface.clear();
-	_imageSurface =
-		Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, imageWidth, imageHeight);
-
-	_imageSurface->flush();
-	unsigned char *data = _imageSurface->get_data();
-	size_t rowStride = _imageSurface->get_stride();
+	ImageRenderer::Parameters parameters;
+	parameters.image = image;
+	parameters.startX = startX;
+	parameters.endX = endX;
+	parameters.startY = startY;
+	parameters.endY = endY;
+	parameters.pyramid = _pyramid;
+	parameters.isLogScale = _scaleOption == LogScale;
+	parameters.min = min;
+	parameters.max = max;
+	parameters.colorTable.resize(ImageRenderer::ColorTableSize * 4);
+	for(size_t i=0; i!=ImageRenderer::ColorTableSize; ++i)
+	{
+		const num_t val = (2.0 * i) / (ImageRenderer::ColorTableSize - 1) - 1.0;
+		parameters.colorTable[i*4] = colorMap->ValueToColorB(val);
+		parameters.colorTable[i*4+1] = colorMap->ValueToColorG(val);
+		parameters.colorTable[i*4+2] = colorMap->ValueToColorR(val);
+		parameters.colorTable[i*4+3] = colorMap->ValueToColorA(val);
+	}
+	delete colorMap;
 
-	Mask2DPtr highlightMask;
 	if(_highlighting)
 	{
-		highlightMask = Mask2D::CreateSetMaskPtr<false>(image->Width(), image->Height());
+		Mask2DPtr highlightMask = Mask2D::CreateSetMaskPtr<false>(image->Width(), image->Height());
 		_highlightConfig->Execute(image, highlightMask, true, 10.0);
-	}
-	const bool
-		originalActive = _showOriginalMask && originalMask != 0,
-		altActive = _showAlternativeMask && alternativeMask != 0;
-	int orMaskR=255, orMaskG=0, orMaskB=255;
-	int altMaskR=255, altMaskG=255, altMaskB=0;
+		parameters.highlightMask = highlightMask;
+	}
+	if(_showOriginalMask)
+		parameters.originalMask = _originalMask;
+	if(_showAlternativeMask)
+		parameters.alternativeMask = _alternativeMask;
+	parameters.segmentedImage = _segmentedImage;
+	unsigned char orMask[4] = { 255, 0, 255, 255 }, altMask[4] = { 0, 255, 255, 255 };
 	if(_colorMap == ViridisMap)
 	{
-		orMaskR=0; orMaskG=0; orMaskB=0;
-		altMaskR=255; altMaskG=255; altMaskB=255;
-	}
-	for(unsigned long y=startY;y<endY;++y) {
-		guint8* rowpointer = data + rowStride * (endY - y - 1);
-		for(unsigned long x=startX;x<endX;++x) {
-			int xa = (x-startX) * 4;
-			unsigned char r,g,b,a;
-			if(_highlighting && highlightMask->Value(x, y) != 0) {
-				r = 255; g = 0; b = 0; a = 255;
-			} else if(originalActive && originalMask->Value(x, y)) {
-				r = orMaskR; g = orMaskG; b = orMaskB; a = 255;
-			} else if(altActive && alternativeMask->Value(x, y)) {
-				r = altMaskR; g = altMaskG; b = altMaskB; a = 255;
-			} else {
-				num_t val = image->Value(x, y);
-				if(val > max) val = max;
-				else if(val < min) val = min;
-
-				if(_scaleOption == LogScale)
-				{
-					if(image->Value(x, y) <= 0.0)
-						val = -1.0;
-					else
-						val = (log10(image->Value(x, y)) - minLog10) * 2.0 / (maxLog10 - minLog10) - 1.0;
-				}
-				else
-					val = (image->Value(x, y) - min) * 2.0 / (max - min) - 1.0;
-				if(val < -1.0) val = -1.0;
-				else if(val > 1.0) val = 1.0;
-				r = colorMap->ValueToColorR(val);
-				g = colorMap->ValueToColorG(val);
-				b = colorMap->ValueToColorB(val);
-				a = colorMap->ValueToColorA(val);
-			}
-			rowpointer[xa]=b;
-			rowpointer[xa+1]=g;
-			rowpointer[xa+2]=r;
-			rowpointer[xa+3]=a;
-		}
-	}
-	delete colorMap;
-
-	if(_segmentedImage != 0)
-	{
-		for(unsigned long y=startY;y<endY;++y) {
-			guint8* rowpointer = data + rowStride * (y - startY);
-			for(unsigned long x=startX;x<endX;++x) {
-				if(_segmentedImage->Value(x,y) != 0)
-				{
-					int xa = (x-startX) * 4;
-					rowpointer[xa]=IntMap::R(_segmentedImage->Value(x,y));
-					rowpointer[xa+1]=IntMap::G(_segmentedImage->Value(x,y));
-					rowpointer[xa+2]=IntMap::B(_segmentedImage->Value(x,y));
-					rowpointer[xa+3]=IntMap::A(_segmentedImage->Value(x,y));
-				}
-			}
-		}
+		orMask[0] = 0; orMask[1] = 0; orMask[2] = 0;
+		altMask[0] = 255; altMask[1] = 255; altMask[2] = 255;
 	}
-	_imageSurface->mark_dirty();
+	std::copy(orMask, orMask+4, parameters.originalColor);
+	std::copy(altMask, altMask+4, parameters.alternativeColor);
 
-	while(_imageSurface->get_width() > (int) width || _imageSurface->get_height() > (int) height)
+	// The image is rendered with at most one pixel per sample; Cairo scales it to the plot area.
+	const unsigned
+		surfaceWidth = std::min<size_t>(imageWidth, width),
+		surfaceHeight = std::min<size_t>(imageHeight, height);
+	cancelRendering();
+	if(isProgressive && ImageRenderer::CellCount(parameters, surfaceWidth, surfaceHeight) > ProgressiveCellCount)
 	{
-		unsigned
-			newWidth = _imageSurface->get_width(),
-			newHeight = _imageSurface->get_height();
-		if(newWidth > width)
-			newWidth = width;
-		if(newHeight > height)
-			newHeight = height;
-		downsampleImageBuffer(newWidth, newHeight);
+		ImageRenderer preview(parameters,
+			std::max(surfaceWidth / PreviewReduction, 1u),
+			std::max(surfaceHeight / PreviewReduction, 1u));
+		preview.Wait();
+		_imageSurface = createSurface(preview);
+		_pendingRenderer.reset(new ImageRenderer(parameters, surfaceWidth, surfaceHeight,
+			boost::bind(&Glib::Dispatcher::emit, &_renderFinishedSignal)));
+	}
+	else {
+		ImageRenderer renderer(parameters, surfaceWidth, surfaceHeight);
+		renderer.Wait();
+		_imageSurface = createSurface(renderer);
 	}
 
 	_isInitialized = true;
@@ -573,6 +549,41 @@ void ImageWidget::update(Cairo::RefPtr<Cairo::Context> cairo, unsigned width, un
 	redrawWithoutChanges(cairo, width, height);
 } 
 
+Cairo::RefPtr<Cairo::ImageSurface> ImageWidget::createSurface(const ImageRenderer &renderer)
+{
+	Cairo::RefPtr<Cairo::ImageSurface> surface =
+		Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, renderer.Width(), renderer.Height());
+	surface->flush();
+	unsigned char *data = surface->get_data();
+	const size_t rowStride = surface->get_stride();
+	for(size_t y=0; y!=renderer.Height(); ++y)
+		std::copy(renderer.Data() + y * renderer.Stride(), renderer.Data() + (y+1) * renderer.Stride(), data + y * rowStride);
+	surface->mark_dirty();
+	return surface;
+}
+
+void ImageWidget::cancelRendering()
+{
+	// Destructing the renderer waits for its threads
+	if(_pendingRenderer != 0)
+	{
+		_pendingRenderer->Cancel();
+		_pendingRenderer.reset();
+	}
+}
+
+void ImageWidget::onRenderFinished()
+{
+	// Signals of cancelled renderers can still arrive after a new render was started
+	if(_pendingRenderer != 0 && _pendingRenderer->IsFinished())
+	{
+		_pendingRenderer->Wait();
+		_imageSurface = createSurface(*_pendingRenderer);
+		_pendingRenderer.reset();
+		queue_draw();
+	}
+}
+
 ColorMap *ImageWidget::createColorMap()
 {
 	switch(_colorMap) {
@@ -597,30 +608,62 @@ ColorMap *ImageWidget::createColorMap()
 	}
 }
 
-void ImageWidget::findMinMax(Image2DCPtr image, Mask2DCPtr mask, num_t &min, num_t &max)
+void ImageWidget::findMinMax(num_t &min, num_t &max)
 {
-	switch(_range)
+	const Mask2DCPtr
+		originalMask = _showOriginalMask ? _originalMask : Mask2DCPtr(),
+		alternativeMask = _showAlternativeMask ? _alternativeMask : Mask2DCPtr();
+	if(_range == Specified)
 	{
-		case MinMax:
-			max = ThresholdTools::MaxValue(image, mask);
-			min = ThresholdTools::MinValue(image, mask);
-		break;
-		case Winsorized:
+		min = _min;
+		max = _max;
+	}
+	else if(_rangeCache.isValid && _rangeCache.image == _image && _rangeCache.range == _range &&
+		_rangeCache.originalMask == originalMask && _rangeCache.alternativeMask == alternativeMask)
+	{
+		min = _rangeCache.min;
+		max = _rangeCache.max;
+	}
+	else {
+		Image2DCPtr image = _image;
+		Mask2DCPtr mask = GetActiveMask();
+		num_t genMin, genMax;
+		// Without shown masks, the extremes of the image are known from the pyramid
+		if(originalMask == 0 && alternativeMask == 0)
 		{
-			num_t mean, stddev, genMax, genMin;
-			ThresholdTools::WinsorizedMeanAndStdDev(image, mask, mean, stddev);
-			genMax = ThresholdTools::MaxValue(image, mask);
+			genMin = _pyramid->MinValue();
+			genMax = _pyramid->MaxValue();
+		}
+		else {
 			genMin = ThresholdTools::MinValue(image, mask);
+			genMax = ThresholdTools::MaxValue(image, mask);
+		}
+		if(_range == Winsorized)
+		{
+			if(image->Width() > 30000)
+			{
+				int shrinkFactor = (image->Width() + 29999) / 30000;
+				image = image->ShrinkHorizontally(shrinkFactor);
+				mask = mask->ShrinkHorizontally(shrinkFactor);
+			}
+			num_t mean, stddev;
+			ThresholdTools::WinsorizedMeanAndStdDev(image, mask, mean, stddev);
 			max = mean + stddev*3.0;
 			min = mean - stddev*3.0;
 			if(genMin > min) min = genMin;
 			if(genMax < max) max = genMax;
 		}
-		break;
-		case Specified:
-			min = _min;
-			max = _max;
-		break;
+		else {
+			min = genMin;
+			max = genMax;
+		}
+		_rangeCache.isValid = true;
+		_rangeCache.image = _image;
+		_rangeCache.originalMask = originalMask;
+		_rangeCache.alternativeMask = alternativeMask;
+		_rangeCache.range = _range;
+		_rangeCache.min = min;
+		_rangeCache.max = max;
 	}
 	if(min == max)
 	{
@@ -689,61 +732,6 @@ void ImageWidget::redrawWithoutChanges(Cairo::RefPtr<Cairo::Context> cairo, unsi
 	}
 }
 
-void ImageWidget::downsampleImageBuffer(unsigned newWidth, unsigned newHeight)
-{
-	_imageSurface->flush();
-	const unsigned
-		oldWidth = _imageSurface->get_width(),
-		oldHeight = _imageSurface->get_height();
-	
-	Cairo::RefPtr<Cairo::ImageSurface> newImageSurface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, newWidth, newHeight);
-
-	unsigned char* newData = newImageSurface->get_data();
-	size_t rowStrideOfNew = newImageSurface->get_stride();
-
-	unsigned char *oldData = _imageSurface->get_data();
-	size_t rowStrideOfOld = _imageSurface->get_stride();
-
-	for(unsigned int y=0;y<newHeight;++y) {
-		guint8* rowpointerToNew = newData + rowStrideOfNew * y;
-		
-		for(unsigned int x=0;x<newWidth;++x) {
-			unsigned int r=0, g=0, b=0, a=0;
-			
-			const unsigned
-				xOldStart = x * oldWidth / newWidth,
-				xOldEnd = (x+1) * oldWidth / newWidth,
-				yOldStart = y * oldHeight / newHeight,
-				yOldEnd = (y+1) * oldHeight / newHeight;
-			
-			for(unsigned int yOld=yOldStart;yOld<yOldEnd;++yOld)
-			{
-				unsigned char *rowpointerToOld = oldData + rowStrideOfOld * yOld + xOldStart*4;
-				for(unsigned int xOld=xOldStart;xOld<xOldEnd;++xOld)
-				{
-					r += (*rowpointerToOld); ++rowpointerToOld;
-					g += (*rowpointerToOld); ++rowpointerToOld;
-					b += (*rowpointerToOld); ++rowpointerToOld;
-					a += (*rowpointerToOld); ++rowpointerToOld;
-				}
-			}
-			
-			const unsigned count = (xOldEnd - xOldStart) * (yOldEnd - yOldStart);
-			(*rowpointerToNew) = (unsigned char) (r/count);
-			++rowpointerToNew;
-			(*rowpointerToNew) = (unsigned char) (g/count);
-			++rowpointerToNew;
-			(*rowpointerToNew) = (unsigned char) (b/count);
-			++rowpointerToNew;
-			(*rowpointerToNew) = (unsigned char) (a/count);
-			++rowpointerToNew;
-		}
-	}
-
-	_imageSurface = newImageSurface;
-	_imageSurface->mark_dirty();
-}
-
 Mask2DCPtr ImageWidget::GetActiveMask() const
 {
 	if(!HasImage())
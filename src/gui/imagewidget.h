@@ -1,17 +1,24 @@
 #ifndef IMAGEWIDGET_H
 #define IMAGEWIDGET_H
 
+#include <glibmm/dispatcher.h>
+
 #include <gtkmm/drawingarea.h>
 
 #include <cairomm/surface.h>
 
+#include <memory>
 #include <vector>
 
+#include <boost/shared_ptr.hpp>
+
 #include "../structures/image2d.h"
 #include "../structures/timefrequencydata.h"
 #include "../structures/timefrequencymetadata.h"
 #include "../structures/segmentedimage.h"
 
+#include "imagerenderer.h"
+
 class ImageWidget : public Gtk::DrawingArea {
 	public:
 		enum TFMap { BWMap, InvertedMap, HotColdMap, RedBlueMap, RedYellowBlueMap, FireMap, BlackRedMap, ViridisMap };
@@ -204,10 +211,27 @@ class ImageWidget : public Gtk::DrawingArea {
 		}
 
 	private:
-		void findMinMax(Image2DCPtr image, Mask2DCPtr mask, num_t &min, num_t &max);
-		void update(Cairo::RefPtr<Cairo::Context> cairo, unsigned width, unsigned height);
+		/**
+		 * The value range that was determined for an image with its masks, so that it
+		 * does not have to be determined again when only the zoom or colour map changes.
+		 */
+		struct RangeCache
+		{
+			RangeCache() : isValid(false) { }
+
+			bool isValid;
+			Image2DCPtr image;
+			Mask2DCPtr originalMask, alternativeMask;
+			enum Range range;
+			num_t min, max;
+		};
+
+		void findMinMax(num_t &min, num_t &max);
+		void update(Cairo::RefPtr<Cairo::Context> cairo, unsigned width, unsigned height, bool isProgressive = false);
 		void redrawWithoutChanges(Cairo::RefPtr<Cairo::Context> cairo, unsigned width, unsigned height);
-		void downsampleImageBuffer(unsigned newWidth, unsigned newHeight);
+		Cairo::RefPtr<Cairo::ImageSurface> createSurface(const ImageRenderer &renderer);
+		void cancelRendering();
+		void onRenderFinished();
 		bool toUnits(double mouseX, double mouseY, int &posX, int &posY);
 		bool onDraw(const Cairo::RefPtr<Cairo::Context>& cr);
 		bool onMotion(GdkEventMotion *event);
@@ -225,6 +249,10 @@ class ImageWidget : public Gtk::DrawingArea {
 		bool _isInitialized;
 		unsigned _initializedWidth, _initializedHeight;
 		Cairo::RefPtr<Cairo::ImageSurface> _imageSurface;
+		boost::shared_ptr<const ImagePyramid> _pyramid;
+		RangeCache _rangeCache;
+		Glib::Dispatcher _renderFinishedSignal;
+		std::unique_ptr<ImageRenderer> _pendingRenderer;
 
 		bool _showOriginalMask, _showAlternativeMask;
 		enum TFMap _colorMap;
@@ -14,6 +14,8 @@
 #include "../../remote/clusteredobservation.h"
 #include "../../remote/processcommander.h"
 
+#include "../../util/stopwatch.h"
+
 #include "antennaeplotpage.h"
 #include "baselineplotpage.h"
 #include "blengthplotpage.h"
@@ -35,7 +37,14 @@ AOQPlotWindow::AOQPlotWindow() :
 	_summaryMI(_pageGroup, "Summary"),
 	_histogramMI(_pageGroup, "Histograms"),
 	
-	_isOpen(false)
+	_isOpen(false),
+	_printTiming(false),
+	_hasTimeStatistics(false),
+	_hasTimeRange(false),
+	_downsampleTime(false),
+	_startTime(0.0),
+	_endTime(0.0),
+	_timeSize(0)
 {
 	set_default_icon_name("aoqplot");
 	
@@ -92,6 +101,8 @@ void AOQPlotWindow::close()
 		delete _statCollection;
 		delete _histCollection;
 		delete _fullStats;
+		_timeIndex.reset();
+		_hasTimeStatistics = false;
 		_isOpen = false;
 	}
 }
@@ -146,7 +157,9 @@ void AOQPlotWindow::readAndCombine(const string& filename)
 	std::cout << "Adding " << filename << " to statistics...\n";
 	QualityTablesFormatter qualityTables(filename);
 	StatisticsCollection statCollection(_polarizationCount);
-	statCollection.Load(qualityTables);
+	// The time statistics are read through the time index when a page needs them
+	statCollection.LoadFrequencyStatisticsOnly(qualityTables);
+	statCollection.LoadBaselineStatisticsOnly(qualityTables);
 	_statCollection->Add(statCollection);
 	
 	HistogramTablesFormatter histogramTables(filename);
@@ -170,6 +183,7 @@ void AOQPlotWindow::readStatistics(const std::vector<std::string>& files, bool d
 			if(files.size() != 1)
 				throw std::runtime_error("You are trying to open multiple distributed or clustered sets. Can only open multiple files if they are not distributed.");
 			readDistributedObservation(firstFile, correctHistograms);
+			_hasTimeStatistics = true;
 		}
 		else {
 			readMetaInfoFromMS(firstFile);
@@ -182,9 +196,15 @@ void AOQPlotWindow::readStatistics(const std::vector<std::string>& files, bool d
 				std::cout << " (" << (i+1) << "/" << files.size() << ") ";
 				readAndCombine(files[i]);
 			}
+			
+			std::cout << "Indexing time statistics..." << std::endl;
+			_timeIndex.reset(new TimeStatisticsIndex(files));
+			_hasTimeStatistics = false;
 		}
 		setShowHistograms(!_histCollection->Empty());
-		if(downsampleTime)
+		_downsampleTime = downsampleTime;
+		_timeSize = timeSize;
+		if(downsampleTime && _hasTimeStatistics)
 		{
 			std::cout << "Lowering time resolution..." << std::endl;
 			_statCollection->LowerTimeResolution(timeSize);
@@ -199,20 +219,70 @@ void AOQPlotWindow::readStatistics(const std::vector<std::string>& files, bool d
 		std::cout << "Integrating baseline statistics to one channel..." << std::endl;
 		_statCollection->IntegrateBaselinesToOneChannel();
 		
-		std::cout << "Regridding time statistics..." << std::endl;
-		_statCollection->RegridTime();
+		if(_hasTimeStatistics)
+		{
+			std::cout << "Regridding time statistics..." << std::endl;
+			_statCollection->RegridTime();
+		}
 		
 		std::cout << "Copying statistics..." << std::endl;
 		_fullStats = new StatisticsCollection(*_statCollection);
 		
-		std::cout << "Integrating time statistics to one channel..." << std::endl;
-		_statCollection->IntegrateTimeToOneChannel();
+		if(_hasTimeStatistics)
+		{
+			std::cout << "Integrating time statistics to one channel..." << std::endl;
+			_statCollection->IntegrateTimeToOneChannel();
+		}
 		
 		std::cout << "Opening statistics panel..." << std::endl;
 		_isOpen = true;
 	}
 }
 
+void AOQPlotWindow::ensureTimeStatistics()
+{
+	if(_isOpen && !_hasTimeStatistics)
+	{
+		// When downsampling, a range with fewer time steps than the requested size is
+		// still read at full resolution.
+		const size_t maxSteps = _downsampleTime ? _timeSize : 0;
+		StatisticsCollection timeStats(_polarizationCount);
+		std::cout << "Reading time statistics..." << std::endl;
+		if(_hasTimeRange)
+			_timeIndex->Load(timeStats, _startTime, _endTime, maxSteps);
+		else
+			_timeIndex->Load(timeStats, maxSteps);
+		
+		std::cout << "Regridding time statistics..." << std::endl;
+		timeStats.RegridTime();
+		_fullStats->Add(timeStats);
+		
+		std::cout << "Integrating time statistics to one channel..." << std::endl;
+		timeStats.IntegrateTimeToOneChannel();
+		_statCollection->Add(timeStats);
+		_hasTimeStatistics = true;
+	}
+}
+
+void AOQPlotWindow::SetTimeRange(double startTime, double endTime)
+{
+	_hasTimeRange = true;
+	_startTime = startTime;
+	_endTime = endTime;
+	if(_isOpen && _timeIndex != 0 && _hasTimeStatistics)
+	{
+		_statCollection->ClearTimeStatistics();
+		_fullStats->ClearTimeStatistics();
+		_hasTimeStatistics = false;
+		// Recreate the active sheet if it shows the time statistics
+		if(_activeSheetIndex == 3 || _activeSheetIndex == 5)
+		{
+			_activeSheetIndex = -1;
+			onChangeSheet();
+		}
+	}
+}
+
 void AOQPlotWindow::onStatusChange(const std::string &newStatus)
 {
 	_statusBar.pop();
@@ -223,36 +293,55 @@ void AOQPlotWindow::Save(const AOQPlotWindow::PlotSavingData& data)
 {
 	const std::string& prefix = data.filenamePrefix;
 	QualityTablesFormatter::StatisticKind kind = data.statisticKind;
+	Stopwatch watch(true);
 	
 	std::cout << "Saving " << prefix << "-antennas.pdf...\n";
 	AntennaePlotPage antPage;
 	antPage.SetStatistics(_statCollection, _antennas);
 	antPage.SavePdf(prefix+"-antennas.pdf", kind);
+	printTiming(watch);
 	
 	std::cout << "Saving " << prefix << "-baselines.pdf...\n";
 	BaselinePlotPage baselPage;
 	baselPage.SetStatistics(_statCollection, _antennas);
 	baselPage.SavePdf(prefix+"-baselines.pdf", kind);
+	printTiming(watch);
 	
 	std::cout << "Saving " << prefix << "-baselinelengths.pdf...\n";
 	BLengthPlotPage blenPage;
 	blenPage.SetStatistics(_statCollection, _antennas);
 	blenPage.SavePdf(prefix+"-baselinelengths.pdf", kind);
+	printTiming(watch);
+	
+	// The time statistics are read here, so that their reading is included in the
+	// time of the first plot that needs them.
+	ensureTimeStatistics();
 	
 	std::cout << "Saving " << prefix << "-timefrequency.pdf...\n";
 	TimeFrequencyPlotPage tfPage;
 	tfPage.SetStatistics(_fullStats, _antennas);
 	tfPage.SavePdf(prefix+"-timefrequency.pdf", kind);
+	printTiming(watch);
 	
 	std::cout << "Saving " << prefix << "-time.pdf...\n";
 	TimePlotPage timePage;
 	timePage.SetStatistics(_statCollection, _antennas);
 	timePage.SavePdf(prefix+"-time.pdf", kind);
+	printTiming(watch);
 	
 	std::cout << "Saving " << prefix << "-frequency.pdf...\n";
 	FrequencyPlotPage freqPage;
 	freqPage.SetStatistics(_statCollection, _antennas);
 	freqPage.SavePdf(prefix+"-frequency.pdf", kind);
+	printTiming(watch);
+}
+
+void AOQPlotWindow::printTiming(Stopwatch &watch)
+{
+	if(_printTiming)
+		std::cout << "Time: " << watch.ToString() << '\n';
+	watch.Reset();
+	watch.Start();
 }
 
 void AOQPlotWindow::onChangeSheet()
@@ -301,6 +390,8 @@ void AOQPlotWindow::onChangeSheet()
 		}
 		
 		_activeSheetIndex = selectedSheet;
+		if(selectedSheet == 3 || selectedSheet == 5)
+			ensureTimeStatistics();
 		if(selectedSheet == 5)
 			_activeSheet->SetStatistics(_fullStats, _antennas);
 		else
@@ -15,6 +15,7 @@
 #include "../imagewidget.h"
 
 #include "../../quality/qualitytablesformatter.h"
+#include "../../quality/timestatisticsindex.h"
 
 #include "plotsheet.h"
 #include "openoptionswindow.h"
@@ -50,6 +51,18 @@ class AOQPlotWindow : public Gtk::Window {
 			std::string filenamePrefix;
 		};
 		void Save(const PlotSavingData& data);
+		
+		/**
+		 * Restricts the time and time-frequency plots to the given range. The time
+		 * statistics of the range are reread, so that a short range is shown at full
+		 * resolution. Only has effect for measurement sets that are opened locally.
+		 */
+		void SetTimeRange(double startTime, double endTime);
+		
+		/**
+		 * When set, Save() reports how long each plot took to render.
+		 */
+		void SetPrintTiming(bool printTiming) { _printTiming = printTiming; }
 	private:
 		void onOpenOptionsSelected(const std::vector<std::string>& files, bool downsampleTime, bool downsampleFreq, size_t timeSize, size_t freqSize, bool correctHistograms);
 		void close();
@@ -57,6 +70,8 @@ class AOQPlotWindow : public Gtk::Window {
 		void readDistributedObservation(const std::string& filename, bool correctHistograms);
 		void readMetaInfoFromMS(const std::string& filename);
 		void readAndCombine(const std::string& filename);
+		void ensureTimeStatistics();
+		void printTiming(class Stopwatch &watch);
 		
 		void onHide()
 		{
@@ -85,10 +100,19 @@ class AOQPlotWindow : public Gtk::Window {
 		
 		OpenOptionsWindow _openOptionsWindow;
 
-		bool _isOpen;
+		bool _isOpen, _printTiming;
 		class StatisticsCollection *_statCollection;
 		class HistogramCollection *_histCollection;
 		class StatisticsCollection *_fullStats;
+		/**
+		 * Index of the time statistics of local measurement sets. These are only read
+		 * once a page that shows them is opened. Null when the statistics were read
+		 * completely, as for distributed observations.
+		 */
+		std::unique_ptr<TimeStatisticsIndex> _timeIndex;
+		bool _hasTimeStatistics, _hasTimeRange, _downsampleTime;
+		double _startTime, _endTime;
+		size_t _timeSize;
 		std::vector<class AntennaInfo> _antennas;
 		size_t _polarizationCount;
 };
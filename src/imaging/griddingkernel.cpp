@@ -0,0 +1,61 @@
+#include "griddingkernel.h"
+
+#include "../baseexception.h"
+
+GriddingKernel::GriddingKernel(size_t support, size_t oversampling) :
+	_support(support),
+	_oversampling(oversampling)
+{
+	if(support > MaxSupport)
+		throw BadUsageException("Support of gridding kernel is larger than the maximum");
+	// Shape parameter of Beatty et al. (2005) for a grid oversampling factor of two
+	const double
+		width = support,
+		alpha = 2.0;
+	_beta = M_PI * sqrt((width/alpha)*(width/alpha)*(alpha-0.5)*(alpha-0.5) - 0.8);
+
+	// The integral of I0(beta sqrt(1 - (2d/W)^2)) over |d| <= W/2 is W sinh(beta) / beta
+	const double normFactor = _beta / (width * sinh(_beta));
+	const size_t halfSize = support * oversampling / 2;
+	_table.resize(halfSize);
+	for(size_t i=0; i!=halfSize; ++i)
+	{
+		const double r = 2.0 * i / (width * oversampling);
+		_table[i] = besselI0(_beta * sqrt(1.0 - r*r)) * normFactor;
+	}
+}
+
+num_t GriddingKernel::Correction(num_t x) const
+{
+	// Continuous Fourier transform of the kernel
+	const double
+		a = M_PI * _support * x,
+		z2 = _beta*_beta - a*a,
+		centre = sinh(_beta) / _beta;
+	if(z2 > 0.0)
+	{
+		const double z = sqrt(z2);
+		return sinh(z) / (z * centre);
+	}
+	else if(z2 < 0.0)
+	{
+		const double z = sqrt(-z2);
+		return sin(z) / (z * centre);
+	}
+	else
+		return 1.0 / centre;
+}
+
+double GriddingKernel::besselI0(double x)
+{
+	// Power series, which converges quickly for the arguments used here
+	const double halfX = x * 0.5;
+	double term = 1.0, sum = 1.0;
+	for(size_t k=1; term > sum * 1e-16; ++k)
+	{
+		const double factor = halfX / k;
+		term *= factor * factor;
+		sum += term;
+	}
+	return sum;
+}
@@ -0,0 +1,64 @@
+#ifndef GRIDDING_KERNEL_H
+#define GRIDDING_KERNEL_H
+
+#include <cmath>
+#include <vector>
+
+#include "../structures/types.h"
+
+/**
+ * Kaiser-Bessel kernel for convolutional gridding of visibilities.
+ *
+ * The kernel is tabulated with a number of samples per uv cell, so that gridding
+ * a visibility only takes table lookups. The table is normalized such that the
+ * kernel integrates to one, and Correction() returns the Fourier transform of the
+ * kernel, which is the taper that the kernel applies to the image, and by which the
+ * image should be divided after the FFT.
+ */
+class GriddingKernel
+{
+	public:
+		/**
+		 * Largest supported full width, so that gridders can keep the kernel
+		 * values of one visibility in a fixed-size array.
+		 */
+		static const size_t MaxSupport = 16;
+
+		/**
+		 * @param support Full width of the kernel in uv cells, at most MaxSupport.
+		 * @param oversampling Number of table entries per uv cell. The table is read
+		 * without interpolation, so this determines the accuracy of the gridding.
+		 * @throws BadUsageException when the support is larger than MaxSupport.
+		 */
+		explicit GriddingKernel(size_t support = 6, size_t oversampling = 256);
+
+		/**
+		 * Full width of the kernel in uv cells.
+		 */
+		size_t Support() const { return _support; }
+
+		/**
+		 * Value of the kernel at the given distance in uv cells from its centre. It is
+		 * zero for distances of half the support or more.
+		 */
+		num_t Value(num_t distance) const
+		{
+			const size_t index = (size_t) (std::fabs(distance) * _oversampling + 0.5);
+			return index < _table.size() ? _table[index] : 0.0;
+		}
+
+		/**
+		 * Taper of the kernel in the image, normalized to one at the centre.
+		 * @param x Image coordinate as fraction of the field, between -0.5 and 0.5.
+		 */
+		num_t Correction(num_t x) const;
+
+	private:
+		static double besselI0(double x);
+
+		size_t _support, _oversampling;
+		double _beta;
+		std::vector<num_t> _table;
+};
+
+#endif
@@ -8,8 +8,11 @@
 #include "../util/integerdomain.h"
 #include "../util/stopwatch.h"
 #include "../util/ffttools.h"
+#include "../util/parallelfor.h"
 
-UVImager::UVImager(unsigned long xRes, unsigned long yRes, ImageKind imageKind) : _xRes(xRes), _yRes(yRes), _xResFT(xRes), _yResFT(yRes), _uvReal(0), _uvImaginary(0), _uvWeights(0), _uvFTReal(0), _uvFTImaginary(0), _antennas(0), _fields(0), _imageKind(imageKind), _invertFlagging(false), _directFT(false), _ignoreBoundWarnings(false)
+#include <boost/bind.hpp>
+
+UVImager::UVImager(unsigned long xRes, unsigned long yRes, ImageKind imageKind) : _xRes(xRes), _yRes(yRes), _xResFT(xRes), _yResFT(yRes), _uvReal(0), _uvImaginary(0), _uvWeights(0), _uvFTReal(0), _uvFTImaginary(0), _antennas(0), _fields(0), _imageKind(imageKind), _invertFlagging(false), _directFT(false), _gridding(KaiserBesselGridding), _ignoreBoundWarnings(false)
 {
 	_uvScaling = 0.0001L; // testing
 	Empty();
@@ -163,10 +166,35 @@ void UVImager::Image(const IntegerDomain &frequencies, const IntegerDomain &ante
 	std::cout << "Imaging..." << std::flush;
 	stopwatch.Reset();
 	stopwatch.Start();
-	for(unsigned f = 0;f<frequencies.ValueCount();++f) {
-		for(unsigned a1 = 0;a1<antenna1Domain.ValueCount();++a1) {
-			for(unsigned a2 = 0;a2<antenna2Domain.ValueCount();++a2) {
-				Image(frequencies.GetValue(f), _antennas[antenna1Domain.GetValue(a1)], _antennas[antenna2Domain.GetValue(a2)], data[f][a1][a2]);
+	// Every thread grids its baselines on its own grid; the first thread uses the
+	// grid of the imager. The direct FT writes to shared images, so it is not threaded.
+	const size_t baselineCount = frequencies.ValueCount() * antenna1Domain.ValueCount() * antenna2Domain.ValueCount();
+	const size_t threadCount = _directFT ? 1 : ParallelFor::ThreadCount(baselineCount);
+	std::vector<Image2DPtr> threadImages;
+	std::vector<UVGrid> grids(threadCount);
+	grids[0].real = _uvReal;
+	grids[0].imaginary = _uvImaginary;
+	grids[0].weights = _uvWeights;
+	for(size_t t=1; t!=threadCount; ++t)
+	{
+		for(size_t i=0; i!=3; ++i)
+			threadImages.push_back(Image2D::CreateZeroImagePtr(_xRes, _yRes));
+		grids[t].real = threadImages[t*3 - 3].get();
+		grids[t].imaginary = threadImages[t*3 - 2].get();
+		grids[t].weights = threadImages[t*3 - 1].get();
+	}
+	std::atomic<size_t> nextBaseline(0);
+	// Every part of the grids is a single grid, because there are as many grids as threads
+	ParallelFor::Run(threadCount, boost::bind(&UVImager::imageBaselines, this, &grids, _1, _2, boost::cref(frequencies), boost::cref(antenna1Domain), boost::cref(antenna2Domain), data, &nextBaseline));
+	for(size_t t=1; t!=threadCount; ++t)
+	{
+		for(size_t y=0; y!=_yRes; ++y)
+		{
+			for(size_t x=0; x!=_xRes; ++x)
+			{
+				_uvReal->AddValue(x, y, grids[t].real->Value(x, y));
+				_uvImaginary->AddValue(x, y, grids[t].imaginary->Value(x, y));
+				_uvWeights->AddValue(x, y, grids[t].weights->Value(x, y));
 			}
 		}
 	}
@@ -186,7 +214,25 @@ void UVImager::Image(const IntegerDomain &frequencies, const IntegerDomain &ante
 	delete[] data;
 }
 
-void UVImager::Image(unsigned frequencyIndex, AntennaInfo &antenna1, AntennaInfo &antenna2, SingleFrequencySingleBaselineData *data)
+void UVImager::imageBaselines(std::vector<UVGrid> *grids, size_t gridIndex, size_t /*gridEnd*/, const IntegerDomain &frequencies, const IntegerDomain &antenna1Domain, const IntegerDomain &antenna2Domain, SingleFrequencySingleBaselineData ****data, std::atomic<size_t> *nextBaseline)
+{
+	UVGrid &grid = (*grids)[gridIndex];
+	const size_t
+		a1Count = antenna1Domain.ValueCount(),
+		a2Count = antenna2Domain.ValueCount(),
+		baselineCount = frequencies.ValueCount() * a1Count * a2Count;
+	size_t index;
+	while((index = nextBaseline->fetch_add(1)) < baselineCount)
+	{
+		const unsigned
+			a2 = index % a2Count,
+			a1 = (index / a2Count) % a1Count,
+			f = index / (a1Count * a2Count);
+		Image(frequencies.GetValue(f), _antennas[antenna1Domain.GetValue(a1)], _antennas[antenna2Domain.GetValue(a2)], data[f][a1][a2], grid);
+	}
+}
+
+void UVImager::Image(unsigned frequencyIndex, AntennaInfo &antenna1, AntennaInfo &antenna2, SingleFrequencySingleBaselineData *data, UVGrid &grid)
 {
 	num_t frequency = _band.channels[frequencyIndex].frequencyHz;
 	num_t speedOfLight = 299792458.0L;
@@ -214,8 +260,8 @@ void UVImager::Image(unsigned frequencyIndex, AntennaInfo &antenna1, AntennaInfo
 				if(!data[i].flag) {
 					num_t u,v;
 					GetUVPosition(u, v, data[i], cache);
-					SetUVValue(u, v, data[i].data.real(), data[i].data.imag(), 1.0);
-					SetUVValue(-u, -v, data[i].data.real(), -data[i].data.imag(), 1.0);
+					addValue(grid, u, v, data[i].data.real(), data[i].data.imag(), 1.0);
+					addValue(grid, -u, -v, data[i].data.real(), -data[i].data.imag(), 1.0);
 					//calcTimer.Pause();
 				} 
 				break;
@@ -224,8 +270,8 @@ void UVImager::Image(unsigned frequencyIndex, AntennaInfo &antenna1, AntennaInfo
 						(!data[i].flag && _invertFlagging)) {
 					num_t u,v;
 					GetUVPosition(u, v, data[i], cache);
-					SetUVValue(u, v, 1, 0, 1.0);
-					SetUVValue(-u, -v, 1, 0, 1.0);
+					addValue(grid, u, v, 1, 0, 1.0);
+					addValue(grid, -u, -v, 1, 0, 1.0);
 				}
 				break;
 			}
@@ -323,19 +369,69 @@ void UVImager::ApplyWeightsToUV()
 
 void UVImager::SetUVValue(num_t u, num_t v, num_t r, num_t i, num_t weight)
 {
-	 // Nearest neighbour interpolation
-	long uPos = (long) floorn(u*_uvScaling*_xRes+0.5) + (_xRes/2);
-	long vPos = (long) floorn(v*_uvScaling*_yRes+0.5) + (_yRes/2);
+	UVGrid grid;
+	grid.real = _uvReal;
+	grid.imaginary = _uvImaginary;
+	grid.weights = _uvWeights;
+	addValue(grid, u, v, r, i, weight);
+}
+
+void UVImager::addValue(UVGrid &grid, num_t u, num_t v, num_t r, num_t i, num_t weight)
+{
+	gridValue(grid, u, v, r, i, weight);
+	if(_directFT)
+		SetUVFTValue(u, v, r, i, weight);
+}
+
+void UVImager::gridValue(UVGrid &grid, num_t u, num_t v, num_t r, num_t i, num_t weight)
+{
+	// Position on the grid, in cells
+	const num_t
+		uGrid = u*_uvScaling*_xRes + (_xRes/2),
+		vGrid = v*_uvScaling*_yRes + (_yRes/2);
+	long uPos = (long) floorn(uGrid+0.5);
+	long vPos = (long) floorn(vGrid+0.5);
 	if(uPos>=0 && uPos<(long) _xRes && vPos>=0 && vPos<(long) _yRes) {
-		_uvReal->AddValue(uPos, vPos, r);
-		_uvImaginary->AddValue(uPos, vPos, i);
-		_uvWeights->AddValue(uPos, vPos, weight);
+		if(_gridding == NearestNeighbourGridding)
+		{
+			grid.real->AddValue(uPos, vPos, r);
+			grid.imaginary->AddValue(uPos, vPos, i);
+			grid.weights->AddValue(uPos, vPos, weight);
+		}
+		else {
+			// Cells of the kernel that fall outside the grid are left out
+			const long
+				half = _kernel.Support() / 2,
+				xStart = std::max(uPos - half, 0L),
+				xEnd = std::min(uPos + half + 1, (long) _xRes),
+				yStart = std::max(vPos - half, 0L),
+				yEnd = std::min(vPos + half + 1, (long) _yRes);
+			// A row covers at most support + 1 cells
+			num_t uKernel[GriddingKernel::MaxSupport + 1];
+			for(long x=xStart; x!=xEnd; ++x)
+				uKernel[x - xStart] = _kernel.Value(x - uGrid);
+			for(long y=yStart; y!=yEnd; ++y)
+			{
+				const num_t vWeight = _kernel.Value(y - vGrid) * weight;
+				if(vWeight == 0.0) continue;
+				num_t
+					*realPtr = grid.real->ValuePtr(xStart, y),
+					*imaginaryPtr = grid.imaginary->ValuePtr(xStart, y),
+					*weightPtr = grid.weights->ValuePtr(xStart, y);
+				for(long x=xStart; x!=xEnd; ++x)
+				{
+					const num_t w = uKernel[x - xStart] * vWeight;
+					*realPtr += r * w; ++realPtr;
+					*imaginaryPtr += i * w; ++imaginaryPtr;
+					*weightPtr += w; ++weightPtr;
+				}
+			}
+		}
 	} else {
-		if(!_ignoreBoundWarnings)
+		if(!_ignoreBoundWarnings.exchange(true))
 		{
 			std::cout << "Warning! Baseline outside uv window (" << uPos << "," << vPos << ")." << 
 			"(subsequent out of bounds warnings will not be noted)" << std::endl;
-			_ignoreBoundWarnings = true;
 		}
 	}
 	// Linear interpolation
@@ -357,17 +453,25 @@ void UVImager::SetUVValue(num_t u, num_t v, num_t r, num_t i, num_t weight)
 
 void UVImager::SetUVFTValue(num_t u, num_t v, num_t r, num_t i, num_t weight)
 {
+	if(_uvFTReal == 0)
+	{
+		_uvFTReal = Image2D::CreateZeroImage(_xRes, _yRes);
+		_uvFTImaginary = Image2D::CreateZeroImage(_xRes, _yRes);
+	}
+	// Uses the sign and normalization of FFTTools::CreateFFTImage(), so that the
+	// result can be compared with PerformFFT() on the gridded values.
+	const num_t normFactor = weight / sqrtn((num_t) _xResFT * _yResFT);
 	for(size_t iy=0;iy<_yResFT;++iy)
 	{
+		num_t y = ((num_t) iy - (_yResFT/2)) * _uvScaling;
 		for(size_t ix=0;ix<_xResFT;++ix)
 		{
-			num_t x = ((num_t) ix - (_xResFT/2)) / _uvScaling * _uvFTReal->Width();
-			num_t y = ((num_t) iy - (_yResFT/2)) / _uvScaling * _uvFTReal->Height();
+			num_t x = ((num_t) ix - (_xResFT/2)) * _uvScaling;
 			// Calculate F(x,y) += f(u, v) e ^ {i 2 pi (x u + y v) } 
-			num_t fftRotation = (u * x + v * y) * -2.0L * M_PIn;
+			num_t fftRotation = (u * x + v * y) * 2.0L * M_PIn;
 			num_t fftCos = cosn(fftRotation), fftSin = sinn(fftRotation);
-			_uvFTReal->AddValue(ix, iy, (fftCos * r - fftSin * i) * weight);
-			_uvFTImaginary->AddValue(ix, iy, (fftSin * r + fftCos * i) * weight);
+			_uvFTReal->AddValue(ix, iy, (fftCos * r - fftSin * i) * normFactor);
+			_uvFTImaginary->AddValue(ix, iy, (fftSin * r + fftCos * i) * normFactor);
 		}
 	}
 
@@ -380,7 +484,32 @@ void UVImager::PerformFFT()
 		_uvFTReal = Image2D::CreateZeroImage(_xRes, _yRes);
 		_uvFTImaginary = Image2D::CreateZeroImage(_xRes, _yRes);
 	}
+	else if(_directFT)
+		return;
 	FFTTools::CreateFFTImage(*_uvReal, *_uvImaginary, *_uvFTReal, *_uvFTImaginary);
+	if(_gridding == KaiserBesselGridding)
+		applyGridCorrection();
+}
+
+void UVImager::applyGridCorrection()
+{
+	std::vector<num_t> xCorrection(_xRes), yCorrection(_yRes);
+	for(size_t x=0;x<_xRes;++x)
+		xCorrection[x] = 1.0 / _kernel.Correction(((num_t) x - (_xRes/2)) / _xRes);
+	for(size_t y=0;y<_yRes;++y)
+		yCorrection[y] = 1.0 / _kernel.Correction(((num_t) y - (_yRes/2)) / _yRes);
+	for(size_t y=0;y<_yRes;++y)
+	{
+		num_t
+			*realPtr = _uvFTReal->ValuePtr(0, y),
+			*imaginaryPtr = _uvFTImaginary->ValuePtr(0, y);
+		for(size_t x=0;x<_xRes;++x)
+		{
+			const num_t correction = xCorrection[x] * yCorrection[y];
+			realPtr[x] *= correction;
+			imaginaryPtr[x] *= correction;
+		}
+	}
 }
 
 void UVImager::GetUVPosition(num_t &u, num_t &v, size_t timeIndex, size_t frequencyIndex, TimeFrequencyMetaDataCPtr metaData)
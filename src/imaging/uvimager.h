@@ -1,12 +1,17 @@
 #ifndef UVIMAGER_H
 #define UVIMAGER_H
 
+#include <atomic>
+#include <vector>
+
 #include "../structures/timefrequencymetadata.h"
 #include "../structures/measurementset.h"
 #include "../structures/date.h"
 
 #include "../structures/timefrequencydata.h"
 
+#include "griddingkernel.h"
+
 struct SingleFrequencySingleBaselineData {
 	casacore::Complex data;
 	bool flag;
@@ -18,6 +23,12 @@ struct SingleFrequencySingleBaselineData {
 class UVImager {
 	public:
 		enum ImageKind { Homogeneous, Flagging };
+		/**
+		 * How visibilities are placed on the uv grid. With Kaiser-Bessel gridding,
+		 * each visibility is spread over the neighbouring cells with a GriddingKernel,
+		 * and PerformFFT() divides the image by the taper of the kernel.
+		 */
+		enum GriddingKind { NearestNeighbourGridding, KaiserBesselGridding };
 		UVImager(unsigned long xRes, unsigned long yRes, ImageKind imageKind=Homogeneous);
 		~UVImager();
 		void Image(class MeasurementSet &measurementSet, unsigned band);
@@ -34,7 +45,14 @@ class UVImager {
 		const class Image2D &RealUVImage() const { return *_uvReal; }
 		const class Image2D &ImaginaryUVImage() const { return *_uvImaginary; }
 		void SetInvertFlagging(bool newValue) { _invertFlagging = newValue; }
+		/**
+		 * In direct FT mode, every visibility is also Fourier transformed directly onto
+		 * the FT images, and PerformFFT() leaves those images as they are. This is
+		 * slow, but can be used to validate the gridding.
+		 */
 		void SetDirectFT(bool directFT) { _directFT = directFT; }
+		void SetGridding(GriddingKind gridding) { _gridding = gridding; }
+		GriddingKind Gridding() const { return _gridding; }
 
 		/**
 		 * This function calculates the uv position, but it's not optimized for speed, so it's not to be used in an imager.
@@ -144,11 +162,18 @@ class UVImager {
 		};
 		void Image(const class IntegerDomain &frequencies);
 		void Image(const IntegerDomain &frequencies, const IntegerDomain &antenna1Domain, const IntegerDomain &antenna2Domain);
-		void Image(unsigned frequencyIndex, class AntennaInfo &antenna1, class AntennaInfo &antenna2, SingleFrequencySingleBaselineData *data);
+		struct UVGrid {
+			class Image2D *real, *imaginary, *weights;
+		};
+		void Image(unsigned frequencyIndex, class AntennaInfo &antenna1, class AntennaInfo &antenna2, SingleFrequencySingleBaselineData *data, UVGrid &grid);
+		void imageBaselines(std::vector<UVGrid> *grids, size_t gridIndex, size_t gridEnd, const IntegerDomain &frequencies, const IntegerDomain &antenna1Domain, const IntegerDomain &antenna2Domain, SingleFrequencySingleBaselineData ****data, std::atomic<size_t> *nextBaseline);
 
 		// This is the fast variant.
 		void GetUVPosition(num_t &u, num_t &v, const SingleFrequencySingleBaselineData &data, const AntennaCache &cache);
+		void addValue(UVGrid &grid, num_t u, num_t v, num_t r, num_t i, num_t weight);
+		void gridValue(UVGrid &grid, num_t u, num_t v, num_t r, num_t i, num_t weight);
 		void SetUVFTValue(num_t u, num_t v, num_t r, num_t i, num_t weight);
+		void applyGridCorrection();
 
 
 		unsigned long _xRes, _yRes;
@@ -165,7 +190,9 @@ class UVImager {
 		size_t _scanCount;
 		ImageKind _imageKind;
 		bool _invertFlagging, _directFT;
-		bool _ignoreBoundWarnings;
+		GriddingKind _gridding;
+		GriddingKernel _kernel;
+		std::atomic<bool> _ignoreBoundWarnings;
 };
 
 #endif
@@ -4,27 +4,39 @@
 
 #include "../structures/image2d.h"
 #include "../structures/mask2d.h"
+#include "../structures/system.h"
 
 #include "../strategy/actions/strategy.h"
 
 #include "../strategy/algorithms/baselineselector.h"
 #include "../strategy/algorithms/polarizationstatistics.h"
 
+#include "../strategy/control/actionprofiler.h"
 #include "../strategy/control/artifactset.h"
 #include "../strategy/control/defaultstrategy.h"
+#include "../strategy/control/executionplan.h"
 #include "../strategy/control/strategyreader.h"
 
+#include "../util/lane.h"
+#include "../util/parallelfor.h"
 #include "../util/progresslistener.h"
 
 #include "../quality/histogramcollection.h"
 #include "../quality/statisticscollection.h"
 
+#include <algorithm>
+#include <fstream>
+#include <stdint.h>
 #include <vector>
 #include <typeinfo>
 
 #include <boost/shared_ptr.hpp>
 
+#include <boost/bind.hpp>
+
+#include <boost/thread/condition.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 namespace aoflagger {
 	
@@ -97,6 +109,14 @@ namespace aoflagger {
 			_data->images[i] = Image2D::CreateSetImagePtr(width, height, initialValue, widthCapacity);
 	}
 	
+	ImageSet::ImageSet(size_t width, size_t height, size_t count, float* const* buffers, size_t horizontalStride) :
+		_data(new ImageSetData(count))
+	{
+		assertValidCount(count);
+		for(size_t i=0; i!=count; ++i)
+			_data->images[i] = Image2D::CreateWrappedImagePtr(buffers[i], width, height, horizontalStride);
+	}
+	
 	ImageSet::ImageSet(const ImageSet& sourceImageSet) :
 		_data(new ImageSetData(*sourceImageSet._data))
 	{
@@ -203,6 +223,11 @@ namespace aoflagger {
 			_data->mask->SetAll<false>();
 	}
 	
+	FlagMask::FlagMask(size_t width, size_t height, bool* buffer, size_t horizontalStride) : _data(new FlagMaskData(
+		Mask2D::CreateWrappedMaskPtr(buffer, width, height, horizontalStride)	))
+	{
+	}
+	
 	FlagMask::FlagMask(const FlagMask& sourceMask) :
 		_data(new FlagMaskData(*sourceMask._data))
 	{
@@ -213,6 +238,15 @@ namespace aoflagger {
 		// _data might be 0, but it's fine to delete 0; (by standard)
 		delete _data;
 	}
+	
+	FlagMask &FlagMask::operator=(const FlagMask& sourceMask)
+	{
+		if(_data == 0)
+			_data = new FlagMaskData(*sourceMask._data);
+		else
+			*_data = *sourceMask._data;
+		return *this;
+	}
 			
 	size_t FlagMask::Width() const
 	{
@@ -242,23 +276,34 @@ namespace aoflagger {
 	
 	class StrategyData {
 		public:
-			explicit StrategyData(rfiStrategy::Strategy *strategy)
-			: strategyPtr(strategy)
-			{
-			}
+			explicit StrategyData(rfiStrategy::Strategy *strategy);
 			
 			StrategyData(const StrategyData& source)
-			: strategyPtr(source.strategyPtr)
+			: strategyPtr(source.strategyPtr), planPtr(source.planPtr), scratchPool(source.scratchPool)
 			{
 			}
 			
 			StrategyData& operator=(const StrategyData& source)
 			{
+				// The old plan refers to the old strategy, so it is released first
+				scratchPool = source.scratchPool;
+				planPtr = source.planPtr;
 				strategyPtr = source.strategyPtr;
 				return *this;
 			}
 			
 			boost::shared_ptr<rfiStrategy::Strategy> strategyPtr;
+			/**
+			 * The compiled strategy. The strategy can not be changed through the
+			 * interface, so it is compiled once and shared by all copies. It is
+			 * declared after the strategy, so that it is destructed first.
+			 */
+			boost::shared_ptr<rfiStrategy::ExecutionPlan> planPtr;
+			/**
+			 * The scratch objects of the Run() calls with this strategy, which are kept
+			 * between calls.
+			 */
+			boost::shared_ptr<class RunScratchPool> scratchPool;
 	};
 	
 	Strategy::Strategy(enum TelescopeId telescopeId, unsigned strategyFlags, double frequency, double timeRes, double frequencyRes) :
@@ -297,14 +342,19 @@ namespace aoflagger {
 	class QualityStatisticsDataImp
 	{
 		public:
-			QualityStatisticsDataImp(const double* _scanTimes, size_t nScans, size_t nPolarizations, bool _computeHistograms) :
+			QualityStatisticsDataImp(const double* _scanTimes, size_t nScans, const double* _channelFrequencies, size_t nChannels, size_t nPolarizations, bool _computeHistograms) :
 				scanTimes(_scanTimes, _scanTimes+nScans),
+				channelFrequencies(_channelFrequencies, _channelFrequencies+nChannels),
+				polarizationCount(nPolarizations),
 				statistics(nPolarizations),
 				histograms(nPolarizations),
 				computeHistograms(_computeHistograms)
 			{
+				statistics.InitializeBand(0, _channelFrequencies, nChannels);
 			}
 			std::vector<double> scanTimes;
+			std::vector<double> channelFrequencies;
+			size_t polarizationCount;
 			StatisticsCollection statistics;
 			HistogramCollection histograms;
 			bool computeHistograms;
@@ -313,8 +363,8 @@ namespace aoflagger {
 	class QualityStatisticsData
 	{
 		public:
-			QualityStatisticsData(const double* _scanTimes, size_t nScans, size_t nPolarizations, bool computeHistograms) :
-				_implementation(new QualityStatisticsDataImp(_scanTimes, nScans, nPolarizations, computeHistograms))
+			QualityStatisticsData(const double* _scanTimes, size_t nScans, const double* channelFrequencies, size_t nChannels, size_t nPolarizations, bool computeHistograms) :
+				_implementation(new QualityStatisticsDataImp(_scanTimes, nScans, channelFrequencies, nChannels, nPolarizations, computeHistograms))
 			{
 			}
 			explicit QualityStatisticsData(boost::shared_ptr<QualityStatisticsDataImp> implementation) :
@@ -325,9 +375,8 @@ namespace aoflagger {
 	};
 
 	QualityStatistics::QualityStatistics(const double* scanTimes, size_t nScans, const double* channelFrequencies, size_t nChannels, size_t nPolarizations, bool computeHistograms) :
-		_data(new QualityStatisticsData(scanTimes, nScans, nPolarizations, computeHistograms))
+		_data(new QualityStatisticsData(scanTimes, nScans, channelFrequencies, nChannels, nPolarizations, computeHistograms))
 	{
-		_data->_implementation->statistics.InitializeBand(0, channelFrequencies, nChannels);
 	}
 	
 	QualityStatistics::QualityStatistics(const QualityStatistics& sourceQS) :
@@ -353,6 +402,238 @@ namespace aoflagger {
 		return *this;
 	}
 	
+	/**
+	 * The timesteps that a flagging session keeps, in one buffer per image. Channel y
+	 * of the window starts at sample offset + y x stride of a buffer, where the stride
+	 * is the default stride of a full window. Removing the first n timesteps increases
+	 * the offset by n. The other samples stay where they are, because channel y now
+	 * simply starts n samples later. New timesteps of a channel are written behind its
+	 * last timestep, over samples that were already removed. The window thus moves
+	 * through the buffers, which hold two windows, and is moved back to the start once
+	 * it reaches the end.
+	 * 
+	 * A window of full width has the default stride, so the flagger can run on it
+	 * without copying it, as long as the offset is a multiple of four samples. Moving
+	 * the window back keeps the offset modulo four.
+	 */
+	class SessionHistory
+	{
+		public:
+			/**
+			 * @param initialOffset Offset of the first timestep, which should be less than four.
+			 */
+			SessionHistory(size_t height, size_t count, size_t capacity, size_t initialOffset) :
+				_height(height),
+				_stride((((capacity-1)/4)+1)*4),
+				_width(0),
+				_offset(initialOffset)
+			{
+				for(size_t i=0; i!=count; ++i)
+					_buffers.push_back(Image2D::CreateZeroImagePtr(_stride, 2*height));
+			}
+			
+			size_t Count() const { return _buffers.size(); }
+			size_t Width() const { return _width; }
+			size_t Stride() const { return _stride; }
+			num_t* Data(size_t imageIndex) const { return _buffers[imageIndex]->Data() + _offset; }
+			
+			/**
+			 * Appends timesteps [x, x + n) of the images.
+			 */
+			void Append(const std::vector<Image2DPtr>& images, size_t x, size_t n)
+			{
+				if(_width + n > _stride)
+					throw std::runtime_error("Bug: the history of a flagging session exceeds its capacity");
+				for(size_t i=0; i!=_buffers.size(); ++i)
+				{
+					num_t* destination = Data(i) + _width;
+					for(size_t y=0; y!=_height; ++y)
+						std::copy(images[i]->ValuePtr(x, y), images[i]->ValuePtr(x, y) + n, destination + y * _stride);
+				}
+				_width += n;
+			}
+			
+			/**
+			 * Removes the first n timesteps.
+			 */
+			void RemoveFront(size_t n)
+			{
+				_offset += n;
+				_width -= n;
+				// The window uses _height x _stride samples from the offset onwards
+				if(_offset > _height * _stride)
+				{
+					// Only the first channel of the window can overlap the destination, and it
+					// is copied first
+					const size_t newOffset = _offset % 4;
+					for(size_t i=0; i!=_buffers.size(); ++i)
+					{
+						const num_t* source = Data(i);
+						num_t* destination = _buffers[i]->Data() + newOffset;
+						for(size_t y=0; y!=_height; ++y)
+							std::copy(source + y * _stride, source + y * _stride + _width, destination + y * _stride);
+					}
+					_offset = newOffset;
+				}
+			}
+			
+		private:
+			std::vector<Image2DPtr> _buffers;
+			size_t _height, _stride, _width, _offset;
+	};
+	
+	class FlaggingSessionDataImp
+	{
+		public:
+			FlaggingSessionDataImp(AOFlagger& _flagger, Strategy& _strategy, size_t _height, size_t count, size_t _chunkSize, size_t _contextSize) :
+				flagger(&_flagger),
+				strategy(_strategy),
+				// Once the session runs, the window starts contextSize timesteps before a
+				// chunk, so this aligns the window when the chunk size is a multiple of four
+				history(_height, count, _chunkSize + 2*_contextSize, _contextSize % 4),
+				height(_height),
+				chunkSize(_chunkSize),
+				contextSize(_contextSize),
+				historyStart(0),
+				finalizedEnd(0),
+				availableCount(0),
+				isFinished(false)
+			{
+			}
+			
+			AOFlagger* flagger;
+			Strategy strategy;
+			// Holds the timesteps [historyStart, historyStart + history.Width()).
+			SessionHistory history;
+			size_t height, chunkSize, contextSize;
+			size_t historyStart, finalizedEnd;
+			// Final flags that have not yet been taken, in order of time
+			std::vector<Mask2DCPtr> available;
+			size_t availableCount;
+			bool isFinished;
+	};
+	
+	class FlaggingSessionData
+	{
+		public:
+			explicit FlaggingSessionData(boost::shared_ptr<FlaggingSessionDataImp> implementation) :
+				_implementation(implementation)
+			{
+			}
+			boost::shared_ptr<FlaggingSessionDataImp> _implementation;
+	};
+	
+	FlaggingSession::FlaggingSession(AOFlagger& flagger, Strategy& strategy, size_t height, size_t count, size_t chunkSize, size_t contextSize)
+	{
+		if(chunkSize == 0)
+			throw std::runtime_error("The chunk size of a flagging session should be at least one timestep");
+		ImageSet::assertValidCount(count);
+		_data = new FlaggingSessionData(boost::shared_ptr<FlaggingSessionDataImp>(
+			new FlaggingSessionDataImp(flagger, strategy, height, count, chunkSize, contextSize)));
+	}
+	
+	FlaggingSession::FlaggingSession(const FlaggingSession& sourceSession) :
+		_data(new FlaggingSessionData(sourceSession._data->_implementation))
+	{
+	}
+	
+	FlaggingSession::~FlaggingSession()
+	{
+		delete _data;
+	}
+	
+	FlaggingSession& FlaggingSession::operator=(const FlaggingSession& sourceSession)
+	{
+		_data->_implementation = sourceSession._data->_implementation;
+		return *this;
+	}
+	
+	void FlaggingSession::AddTimesteps(const ImageSet& timesteps)
+	{
+		FlaggingSessionDataImp& session = *_data->_implementation;
+		if(session.isFinished)
+			throw std::runtime_error("Timesteps were added to a flagging session after it was finished");
+		if(timesteps.Height() != session.height || timesteps.ImageCount() != session.history.Count())
+			throw std::runtime_error("The timesteps added to a flagging session do not match the dimensions of the session");
+		
+		size_t x = 0;
+		while(x != timesteps.Width())
+		{
+			// Never add more timesteps than required to finalize the next chunk, so that the
+			// history never exceeds chunkSize + 2*contextSize timesteps.
+			const size_t
+				pending = session.historyStart + session.history.Width() - session.finalizedEnd,
+				n = std::min(timesteps.Width() - x, session.chunkSize + session.contextSize - pending);
+			session.history.Append(timesteps._data->images, x, n);
+			x += n;
+			
+			if(pending + n == session.chunkSize + session.contextSize)
+				flagChunk(session.chunkSize);
+		}
+	}
+	
+	void FlaggingSession::Finish()
+	{
+		FlaggingSessionDataImp& session = *_data->_implementation;
+		if(!session.isFinished)
+		{
+			const size_t pending = session.historyStart + session.history.Width() - session.finalizedEnd;
+			if(pending != 0)
+				flagChunk(pending);
+			session.isFinished = true;
+		}
+	}
+	
+	/**
+	 * Runs the strategy over the full history, makes the flags of the chunkWidth
+	 * timesteps after finalizedEnd final, and removes the timesteps that are no longer
+	 * needed as context from the history.
+	 */
+	void FlaggingSession::flagChunk(size_t chunkWidth)
+	{
+		FlaggingSessionDataImp& session = *_data->_implementation;
+		float* buffers[8];
+		for(size_t i=0; i!=session.history.Count(); ++i)
+			buffers[i] = session.history.Data(i);
+		const ImageSet window(session.history.Width(), session.height, session.history.Count(), buffers, session.history.Stride());
+		FlagMask flags = session.flagger->Run(session.strategy, window);
+		const size_t chunkStart = session.finalizedEnd - session.historyStart;
+		session.available.push_back(flags._data->mask->Trim(chunkStart, 0, chunkStart + chunkWidth, session.height));
+		session.availableCount += chunkWidth;
+		session.finalizedEnd += chunkWidth;
+		
+		const size_t newStart = std::max(session.historyStart, session.finalizedEnd - std::min(session.finalizedEnd, session.contextSize));
+		session.history.RemoveFront(newStart - session.historyStart);
+		session.historyStart = newStart;
+	}
+	
+	size_t FlaggingSession::AvailableCount() const
+	{
+		return _data->_implementation->availableCount;
+	}
+	
+	size_t FlaggingSession::ReceivedCount() const
+	{
+		const FlaggingSessionDataImp& session = *_data->_implementation;
+		return session.historyStart + session.history.Width();
+	}
+	
+	FlagMask FlaggingSession::TakeFlags()
+	{
+		FlaggingSessionDataImp& session = *_data->_implementation;
+		FlagMask result(session.availableCount, session.height);
+		size_t x = 0;
+		for(std::vector<Mask2DCPtr>::const_iterator chunk=session.available.begin(); chunk!=session.available.end(); ++chunk)
+		{
+			for(size_t y=0; y!=session.height; ++y)
+				std::copy((*chunk)->ValuePtr(0, y), (*chunk)->ValuePtr(0, y) + (*chunk)->Width(), result._data->mask->ValuePtr(x, y));
+			x += (*chunk)->Width();
+		}
+		session.available.clear();
+		session.availableCount = 0;
+		return result;
+	}
+	
 	class ErrorListener : public ProgressListener {
 		virtual void OnStartTask(const rfiStrategy::Action &, size_t, size_t, const std::string &, size_t = 1) {}
 		virtual void OnEndTask(const rfiStrategy::Action &) {}
@@ -382,37 +663,249 @@ namespace aoflagger {
 		StatusListener *_destination;
 	};
 	
+	/**
+	 * Objects that are required to run a strategy, but that do not depend on the
+	 * input data. Each thread of RunBatch() keeps one, so that these are only
+	 * allocated once per thread instead of once per image set. Calls to Run() take one
+	 * from the RunScratchPool of the strategy.
+	 */
+	class RunScratch
+	{
+		public:
+			RunScratch() : _statusListener(0), _listener(new ErrorListener()), _unflaggedMask(0), _plan(0), _width(0), _height(0)
+			{
+			}
+			
+			~RunScratch()
+			{
+				delete _listener;
+				delete _unflaggedMask;
+			}
+			
+			boost::mutex& Mutex() { return _mutex; }
+			
+			ProgressListener& Listener() { return *_listener; }
+			
+			void SetStatusListener(StatusListener* statusListener)
+			{
+				if(statusListener != _statusListener)
+				{
+					delete _listener;
+					_listener = 0;
+					if(statusListener == 0)
+						_listener = new ErrorListener();
+					else
+						_listener = new ForwardingListener(statusListener);
+					_statusListener = statusListener;
+				}
+			}
+			
+			/**
+			 * The zero image is shared by all polarizations of the revised data. Because
+			 * this object keeps a reference, a strategy that changes the revised data
+			 * will always change a copy.
+			 */
+			Image2DCPtr ZeroImage(size_t width, size_t height)
+			{
+				if(_zeroImage == 0 || _zeroImage->Width() != width || _zeroImage->Height() != height)
+					_zeroImage = Image2D::CreateZeroImagePtr(width, height);
+				return _zeroImage;
+			}
+			
+			/**
+			 * Returns true when the plan or the shape differs from the previous call, i.e.,
+			 * when the plan should reserve its buffers.
+			 */
+			bool IsNewShape(const rfiStrategy::ExecutionPlan* plan, size_t width, size_t height)
+			{
+				const bool isNew = plan != _plan || width != _width || height != _height;
+				_plan = plan;
+				_width = width;
+				_height = height;
+				return isNew;
+			}
+			
+			const FlagMask& UnflaggedMask(AOFlagger& flagger, size_t width, size_t height)
+			{
+				if(_unflaggedMask == 0 || _unflaggedMask->Width() != width || _unflaggedMask->Height() != height)
+				{
+					delete _unflaggedMask;
+					_unflaggedMask = 0;
+					_unflaggedMask = new FlagMask(flagger.MakeFlagMask(width, height, false));
+				}
+				return *_unflaggedMask;
+			}
+			
+		private:
+			RunScratch(const RunScratch&) = delete;
+			void operator=(const RunScratch&) = delete;
+			
+			boost::mutex _mutex;
+			StatusListener* _statusListener;
+			ProgressListener* _listener;
+			Image2DCPtr _zeroImage;
+			FlagMask* _unflaggedMask;
+			const rfiStrategy::ExecutionPlan* _plan;
+			size_t _width, _height;
+	};
+	
+	/**
+	 * The RunScratch objects of one strategy. Each concurrent call to Run() takes
+	 * its own, and returns it when it is done.
+	 */
+	class RunScratchPool
+	{
+		public:
+			RunScratchPool() { }
+			
+			~RunScratchPool()
+			{
+				for(std::vector<RunScratch*>::iterator i=_available.begin(); i!=_available.end(); ++i)
+					delete *i;
+			}
+			
+			/**
+			 * Takes a scratch object from the pool for as long as it exists.
+			 */
+			class Lease
+			{
+				public:
+					explicit Lease(RunScratchPool& pool) : _pool(pool), _scratch(pool.take())
+					{ }
+					
+					~Lease() { _pool.give(_scratch); }
+					
+					RunScratch& Scratch() { return *_scratch; }
+					
+				private:
+					Lease(const Lease&) = delete;
+					void operator=(const Lease&) = delete;
+					
+					RunScratchPool& _pool;
+					RunScratch* _scratch;
+			};
+			
+		private:
+			RunScratchPool(const RunScratchPool&) = delete;
+			void operator=(const RunScratchPool&) = delete;
+			
+			RunScratch* take()
+			{
+				boost::mutex::scoped_lock lock(_mutex);
+				if(_available.empty())
+					return new RunScratch();
+				RunScratch* scratch = _available.back();
+				_available.pop_back();
+				return scratch;
+			}
+			
+			void give(RunScratch* scratch)
+			{
+				boost::mutex::scoped_lock lock(_mutex);
+				_available.push_back(scratch);
+			}
+			
+			boost::mutex _mutex;
+			std::vector<RunScratch*> _available;
+	};
+	
+	StrategyData::StrategyData(rfiStrategy::Strategy *strategy) :
+		strategyPtr(strategy),
+		planPtr(new rfiStrategy::ExecutionPlan(*strategy)),
+		scratchPool(new RunScratchPool())
+	{
+	}
+	
 	FlagMask AOFlagger::Run(Strategy& strategy, const ImageSet& input)
 	{
-		boost::mutex mutex;
-		rfiStrategy::ArtifactSet artifacts(&mutex);
-		ProgressListener* listener;
-		if(_statusListener == 0)
-			listener = new ErrorListener();
-		else
-			listener = new ForwardingListener(_statusListener);
+		RunScratchPool::Lease lease(*strategy._data->scratchPool);
+		lease.Scratch().SetStatusListener(_statusListener);
+		return run(strategy, input, lease.Scratch());
+	}
+	
+	/**
+	 * The algorithms assume that images of the same size have the same stride, and that rows
+	 * are aligned for SSE instructions. Images that were created with a larger width capacity
+	 * and wrapped buffers of the caller might not, and are copied.
+	 */
+	static std::vector<Image2DCPtr> makeCompatibleImages(const std::vector<Image2DPtr>& images)
+	{
+		std::vector<Image2DCPtr> compatibleImages(images.begin(), images.end());
+		for(std::vector<Image2DCPtr>::iterator image=compatibleImages.begin(); image!=compatibleImages.end(); ++image)
+		{
+			const size_t width = (*image)->Width();
+			const size_t defaultStride = width == 0 ? 0 : (((width-1)/4)+1)*4;
+			if((*image)->Stride() != defaultStride || reinterpret_cast<uintptr_t>((*image)->Data()) % 16 != 0)
+				*image = Image2D::CreateCopy(*image);
+		}
+		return compatibleImages;
+	}
+	
+	void AOFlagger::Run(Strategy& strategy, const ImageSet& input, FlagMask& destination)
+	{
+		if(destination.Width() != input.Width() || destination.Height() != input.Height())
+			throw std::runtime_error("The destination flag mask has a different size than the data");
+		RunScratchPool::Lease lease(*strategy._data->scratchPool);
+		lease.Scratch().SetStatusListener(_statusListener);
+		run(strategy, input, lease.Scratch(), &destination);
+	}
+	
+	/**
+	 * Writes the union of the masks of @p data into @p destination. Unlike
+	 * TimeFrequencyData::GetSingleMask(), this does not create a new mask when the
+	 * polarizations have different masks.
+	 */
+	static void writeCombinedMask(const TimeFrequencyData& data, Mask2D& destination)
+	{
+		const size_t width = destination.Width();
+		for(size_t y=0; y!=destination.Height(); ++y)
+		{
+			bool* destRow = destination.ValuePtr(0, y);
+			if(data.MaskCount() == 0)
+				std::fill(destRow, destRow + width, false);
+			else {
+				const bool* firstRow = data.GetMask(0)->ValuePtr(0, y);
+				std::copy(firstRow, firstRow + width, destRow);
+				for(size_t m=1; m!=data.MaskCount(); ++m)
+				{
+					const bool* row = data.GetMask(m)->ValuePtr(0, y);
+					for(size_t x=0; x!=width; ++x)
+						destRow[x] = destRow[x] || row[x];
+				}
+			}
+		}
+	}
+	
+	/**
+	 * When @p destination is given, the flags are written into it and an empty mask
+	 * is returned.
+	 */
+	FlagMask AOFlagger::run(Strategy& strategy, const ImageSet& input, RunScratch& scratch, FlagMask* destination)
+	{
+		rfiStrategy::ArtifactSet artifacts(&scratch.Mutex());
+		const std::vector<Image2DCPtr> images = makeCompatibleImages(input._data->images);
 		
 		Mask2DPtr mask = Mask2D::CreateSetMaskPtr<false>(input.Width(), input.Height());
 		TimeFrequencyData inputData, revisedData;
-		Image2DPtr zeroImage = Image2D::CreateZeroImagePtr(input.Width(), input.Height());
+		Image2DCPtr zeroImage = scratch.ZeroImage(input.Width(), input.Height());
 		switch(input.ImageCount())
 		{
 			case 1:
-				inputData = TimeFrequencyData(TimeFrequencyData::AmplitudePart, Polarization::StokesI, input._data->images[0]);
+				inputData = TimeFrequencyData(TimeFrequencyData::AmplitudePart, Polarization::StokesI, images[0]);
 				inputData.SetGlobalMask(mask);
 				revisedData = TimeFrequencyData(TimeFrequencyData::AmplitudePart, Polarization::StokesI, zeroImage);
 				revisedData.SetGlobalMask(mask);
 				break;
 			case 2:
-				inputData = TimeFrequencyData(Polarization::StokesI, input._data->images[0], input._data->images[1]);
+				inputData = TimeFrequencyData(Polarization::StokesI, images[0], images[1]);
 				inputData.SetGlobalMask(mask);
 				revisedData = TimeFrequencyData(Polarization::StokesI, zeroImage, zeroImage);
 				revisedData.SetGlobalMask(mask);
 				break;
 			case 4:
 				inputData = TimeFrequencyData(
-					Polarization::XX, input._data->images[0], input._data->images[1],
-					Polarization::YY, input._data->images[2], input._data->images[3]
+					Polarization::XX, images[0], images[1],
+					Polarization::YY, images[2], images[3]
 				);
 				inputData.SetIndividualPolarizationMasks(mask, mask);
 				revisedData = TimeFrequencyData(
@@ -422,10 +915,10 @@ namespace aoflagger {
 				break;
 			case 8:
 				inputData = TimeFrequencyData::FromLinear(
-					input._data->images[0], input._data->images[1],
-					input._data->images[2], input._data->images[3],
-					input._data->images[4], input._data->images[5],
-					input._data->images[6], input._data->images[7]
+					images[0], images[1],
+					images[2], images[3],
+					images[4], images[5],
+					images[6], images[7]
 				);
 				inputData.SetIndividualPolarizationMasks(mask, mask, mask, mask);
 				revisedData = TimeFrequencyData::FromLinear(
@@ -440,17 +933,286 @@ namespace aoflagger {
 		artifacts.SetPolarizationStatistics(new PolarizationStatistics());
 		artifacts.SetBaselineSelectionInfo(new rfiStrategy::BaselineSelector());
 		
-		strategy._data->strategyPtr->Perform(artifacts, *listener);
+		const rfiStrategy::ExecutionPlan* plan = strategy._data->planPtr.get();
+		artifacts.SetPlan(plan);
+		if(scratch.IsNewShape(plan, input.Width(), input.Height()))
+			plan->ReserveScratch(input.Width(), input.Height(), inputData.PolarizationCount(), 1);
+		strategy._data->strategyPtr->Perform(artifacts, scratch.Listener());
 		
 		delete artifacts.BaselineSelectionInfo();
 		delete artifacts.PolarizationStatistics();
-		delete listener;
+		
+		if(destination != 0)
+		{
+			writeCombinedMask(artifacts.ContaminatedData(), *destination->_data->mask);
+			return FlagMask();
+		}
+		
+		// Drop the other references to the result, so that it normally does not have to be copied
+		Mask2DCPtr result = artifacts.ContaminatedData().GetSingleMask();
+		artifacts.SetOriginalData(TimeFrequencyData());
+		artifacts.SetContaminatedData(TimeFrequencyData());
+		artifacts.SetRevisedData(TimeFrequencyData());
+		inputData = TimeFrequencyData();
+		revisedData = TimeFrequencyData();
+		mask.reset();
 		
 		FlagMask flagMask;
-		flagMask._data = new FlagMaskData(Mask2D::CreateCopy(artifacts.ContaminatedData().GetSingleMask()));
+		if(result.unique())
+			flagMask._data = new FlagMaskData(boost::const_pointer_cast<Mask2D>(result));
+		else
+			flagMask._data = new FlagMaskData(Mask2D::CreateCopy(result));
 		return flagMask;
 	}
 	
+	struct BatchTask
+	{
+		class Batch* batch;
+		size_t index;
+	};
+	
+	/**
+	 * The image sets and results of one call to RunBatch().
+	 */
+	class Batch
+	{
+		public:
+			Batch(Strategy& _strategy, const std::vector<ImageSet>& _inputs, std::vector<QualityStatistics>* _workerStatistics, const size_t* _antenna1, const size_t* _antenna2) :
+				strategy(&_strategy),
+				inputs(&_inputs),
+				workerStatistics(_workerStatistics),
+				antenna1(_antenna1),
+				antenna2(_antenna2),
+				results(_inputs.size(), 0),
+				remaining(_inputs.size())
+			{
+			}
+			
+			Strategy* strategy;
+			const std::vector<ImageSet>* inputs;
+			// Statistics are collected per worker, or not at all when this is null
+			std::vector<QualityStatistics>* workerStatistics;
+			const size_t *antenna1, *antenna2;
+			std::vector<FlagMask*> results;
+			std::string errorMessage;
+			
+			boost::mutex mutex;
+			boost::condition finishedCondition;
+			size_t remaining;
+	};
+	
+	/**
+	 * Threads that flag the image sets given to RunBatch(). The threads keep
+	 * running until the pool is destructed, so that their scratch objects and the
+	 * image buffers cached by each thread are reused for the next batch.
+	 */
+	class WorkerPool
+	{
+		public:
+			WorkerPool(AOFlagger& flagger, size_t threadCount) :
+				_flagger(flagger),
+				_threadCount(threadCount),
+				_tasks(threadCount * 4)
+			{
+				for(size_t i=0; i!=threadCount; ++i)
+					_threads.create_thread(boost::bind(&WorkerPool::work, this, i));
+			}
+			
+			~WorkerPool()
+			{
+				_tasks.write_end();
+				_threads.join_all();
+			}
+			
+			size_t ThreadCount() const { return _threadCount; }
+			
+			void Perform(Batch& batch)
+			{
+				for(size_t i=0; i!=batch.inputs->size(); ++i)
+				{
+					BatchTask task;
+					task.batch = &batch;
+					task.index = i;
+					_tasks.write(task);
+				}
+				boost::mutex::scoped_lock lock(batch.mutex);
+				while(batch.remaining != 0)
+					batch.finishedCondition.wait(lock);
+			}
+			
+		private:
+			void work(size_t workerIndex)
+			{
+				// Every worker flags its own baselines, so loops inside the strategy run serially
+				ParallelFor::Limit limit(1);
+				RunScratch scratch;
+				BatchTask task;
+				while(_tasks.read(task))
+				{
+					Batch& batch = *task.batch;
+					try {
+						scratch.SetStatusListener(_flagger._statusListener);
+						const ImageSet& input = (*batch.inputs)[task.index];
+						FlagMask* flags = new FlagMask(AOFlagger::run(*batch.strategy, input, scratch));
+						batch.results[task.index] = flags;
+						if(batch.workerStatistics != 0)
+						{
+							const FlagMask& correlatorFlags = scratch.UnflaggedMask(_flagger, input.Width(), input.Height());
+							_flagger.CollectStatistics((*batch.workerStatistics)[workerIndex], input, *flags, correlatorFlags, batch.antenna1[task.index], batch.antenna2[task.index]);
+						}
+					} catch(std::exception& e) {
+						boost::mutex::scoped_lock lock(batch.mutex);
+						if(batch.errorMessage.empty())
+							batch.errorMessage = e.what();
+					}
+					boost::mutex::scoped_lock lock(batch.mutex);
+					--batch.remaining;
+					if(batch.remaining == 0)
+						batch.finishedCondition.notify_all();
+				}
+			}
+			
+			AOFlagger& _flagger;
+			size_t _threadCount;
+			lane<BatchTask> _tasks;
+			boost::thread_group _threads;
+	};
+	
+	/**
+	 * State of the flagger that is not part of the public class, so that it can
+	 * change without changing the layout of AOFlagger.
+	 */
+	class AOFlaggerData
+	{
+		public:
+			AOFlaggerData() : threadCount(0), workerPool(0) { }
+			~AOFlaggerData() { delete workerPool; }
+			
+			size_t threadCount;
+			WorkerPool* workerPool;
+	};
+	
+	AOFlagger::AOFlagger() : _statusListener(0), _data(new AOFlaggerData())
+	{
+	}
+	
+	AOFlagger::~AOFlagger()
+	{
+		delete _data;
+	}
+	
+	std::vector<FlagMask> AOFlagger::RunBatch(Strategy& strategy, const std::vector<ImageSet>& inputs)
+	{
+		return runBatch(strategy, inputs, 0, 0, 0);
+	}
+	
+	std::vector<FlagMask> AOFlagger::RunBatch(Strategy& strategy, const std::vector<ImageSet>& inputs, QualityStatistics& statistics, const size_t* antenna1, const size_t* antenna2)
+	{
+		return runBatch(strategy, inputs, &statistics, antenna1, antenna2);
+	}
+	
+	std::vector<FlagMask> AOFlagger::runBatch(Strategy& strategy, const std::vector<ImageSet>& inputs, QualityStatistics* statistics, const size_t* antenna1, const size_t* antenna2)
+	{
+		WorkerPool*& workerPool = _data->workerPool;
+		if(workerPool == 0)
+			workerPool = new WorkerPool(*this, _data->threadCount == 0 ? System::ProcessorCount() : _data->threadCount);
+		
+		std::vector<QualityStatistics> workerStatistics;
+		if(statistics != 0)
+		{
+			const QualityStatisticsDataImp& meta = *statistics->_data->_implementation;
+			for(size_t i=0; i!=workerPool->ThreadCount(); ++i)
+			{
+				workerStatistics.push_back(QualityStatistics(
+					meta.scanTimes.data(), meta.scanTimes.size(),
+					meta.channelFrequencies.data(), meta.channelFrequencies.size(),
+					meta.polarizationCount, meta.computeHistograms));
+			}
+		}
+		
+		Batch batch(strategy, inputs, statistics == 0 ? 0 : &workerStatistics, antenna1, antenna2);
+		workerPool->Perform(batch);
+		
+		std::vector<FlagMask> results;
+		results.reserve(inputs.size());
+		for(std::vector<FlagMask*>::const_iterator i=batch.results.begin(); i!=batch.results.end(); ++i)
+		{
+			if(*i != 0)
+			{
+				results.push_back(**i);
+				delete *i;
+			}
+		}
+		if(!batch.errorMessage.empty())
+			throw std::runtime_error("Flagging in RunBatch() failed: " + batch.errorMessage);
+		
+		if(statistics != 0)
+		{
+			for(std::vector<QualityStatistics>::const_iterator i=workerStatistics.begin(); i!=workerStatistics.end(); ++i)
+				(*statistics) += *i;
+		}
+		return results;
+	}
+	
+	void AOFlagger::SetThreadCount(size_t threadCount)
+	{
+		delete _data->workerPool;
+		_data->workerPool = 0;
+		_data->threadCount = threadCount;
+	}
+	
+	void AOFlagger::RunPacked(Strategy& strategy, const ImageSet& input, unsigned char* destination, size_t bytesPerRow)
+	{
+		if(bytesPerRow < (input.Width() + 7) / 8)
+			throw std::runtime_error("The rows of the destination are too short to hold the flags");
+		const FlagMask flags = Run(strategy, input);
+		const Mask2D& source = *flags._data->mask;
+		for(size_t y=0; y!=input.Height(); ++y)
+		{
+			const bool* sourcePtr = source.ValuePtr(0, y);
+			unsigned char* destPtr = destination + y * bytesPerRow;
+			for(size_t x=0; x<input.Width(); x += 8)
+			{
+				const size_t n = std::min<size_t>(8, input.Width() - x);
+				unsigned char byte = 0;
+				for(size_t bit=0; bit!=n; ++bit)
+					byte |= (unsigned char) sourcePtr[x + bit] << bit;
+				destPtr[x / 8] = byte;
+			}
+		}
+	}
+	
+	ImageSet AOFlagger::WrapImageSet(size_t width, size_t height, size_t count, float* buffer, size_t horizontalStride, size_t imageStride)
+	{
+		ImageSet::assertValidCount(count);
+		float* buffers[8];
+		for(size_t i=0; i!=count; ++i)
+			buffers[i] = buffer + i * imageStride;
+		return ImageSet(width, height, count, buffers, horizontalStride);
+	}
+	
+	ImageSet AOFlagger::MakeImageSetFromInterleaved(size_t width, size_t height, size_t polarizationCount, const float* buffer, size_t horizontalStride, size_t sampleStride, size_t polarizationStride)
+	{
+		ImageSet imageSet(width, height, polarizationCount * 2);
+		std::vector<float*> rows(polarizationCount * 2);
+		for(size_t y=0; y!=height; ++y)
+		{
+			for(size_t i=0; i!=polarizationCount*2; ++i)
+				rows[i] = imageSet.ImageBuffer(i) + y * imageSet.HorizontalStride();
+			const float* rowPtr = buffer + y * horizontalStride;
+			for(size_t x=0; x!=width; ++x)
+			{
+				const float* samplePtr = rowPtr + x * sampleStride;
+				for(size_t p=0; p!=polarizationCount; ++p)
+				{
+					rows[p*2][x] = samplePtr[p * polarizationStride];
+					rows[p*2+1][x] = samplePtr[p * polarizationStride + 1];
+				}
+			}
+		}
+		return imageSet;
+	}
+	
 	QualityStatistics AOFlagger::MakeQualityStatistics(const double *scanTimes, size_t nScans, const double *channelFrequencies, size_t nChannels, size_t nPolarizations)
 	{
 		return QualityStatistics(scanTimes, nScans, channelFrequencies, nChannels, nPolarizations, false);
@@ -525,4 +1287,20 @@ namespace aoflagger {
 		return AOFLAGGER_VERSION_DATE_STR;
 	}
 	
+	void AOFlagger::SetProfilingEnabled(bool enabled)
+	{
+		rfiStrategy::ActionProfiler::SetEnabled(enabled);
+	}
+	
+	void AOFlagger::WriteProfile(const std::string& textFilename, const std::string& jsonFilename)
+	{
+		std::ofstream textFile(textFilename.c_str());
+		rfiStrategy::ActionProfiler::WriteTextReport(textFile);
+		if(!jsonFilename.empty())
+		{
+			std::ofstream jsonFile(jsonFilename.c_str());
+			rfiStrategy::ActionProfiler::WriteJSONReport(jsonFile);
+		}
+	}
+	
 } // end of namespace aoflagger
@@ -8,6 +8,7 @@
 
 #include <cstring>
 #include <string>
+#include <vector>
 
 /** @brief Contains all the public types used by the AOFlagger.
  * 
@@ -162,11 +163,15 @@ namespace aoflagger {
 	 * than the width of the image. The rows are padded to align them e.g. for
 	 * SSE instructions. Use @ref HorizontalStride() to get the actual number of
 	 * floats per row. 
+	 * 
+	 * An image set normally owns its images, but it can also refer to buffers
+	 * of the caller, see @ref AOFlagger::WrapImageSet().
 	 */
 	class ImageSet
 	{
 		public:
 			friend class AOFlagger;
+			friend class FlaggingSession;
 			
 			/** @brief Copy the image set. Only references to images are copied. */
 			ImageSet(const ImageSet& sourceImageSet);
@@ -240,6 +245,8 @@ namespace aoflagger {
 			
 			ImageSet(size_t width, size_t height, size_t count, float initialValue, size_t widthCapacity);
 			
+			ImageSet(size_t width, size_t height, size_t count, float* const* buffers, size_t horizontalStride);
+			
 			static void assertValidCount(size_t count);
 			
 			class ImageSetData *_data;
@@ -270,6 +277,7 @@ namespace aoflagger {
 	{
 		public:
 			friend class AOFlagger;
+			friend class FlaggingSession;
 			
 			/** @brief Copy a flag mask. Only copies a reference, not the data. */
 			FlagMask(const FlagMask& sourceMask);
@@ -277,6 +285,11 @@ namespace aoflagger {
 			/** @brief Destroy a flag mask. Destroys mask data if no longer references. */
 			~FlagMask();
 			
+			/** @brief Assign to this flag mask. Only copies a reference, not the data.
+			 * @since Version 2.10
+			 */
+			FlagMask &operator=(const FlagMask& sourceMask);
+			
 			/** @brief Get the width of the mask. */
 			size_t Width() const;
 			
@@ -308,6 +321,7 @@ namespace aoflagger {
 			FlagMask();
 			FlagMask(size_t width, size_t height);
 			FlagMask(size_t width, size_t height, bool initialValue);
+			FlagMask(size_t width, size_t height, bool* buffer, size_t horizontalStride);
 			
 			class FlagMaskData *_data;
 	};
@@ -393,6 +407,87 @@ namespace aoflagger {
 			class QualityStatisticsData *_data;
 	};
 	
+	/** @brief Flags data that arrives a few timesteps at a time.
+	 * 
+	 * A session can be used to flag inside an online pipeline, such as a correlator,
+	 * where the timesteps of a baseline become available one integration at a time.
+	 * It is created with @ref AOFlagger::MakeFlaggingSession(). New timesteps are passed
+	 * to the session with AddTimesteps(). The session keeps a bounded window with the
+	 * most recent timesteps. Every time a chunk of new timesteps has been received,
+	 * together with enough timesteps after the chunk for context, the strategy is run over
+	 * the chunk and the context around it. The flags of the chunk are then final and can be
+	 * retrieved with TakeFlags(). Hence, the flags of a timestep are available at the latest
+	 * after chunkSize + contextSize further timesteps have been added.
+	 * 
+	 * The strategy only sees the window, so its thresholds are based on the statistics of the
+	 * window instead of those of the full observation. With a sufficiently large window
+	 * (a few hundred timesteps), the flags are very close to those of flagging the full
+	 * observation at once with @ref AOFlagger::Run(). The @c aobench tool can replay a
+	 * measurement set through a session to compare the two for a given window.
+	 * 
+	 * Added timesteps are copied into the session once. When the chunk size is a multiple
+	 * of four, the strategy runs on the window without copying it again.
+	 * 
+	 * A session is not thread safe, but different sessions (e.g., one for each baseline)
+	 * can be used from different threads. Like the other objects, copying a session
+	 * only copies a reference to the same session. The @ref AOFlagger instance that
+	 * created the session should exist as long as the session is used.
+	 * @since Version 2.10
+	 */
+	class FlaggingSession
+	{
+		public:
+			friend class AOFlagger;
+			
+			/** @brief Copy the session. Only a reference to the session is copied. */
+			FlaggingSession(const FlaggingSession& sourceSession);
+			
+			/** @brief Destruct the session. The data is destroyed if no more references exist. */
+			~FlaggingSession();
+			
+			/** @brief Assign to this session. Only a reference is copied. */
+			FlaggingSession &operator=(const FlaggingSession& sourceSession);
+			
+			/** @brief Add new timesteps to the session.
+			 * 
+			 * This runs the strategy when enough timesteps are available to finalize
+			 * a chunk, and will therefore occasionally take much longer than other calls.
+			 * @param timesteps Images with the new timesteps. The width is the number of new
+			 * timesteps; the height and image count should be equal to the values that were used
+			 * for creating the session.
+			 */
+			void AddTimesteps(const ImageSet& timesteps);
+			
+			/** @brief Flag all remaining timesteps.
+			 * 
+			 * Should be called after the last timesteps have been added. Afterwards,
+			 * the flags of all timesteps can be retrieved, and no more timesteps can be added.
+			 */
+			void Finish();
+			
+			/** @brief Number of timesteps with final flags that have not yet been retrieved. */
+			size_t AvailableCount() const;
+			
+			/** @brief Total number of timesteps that were added. */
+			size_t ReceivedCount() const;
+			
+			/** @brief Retrieve the final flags.
+			 * 
+			 * Returns the flags of the next AvailableCount() timesteps, in the order in which
+			 * they were added. Flags are returned only once; the next call returns the flags of
+			 * the timesteps that were finalized after this call.
+			 * @return Flags with a width of AvailableCount(), which might be zero.
+			 */
+			FlagMask TakeFlags();
+			
+		private:
+			FlaggingSession(class AOFlagger& flagger, Strategy& strategy, size_t height, size_t count, size_t chunkSize, size_t contextSize);
+			
+			void flagChunk(size_t chunkWidth);
+			
+			class FlaggingSessionData *_data;
+	};
+	
 	/**
 	 * @brief A base class which callers can inherit from to be able to receive
 	 * progress updates and error messages.
@@ -471,6 +566,9 @@ namespace aoflagger {
 	 * To flag multiple baselines, the Strategy can be stored and the same instance can be used
 	 * again.
 	 * 
+	 * When the data arrives a few timesteps at a time, e.g. inside a correlator pipeline,
+	 * the data can be flagged with a @ref FlaggingSession instead of calling Run().
+	 * 
 	 * ### Thread safety
 	 * 
 	 * The Run() method is thread-safe, as long as different ImageSet instances are specified.
@@ -481,6 +579,10 @@ namespace aoflagger {
 	 * its own QualityStatistics object. When finished, these can be combined with
 	 * QualityStatistics::operator+=().
 	 * 
+	 * Instead of implementing the threading themselves, applications can pass
+	 * many baselines at once to RunBatch(), which flags them with a pool of threads
+	 * and optionally collects the statistics.
+	 * 
 	 * It is okay to create multiple AOFlagger instances, but not recommended.
 	 * 
 	 * ### Data order
@@ -512,10 +614,10 @@ namespace aoflagger {
 	{
 		public:
 			/** @brief Create and initialize the flagger main class. */
-			AOFlagger() : _statusListener(0) { }
+			AOFlagger();
 			
-			/** @brief Destructor. */
-			~AOFlagger() { }
+			/** @brief Destructor. Stops the threads that were started by RunBatch(). */
+			~AOFlagger();
 			
 			/** @brief Create a new uninitialized @ref ImageSet with specified specs.
 			 * 
@@ -575,6 +677,71 @@ namespace aoflagger {
 				return ImageSet(width, height, count, initialValue, widthCapacity);
 			}
 			
+			/** @brief Create an @ref ImageSet that uses the caller's buffers, without copying them.
+			 * 
+			 * The image set refers to the buffers for as long as it, or a copy of it, exists.
+			 * The flagger does not change the values in the buffers. This avoids copying
+			 * the data into an image set when the caller already has the data
+			 * in the right layout.
+			 * 
+			 * The data is only used without copying when each buffer is aligned on 16 bytes and
+			 * @p horizontalStride is a multiple of four, so that the SSE instructions of the
+			 * algorithms can be used on full rows. Otherwise, Run() will
+			 * make an aligned copy of the images.
+			 * @param width Number of time steps in images
+			 * @param height Number of frequency channels in images
+			 * @param count Number of images in set (see class description
+			 * of @ref ImageSet for image order).
+			 * @param buffers Array of @p count pointers, one for each image. Each buffer
+			 * should have at least @p height x @p horizontalStride floats.
+			 * @param horizontalStride Number of floats from the start of one row to the next.
+			 * @return A new ImageSet.
+			 * @since Version 2.10
+			 */
+			ImageSet WrapImageSet(size_t width, size_t height, size_t count, float* const* buffers, size_t horizontalStride)
+			{
+				return ImageSet(width, height, count, buffers, horizontalStride);
+			}
+			
+			/** @brief Create an @ref ImageSet from a single buffer that holds all images.
+			 * 
+			 * This is useful when the data is stored polarization-major, i.e., with the real and
+			 * imaginary planes of each polarization one after the other in a single buffer.
+			 * Like WrapImageSet(size_t, size_t, size_t, float* const*, size_t), the data is not copied.
+			 * @param width Number of time steps in images
+			 * @param height Number of frequency channels in images
+			 * @param count Number of images in set.
+			 * @param buffer The buffer. Image i starts at @p buffer + i x @p imageStride.
+			 * @param horizontalStride Number of floats from the start of one row to the next.
+			 * @param imageStride Number of floats from the start of one image to the next.
+			 * @return A new ImageSet.
+			 * @since Version 2.10
+			 */
+			ImageSet WrapImageSet(size_t width, size_t height, size_t count, float* buffer, size_t horizontalStride, size_t imageStride);
+			
+			/** @brief Create an @ref ImageSet from complex data with interleaved real and imaginary values.
+			 * 
+			 * The flagger needs the real and imaginary values in separate images, so the
+			 * data has to be copied. This is done in a single pass over the data.
+			 * The position of the real value of polarization p, channel y and time step x is
+			 * @p buffer + p x @p polarizationStride + y x @p horizontalStride + x x @p sampleStride.
+			 * The imaginary value follows the real value.
+			 * 
+			 * For example, for data that is ordered by channel, time step, polarization and
+			 * then real/imaginary, the sample stride is 2 x @p polarizationCount and the polarization
+			 * stride is 2.
+			 * @param width Number of time steps
+			 * @param height Number of frequency channels
+			 * @param polarizationCount Number of polarizations: 1, 2 or 4.
+			 * @param buffer The complex data.
+			 * @param horizontalStride Number of floats between two channels.
+			 * @param sampleStride Number of floats between two time steps.
+			 * @param polarizationStride Number of floats between two polarizations.
+			 * @return A new ImageSet with 2 x @p polarizationCount images.
+			 * @since Version 2.10
+			 */
+			ImageSet MakeImageSetFromInterleaved(size_t width, size_t height, size_t polarizationCount, const float* buffer, size_t horizontalStride, size_t sampleStride, size_t polarizationStride);
+			
 			/** @brief Create a new uninitialized @ref FlagMask with specified dimensions.
 			 * @param width Width of mask (number of timesteps)
 			 * @param height Height of mask (number of frequency channels)
@@ -596,6 +763,23 @@ namespace aoflagger {
 				return FlagMask(width, height, initialValue);
 			}
 			
+			/** @brief Create a @ref FlagMask that uses the caller's buffer, without copying it.
+			 * 
+			 * This can be used to pass correlator flags to CollectStatistics() or to let
+			 * Run(Strategy&, const ImageSet&, FlagMask&) write the flags directly into
+			 * the caller's buffer.
+			 * @param width Width of mask (number of timesteps)
+			 * @param height Height of mask (number of frequency channels)
+			 * @param buffer Buffer with at least @p height x @p horizontalStride bools.
+			 * @param horizontalStride Number of bools from the start of one row to the next.
+			 * @return A new FlagMask.
+			 * @since Version 2.10
+			 */
+			FlagMask WrapFlagMask(size_t width, size_t height, bool* buffer, size_t horizontalStride)
+			{
+				return FlagMask(width, height, buffer, horizontalStride);
+			}
+			
 			/** @brief Initialize a strategy for a specific telescope.
 			 * 
 			 * All parameters are hints to optimize the strategy, but need not actual alter the
@@ -645,6 +829,97 @@ namespace aoflagger {
 			 */
 			FlagMask Run(Strategy& strategy, const ImageSet& input);
 			
+			/** @brief Run the flagging strategy and store the flags in an existing mask.
+			 * 
+			 * When @p destination wraps a buffer of the caller (see WrapFlagMask()), the
+			 * flags are written into that buffer and no intermediate flag mask is created.
+			 * @param strategy The flagging strategy that will be used.
+			 * @param input The data to run the flagger on.
+			 * @param destination Mask with the same dimensions as the input, which will be
+			 * overwritten with the flags.
+			 * @since Version 2.10
+			 */
+			void Run(Strategy& strategy, const ImageSet& input, FlagMask& destination);
+			
+			/** @brief Run the flagging strategy and store the flags as bits.
+			 * 
+			 * The flag of time step x and channel y is stored in bit (x mod 8) of byte
+			 * @p destination [y x @p bytesPerRow + x / 8], where bit 0 is the least significant bit.
+			 * Unused bits at the end of a row are set to zero.
+			 * @param strategy The flagging strategy that will be used.
+			 * @param input The data to run the flagger on.
+			 * @param destination Buffer of at least @p bytesPerRow x input.Height() bytes.
+			 * @param bytesPerRow Number of bytes from the start of one row to the next; at least
+			 * (input.Width() + 7) / 8.
+			 * @since Version 2.10
+			 */
+			void RunPacked(Strategy& strategy, const ImageSet& input, unsigned char* destination, size_t bytesPerRow);
+			
+			/** @brief Run the flagging strategy on many image sets in parallel.
+			 * 
+			 * This is equivalent to calling Run() for each image set, but the
+			 * image sets are divided over a pool of threads that is managed
+			 * by the flagger. The threads are started on the first call
+			 * and are reused for later calls, as is the memory that each
+			 * thread allocates for flagging. Hence, an application can
+			 * use all cores without implementing its own scheduling, and it
+			 * is efficient to call this method many times with a batch of baselines.
+			 * 
+			 * The calls to the @ref StatusListener will be made from the threads of the pool.
+			 * This method should not be called from multiple threads at the same time.
+			 * @param strategy The flagging strategy that will be used.
+			 * @param inputs The data of the baselines to run the flagger on.
+			 * @return The flags of each image set, in the same order as @p inputs.
+			 * @sa SetThreadCount()
+			 * @since Version 2.10
+			 */
+			std::vector<FlagMask> RunBatch(Strategy& strategy, const std::vector<ImageSet>& inputs);
+			
+			/** @brief Run the flagging strategy on many image sets in parallel and collect statistics.
+			 * 
+			 * Like RunBatch(Strategy&, const std::vector<ImageSet>&), but additionally
+			 * adds the data and flags of all image sets to the statistics, as if
+			 * CollectStatistics() was called for each image set with empty correlator flags.
+			 * Each thread collects into its own object, and these are combined
+			 * into @p statistics before the method returns.
+			 * @param strategy The flagging strategy that will be used.
+			 * @param inputs The data of the baselines to run the flagger on.
+			 * @param statistics Object to which the statistics will be added.
+			 * @param antenna1 Array with for each image set the index of its first antenna.
+			 * @param antenna2 Array with for each image set the index of its second antenna.
+			 * @return The flags of each image set, in the same order as @p inputs.
+			 * @since Version 2.10
+			 */
+			std::vector<FlagMask> RunBatch(Strategy& strategy, const std::vector<ImageSet>& inputs, QualityStatistics& statistics, const size_t* antenna1, const size_t* antenna2);
+			
+			/** @brief Set the number of threads that are used by RunBatch().
+			 * 
+			 * By default, one thread per processor is used. Changing the number of threads
+			 * stops the current threads. This method is not thread safe.
+			 * @param threadCount The number of threads, or zero to use the number of processors.
+			 * @since Version 2.10
+			 */
+			void SetThreadCount(size_t threadCount);
+			
+			/** @brief Start flagging data that arrives incrementally.
+			 * 
+			 * See the @ref FlaggingSession class description for details.
+			 * @param strategy The flagging strategy that will be used.
+			 * @param height Number of frequency channels of the data.
+			 * @param count Number of images per timestep, see the @ref ImageSet class description.
+			 * @param chunkSize Number of timesteps that are finalized together. Smaller chunks lower
+			 * the latency, but the strategy is run more often.
+			 * @param contextSize Number of timesteps before and after a chunk that the strategy
+			 * sees when flagging the chunk. More context makes the flags more similar to those
+			 * of @ref Run(), at the cost of latency and processing time.
+			 * @return A new session.
+			 * @since Version 2.10
+			 */
+			FlaggingSession MakeFlaggingSession(Strategy& strategy, size_t height, size_t count, size_t chunkSize, size_t contextSize)
+			{
+				return FlaggingSession(*this, strategy, height, count, chunkSize, contextSize);
+			}
+			
 			/** @brief Create a new object for collecting statistics.
 			 * 
 			 * See the QualityStatistics class description for info on multithreading and/or combining statistics
@@ -728,6 +1003,32 @@ namespace aoflagger {
 				_statusListener = statusListener;
 			}
 			
+			/**
+			 * @brief Measure the time and memory used by each action of the strategies.
+			 * 
+			 * When enabled, every call to Run() records the wall time, cpu time,
+			 * number of calls and the bytes allocated for each step of the strategy.
+			 * Measurements of all threads and all calls are combined. This can be used to find
+			 * which step of a (custom) strategy is the bottleneck. It should be enabled before
+			 * the first call to Run(); enabling it slows down the flagging a little.
+			 * @param enabled Whether to profile the strategies.
+			 * @since Version 2.10
+			 */
+			void SetProfilingEnabled(bool enabled);
+			
+			/**
+			 * @brief Write the measurements collected since profiling was enabled.
+			 * 
+			 * The report is a tree with one node per step of the strategy. This method should
+			 * not be called while Run() is executing in another thread.
+			 * @param textFilename File to which a readable report will be written.
+			 * @param jsonFilename File to which the same report will be written in JSON format,
+			 * or an empty string if no JSON report is required.
+			 * @sa SetProfilingEnabled()
+			 * @since Version 2.10
+			 */
+			void WriteProfile(const std::string& textFilename, const std::string& jsonFilename);
+			
 		private:
 			/** @brief It is not allowed to copy this class
 			 */
@@ -737,7 +1038,16 @@ namespace aoflagger {
 			 */
 			void operator=(const AOFlagger&) = delete;
 			
+			friend class WorkerPool;
+			
+			static FlagMask run(Strategy& strategy, const ImageSet& input, class RunScratch& scratch, FlagMask* destination = 0);
+			
+			std::vector<FlagMask> runBatch(Strategy& strategy, const std::vector<ImageSet>& inputs, QualityStatistics* statistics, const size_t* antenna1, const size_t* antenna2);
+			
 			StatusListener* _statusListener;
+			// Adding this pointer changed the size of AOFlagger (SOVERSION 1). New
+			// state should go in AOFlaggerData, which keeps the layout stable.
+			class AOFlaggerData* _data;
 	};
 
 }
@@ -298,7 +298,10 @@ void DirectBaselineReader::PerformFlagWriteRequests()
 		}
 	}
 
-	size_t rowsWritten = 0;
+	// The rows of all requests are visited in row order, so that the flag column is accessed
+	// sequentially. Rows of which none of the flags changed are not written back.
+	size_t rowsWritten = 0, rowsUnchanged = 0;
+	const size_t polarizationCount = Polarizations().size();
 
 	for(std::vector<std::pair<size_t, size_t> >::const_iterator i=rows.begin();i!=rows.end();++i)
 	{
@@ -310,20 +313,32 @@ void DirectBaselineReader::PerformFlagWriteRequests()
 		{
 			casacore::Array<bool> flag = flagColumn(rowIndex);
 			casacore::Array<bool>::iterator j = flag.begin();
+			const size_t x = timeIndex - request.startIndex;
+			bool isChanged = false;
 			for(size_t f=0;f<(size_t) Set().FrequencyCount(request.spectralWindow);++f) {
-				for(size_t p=0;p<Polarizations().size();++p)
+				for(size_t p=0;p<polarizationCount;++p)
 				{
-					*j = request.flags[p]->Value(timeIndex - request.startIndex, f);
+					const bool value = request.flags[p]->Value(x, f);
+					if(*j != value)
+					{
+						*j = value;
+						isChanged = true;
+					}
 					++j;
 				}
 			}
-			flagColumn.basePut(rowIndex, flag);
-			++rowsWritten;
+			if(isChanged)
+			{
+				flagColumn.basePut(rowIndex, flag);
+				++rowsWritten;
+			} else {
+				++rowsUnchanged;
+			}
 		}
 	}
 	_writeRequests.clear();
 	
-	AOLogger::Debug << rowsWritten << "/" << rows.size() << " rows written in " << stopwatch.ToString() << '\n';
+	AOLogger::Debug << rowsWritten << "/" << rows.size() << " rows written (" << rowsUnchanged << " unchanged) in " << stopwatch.ToString() << '\n';
 }
 
 void DirectBaselineReader::readTimeData(size_t requestIndex, size_t xOffset, int frequencyCount, const casacore::Array<casacore::Complex> data, const casacore::Array<casacore::Complex> *model)
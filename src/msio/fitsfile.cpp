@@ -4,6 +4,7 @@
 #include <cmath>
 
 #include <sstream>
+#include <vector>
 #include <iostream>
 
 #include <boost/algorithm/string/trim.hpp>
@@ -465,6 +466,31 @@ void FitsFile::ReadGroupData(long groupIndex, long double *groupData)
 		AOLogger::Warn << "There were nulls in the group data\n";
 }
 
+void FitsFile::ReadGroupParameters(long firstGroupIndex, long groupCount, double *parametersData)
+{
+	// The parameters of consecutive groups are read in one call: cfitsio continues
+	// with the parameters of the next group when more than PCOUNT values are requested.
+	int status = 0;
+	long pSize = GetParameterCount();
+	fits_read_grppar_dbl(_fptr, firstGroupIndex+1, 1, pSize*groupCount, parametersData, &status);
+	CheckStatus(status);
+}
+
+void FitsFile::ReadGroupData(long firstGroupIndex, long groupCount, double *groupData)
+{
+	// As above, reading past the end of a group's data continues with the data of the next group
+	int status = 0;
+	long size = GetImageSize();
+	double nulValue = std::numeric_limits<double>::quiet_NaN();
+	int anynul = 0;
+
+	fits_read_img_dbl(_fptr, firstGroupIndex+1, 1, size*groupCount, nulValue, groupData, &anynul, &status);
+	CheckStatus(status);
+
+	if(anynul != 0)
+		AOLogger::Warn << "There were nulls in the group data\n";
+}
+
 int FitsFile::GetGroupParameterIndex(const std::string &parameterName)
 {
 	if(!HasGroups())
@@ -638,3 +664,54 @@ void FitsFile::WriteTableCell(int row, int col, const bool *data, size_t size)
 	fits_write_col(_fptr, TBIT, col, row, 1, size, dataChar, &status);
 	delete[] dataChar;
 }
+
+long FitsFile::GetRowBufferSize()
+{
+	CheckOpen();
+	int status = 0;
+	long rowCount = 0;
+	fits_get_rowsize(_fptr, &rowCount, &status);
+	CheckStatus(status);
+	return rowCount > 0 ? rowCount : 1;
+}
+
+void FitsFile::ReadTableRows(int firstRow, int rowCount, int col, double *output, size_t cellSize)
+{
+	// cfitsio continues with the next row when more elements than the repeat count are read
+	int status = 0;
+	double nulValue = std::numeric_limits<double>::quiet_NaN();
+	int anynul = 0;
+	fits_read_col(_fptr, TDOUBLE, col, firstRow, 1, cellSize * rowCount, &nulValue, output, &anynul, &status);
+	CheckStatus(status);
+}
+
+void FitsFile::ReadTableRows(int firstRow, int rowCount, int col, bool *output, size_t cellSize)
+{
+	const size_t size = cellSize * rowCount;
+	std::vector<char> data(size);
+	int status = 0;
+	char nulValue = 0;
+	int anynul = 0;
+	fits_read_col(_fptr, TBIT, col, firstRow, 1, size, &nulValue, &data[0], &anynul, &status);
+	CheckStatus(status);
+	for(size_t i = 0;i<size;++i)
+		output[i] = data[i]!=0;
+}
+
+void FitsFile::WriteTableRows(int firstRow, int rowCount, int col, const double *data, size_t cellSize)
+{
+	int status = 0;
+	fits_write_col(_fptr, TDOUBLE, col, firstRow, 1, cellSize * rowCount, const_cast<double*>(data), &status);
+	CheckStatus(status);
+}
+
+void FitsFile::WriteTableRows(int firstRow, int rowCount, int col, const bool *data, size_t cellSize)
+{
+	const size_t size = cellSize * rowCount;
+	std::vector<char> dataChar(size);
+	for(size_t i = 0;i<size;++i)
+		dataChar[i] = data[i] ? 1 : 0;
+	int status = 0;
+	fits_write_col(_fptr, TBIT, col, firstRow, 1, size, &dataChar[0], &status);
+	CheckStatus(status);
+}
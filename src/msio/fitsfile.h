@@ -243,12 +243,40 @@ class FitsFile {
 		void ReadGroup(long groupIndex, long double *groupData);
 		void ReadGroupData(long groupIndex, long double *groupData);
 		void ReadGroupParameters(long groupIndex, long double *parametersData);
+		/**
+		 * Read the parameters of a range of consecutive groups. The parameters are stored
+		 * group after group, i.e., @p parametersData should hold groupCount x GetParameterCount() values.
+		 */
+		void ReadGroupParameters(long firstGroupIndex, long groupCount, double *parametersData);
+		/**
+		 * Read the data of a range of consecutive groups without their parameters.
+		 * @p groupData should hold groupCount x GetImageSize() values.
+		 */
+		void ReadGroupData(long firstGroupIndex, long groupCount, double *groupData);
 		void ReadTableCell(int row, int col, long double *output, size_t size);
 		void ReadTableCell(int row, int col, double *output, size_t size);
 		void ReadTableCell(int row, int col, bool *output, size_t size);
 		void ReadTableCell(int row, int col, char *output);
 		void WriteTableCell(int row, int col, double *data, size_t size);
 		void WriteTableCell(int row, int col, const bool *data, size_t size);
+		/**
+		 * Number of rows of the current table that cfitsio can buffer at once. Reading or
+		 * writing this many rows per call gives the best performance.
+		 */
+		long GetRowBufferSize();
+		/**
+		 * Read the cells of a column for a range of consecutive rows with one call.
+		 * @param cellSize Number of elements per cell, which should be the repeat count
+		 * of the column. Cells are stored one after another in @p output.
+		 */
+		void ReadTableRows(int firstRow, int rowCount, int col, double *output, size_t cellSize);
+		void ReadTableRows(int firstRow, int rowCount, int col, bool *output, size_t cellSize);
+		/**
+		 * Write the cells of a column for a range of consecutive rows with one call.
+		 * @see ReadTableRows()
+		 */
+		void WriteTableRows(int firstRow, int rowCount, int col, const double *data, size_t cellSize);
+		void WriteTableRows(int firstRow, int rowCount, int col, const bool *data, size_t cellSize);
 		bool HasTableColumn(const std::string &columnName, int columnIndex);
 		int GetTableColumnIndex(const std::string &columnName);
 		int GetTableColumnArraySize(int columnIndex);
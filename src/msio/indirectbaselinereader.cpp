@@ -2,6 +2,7 @@
 
 #include <casacore/ms/MeasurementSets/MeasurementSet.h>
 
+#include <algorithm>
 #include <fstream>
 #include <set>
 #include <stdexcept>
@@ -109,9 +110,25 @@ void IndirectBaselineReader::PerformReadRequests()
 
 void IndirectBaselineReader::PerformFlagWriteRequests()
 {
+	if(_writeRequests.empty())
+		return;
+	initializeMeta();
+	if(!_msIsReordered) reorderedMS();
+	
+	// Requests are written in the order of their position in the flag file, so that the
+	// file is written front to back.
+	std::vector<std::pair<size_t, size_t> > order;
 	for(size_t i=0;i!=_writeRequests.size();++i)
 	{
-		const FlagWriteRequest request = _writeRequests[i];
+		const FlagWriteRequest &request = _writeRequests[i];
+		size_t index = _seqIndexTable->Value(request.antenna1, request.antenna2, request.spectralWindow, request.sequenceId);
+		order.push_back(std::pair<size_t, size_t>(_filePositions[index], i));
+	}
+	std::sort(order.begin(), order.end());
+	
+	for(std::vector<std::pair<size_t, size_t> >::const_iterator i=order.begin();i!=order.end();++i)
+	{
+		const FlagWriteRequest &request = _writeRequests[i->second];
 		performFlagWriteTask(request.flags, request.antenna1, request.antenna2, request.spectralWindow, request.sequenceId);
 	}
 	_writeRequests.clear();
@@ -467,7 +484,7 @@ void IndirectBaselineReader::updateOriginalMS()
 	std::vector<size_t> updatedFilePos = _filePositions;
 	std::vector<size_t> timePositions(updatedFilePos.size(), size_t(-1));
 	double prevTime = -1.0;
-	size_t timeIndex = size_t(-1);
+	size_t timeIndex = size_t(-1), unchangedFlagRows = 0;
 	for(int rowIndex = 0; rowIndex!=rowCount; ++rowIndex)
 	{
 		size_t fieldId = fieldIdColumn(rowIndex);
@@ -524,7 +541,12 @@ void IndirectBaselineReader::updateOriginalMS()
 			if(flagFile.fail())
 				throw std::runtime_error("Error: failed to read temporary flag files!");
 			
-			flagColumn.basePut(rowIndex, flagArray);
+			// Rows of which the flags did not change are not rewritten
+			const casacore::Array<bool> oldFlagArray = flagColumn(rowIndex);
+			if(!oldFlagArray.shape().isEqual(shape) || !std::equal(flagArray.cbegin(), flagArray.cend(), oldFlagArray.cbegin()))
+				flagColumn.basePut(rowIndex, flagArray);
+			else
+				++unchangedFlagRows;
 		}
 		
 		filePos += sampleCount;
@@ -539,7 +561,7 @@ void IndirectBaselineReader::updateOriginalMS()
 	if(UpdateData)
 		AOLogger::Debug << "Done updating measurement set data\n";
 	if(UpdateFlags)
-		AOLogger::Debug << "Done updating measurement set flags\n";
+		AOLogger::Debug << "Done updating measurement set flags, " << unchangedFlagRows << "/" << rowCount << " rows were unchanged\n";
 }
 
 void IndirectBaselineReader::updateOriginalMSData()
@@ -331,19 +331,25 @@ void MemoryBaselineReader::writeFlags()
 
 bool MemoryBaselineReader::IsEnoughMemoryAvailable(const std::string &filename)
 {
-	uint64_t size = MeasurementSetDataSize(filename);
+	return IsEnoughMemoryAvailable(MeasurementSetDataSize(filename), true);
+}
+
+bool MemoryBaselineReader::IsEnoughMemoryAvailable(uint64_t size, bool report)
+{
 	uint64_t totalMem = System::TotalMemory();
 	
 	if(size * 2 >= totalMem)
 	{
-		AOLogger::Warn
-			<< (size/1000000) << " MB required, but " << (totalMem/1000000) << " MB available.\n"
-			"Because this is not at least twice as much, direct read mode (slower!) will be used.\n";
+		if(report)
+			AOLogger::Warn
+				<< (size/1000000) << " MB required, but " << (totalMem/1000000) << " MB available.\n"
+				"Because this is not at least twice as much, direct read mode (slower!) will be used.\n";
 		return false;
 	} else {
-		AOLogger::Debug
-			<< (size/1000000) << " MB required, " << (totalMem/1000000)
-			<< " MB available: will use memory read mode.\n";
+		if(report)
+			AOLogger::Debug
+				<< (size/1000000) << " MB required, " << (totalMem/1000000)
+				<< " MB available: will use memory read mode.\n";
 		return true;
 	}
 }
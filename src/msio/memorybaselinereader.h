@@ -34,6 +34,12 @@ class MemoryBaselineReader : public BaselineReader {
 		
 		static bool IsEnoughMemoryAvailable(const std::string &msFile);
 		
+		/**
+		 * Like IsEnoughMemoryAvailable(msFile), for a set with the given data size in bytes.
+		 * When @p report is false, the decision is not logged.
+		 */
+		static bool IsEnoughMemoryAvailable(uint64_t size, bool report);
+		
 		virtual size_t GetMinRecommendedBufferSize(size_t /*threadCount*/) { return 1; }
 		virtual size_t GetMaxRecommendedBufferSize(size_t /*threadCount*/) { return 2; }
 	private:
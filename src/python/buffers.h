@@ -0,0 +1,75 @@
+#ifndef PYTHON_BUFFERS_H
+#define PYTHON_BUFFERS_H
+
+#include "../structures/image2d.h"
+#include "../structures/mask2d.h"
+
+#include <boost/python/dict.hpp>
+#include <boost/python/tuple.hpp>
+
+namespace aoflagger_python
+{
+	/**
+	 * Makes the numpy array interface (version 3) for a two-dimensional buffer.
+	 * Rows are padded up to the stride, so the row stride is given explicitly.
+	 */
+	inline boost::python::dict make_array_interface(const void* data, bool isReadOnly, const char* typeString, size_t elementSize, size_t width, size_t height, size_t stride)
+	{
+		boost::python::dict interface;
+		interface["version"] = 3;
+		interface["typestr"] = typeString;
+		interface["shape"] = boost::python::make_tuple(height, width);
+		interface["strides"] = boost::python::make_tuple(stride * elementSize, elementSize);
+		interface["data"] = boost::python::make_tuple(reinterpret_cast<size_t>(data), isReadOnly);
+		return interface;
+	}
+
+	/**
+	 * Read-only view on an image of a Data object. It supports the numpy
+	 * array interface, so numpy.asarray() gives a float32 array of
+	 * height x width without copying the image. The view keeps the image
+	 * alive, also when the Data object changes.
+	 */
+	class ImageBuffer
+	{
+	public:
+		explicit ImageBuffer(const Image2DCPtr& image) : _image(image)
+		{ }
+
+		boost::python::dict array_interface() const
+		{
+			return make_array_interface(_image->Data(), true, sizeof(num_t) == 4 ? "<f4" : "<f8", sizeof(num_t), _image->Width(), _image->Height(), _image->Stride());
+		}
+
+		size_t width() const { return _image->Width(); }
+		size_t height() const { return _image->Height(); }
+
+	private:
+		Image2DCPtr _image;
+	};
+
+	/**
+	 * Writable view on a mask of a Data object. It supports the numpy
+	 * array interface, so numpy.asarray() gives a boolean array of
+	 * height x width that writes directly into the mask.
+	 */
+	class MaskBuffer
+	{
+	public:
+		explicit MaskBuffer(const Mask2DPtr& mask) : _mask(mask)
+		{ }
+
+		boost::python::dict array_interface() const
+		{
+			return make_array_interface(_mask->Data(), false, "|b1", sizeof(bool), _mask->Width(), _mask->Height(), _mask->Stride());
+		}
+
+		size_t width() const { return _mask->Width(); }
+		size_t height() const { return _mask->Height(); }
+
+	private:
+		Mask2DPtr _mask;
+	};
+}
+
+#endif
@@ -1,10 +1,18 @@
 #ifndef PYTHON_DATA_H
 #define PYTHON_DATA_H
 
+#include "buffers.h"
+
 #include "../structures/timefrequencydata.h"
 
 #include <boost/python/list.hpp>
 
+#include <boost/weak_ptr.hpp>
+
+#include <vector>
+
+#include "scopedgil.h"
+
 namespace aoflagger_python
 {
 	class Data
@@ -15,8 +23,26 @@ namespace aoflagger_python
 		Data(const TimeFrequencyData& tfData) : _tfData(tfData)
 		{ }
 		
+		/**
+		 * After a copy, the masks are shared by both objects, so neither
+		 * of them may hand out views without copying the mask first.
+		 */
+		Data(const Data& source) : _tfData(source._tfData)
+		{
+			source._writableMasks.clear();
+		}
+		
+		Data& operator=(const Data& source)
+		{
+			_tfData = source._tfData;
+			_writableMasks.clear();
+			source._writableMasks.clear();
+			return *this;
+		}
+		
 		Data operator-(const Data& other) const
 		{
+			ScopedGILRelease gilRelease;
 			std::unique_ptr<TimeFrequencyData> diff(
 				TimeFrequencyData::CreateTFDataFromDiff(_tfData, other.TFData())
 			);
@@ -30,11 +56,13 @@ namespace aoflagger_python
 		
 		Data convert_to_polarization(PolarizationEnum polarization) const
 		{
+			ScopedGILRelease gilRelease;
 			return Data(_tfData.Make(polarization));
 		}
 		
 		Data convert_to_complex(enum TimeFrequencyData::ComplexRepresentation complexRepresentation) const
 		{
+			ScopedGILRelease gilRelease;
 			return Data(_tfData.Make(complexRepresentation));
 		}
 		
@@ -45,17 +73,57 @@ namespace aoflagger_python
 		
 		void join_mask(const Data& other)
 		{
+			ScopedGILRelease gilRelease;
 			_tfData.JoinMask(other._tfData);
 		}
 		
 		Data make_complex() const
 		{
+			ScopedGILRelease gilRelease;
 			std::unique_ptr<TimeFrequencyData> newTFData(
 				_tfData.CreateTFDataFromComplexCombination(_tfData, _tfData)
 			);
 			return Data(*newTFData);
 		}
 		
+		/**
+		 * Returns a read-only numpy-compatible view on the image with the given index.
+		 */
+		ImageBuffer get_image(size_t index) const
+		{
+			return ImageBuffer(_tfData.GetImage(index));
+		}
+		
+		/**
+		 * Returns a writable numpy-compatible view on the mask with the given index.
+		 * When the mask is shared with other Data objects, it is first replaced by
+		 * a copy, so that changes made through the view do not affect them. Later
+		 * views on the same mask refer to that copy, so that they all see each
+		 * other's changes. Data objects that are copied from this one while a view is
+		 * alive do share the mask with the view. If the data has no mask yet,
+		 * an unflagged mask is created.
+		 */
+		MaskBuffer get_mask(size_t index)
+		{
+			if(_tfData.MaskCount() == 0)
+				_tfData.SetGlobalMask(Mask2D::CreateSetMaskPtr<false>(_tfData.ImageWidth(), _tfData.ImageHeight()));
+			if(!isWritable(_tfData.GetMask(index)))
+			{
+				if(!_tfData.GetMask(index).unique())
+					_tfData.SetMask(index, Mask2D::CreateCopy(_tfData.GetMask(index)));
+				_writableMasks.push_back(boost::weak_ptr<const Mask2D>(_tfData.GetMask(index)));
+			}
+			return MaskBuffer(boost::const_pointer_cast<Mask2D>(_tfData.GetMask(index)));
+		}
+		
+		size_t height() const { return _tfData.ImageHeight(); }
+		
+		size_t image_count() const { return _tfData.ImageCount(); }
+		
+		size_t mask_count() const { return _tfData.MaskCount(); }
+		
+		size_t width() const { return _tfData.ImageWidth(); }
+		
 		boost::python::list polarizations() const
 		{
 			const std::vector<PolarizationEnum> pols = _tfData.Polarizations();
@@ -89,7 +157,27 @@ namespace aoflagger_python
 		const TimeFrequencyData& TFData() const { return _tfData; }
 		
 	private:
+		/**
+		 * Whether the mask was made exclusive to this object by get_mask(). The views
+		 * keep such masks alive, so they are no longer unique, but need no copy.
+		 */
+		bool isWritable(const Mask2DCPtr& mask)
+		{
+			for(std::vector<boost::weak_ptr<const Mask2D>>::iterator i=_writableMasks.begin(); i!=_writableMasks.end();)
+			{
+				if(i->expired())
+					i = _writableMasks.erase(i);
+				else if(i->lock() == mask)
+					return true;
+				else
+					++i;
+			}
+			return false;
+		}
+		
 		TimeFrequencyData _tfData;
+		// Masks of _tfData that are not shared with other Data objects
+		mutable std::vector<boost::weak_ptr<const Mask2D>> _writableMasks;
 	};
 }
 
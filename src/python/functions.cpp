@@ -1,4 +1,5 @@
 #include "functions.h"
+#include "scopedgil.h"
 
 #include "../strategy/algorithms/highpassfilter.h"
 #include "../strategy/algorithms/medianwindow.h"
@@ -21,6 +22,7 @@ static object flagFunction;
 
 void enlarge(const Data& input, Data& destination, size_t horizontalFactor, size_t verticalFactor)
 {
+	ScopedGILRelease gilRelease;
 	TimeFrequencyData timeFrequencyData = input.TFData();
 	const size_t
 		imageCount = timeFrequencyData.ImageCount(),
@@ -61,6 +63,7 @@ object get_flag_function()
 	
 void low_pass_filter(Data& data, size_t kernelWidth, size_t kernelHeight, double horizontalSigmaSquared, double verticalSigmaSquared)
 {
+	ScopedGILRelease gilRelease;
 	if(data.TFData().PolarizationCount() != 1)
 		throw std::runtime_error("High-pass filtering needs single polarization");
 	HighPassFilter filter;
@@ -77,6 +80,7 @@ void low_pass_filter(Data& data, size_t kernelWidth, size_t kernelHeight, double
 
 void high_pass_filter(Data& data, size_t kernelWidth, size_t kernelHeight, double horizontalSigmaSquared, double verticalSigmaSquared)
 {
+	ScopedGILRelease gilRelease;
 	if(data.TFData().PolarizationCount() != 1)
 		throw std::runtime_error("High-pass filtering needs single polarization");
 	HighPassFilter filter;
@@ -93,6 +97,7 @@ void high_pass_filter(Data& data, size_t kernelWidth, size_t kernelHeight, doubl
 
 void scale_invariant_rank_operator(Data& data, double level_horizontal, double level_vertical)
 {
+	ScopedGILRelease gilRelease;
 	Mask2DPtr mask = Mask2D::CreateCopy(data.TFData().GetSingleMask());
 	
 	SIROperator::OperateHorizontally(mask, level_horizontal);
@@ -107,6 +112,7 @@ void set_flag_function(PyObject* callable)
 
 Data shrink(const Data& data, size_t horizontalFactor, size_t verticalFactor)
 {
+	ScopedGILRelease gilRelease;
 	TimeFrequencyData timeFrequencyData = data.TFData();
 	const size_t imageCount = timeFrequencyData.ImageCount();
 	const size_t maskCount = timeFrequencyData.MaskCount();
@@ -147,6 +153,7 @@ Data shrink(const Data& data, size_t horizontalFactor, size_t verticalFactor)
 
 void sumthreshold(Data& data, double thresholdFactor, bool horizontal, bool vertical)
 {
+	ScopedGILRelease gilRelease;
 	ThresholdConfig thresholdConfig;
 	thresholdConfig.InitializeLengthsDefault();
 	thresholdConfig.InitializeThresholdsFromFirstThreshold(6.0L, ThresholdConfig::Rayleigh);
@@ -166,6 +173,7 @@ void sumthreshold(Data& data, double thresholdFactor, bool horizontal, bool vert
 
 void threshold_channel_rms(Data& data, double threshold, bool thresholdLowValues)
 {
+	ScopedGILRelease gilRelease;
 	Image2DCPtr image = data.TFData().GetSingleImage();
 	SampleRowPtr channels = SampleRow::CreateEmpty(image->Height());
 	Mask2DPtr mask = Mask2D::CreateCopy(data.TFData().GetSingleMask());
@@ -195,6 +203,7 @@ void threshold_channel_rms(Data& data, double threshold, bool thresholdLowValues
 
 void threshold_timestep_rms(Data& data, double threshold)
 {
+	ScopedGILRelease gilRelease;
 	Image2DCPtr image = data.TFData().GetSingleImage();
 	SampleRowPtr timesteps = SampleRow::CreateEmpty(image->Width());
 	Mask2DPtr mask = Mask2D::CreateCopy(data.TFData().GetSingleMask());
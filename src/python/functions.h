@@ -4,6 +4,11 @@
 
 #include <boost/python/object.hpp>
 
+/**
+ * The functions of the aoflagger Python module. Except for get_flag_function() and
+ * set_flag_function(), they release the GIL while they process the data, so that
+ * several Python threads can flag at the same time.
+ */
 namespace aoflagger_python
 {	
 	boost::python::object get_flag_function();
@@ -15,11 +15,27 @@ BOOST_PYTHON_MODULE(aoflagger)
 		.def("clear_mask", &aoflagger_python::Data::clear_mask)
 		.def("convert_to_polarization", &aoflagger_python::Data::convert_to_polarization)
 		.def("convert_to_complex", &aoflagger_python::Data::convert_to_complex)
+		.def("get_image", &aoflagger_python::Data::get_image)
+		.def("get_mask", &aoflagger_python::Data::get_mask)
+		.def("height", &aoflagger_python::Data::height)
+		.def("image_count", &aoflagger_python::Data::image_count)
 		.def("join_mask", &aoflagger_python::Data::join_mask)
 		.def("make_complex", &aoflagger_python::Data::make_complex)
+		.def("mask_count", &aoflagger_python::Data::mask_count)
 		.def("polarizations", &aoflagger_python::Data::polarizations)
 		.def("set_image", &aoflagger_python::Data::set_image)
-		.def("set_polarization_data", &aoflagger_python::Data::set_polarization_data);
+		.def("set_polarization_data", &aoflagger_python::Data::set_polarization_data)
+		.def("width", &aoflagger_python::Data::width);
+	
+	class_<aoflagger_python::ImageBuffer>("ImageBuffer", no_init)
+		.add_property("__array_interface__", &aoflagger_python::ImageBuffer::array_interface)
+		.def("height", &aoflagger_python::ImageBuffer::height)
+		.def("width", &aoflagger_python::ImageBuffer::width);
+	
+	class_<aoflagger_python::MaskBuffer>("MaskBuffer", no_init)
+		.add_property("__array_interface__", &aoflagger_python::MaskBuffer::array_interface)
+		.def("height", &aoflagger_python::MaskBuffer::height)
+		.def("width", &aoflagger_python::MaskBuffer::width);
 
 	def("enlarge", aoflagger_python::enlarge);
 	def("high_pass_filter", aoflagger_python::high_pass_filter);
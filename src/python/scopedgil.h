@@ -0,0 +1,55 @@
+#ifndef PYTHON_SCOPED_GIL_H
+#define PYTHON_SCOPED_GIL_H
+
+#include <Python.h>
+
+namespace aoflagger_python
+{
+	/**
+	 * Releases the global interpreter lock for the lifetime of the object,
+	 * so that other Python threads can run while a native kernel is busy.
+	 * No Python objects may be touched while the lock is released.
+	 */
+	class ScopedGILRelease
+	{
+	public:
+		ScopedGILRelease() : _state(PyEval_SaveThread())
+		{ }
+
+		~ScopedGILRelease()
+		{
+			PyEval_RestoreThread(_state);
+		}
+
+	private:
+		ScopedGILRelease(const ScopedGILRelease&) = delete;
+		ScopedGILRelease& operator=(const ScopedGILRelease&) = delete;
+
+		PyThreadState* _state;
+	};
+
+	/**
+	 * Acquires the global interpreter lock for the lifetime of the object.
+	 * This can be used from any thread, including threads that were not
+	 * created by Python.
+	 */
+	class ScopedGILAcquire
+	{
+	public:
+		ScopedGILAcquire() : _state(PyGILState_Ensure())
+		{ }
+
+		~ScopedGILAcquire()
+		{
+			PyGILState_Release(_state);
+		}
+
+	private:
+		ScopedGILAcquire(const ScopedGILAcquire&) = delete;
+		ScopedGILAcquire& operator=(const ScopedGILAcquire&) = delete;
+
+		PyGILState_STATE _state;
+	};
+}
+
+#endif
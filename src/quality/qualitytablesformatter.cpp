@@ -491,6 +491,52 @@ void QualityTablesFormatter::QueryTimeStatistic(unsigned kindIndex, std::vector<
 	}
 }
 
+void QualityTablesFormatter::QueryTimeStatisticPositions(std::vector<unsigned> &kindIndices, std::vector<TimePosition> &positions)
+{
+	casacore::Table &table(getTable(TimeStatisticTable, false));
+	const unsigned nrRow = table.nrow();
+	
+	// Reading the scalar columns at once is much faster than reading them row by row
+	casacore::Vector<double> times = casacore::ROScalarColumn<double>(table, ColumnNameTime).getColumn();
+	casacore::Vector<double> frequencies = casacore::ROScalarColumn<double>(table, ColumnNameFrequency).getColumn();
+	casacore::Vector<int> kinds = casacore::ROScalarColumn<int>(table, ColumnNameKind).getColumn();
+	
+	kindIndices.resize(nrRow);
+	positions.resize(nrRow);
+	for(unsigned i=0;i<nrRow;++i)
+	{
+		kindIndices[i] = kinds[i];
+		positions[i].time = times[i];
+		positions[i].frequency = frequencies[i];
+	}
+}
+
+void QualityTablesFormatter::QueryTimeStatisticValues(const std::vector<unsigned> &rows, std::vector<StatisticalValue> &values)
+{
+	casacore::Table &table(getTable(TimeStatisticTable, false));
+	casacore::ROScalarColumn<int> kindColumn(table, ColumnNameKind);
+	casacore::ROArrayColumn<casacore::Complex> valueColumn(table, ColumnNameValue);
+	
+	int polarizationCount = valueColumn.columnDesc().shape()[0];
+	
+	values.clear();
+	values.reserve(rows.size());
+	casacore::Array<casacore::Complex> valueArray;
+	for(std::vector<unsigned>::const_iterator row=rows.begin();row!=rows.end();++row)
+	{
+		StatisticalValue value(polarizationCount);
+		value.SetKindIndex(kindColumn(*row));
+		valueColumn.get(*row, valueArray, true);
+		casacore::Array<casacore::Complex>::const_iterator iter = valueArray.begin();
+		for(int p=0;p<polarizationCount;++p)
+		{
+			value.SetValue(p, *iter);
+			++iter;
+		}
+		values.push_back(value);
+	}
+}
+
 void QualityTablesFormatter::QueryFrequencyStatistic(unsigned kindIndex, std::vector<std::pair<FrequencyPosition, StatisticalValue> > &entries)
 {
 	casacore::Table &table(getTable(FrequencyStatisticTable, false));
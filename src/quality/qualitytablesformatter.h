@@ -243,6 +243,21 @@ class QualityTablesFormatter {
 		void QueryBaselineStatistic(unsigned kindIndex, std::vector<std::pair<BaselinePosition, class StatisticalValue> > &entries);
 		void QueryBaselineTimeStatistic(unsigned kindIndex, std::vector<std::pair<BaselineTimePosition, class StatisticalValue> > &entries);
 		
+		/**
+		 * Reads the kind index and position of every row in the time statistic table,
+		 * without reading the values. Rows can be indexed this way without the cost of
+		 * the value column, and their values can be read later with
+		 * QueryTimeStatisticValues().
+		 */
+		void QueryTimeStatisticPositions(std::vector<unsigned> &kindIndices, std::vector<TimePosition> &positions);
+		
+		/**
+		 * Reads the values of the given rows in the time statistic table.
+		 * @param rows Row numbers, preferably in increasing order.
+		 * @param values Receives one value for each row.
+		 */
+		void QueryTimeStatisticValues(const std::vector<unsigned> &rows, std::vector<class StatisticalValue> &values);
+		
 		unsigned GetPolarizationCount();
 	private:
 		QualityTablesFormatter(const QualityTablesFormatter &) = delete; // don't allow copies
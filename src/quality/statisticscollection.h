@@ -54,6 +54,11 @@ class StatisticsCollection : public Serializable
 			_baselineStatistics.clear();
 		}
 		
+		void ClearTimeStatistics()
+		{
+			_timeStatistics.clear();
+		}
+		
 		void InitializeBand(unsigned band, const double *frequencies, unsigned channelCount)
 		{
 			std::vector<DefaultStatistics *> pointers;
@@ -105,6 +110,25 @@ class StatisticsCollection : public Serializable
 			loadTime<false>(qualityData);
 		}
 		
+		void LoadFrequencyStatisticsOnly(QualityTablesFormatter &qualityData)
+		{
+			loadFrequency<false>(qualityData);
+		}
+		
+		void LoadBaselineStatisticsOnly(QualityTablesFormatter &qualityData)
+		{
+			loadBaseline<false>(qualityData);
+		}
+		
+		/**
+		 * Adds a single value of one of the default statistic kinds, as read from the
+		 * time statistic table, to the time statistic at the given position.
+		 */
+		void AddTimeStatistic(double time, double frequency, const StatisticalValue &value, QualityTablesFormatter::StatisticKind kind)
+		{
+			assignStatistic<true>(getTimeStatistic(time, frequency), value, kind);
+		}
+		
 		void Add(QualityTablesFormatter &qualityData)
 		{
 			loadTime<true>(qualityData);
@@ -0,0 +1,182 @@
+#include "timestatisticsindex.h"
+
+#include "statisticalvalue.h"
+#include "statisticscollection.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace {
+	/**
+	 * The kinds that make up a DefaultStatistics object; other kinds in the table are not indexed.
+	 */
+	const QualityTablesFormatter::StatisticKind defaultKinds[] = {
+		QualityTablesFormatter::CountStatistic,
+		QualityTablesFormatter::SumStatistic,
+		QualityTablesFormatter::SumP2Statistic,
+		QualityTablesFormatter::DCountStatistic,
+		QualityTablesFormatter::DSumStatistic,
+		QualityTablesFormatter::DSumP2Statistic,
+		QualityTablesFormatter::RFICountStatistic
+	};
+
+	/**
+	 * Number of rows whose values are read at once.
+	 */
+	const size_t readBlockSize = 65536;
+}
+
+TimeStatisticsIndex::TimeStatisticsIndex(const std::vector<std::string> &filenames) :
+	_filenames(filenames),
+	_cachedStartTime(0.0),
+	_cachedEndTime(0.0),
+	_cachedMaxSteps(0)
+{
+	for(unsigned i=0; i!=_filenames.size(); ++i)
+		readFile(i);
+	std::stable_sort(_entries.begin(), _entries.end());
+
+	if(!_entries.empty())
+	{
+		// The steps of the first frequency of the first file with time statistics are
+		// used as reference
+		unsigned referenceFile = _entries.front().file;
+		for(std::vector<Entry>::const_iterator i=_entries.begin(); i!=_entries.end(); ++i)
+		{
+			if(i->file < referenceFile)
+				referenceFile = i->file;
+		}
+		double referenceFrequency = 0.0;
+		bool hasReference = false;
+		for(std::vector<Entry>::const_iterator i=_entries.begin(); i!=_entries.end(); ++i)
+		{
+			if(i->file == referenceFile)
+			{
+				if(!hasReference || i->frequency < referenceFrequency)
+					referenceFrequency = i->frequency;
+				hasReference = true;
+			}
+		}
+		for(std::vector<Entry>::const_iterator i=_entries.begin(); i!=_entries.end(); ++i)
+		{
+			if(i->file == referenceFile && i->frequency == referenceFrequency && (_referenceTimes.empty() || _referenceTimes.back() != i->time))
+				_referenceTimes.push_back(i->time);
+		}
+	}
+}
+
+TimeStatisticsIndex::~TimeStatisticsIndex()
+{ }
+
+void TimeStatisticsIndex::readFile(unsigned fileIndex)
+{
+	QualityTablesFormatter qualityTables(_filenames[fileIndex]);
+	if(!qualityTables.TableExists(QualityTablesFormatter::KindNameTable) || !qualityTables.TableExists(QualityTablesFormatter::TimeStatisticTable))
+		return;
+
+	std::map<unsigned, QualityTablesFormatter::StatisticKind> kinds;
+	for(size_t k=0; k!=sizeof(defaultKinds)/sizeof(defaultKinds[0]); ++k)
+	{
+		unsigned kindIndex;
+		if(qualityTables.QueryKindIndex(defaultKinds[k], kindIndex))
+			kinds.insert(std::make_pair(kindIndex, defaultKinds[k]));
+	}
+
+	std::vector<unsigned> kindIndices;
+	std::vector<QualityTablesFormatter::TimePosition> positions;
+	qualityTables.QueryTimeStatisticPositions(kindIndices, positions);
+	for(unsigned row=0; row!=positions.size(); ++row)
+	{
+		std::map<unsigned, QualityTablesFormatter::StatisticKind>::const_iterator kind = kinds.find(kindIndices[row]);
+		if(kind != kinds.end())
+		{
+			Entry entry;
+			entry.time = positions[row].time;
+			entry.frequency = positions[row].frequency;
+			entry.file = fileIndex;
+			entry.row = row;
+			entry.kind = kind->second;
+			_entries.push_back(entry);
+		}
+	}
+}
+
+size_t TimeStatisticsIndex::TimestepCount(double startTime, double endTime) const
+{
+	return std::upper_bound(_referenceTimes.begin(), _referenceTimes.end(), endTime) -
+		std::lower_bound(_referenceTimes.begin(), _referenceTimes.end(), startTime);
+}
+
+void TimeStatisticsIndex::Load(StatisticsCollection &collection, double startTime, double endTime, size_t maxSteps)
+{
+	if(_cachedGrid == 0 || _cachedStartTime != startTime || _cachedEndTime != endTime || _cachedMaxSteps != maxSteps || _cachedGrid->PolarizationCount() != collection.PolarizationCount())
+	{
+		Entry startEntry, endEntry;
+		startEntry.time = startTime;
+		endEntry.time = endTime;
+		const std::vector<Entry>::const_iterator
+			begin = std::lower_bound(_entries.begin(), _entries.end(), startEntry),
+			end = std::upper_bound(_entries.begin(), _entries.end(), endEntry);
+
+		// Grid like StatisticsCollection::LowerTimeResolution() does
+		const size_t stepCount = TimestepCount(startTime, endTime);
+		const bool isGridded = stepCount > maxSteps && maxSteps > 0;
+		double gridStart = startTime, gridStep = endTime - startTime;
+		if(isGridded && maxSteps > 1)
+		{
+			const double oldGridStep = (endTime - startTime) / (stepCount - 1);
+			gridStep = (endTime - startTime + oldGridStep) / maxSteps;
+			gridStart = startTime - 0.5*oldGridStep;
+		}
+
+		std::vector<std::vector<Target> > targets(_filenames.size());
+		for(std::vector<Entry>::const_iterator i=begin; i!=end; ++i)
+		{
+			Target target;
+			target.row = i->row;
+			target.frequency = i->frequency;
+			target.kind = i->kind;
+			if(isGridded)
+			{
+				size_t gridIndex = (size_t) std::max(0.0, floor((i->time - gridStart) / gridStep));
+				if(gridIndex >= maxSteps)
+					gridIndex = maxSteps - 1;
+				target.time = (gridIndex+0.5)*gridStep + gridStart;
+			}
+			else
+				target.time = i->time;
+			targets[i->file].push_back(target);
+		}
+
+		_cachedGrid.reset(new StatisticsCollection(collection.PolarizationCount()));
+		for(size_t file=0; file!=_filenames.size(); ++file)
+		{
+			std::vector<Target> &fileTargets = targets[file];
+			if(fileTargets.empty())
+				continue;
+			// Reading in row order prevents seeking through the value column
+			std::sort(fileTargets.begin(), fileTargets.end());
+			QualityTablesFormatter qualityTables(_filenames[file]);
+			std::vector<unsigned> rows;
+			std::vector<StatisticalValue> values;
+			for(size_t blockStart=0; blockStart<fileTargets.size(); blockStart+=readBlockSize)
+			{
+				const size_t blockEnd = std::min(blockStart + readBlockSize, fileTargets.size());
+				rows.clear();
+				for(size_t i=blockStart; i!=blockEnd; ++i)
+					rows.push_back(fileTargets[i].row);
+				qualityTables.QueryTimeStatisticValues(rows, values);
+				for(size_t i=blockStart; i!=blockEnd; ++i)
+				{
+					const Target &target = fileTargets[i];
+					_cachedGrid->AddTimeStatistic(target.time, target.frequency, values[i - blockStart], target.kind);
+				}
+			}
+		}
+		_cachedStartTime = startTime;
+		_cachedEndTime = endTime;
+		_cachedMaxSteps = maxSteps;
+	}
+	collection.Add(*_cachedGrid);
+}
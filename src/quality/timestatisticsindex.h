@@ -0,0 +1,107 @@
+#ifndef QUALITY__TIME_STATISTICS_INDEX_H
+#define QUALITY__TIME_STATISTICS_INDEX_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "qualitytablesformatter.h"
+
+/**
+ * Index over the time statistics in the quality tables of one or more measurement
+ * sets. The time statistics are by far the largest part of the quality tables;
+ * instead of reading them all into a StatisticsCollection, the index only reads the
+ * position of each row, and reads the values of a time range when they are needed.
+ *
+ * The index has two levels of resolution: the rows themselves, which are read when
+ * a range has no more time steps than requested, and a grid of at most the requested
+ * number of steps, on which the rows are integrated while they are read. The most
+ * recently loaded grid is kept, so that pages that show the same range at the same
+ * resolution do not read the tables again.
+ */
+class TimeStatisticsIndex
+{
+	public:
+		/**
+		 * Reads the positions of the time statistics of the given measurement sets.
+		 */
+		explicit TimeStatisticsIndex(const std::vector<std::string> &filenames);
+
+		~TimeStatisticsIndex();
+
+		bool Empty() const { return _entries.empty(); }
+
+		/**
+		 * First time step of the statistics; the index should not be empty.
+		 */
+		double StartTime() const { return _referenceTimes.front(); }
+
+		/**
+		 * Last time step of the statistics; the index should not be empty.
+		 */
+		double EndTime() const { return _referenceTimes.back(); }
+
+		/**
+		 * Number of time steps between the given times, inclusive, as counted in the
+		 * first frequency of the first measurement set that has time statistics.
+		 */
+		size_t TimestepCount(double startTime, double endTime) const;
+
+		size_t TimestepCount() const { return _referenceTimes.size(); }
+
+		/**
+		 * Reads the time statistics between the given times (inclusive) and adds them to
+		 * the collection. If the range has more than maxSteps time steps, the statistics
+		 * are integrated onto a regular grid of maxSteps steps, otherwise they are read at
+		 * full resolution. A maxSteps of zero always reads at full resolution.
+		 * @param collection Collection that receives the statistics. It should have the
+		 * polarization count of the measurement sets.
+		 */
+		void Load(class StatisticsCollection &collection, double startTime, double endTime, size_t maxSteps);
+
+		/**
+		 * Reads all time statistics at a resolution of at most maxSteps time steps.
+		 */
+		void Load(class StatisticsCollection &collection, size_t maxSteps)
+		{
+			if(!Empty())
+				Load(collection, StartTime(), EndTime(), maxSteps);
+		}
+
+	private:
+		TimeStatisticsIndex(const TimeStatisticsIndex&) = delete;
+		void operator=(const TimeStatisticsIndex&) = delete;
+
+		struct Entry
+		{
+			double time, frequency;
+			unsigned file, row;
+			QualityTablesFormatter::StatisticKind kind;
+
+			bool operator<(const Entry &rhs) const { return time < rhs.time; }
+		};
+
+		/**
+		 * Entry positions after gridding, to be read from one file.
+		 */
+		struct Target
+		{
+			unsigned row;
+			double time, frequency;
+			QualityTablesFormatter::StatisticKind kind;
+
+			bool operator<(const Target &rhs) const { return row < rhs.row; }
+		};
+
+		void readFile(unsigned fileIndex);
+
+		std::vector<std::string> _filenames;
+		std::vector<Entry> _entries;
+		std::vector<double> _referenceTimes;
+
+		std::unique_ptr<class StatisticsCollection> _cachedGrid;
+		double _cachedStartTime, _cachedEndTime;
+		size_t _cachedMaxSteps;
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "client.h"
 
+#include <algorithm>
 #include <typeinfo>
 
 #include <boost/asio/read.hpp>
@@ -14,6 +15,7 @@
 
 #include "format.h"
 #include "processcommander.h"
+#include "rowblockcodec.h"
 
 #include "../structures/antennainfo.h"
 #include "../structures/measurementset.h"
@@ -22,7 +24,9 @@ namespace aoRemote
 {
 
 Client::Client()
-	: _socket(_ioService)
+	: _socket(_ioService),
+	_protocolVersion(AO_REMOTE_PROTOCOL_VERSION),
+	_compressRows(false)
 {
 }
 
@@ -43,12 +47,20 @@ void Client::Run(const std::string &serverHost)
 		struct InitialBlock initialBlock;
 		boost::asio::read(_socket, boost::asio::buffer(&initialBlock, sizeof(initialBlock)));
 		
+		// Servers always offer version 1 for the sake of old clients, and announce row block
+		// support with an option; use the highest version both sides speak
+		int offeredVersion = initialBlock.protocolVersion;
+		if((initialBlock.options & INITIAL_OPTION_ROW_BLOCKS) != 0)
+			offeredVersion = std::max<int>(offeredVersion, AO_REMOTE_ROW_BLOCK_PROTOCOL_VERSION);
+		_protocolVersion = std::min<int>(offeredVersion, AO_REMOTE_PROTOCOL_VERSION);
+		_compressRows = (initialBlock.options & INITIAL_OPTION_COMPRESS_ROWS) != 0;
+		
 		struct InitialResponseBlock initialResponse;
 		initialResponse.blockIdentifier = InitialResponseId;
 		initialResponse.blockSize = sizeof(initialResponse);
-		initialResponse.negotiatedProtocolVersion = AO_REMOTE_PROTOCOL_VERSION;
+		initialResponse.negotiatedProtocolVersion = _protocolVersion;
 		initialResponse.hostNameSize = hostname.AsString().size();
-		if(initialBlock.protocolVersion != AO_REMOTE_PROTOCOL_VERSION || initialBlock.blockSize != sizeof(initialBlock) || initialBlock.blockIdentifier != InitialId)
+		if(_protocolVersion < AO_REMOTE_MIN_PROTOCOL_VERSION || initialBlock.blockSize != sizeof(initialBlock) || initialBlock.blockIdentifier != InitialId)
 		{
 			initialResponse.errorCode = ProtocolNotUnderstoodError;
 			boost::asio::write(_socket, boost::asio::buffer(&initialResponse, sizeof(initialResponse)));
@@ -279,6 +291,7 @@ void Client::handleReadDataRows(unsigned dataSize)
 			else
 				throw std::runtime_error("Unknown shape of DATA column");
 			const size_t samplesPerRow = polarizationCount * channelCount;
+			std::vector<MSRowDataExt> rows(options.rowCount);
 			
 			// Read and serialize the rows
 			const size_t endRow = options.startRow + options.rowCount;
@@ -288,7 +301,8 @@ void Client::handleReadDataRows(unsigned dataSize)
 				const casacore::Array<casacore::Complex> cellData = dataCol(rowIndex);
 				casacore::Array<casacore::Complex>::const_iterator cellIter = cellData.begin();
 				
-				MSRowDataExt dataExt(polarizationCount, channelCount);
+				MSRowDataExt &dataExt = rows[rowIndex - options.startRow];
+				dataExt = MSRowDataExt(polarizationCount, channelCount);
 				MSRowData &data = dataExt.Data();
 				num_t *realPtr = data.RealPtr();
 				num_t *imagPtr = data.ImagPtr();
@@ -314,8 +328,13 @@ void Client::handleReadDataRows(unsigned dataSize)
 				dataExt.SetAntenna2(a2Column(rowIndex));
 				dataExt.SetTime(timeColumn(rowIndex));
 				dataExt.SetTimeOffsetIndex(rowIndex);
-				
-				dataExt.Serialize(buffer);
+			}
+			
+			if(_protocolVersion >= AO_REMOTE_ROW_BLOCK_PROTOCOL_VERSION)
+				RowBlockCodec::Encode(buffer, &rows[0], rows.size(), _compressRows);
+			else {
+				for(std::vector<MSRowDataExt>::const_iterator i=rows.begin(); i!=rows.end(); ++i)
+					i->Serialize(buffer);
 			}
 		}
 		
@@ -361,18 +380,27 @@ void Client::handleWriteDataRows(unsigned dataSize)
 		const size_t samplesPerRow = polarizationCount * channelCount;
 		
 		// Unserialize and write the rows
+		std::vector<MSRowDataExt> rows;
+		if(_protocolVersion >= AO_REMOTE_ROW_BLOCK_PROTOCOL_VERSION)
+		{
+			rows.resize(options.rowCount);
+			if(RowBlockCodec::Decode(stream, rows.empty() ? 0 : &rows[0], rows.size()) != options.rowCount)
+				throw std::runtime_error("Row block does not contain the number of rows that was specified");
+		}
 		casacore::Array<casacore::Complex> cellData(shape);
 		const size_t endRow = options.startRow + options.rowCount;
 		for(size_t rowIndex=options.startRow; rowIndex != endRow; ++rowIndex)
 		{
-			MSRowDataExt dataExt;
-			dataExt.Unserialize(stream);
-			MSRowData &data = dataExt.Data();
+			MSRowDataExt unserializedRow;
+			if(rows.empty())
+				unserializedRow.Unserialize(stream);
+			const MSRowDataExt &dataExt = rows.empty() ? unserializedRow : rows[rowIndex - options.startRow];
+			const MSRowData &data = dataExt.Data();
 			
 			casacore::Array<casacore::Complex>::iterator cellIter = cellData.begin();
 			
-			num_t *realPtr = data.RealPtr();
-			num_t *imagPtr = data.ImagPtr();
+			const num_t *realPtr = data.RealPtr();
+			const num_t *imagPtr = data.ImagPtr();
 			for(size_t i=0;i<samplesPerRow;++i) {
 				*cellIter = casacore::Complex(*realPtr, *imagPtr);
 				++realPtr;
@@ -20,6 +20,8 @@ class Client
 	private:
 		boost::asio::io_service _ioService;
 		boost::asio::ip::tcp::socket _socket;
+		int _protocolVersion;
+		bool _compressRows;
 		
 		void writeGenericReadException(const std::exception &e);
 		void writeGenericReadException(const std::string &s);
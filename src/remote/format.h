@@ -4,7 +4,20 @@
 #include <stdint.h>
 #include <string>
 
-#define AO_REMOTE_PROTOCOL_VERSION 1
+#define AO_REMOTE_PROTOCOL_VERSION 2
+
+// Oldest protocol version that is still understood. Version 1 sends data rows as
+// individually serialized MSRowDataExt objects, version 2 sends them as row blocks
+// (see RowBlockCodec).
+#define AO_REMOTE_MIN_PROTOCOL_VERSION 1
+#define AO_REMOTE_ROW_BLOCK_PROTOCOL_VERSION 2
+
+// Options that the server can set in InitialBlock::options
+#define INITIAL_OPTION_COMPRESS_ROWS             0x0001
+// Set by servers that understand row blocks. Version 1 clients refuse any initial
+// block that does not offer version 1, so the server always offers the oldest version
+// and uses this option to tell newer clients that they may negotiate row blocks.
+#define INITIAL_OPTION_ROW_BLOCKS                0x0002
 
 namespace aoRemote {
 
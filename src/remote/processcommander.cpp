@@ -14,7 +14,7 @@
 namespace aoRemote {
 
 ProcessCommander::ProcessCommander(const ClusteredObservation &observation)
-: _server(), _observation(observation)
+: _server(), _observation(observation), _compressRows(false)
 {
 	_server.SignalConnectionCreated().connect(boost::bind(&ProcessCommander::onConnectionCreated, this, _1, _2));
 }
@@ -197,6 +197,7 @@ void ProcessCommander::onConnectionCreated(ServerConnectionPtr serverConnection,
 	serverConnection->SignalFinishReadBandTable().connect(boost::bind(&ProcessCommander::onConnectionFinishReadBandTable, this, _1, _2));
 	serverConnection->SignalFinishReadDataRows().connect(boost::bind(&ProcessCommander::onConnectionFinishReadDataRows, this, _1, _2, _3));
 	serverConnection->SignalError().connect(boost::bind(&ProcessCommander::onError, this, _1, _2));
+	serverConnection->SetCompressRows(_compressRows);
 	acceptConnection = true;
 }
 
@@ -83,6 +83,13 @@ class ProcessCommander
 		}
 		
 		const ClusteredObservation &Observation() const { return _observation; }
+		
+		/**
+		 * Whether data rows should be compressed on the wire. This costs some cpu on both
+		 * sides, but reduces the network traffic of ReadDataRows and WriteDataRows tasks.
+		 * Only applies to connections that are created after this call.
+		 */
+		void SetCompressRows(bool compressRows) { _compressRows = compressRows; }
 	private:
 		enum Task {
 			NoTask,
@@ -129,6 +136,7 @@ class ProcessCommander
 		const ClusteredObservation &_observation;
 		NodeCommandMap _nodeCommands;
 		bool _finishConnections;
+		bool _compressRows;
 		
 		std::vector<std::string> _errors;
 		std::deque<enum Task> _tasks;
@@ -0,0 +1,266 @@
+#include "rowblockcodec.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "../structures/msrowdataext.h"
+
+#include "../util/serializable.h"
+
+namespace aoRemote
+{
+
+void RowBlockCodec::Encode(std::ostream &stream, const MSRowDataExt *rows, size_t rowCount, bool compress)
+{
+	const unsigned
+		polarizationCount = rowCount == 0 ? 0 : rows[0].Data().PolarizationCount(),
+		channelCount = rowCount == 0 ? 0 : rows[0].Data().ChannelCount();
+	const size_t samplesPerRow = polarizationCount * channelCount;
+
+	Serializable::SerializeToUInt64(stream, rowCount);
+	Serializable::SerializeToUInt32(stream, polarizationCount);
+	Serializable::SerializeToUInt32(stream, channelCount);
+	Serializable::SerializeToUInt32(stream, compress ? CompressedBlock : 0);
+
+	std::vector<uint32_t> antenna1(rowCount), antenna2(rowCount);
+	std::vector<uint64_t> timeOffsetIndex(rowCount);
+	std::vector<double> u(rowCount), v(rowCount), w(rowCount), time(rowCount);
+	std::vector<float> realData(rowCount * samplesPerRow), imagData(rowCount * samplesPerRow);
+	for(size_t row=0; row!=rowCount; ++row)
+	{
+		const MSRowDataExt &rowData = rows[row];
+		const MSRowData &data = rowData.Data();
+		if(data.PolarizationCount() != polarizationCount || data.ChannelCount() != channelCount)
+			throw std::runtime_error("Rows in a row block do not have the same shape");
+		antenna1[row] = rowData.Antenna1();
+		antenna2[row] = rowData.Antenna2();
+		timeOffsetIndex[row] = rowData.TimeOffsetIndex();
+		u[row] = rowData.U();
+		v[row] = rowData.V();
+		w[row] = rowData.W();
+		time[row] = rowData.Time();
+		const num_t
+			*realPtr = data.RealPtr(),
+			*imagPtr = data.ImagPtr();
+		float
+			*realDest = &realData[row * samplesPerRow],
+			*imagDest = &imagData[row * samplesPerRow];
+		for(size_t i=0; i!=samplesPerRow; ++i)
+		{
+			realDest[i] = realPtr[i];
+			imagDest[i] = imagPtr[i];
+		}
+	}
+
+	writeColumn(stream, antenna1, compress);
+	writeColumn(stream, antenna2, compress);
+	writeColumn(stream, timeOffsetIndex, compress);
+	writeColumn(stream, u, compress);
+	writeColumn(stream, v, compress);
+	writeColumn(stream, w, compress);
+	writeColumn(stream, time, compress);
+	writeColumn(stream, realData, compress);
+	writeColumn(stream, imagData, compress);
+}
+
+size_t RowBlockCodec::Decode(std::istream &stream, MSRowDataExt *rows, size_t maxRowCount)
+{
+	const size_t rowCount = Serializable::UnserializeUInt64(stream);
+	const unsigned
+		polarizationCount = Serializable::UnserializeUInt32(stream),
+		channelCount = Serializable::UnserializeUInt32(stream);
+	const bool compressed = (Serializable::UnserializeUInt32(stream) & CompressedBlock) != 0;
+	if(!stream)
+		throw std::runtime_error("Could not read the header of a row block");
+	if(rowCount > maxRowCount)
+		throw std::runtime_error("Row block contains more rows than requested");
+	const size_t samplesPerRow = polarizationCount * channelCount;
+
+	std::vector<uint32_t> antenna1(rowCount), antenna2(rowCount);
+	std::vector<uint64_t> timeOffsetIndex(rowCount);
+	std::vector<double> u(rowCount), v(rowCount), w(rowCount), time(rowCount);
+	std::vector<float> realData(rowCount * samplesPerRow), imagData(rowCount * samplesPerRow);
+	readColumn(stream, antenna1, compressed);
+	readColumn(stream, antenna2, compressed);
+	readColumn(stream, timeOffsetIndex, compressed);
+	readColumn(stream, u, compressed);
+	readColumn(stream, v, compressed);
+	readColumn(stream, w, compressed);
+	readColumn(stream, time, compressed);
+	readColumn(stream, realData, compressed);
+	readColumn(stream, imagData, compressed);
+
+	for(size_t row=0; row!=rowCount; ++row)
+	{
+		MSRowDataExt &rowData = rows[row];
+		if(rowData.Data().PolarizationCount() != polarizationCount || rowData.Data().ChannelCount() != channelCount)
+			rowData.Data() = MSRowData(polarizationCount, channelCount);
+		rowData.SetAntenna1(antenna1[row]);
+		rowData.SetAntenna2(antenna2[row]);
+		rowData.SetTimeOffsetIndex(timeOffsetIndex[row]);
+		rowData.SetU(u[row]);
+		rowData.SetV(v[row]);
+		rowData.SetW(w[row]);
+		rowData.SetTime(time[row]);
+		num_t
+			*realPtr = rowData.Data().RealPtr(),
+			*imagPtr = rowData.Data().ImagPtr();
+		const float
+			*realSrc = &realData[row * samplesPerRow],
+			*imagSrc = &imagData[row * samplesPerRow];
+		for(size_t i=0; i!=samplesPerRow; ++i)
+		{
+			realPtr[i] = realSrc[i];
+			imagPtr[i] = imagSrc[i];
+		}
+	}
+	return rowCount;
+}
+
+void RowBlockCodec::writeColumn(std::ostream &stream, const char *data, size_t elementSize, size_t elementCount, bool compress)
+{
+	const size_t size = elementSize * elementCount;
+	if(compress)
+	{
+		std::vector<char> shuffled(size), compressed;
+		Shuffle(data, elementSize, elementCount, &shuffled[0]);
+		Compress(shuffled, compressed);
+		Serializable::SerializeToUInt64(stream, compressed.size());
+		if(!compressed.empty())
+			stream.write(&compressed[0], compressed.size());
+	}
+	else {
+		stream.write(data, size);
+	}
+}
+
+void RowBlockCodec::readColumn(std::istream &stream, char *data, size_t elementSize, size_t elementCount, bool compressed)
+{
+	const size_t size = elementSize * elementCount;
+	if(compressed)
+	{
+		const size_t compressedSize = Serializable::UnserializeUInt64(stream);
+		std::vector<char> buffer(compressedSize), shuffled(size);
+		if(compressedSize != 0)
+			stream.read(&buffer[0], compressedSize);
+		if(!stream)
+			throw std::runtime_error("Row block ended prematurely");
+		Decompress(compressedSize == 0 ? 0 : &buffer[0], compressedSize, shuffled);
+		Unshuffle(&shuffled[0], elementSize, elementCount, data);
+	}
+	else {
+		stream.read(data, size);
+		if(!stream)
+			throw std::runtime_error("Row block ended prematurely");
+	}
+}
+
+void RowBlockCodec::Shuffle(const char *input, size_t elementSize, size_t elementCount, char *output)
+{
+	for(size_t b=0; b!=elementSize; ++b)
+	{
+		const char *src = input + b;
+		for(size_t i=0; i!=elementCount; ++i)
+		{
+			*output = *src;
+			++output;
+			src += elementSize;
+		}
+	}
+}
+
+void RowBlockCodec::Unshuffle(const char *input, size_t elementSize, size_t elementCount, char *output)
+{
+	for(size_t b=0; b!=elementSize; ++b)
+	{
+		char *dest = output + b;
+		for(size_t i=0; i!=elementCount; ++i)
+		{
+			*dest = *input;
+			++input;
+			dest += elementSize;
+		}
+	}
+}
+
+/*
+ * The run-length encoding uses a control byte c, followed by either a literal sequence
+ * or a single repeated byte:
+ * - c < 128 : the c+1 following bytes are copied as-is;
+ * - c >= 128 : the next byte is repeated c-128+MinRun times.
+ */
+namespace {
+	const size_t MinRun = 3, MaxRun = 127 + MinRun, MaxLiteral = 128;
+
+	size_t runLength(const std::vector<char> &input, size_t pos)
+	{
+		size_t length = 1;
+		while(pos + length != input.size() && length != MaxRun && input[pos + length] == input[pos])
+			++length;
+		return length;
+	}
+}
+
+void RowBlockCodec::Compress(const std::vector<char> &input, std::vector<char> &output)
+{
+	output.clear();
+	output.reserve(input.size() + input.size() / MaxLiteral + 1);
+	size_t pos = 0;
+	while(pos != input.size())
+	{
+		size_t run = runLength(input, pos);
+		if(run >= MinRun)
+		{
+			output.push_back(char(128 + run - MinRun));
+			output.push_back(input[pos]);
+			pos += run;
+		}
+		else {
+			size_t literalEnd = pos + run;
+			while(literalEnd != input.size() && literalEnd - pos < MaxLiteral)
+			{
+				run = runLength(input, literalEnd);
+				if(run >= MinRun)
+					break;
+				literalEnd += run;
+			}
+			if(literalEnd - pos > MaxLiteral)
+				literalEnd = pos + MaxLiteral;
+			output.push_back(char(literalEnd - pos - 1));
+			output.insert(output.end(), input.begin() + pos, input.begin() + literalEnd);
+			pos = literalEnd;
+		}
+	}
+}
+
+void RowBlockCodec::Decompress(const char *input, size_t inputSize, std::vector<char> &output)
+{
+	const char *inputEnd = input + inputSize;
+	size_t pos = 0;
+	while(input != inputEnd)
+	{
+		const unsigned char control = *input;
+		++input;
+		if(control < 128)
+		{
+			const size_t length = size_t(control) + 1;
+			if(size_t(inputEnd - input) < length || pos + length > output.size())
+				throw std::runtime_error("Corrupt compressed row block");
+			std::copy(input, input + length, output.begin() + pos);
+			input += length;
+			pos += length;
+		}
+		else {
+			const size_t length = size_t(control) - 128 + MinRun;
+			if(input == inputEnd || pos + length > output.size())
+				throw std::runtime_error("Corrupt compressed row block");
+			std::fill(output.begin() + pos, output.begin() + pos + length, *input);
+			++input;
+			pos += length;
+		}
+	}
+	if(pos != output.size())
+		throw std::runtime_error("Compressed row block has unexpected size");
+}
+
+}
@@ -0,0 +1,80 @@
+#ifndef AOREMOTE__ROW_BLOCK_CODEC_H
+#define AOREMOTE__ROW_BLOCK_CODEC_H
+
+#include <iostream>
+#include <vector>
+
+#include <stdint.h>
+
+class MSRowDataExt;
+
+namespace aoRemote {
+
+/**
+ * Packs a block of measurement set rows into the columnar wire format that is used
+ * from protocol version 2 onwards. Protocol version 1 serializes every MSRowDataExt
+ * separately, which interleaves the per-row meta data with the samples. Instead, a
+ * row block stores each quantity (antennas, time indices, uvw, time, real and imaginary
+ * samples) as one contiguous column. Each column can optionally be compressed: its
+ * bytes are first shuffled, such that the n-th bytes of all elements are consecutive,
+ * and the shuffled bytes are then run-length encoded. Because consecutive rows have
+ * similar antennas, times and sample exponents, the shuffled columns contain long runs.
+ *
+ * All rows in a block are required to have the same number of polarizations and channels.
+ */
+class RowBlockCodec
+{
+	public:
+		/**
+		 * Write @p rowCount rows as a row block to the stream.
+		 * @param compress Whether the columns should be shuffled and run-length encoded.
+		 */
+		static void Encode(std::ostream &stream, const MSRowDataExt *rows, size_t rowCount, bool compress);
+
+		/**
+		 * Read a row block from the stream. Compressed and uncompressed blocks are both
+		 * accepted; the header of the block tells which one it is.
+		 * @returns The number of rows that were read into @p rows.
+		 */
+		static size_t Decode(std::istream &stream, MSRowDataExt *rows, size_t maxRowCount);
+
+		/**
+		 * Run-length encode a byte buffer. Exposed for testing.
+		 */
+		static void Compress(const std::vector<char> &input, std::vector<char> &output);
+
+		/**
+		 * Decompress a buffer that was created with Compress().
+		 * @param output Should have been resized to the uncompressed size.
+		 */
+		static void Decompress(const char *input, size_t inputSize, std::vector<char> &output);
+
+		static void Shuffle(const char *input, size_t elementSize, size_t elementCount, char *output);
+		static void Unshuffle(const char *input, size_t elementSize, size_t elementCount, char *output);
+
+	private:
+		enum BlockFlags {
+			CompressedBlock = 0x0001
+		};
+
+		static void writeColumn(std::ostream &stream, const char *data, size_t elementSize, size_t elementCount, bool compress);
+		static void readColumn(std::istream &stream, char *data, size_t elementSize, size_t elementCount, bool compressed);
+
+		template<typename T>
+		static void writeColumn(std::ostream &stream, const std::vector<T> &column, bool compress)
+		{
+			if(!column.empty())
+				writeColumn(stream, reinterpret_cast<const char*>(&column[0]), sizeof(T), column.size(), compress);
+		}
+
+		template<typename T>
+		static void readColumn(std::istream &stream, std::vector<T> &column, bool compressed)
+		{
+			if(!column.empty())
+				readColumn(stream, reinterpret_cast<char*>(&column[0]), sizeof(T), column.size(), compressed);
+		}
+};
+
+}
+
+#endif
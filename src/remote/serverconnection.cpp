@@ -8,17 +8,22 @@
 
 #include "format.h"
 #include "hostname.h"
+#include "rowblockcodec.h"
 
 #include "../quality/statisticscollection.h"
 #include "../quality/histogramcollection.h"
 
+#include <sstream>
 #include <vector>
 
 namespace aoRemote
 {
 
 ServerConnection::ServerConnection(boost::asio::io_service &ioService) :
-	_socket(ioService), _buffer(0)
+	_socket(ioService), _buffer(0),
+	_protocolVersion(AO_REMOTE_PROTOCOL_VERSION),
+	_maxProtocolVersion(AO_REMOTE_PROTOCOL_VERSION),
+	_compressRows(false)
 {
 }
 
@@ -33,8 +38,11 @@ void ServerConnection::Start()
 	InitialBlock initialBlock;
 	initialBlock.blockIdentifier = InitialId;
 	initialBlock.blockSize = sizeof(initialBlock);
-	initialBlock.options = 0;
-	initialBlock.protocolVersion = AO_REMOTE_PROTOCOL_VERSION;
+	initialBlock.options = _compressRows ? INITIAL_OPTION_COMPRESS_ROWS : 0;
+	// Offer the oldest version, because version 1 clients do not accept anything else
+	initialBlock.protocolVersion = AO_REMOTE_MIN_PROTOCOL_VERSION;
+	if(_maxProtocolVersion >= AO_REMOTE_ROW_BLOCK_PROTOCOL_VERSION)
+		initialBlock.options |= INITIAL_OPTION_ROW_BLOCKS;
 	
 	boost::asio::write(_socket, boost::asio::buffer(&initialBlock, sizeof(initialBlock)));
 	
@@ -48,10 +56,21 @@ void ServerConnection::onReceiveInitialResponse()
 	enum ErrorCode errorCode = (enum ErrorCode) initialResponse.errorCode;
 	if(initialResponse.blockIdentifier != InitialResponseId || initialResponse.blockSize != sizeof(initialResponse))
 		throw std::runtime_error("Bad response from client during initial response");
+	if(errorCode == ProtocolNotUnderstoodError)
+	{
+		std::ostringstream s;
+		s << "Client does not understand the offered protocol versions " << AO_REMOTE_MIN_PROTOCOL_VERSION << " to " << _maxProtocolVersion;
+		throw std::runtime_error(s.str());
+	}
 	if(errorCode != NoError)
 		throw std::runtime_error(std::string("Error reported by client during initial response: ") + ErrorStr::GetStr(errorCode));
-	if(initialResponse.negotiatedProtocolVersion != AO_REMOTE_PROTOCOL_VERSION)
-		throw std::runtime_error("Client seems to run different protocol version");
+	if(initialResponse.negotiatedProtocolVersion < AO_REMOTE_MIN_PROTOCOL_VERSION || initialResponse.negotiatedProtocolVersion > _maxProtocolVersion)
+	{
+		std::ostringstream s;
+		s << "Client negotiated protocol version " << initialResponse.negotiatedProtocolVersion << ", but this server supports versions " << AO_REMOTE_MIN_PROTOCOL_VERSION << " to " << _maxProtocolVersion;
+		throw std::runtime_error(s.str());
+	}
+	_protocolVersion = initialResponse.negotiatedProtocolVersion;
 	if(initialResponse.hostNameSize == 0)
 		throw std::runtime_error("Client did not send proper hostname");
 	
@@ -207,8 +226,12 @@ void ServerConnection::WriteDataRows(const std::string &msFilename, size_t rowSt
 	
 	std::ostringstream dataBuffer;
 	// Serialize the rows
-	for(size_t rowIndex=0; rowIndex != rowCount; ++rowIndex) {
-		rowArray[rowIndex].Serialize(dataBuffer);
+	if(_protocolVersion >= AO_REMOTE_ROW_BLOCK_PROTOCOL_VERSION)
+		RowBlockCodec::Encode(dataBuffer, rowArray, rowCount, _compressRows);
+	else {
+		for(size_t rowIndex=0; rowIndex != rowCount; ++rowIndex) {
+			rowArray[rowIndex].Serialize(dataBuffer);
+		}
 	}
 	std::string dataBufferStr = dataBuffer.str();
 
@@ -386,8 +409,27 @@ void ServerConnection::onReceiveReadDataRowsResponseData(size_t dataSize)
 	size_t rowsTotal = 0;
 	if(rowsSent == 0)
 		rowsTotal = Serializable::UnserializeUInt64(stream);
-	for(size_t i=0;i<rowsSent;++i)
-		_readRowData[i].Unserialize(stream);
+	if(rowsSent != 0 && _protocolVersion >= AO_REMOTE_ROW_BLOCK_PROTOCOL_VERSION)
+	{
+		size_t rowsDecoded;
+		try {
+			rowsDecoded = RowBlockCodec::Decode(stream, _readRowData, rowsSent);
+		} catch(std::exception &e) {
+			_onError(shared_from_this(), std::string("Client sent a bad row block: ") + e.what());
+			StopClient();
+			return;
+		}
+		if(rowsDecoded != rowsSent)
+		{
+			_onError(shared_from_this(), "Row block from client does not contain the number of rows that was announced");
+			StopClient();
+			return;
+		}
+	}
+	else {
+		for(size_t i=0;i<rowsSent;++i)
+			_readRowData[i].Unserialize(stream);
+	}
 
 	_onFinishReadDataRows(shared_from_this(), _readRowData, rowsTotal);
 	_onAwaitingCommand(shared_from_this());
@@ -50,6 +50,25 @@ class ServerConnection : public boost::enable_shared_from_this<ServerConnection>
 		boost::signals2::signal<void(ServerConnectionPtr, const std::string&)> &SignalError() { return _onError; }
 		
 		const Hostname &GetHostname() const { return _hostname; }
+		
+		/**
+		 * Protocol version that was agreed on with the client. Only valid after the
+		 * initial response has been received.
+		 */
+		int ProtocolVersion() const { return _protocolVersion; }
+		
+		/**
+		 * Request the client to compress the data rows that it sends, and compress the
+		 * rows that are sent to the client. Only has effect when both sides speak protocol
+		 * version 2 or higher. Should be set before Start() is called.
+		 */
+		void SetCompressRows(bool compressRows) { _compressRows = compressRows; }
+		
+		/**
+		 * Limit the protocol version that is offered to the client, e.g. to compare
+		 * throughput with older protocol versions. Should be set before Start() is called.
+		 */
+		void SetMaxProtocolVersion(int maxProtocolVersion) { _maxProtocolVersion = maxProtocolVersion; }
 	private:
 		explicit ServerConnection(boost::asio::io_service &ioService);
 		boost::asio::ip::tcp::socket _socket;
@@ -63,6 +82,8 @@ class ServerConnection : public boost::enable_shared_from_this<ServerConnection>
 		boost::signals2::signal<void(ServerConnectionPtr, const std::string&)> _onError;
 		
 		char *_buffer;
+		int _protocolVersion, _maxProtocolVersion;
+		bool _compressRows;
 		
 		void onReceiveInitialResponse();
 		
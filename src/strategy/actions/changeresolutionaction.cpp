@@ -3,6 +3,8 @@
 #include "../control/artifactset.h"
 
 #include <stdexcept>
+#include <vector>
+
 #include "../algorithms/thresholdtools.h"
 
 namespace rfiStrategy {
@@ -76,13 +78,15 @@ namespace rfiStrategy {
 			DecreaseTimeWithMask(timeFrequencyData);
 		}
 		else {
+			// All images are averaged in one pass
 			size_t imageCount = timeFrequencyData.ImageCount();
+			std::vector<Image2DCPtr> images;
 			for(size_t i=0;i<imageCount;++i)
-			{
-				Image2DCPtr image = timeFrequencyData.GetImage(i);
-				Image2DPtr newImage = image->ShrinkHorizontally(_timeDecreaseFactor);
-				timeFrequencyData.SetImage(i, newImage);
-			}
+				images.push_back(timeFrequencyData.GetImage(i));
+			std::vector<Image2DPtr> newImages;
+			Image2D::ShrinkHorizontally(_timeDecreaseFactor, images, newImages);
+			for(size_t i=0;i<imageCount;++i)
+				timeFrequencyData.SetImage(i, newImages[i]);
 			size_t maskCount = timeFrequencyData.MaskCount();
 			for(size_t i=0;i<maskCount;++i)
 			{
@@ -119,12 +123,13 @@ namespace rfiStrategy {
 	void ChangeResolutionAction::DecreaseFrequency(TimeFrequencyData &timeFrequencyData)
 	{
 		size_t imageCount = timeFrequencyData.ImageCount();
+		std::vector<Image2DCPtr> images;
 		for(size_t i=0;i<imageCount;++i)
-		{
-			Image2DCPtr image = timeFrequencyData.GetImage(i);
-			Image2DPtr newImage = image->ShrinkVertically(_frequencyDecreaseFactor);
-			timeFrequencyData.SetImage(i, newImage);
-		}
+			images.push_back(timeFrequencyData.GetImage(i));
+		std::vector<Image2DPtr> newImages;
+		Image2D::ShrinkVertically(_frequencyDecreaseFactor, images, newImages);
+		for(size_t i=0;i<imageCount;++i)
+			timeFrequencyData.SetImage(i, newImages[i]);
 		size_t maskCount = timeFrequencyData.MaskCount();
 		for(size_t i=0;i<maskCount;++i)
 		{
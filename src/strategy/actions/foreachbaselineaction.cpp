@@ -3,7 +3,11 @@
 #include "../../structures/antennainfo.h"
 #include "../../structures/system.h"
 
+#include "../control/actionprofiler.h"
+#include "../control/executionplan.h"
+
 #include "../../util/aologger.h"
+#include "../../util/parallelfor.h"
 #include "../../util/stopwatch.h"
 
 #include "../imagesets/bhfitsimageset.h"
@@ -17,6 +21,7 @@
 #include <sys/sysctl.h>
 
 #include <iostream>
+#include <memory>
 #include <sstream>
 
 #include <boost/thread.hpp>
@@ -40,16 +45,16 @@ namespace rfiStrategy {
 		{
 			ImageSet *imageSet = artifacts.ImageSet();
 			MSImageSet *msImageSet = dynamic_cast<MSImageSet*>(imageSet);
+			_msImageSet = msImageSet;
+			// For SD/BHFits/QS files, we want to select everything -- it's confusing
+			// if the default option "only flag cross correlations" would also
+			// hold for sdfits files.
+			_isSelectingAllBaselines = dynamic_cast<FitsImageSet*>(imageSet)!=0 || dynamic_cast<BHFitsImageSet*>(imageSet)!=0 || dynamic_cast<FilterBankSet*>(imageSet)!=0 || dynamic_cast<QualityStatImageSet*>(imageSet)!=0;
 			if(msImageSet != 0)
 			{
 				// Check memory usage
-				ImageSetIndex *tempIndex = msImageSet->StartIndex();
-				size_t timeStepCount = msImageSet->ObservationTimesVector(*tempIndex).size();
-				delete tempIndex;
-				size_t channelCount = msImageSet->GetBandInfo(0).channels.size();
-				double estMemorySizePerThread =
-					8.0/*bp complex*/ * 4.0 /*polarizations*/ *
-					double(timeStepCount) * double(channelCount) *
+				const double baselineSize = EstimateBaselineSize(*msImageSet);
+				double estMemorySizePerThread = baselineSize *
 					3.0 /* approx copies of the data that will be made in memory*/;
 				AOLogger::Debug << "Estimate of memory each thread will use: " << memToStr(estMemorySizePerThread) << ".\n";
 				size_t compThreadCount = _threadCount;
@@ -58,10 +63,9 @@ namespace rfiStrategy {
 				int64_t memSize = System::TotalMemory();
 				AOLogger::Debug << "Detected " << memToStr(memSize) << " of system memory.\n";
 				
-				if(estMemorySizePerThread * double(compThreadCount) > memSize)
+				const size_t maxThreads = ThreadCountForMemory(_threadCount, baselineSize, memSize);
+				if(maxThreads != _threadCount)
 				{
-					size_t maxThreads = size_t(memSize / estMemorySizePerThread);
-					if(maxThreads < 1) maxThreads = 1;
 					AOLogger::Warn <<
 						"This measurement set is TOO LARGE to be processed with " << _threadCount << " threads!\n" <<
 						_threadCount << " threads would require " << memToStr(estMemorySizePerThread*compThreadCount) << " of memory approximately.\n"
@@ -121,11 +125,23 @@ namespace rfiStrategy {
 			delete iteratorIndex;
 			AOLogger::Debug << "Will process " << _baselineCount << " baselines.\n";
 			
+			// The children are run from a plan, unless an enclosing plan already compiled them
+			const ExecutionPlan *enclosingPlan = artifacts.Plan();
+			std::unique_ptr<ExecutionPlan> plan;
+			if(enclosingPlan != 0 && enclosingPlan->Contains(*this))
+				_plan = enclosingPlan;
+			else {
+				plan.reset(new ExecutionPlan(*this));
+				_plan = plan.get();
+			}
+			_hasReservedScratch = false;
+			
 			// Initialize thread data and threads
 			_loopIndex = imageSet->StartIndex();
 			_progressTaskNo = new int[_threadCount];
 			_progressTaskCount = new int[_threadCount];
 			progress.OnStartTask(*this, 0, 1, "Initializing");
+			_profilerPath = ActionProfiler::CurrentPath();
 
 			boost::thread_group threadGroup;
 			ReaderFunction reader(*this);
@@ -144,8 +160,11 @@ namespace rfiStrategy {
 			if(_resultSet != 0)
 			{
 				artifacts = *_resultSet;
+				// The result was performed with the plan of this action, which is destructed
+				artifacts.SetPlan(enclosingPlan);
 				delete _resultSet;
 			}
+			_plan = 0;
 
 			delete[] _progressTaskCount;
 			delete[] _progressTaskNo;
@@ -159,16 +178,14 @@ namespace rfiStrategy {
 
 	bool ForEachBaselineAction::IsBaselineSelected(ImageSetIndex &index)
 	{
-		ImageSet *imageSet = _artifacts->ImageSet();
-		MSImageSet *msImageSet = dynamic_cast<MSImageSet*>(imageSet);
 		size_t a1id, a2id;
-		if(msImageSet != 0)
+		if(_msImageSet != 0)
 		{
-			a1id = msImageSet->GetAntenna1(index);
-			a2id = msImageSet->GetAntenna2(index);
-			if(!_bands.empty() && _bands.count(msImageSet->GetBand(index))==0)
+			a1id = _msImageSet->GetAntenna1(index);
+			a2id = _msImageSet->GetAntenna2(index);
+			if(!_bands.empty() && _bands.count(_msImageSet->GetBand(index))==0)
 				return false;
-			if(!_fields.empty() && _fields.count(msImageSet->GetField(index))==0)
+			if(!_fields.empty() && _fields.count(_msImageSet->GetField(index))==0)
 				return false;
 		} else {
 			a1id = 0;
@@ -179,10 +196,7 @@ namespace rfiStrategy {
 		if(!_antennaeToInclude.empty() && (_antennaeToInclude.count(a1id) == 0 && _antennaeToInclude.count(a2id) == 0))
 			return false;
 		
-		// For SD/BHFits/QS files, we want to select everything -- it's confusing
-		// if the default option "only flag cross correlations" would also
-		// hold for sdfits files.
-		if(dynamic_cast<FitsImageSet*>(imageSet)!=0 || dynamic_cast<BHFitsImageSet*>(imageSet)!=0 || dynamic_cast<FilterBankSet*>(imageSet)!=0 || dynamic_cast<QualityStatImageSet*>(imageSet)!=0)
+		if(_isSelectingAllBaselines)
 			return true;
 
 		switch(_selection)
@@ -226,6 +240,17 @@ namespace rfiStrategy {
 		return 0;
 	}
 
+	void ForEachBaselineAction::reserveScratch(const TimeFrequencyData &data)
+	{
+		boost::mutex::scoped_lock lock(_mutex);
+		if(!_hasReservedScratch && _plan != 0)
+		{
+			_hasReservedScratch = true;
+			lock.unlock();
+			_plan->ReserveScratch(data.ImageWidth(), data.ImageHeight(), data.PolarizationCount(), mathThreadCount());
+		}
+	}
+	
 	void ForEachBaselineAction::SetExceptionOccured()
 	{
 		boost::mutex::scoped_lock lock(_mutex);
@@ -240,6 +265,9 @@ namespace rfiStrategy {
 	
 	void ForEachBaselineAction::PerformFunction::operator()()
 	{
+		ActionProfiler::EnterPath(_action._profilerPath);
+		// The baselines already occupy all threads, so the actions run single threaded
+		ParallelFor::Limit limit(1);
 		boost::mutex::scoped_lock ioLock(_action._artifacts->IOMutex());
 		ImageSet *privateImageSet = _action._artifacts->ImageSet()->Copy();
 		ioLock.unlock();
@@ -247,6 +275,7 @@ namespace rfiStrategy {
 		try {
 			boost::mutex::scoped_lock lock(_action._mutex);
 			ArtifactSet newArtifacts(*_action._artifacts);
+			newArtifacts.SetPlan(_action._plan);
 			lock.unlock();
 			
 			BaselineData *baseline = _action.GetNextBaseline();
@@ -269,6 +298,8 @@ namespace rfiStrategy {
 				delete zero;
 				newArtifacts.SetImageSetIndex(&baseline->Index());
 				newArtifacts.SetMetaData(baseline->MetaData());
+				
+				_action.reserveScratch(baseline->Data());
 
 				_action.ActionBlock::Perform(newArtifacts, *this);
 				delete baseline;
@@ -308,6 +339,7 @@ namespace rfiStrategy {
 	
 	void ForEachBaselineAction::ReaderFunction::operator()()
 	{
+		ParallelFor::Limit limit(_action._threadCount);
 		Stopwatch watch(true);
 		bool finished = false;
 		size_t threadCount = _action.mathThreadCount();
@@ -366,8 +398,15 @@ namespace rfiStrategy {
 			_action._dataAvailable.notify_all();
 			watch.Start();
 		} while(!finished);
+		if(msImageSet != 0)
+		{
+			// Prefetched baselines that are not selected are never requested
+			boost::mutex::scoped_lock lock(_action._artifacts->IOMutex());
+			msImageSet->ClearPrefetchedBaselines();
+		}
 		_action.SetFinishedBaselines();
 		_action._dataAvailable.notify_all();
+		_action._artifacts->OnReadsFinished();
 		watch.Pause();
 		AOLogger::Debug << "Time spent on reading: " << watch.ToString() << '\n';
 	}
@@ -389,6 +428,32 @@ namespace rfiStrategy {
 		progress.OnStartTask(*this, totalNo, totalCount, str.str());
 	}
 	
+	double ForEachBaselineAction::EstimateBaselineSize(MSImageSet &set)
+	{
+		ImageSetIndex *tempIndex = set.StartIndex();
+		size_t timeStepCount = set.ObservationTimesVector(*tempIndex).size();
+		delete tempIndex;
+		size_t channelCount = set.GetBandInfo(0).channels.size();
+		return 8.0/*bp complex*/ * 4.0 /*polarizations*/ *
+			double(timeStepCount) * double(channelCount);
+	}
+	
+	size_t ForEachBaselineAction::ThreadCountForMemory(size_t threadCount, double baselineSize, int64_t memSize)
+	{
+		const double estMemorySizePerThread = baselineSize *
+			3.0 /* approx copies of the data that will be made in memory*/;
+		// One of the threads reads the data
+		size_t compThreadCount = threadCount;
+		if(compThreadCount > 0) --compThreadCount;
+		if(estMemorySizePerThread * double(compThreadCount) > memSize)
+		{
+			size_t maxThreads = size_t(memSize / estMemorySizePerThread);
+			if(maxThreads < 1) maxThreads = 1;
+			return maxThreads;
+		}
+		return threadCount;
+	}
+	
 	std::string ForEachBaselineAction::memToStr(double memSize)
 	{
 		std::ostringstream str;
@@ -2,6 +2,7 @@
 #define RFISTRATEGYFOREACHBASELINEACTION_H
 
 #include "../control/actionblock.h"
+#include "../control/actionprofiler.h"
 #include "../control/artifactset.h"
 
 #include "../imagesets/imageset.h"
@@ -32,7 +33,11 @@ namespace rfiStrategy {
 				_exceptionOccured(false),
 				_baselineProgress(0),
 				_hasInitAntennae(false),
-				_initPartIndex(0)
+				_initPartIndex(0),
+				_msImageSet(nullptr),
+				_isSelectingAllBaselines(false),
+				_hasReservedScratch(false),
+				_plan(nullptr)
 			{
 			}
 			virtual ~ForEachBaselineAction()
@@ -66,12 +71,25 @@ namespace rfiStrategy {
 			
 			std::set<size_t>& Bands() { return _bands; }
 			const std::set<size_t>& Bands() const { return _bands; }
+			
+			/**
+			 * Rough estimate of the size of the data of one baseline of the set, assuming
+			 * four polarizations.
+			 */
+			static double EstimateBaselineSize(class MSImageSet &set);
+			
+			/**
+			 * The number of threads that is used with the given amount of memory: the
+			 * requested count, or less when its threads would not fit in memory.
+			 */
+			static size_t ThreadCountForMemory(size_t threadCount, double baselineSize, int64_t memSize);
 		private:
 			bool IsBaselineSelected(ImageSetIndex &index);
 			class ImageSetIndex *GetNextIndex();
 			static std::string memToStr(double memSize);
 			
 			void SetExceptionOccured();
+			void reserveScratch(const TimeFrequencyData &data);
 			void SetFinishedBaselines();
 			void SetProgress(ProgressListener &progress, int no, int count, const std::string& taskName, int threadId);
 			size_t mathThreadCount() const
@@ -171,6 +189,7 @@ namespace rfiStrategy {
 			int *_progressTaskNo, *_progressTaskCount;
 			bool _exceptionOccured;
 			size_t _baselineProgress;
+			ActionProfiler::Path _profilerPath;
 			
 			// Initial data
 			AntennaInfo _initAntenna1, _initAntenna2;
@@ -180,6 +199,14 @@ namespace rfiStrategy {
 			std::set<size_t> _antennaeToSkip;
 			std::set<size_t> _fields;
 			std::set<size_t> _bands;
+			
+			// The type of the image set, determined once in Perform()
+			class MSImageSet *_msImageSet;
+			bool _isSelectingAllBaselines;
+			
+			bool _hasReservedScratch;
+			// The plan that performs the children while Perform() runs
+			const class ExecutionPlan *_plan;
 	};
 }
 
@@ -1,14 +1,20 @@
 #include "foreachmsaction.h"
 
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 
+#include "../../msio/memorybaselinereader.h"
+
 #include "../../structures/measurementset.h"
+#include "../../structures/system.h"
 
 #include "strategy.h"
 
 #include "../control/artifactset.h"
 #include "../control/defaultstrategy.h"
 
+#include "foreachbaselineaction.h"
+
 #include "../imagesets/imageset.h"
 #include "../imagesets/msimageset.h"
 
@@ -29,35 +35,45 @@ void ForEachMSAction::Perform(ArtifactSet &artifacts, ProgressListener &progress
 	
 	FinishAll();
 
+	// The next set is opened, and with the direct reader its first baselines are read, while
+	// the current set is processed. The preparation starts once all baselines of the current
+	// set have been read, so that it does not hold up those reads. It only logs debug
+	// messages; all other messages are written in the same order as when the sets are
+	// processed one after another. As casacore is not thread safe, each measurement set
+	// access of both threads holds the IO mutex.
+	boost::mutex &ioMutex = artifacts.IOMutex();
+	std::unique_ptr<PreparedSet> current, next;
+
 	for(std::vector<std::string>::const_iterator i=_filenames.begin();i!=_filenames.end();++i)
 	{
 		std::string filename = *i;
 		
 		progress.OnStartTask(*this, taskIndex, _filenames.size(), std::string("Processing measurement set ") + filename);
 		
-		bool skip = false;
-		if(_skipIfAlreadyProcessed)
+		if(next)
 		{
-			MeasurementSet set(filename);
-			if(set.HasRFIConsoleHistory())
-			{
-				skip = true;
-				AOLogger::Info << "Skipping " << filename << ",\n"
-					"because the set contains AOFlagger history and -skip-flagged was given.\n";
-			}
+			next->Join();
+			current = std::move(next);
+		} else {
+			current.reset(new PreparedSet());
+			current->filename = filename;
+			prepareSet(&*current, &ioMutex);
 		}
+		if(current->error)
+			std::rethrow_exception(current->error);
 		
-		if(!skip)
+		if(current->skip)
 		{
-			std::unique_ptr<ImageSet> imageSet(ImageSet::Create(filename, _baselineIOMode, _readUVW));
-			bool isMS = dynamic_cast<MSImageSet*>(&*imageSet) != 0;
-			if(isMS)
-			{ 
-				MSImageSet *msImageSet = static_cast<MSImageSet*>(&*imageSet);
-				msImageSet->SetDataColumnName(_dataColumnName);
-				msImageSet->SetSubtractModel(_subtractModel);
-			}
-			imageSet->Initialize();
+			AOLogger::Info << "Skipping " << filename << ",\n"
+				"because the set contains AOFlagger history and -skip-flagged was given.\n";
+		}
+		
+		if(!current->skip)
+		{
+			std::unique_ptr<ImageSet> imageSet(std::move(current->imageSet));
+			bool isMS = current->isMS;
+			if(isMS && _baselineIOMode == AutoReadMode)
+				MemoryBaselineReader::IsEnoughMemoryAvailable(current->dataSize, true);
 			
 			if(_loadOptimizedStrategy)
 			{
@@ -89,6 +105,14 @@ void ForEachMSAction::Perform(ArtifactSet &artifacts, ProgressListener &progress
 					fobAction->Fields() = _fields;
 				}
 			}
+			
+			// A set that is listed twice is prepared after the first one has been written
+			if(i+1 != _filenames.end() && !isSameSet(*(i+1), filename))
+			{
+				next.reset(new PreparedSet());
+				next->filename = *(i+1);
+				artifacts.SetReadsFinishedHandler(boost::bind(&PreparedSet::Start, &*next, this, &ioMutex));
+			}
 				
 			std::unique_ptr<ImageSetIndex> index(imageSet->StartIndex());
 			artifacts.SetImageSet(&*imageSet);
@@ -96,11 +120,22 @@ void ForEachMSAction::Perform(ArtifactSet &artifacts, ProgressListener &progress
 
 			InitializeAll();
 			
-			ActionBlock::Perform(artifacts, progress);
+			try {
+				ActionBlock::Perform(artifacts, progress);
+			} catch(...) {
+				artifacts.SetReadsFinishedHandler(boost::function<void()>());
+				throw;
+			}
 			
 			FinishAll();
 			
+			artifacts.SetReadsFinishedHandler(boost::function<void()>());
+			// Starts the preparation when the strategy did not read the baselines of this set
+			if(next)
+				next->Start(this, &ioMutex);
+			
 			artifacts.SetNoImageSet();
+			boost::mutex::scoped_lock ioLock(ioMutex);
 			index.reset();
 			imageSet.reset();
 
@@ -117,6 +152,110 @@ void ForEachMSAction::Perform(ArtifactSet &artifacts, ProgressListener &progress
 	InitializeAll();
 }
 
+ForEachMSAction::PreparedSet::~PreparedSet()
+{
+	Join();
+}
+
+void ForEachMSAction::PreparedSet::Start(ForEachMSAction *action, boost::mutex *ioMutex)
+{
+	boost::mutex::scoped_lock lock(preparerMutex);
+	if(!isStarted)
+	{
+		isStarted = true;
+		preparer.reset(new boost::thread(boost::bind(&ForEachMSAction::prepareSet, action, this, ioMutex)));
+	}
+}
+
+void ForEachMSAction::PreparedSet::Join()
+{
+	boost::mutex::scoped_lock lock(preparerMutex);
+	if(preparer)
+	{
+		preparer->join();
+		preparer.reset();
+	}
+}
+
+void ForEachMSAction::prepareSet(PreparedSet *set, boost::mutex *ioMutex)
+{
+	try {
+		if(_skipIfAlreadyProcessed)
+		{
+			boost::mutex::scoped_lock ioLock(*ioMutex);
+			MeasurementSet ms(set->filename);
+			set->skip = ms.HasRFIConsoleHistory();
+		}
+		
+		if(!set->skip)
+		{
+			boost::mutex::scoped_lock ioLock(*ioMutex);
+			std::unique_ptr<ImageSet> imageSet(ImageSet::Create(set->filename, _baselineIOMode, _readUVW));
+			ioLock.unlock();
+			MSImageSet *msImageSet = dynamic_cast<MSImageSet*>(&*imageSet);
+			set->isMS = msImageSet != 0;
+			BaselineIOMode ioMode = _baselineIOMode;
+			if(set->isMS)
+			{ 
+				msImageSet->SetDataColumnName(_dataColumnName);
+				msImageSet->SetSubtractModel(_subtractModel);
+				if(_baselineIOMode == AutoReadMode || _baselineIOMode == MemoryReadMode)
+				{
+					ioLock.lock();
+					set->dataSize = BaselineReader::MeasurementSetDataSize(set->filename);
+					ioLock.unlock();
+				}
+				if(_baselineIOMode == AutoReadMode)
+				{
+					// The choice is logged when the set is processed
+					ioMode = MemoryBaselineReader::IsEnoughMemoryAvailable(set->dataSize, false) ? MemoryReadMode : DirectReadMode;
+					msImageSet->SetIOMode(ioMode);
+				}
+			}
+			ioLock.lock();
+			imageSet->Initialize();
+			ioLock.unlock();
+			
+			// Only the direct reader reads the first baselines by themselves; the memory and
+			// indirect readers would read or reorder the whole set
+			if(set->isMS && ioMode == DirectReadMode)
+			{
+				// The for each baseline action lowers its thread count in the same way when
+				// the memory is short. The prefetched baselines and the threads that flag this
+				// set may use half of the memory, the current set uses the other half.
+				const double baselineSize = ForEachBaselineAction::EstimateBaselineSize(*msImageSet);
+				const int64_t memSize = System::TotalMemory();
+				const size_t threadCount = ForEachBaselineAction::ThreadCountForMemory(
+					_threadCount != 0 ? _threadCount : System::ProcessorCount(), baselineSize, memSize);
+				const double budget = 0.5 * double(memSize) - 3.0 * baselineSize * double(threadCount);
+				size_t prefetchCount = msImageSet->Reader()->GetMaxRecommendedBufferSize(threadCount);
+				if(budget <= 0.0)
+					prefetchCount = 0;
+				else if(budget < baselineSize * double(prefetchCount))
+					prefetchCount = size_t(budget / baselineSize);
+				AOLogger::Debug << "Prefetching " << prefetchCount << " baselines of " << set->filename << ".\n";
+				if(prefetchCount != 0)
+				{
+					ioLock.lock();
+					msImageSet->PrefetchBaselines(prefetchCount);
+					ioLock.unlock();
+				}
+			}
+			set->imageSet = std::move(imageSet);
+		}
+	} catch(...) {
+		set->error = std::current_exception();
+	}
+}
+
+bool ForEachMSAction::isSameSet(const std::string &filenameA, const std::string &filenameB)
+{
+	if(filenameA == filenameB)
+		return true;
+	boost::system::error_code error;
+	return boost::filesystem::equivalent(filenameA, filenameB, error);
+}
+
 void ForEachMSAction::AddDirectory(const std::string &name)
 {
   // get all files ending in .MS
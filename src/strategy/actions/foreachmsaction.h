@@ -5,8 +5,15 @@
 
 #include "../../structures/types.h"
 
+#include <exception>
+#include <memory>
 #include <set>
 
+#include <stdint.h>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
 namespace rfiStrategy {
 
 	class ForEachMSAction  : public ActionBlock {
@@ -62,6 +69,31 @@ namespace rfiStrategy {
 			std::set<size_t>& Bands() { return _bands; }
 			const std::set<size_t>& Bands() const { return _bands; }
 		private:
+			/**
+			 * A set that has been opened and initialized before it is processed. The next set is
+			 * prepared in a separate thread, which is started once all baselines of the current
+			 * set have been read, and is joined before the prepared set is used or destructed.
+			 */
+			struct PreparedSet
+			{
+				PreparedSet() : skip(false), isMS(false), dataSize(0), isStarted(false) { }
+				~PreparedSet();
+				void Start(ForEachMSAction *action, boost::mutex *ioMutex);
+				void Join();
+
+				std::string filename;
+				bool skip, isMS;
+				uint64_t dataSize;
+				std::unique_ptr<class ImageSet> imageSet;
+				std::exception_ptr error;
+				boost::mutex preparerMutex;
+				bool isStarted;
+				std::unique_ptr<boost::thread> preparer;
+			};
+
+			void prepareSet(PreparedSet *set, boost::mutex *ioMutex);
+			static bool isSameSet(const std::string &filenameA, const std::string &filenameB);
+
 			std::vector<std::string> _filenames;
 			bool _readUVW;
 			std::string _dataColumnName;
@@ -1,3 +1,4 @@
+#include "../../util/parallelfor.h"
 #include "../../util/progresslistener.h"
 
 #include "fringestopaction.h"
@@ -6,6 +7,37 @@
 
 #include "../control/artifactset.h"
 
+#include <algorithm>
+#include <atomic>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace {
+	/**
+	 * Performs the tasks of a fitter with ParallelFor::RunDynamic(), because the tasks do
+	 * not all take equally long. Listeners such as the progress window expect to be
+	 * called by the thread that performs the action, so only that thread reports progress.
+	 */
+	struct FitTaskScheduler
+	{
+		FringeStoppingFitter *fitter;
+		const rfiStrategy::Action *action;
+		ProgressListener *listener;
+		boost::thread::id callingThread;
+		std::atomic<size_t> finishedTasks;
+		size_t taskCount;
+
+		void Run(size_t task)
+		{
+			fitter->PerformFit(task);
+			const size_t finished = ++finishedTasks;
+			if(boost::this_thread::get_id() == callingThread)
+				listener->OnProgress(*action, finished, taskCount);
+		}
+	};
+}
+
 namespace rfiStrategy {
 
 	void FringeStopAction::Perform(ArtifactSet &artifacts, class ProgressListener &listener)
@@ -31,11 +63,16 @@ namespace rfiStrategy {
 		if(_onlyFringeStop)
 			fitter.PerformFringeStop();
 		else {
-			for(size_t i=0;i<fitter.TaskCount();++i)
-			{
-				fitter.PerformFit(i);
-				listener.OnProgress(*this, i+1, fitter.TaskCount());
-			}
+			FitTaskScheduler scheduler;
+			scheduler.fitter = &fitter;
+			scheduler.action = this;
+			scheduler.listener = &listener;
+			scheduler.callingThread = boost::this_thread::get_id();
+			scheduler.finishedTasks = 0;
+			scheduler.taskCount = fitter.TaskCount();
+			ParallelFor::RunDynamic(scheduler.taskCount, boost::bind(&FitTaskScheduler::Run, &scheduler, _1));
+			if(scheduler.taskCount != 0)
+				listener.OnProgress(*this, scheduler.taskCount, scheduler.taskCount);
 		}
 
 		TimeFrequencyData newContaminatedData = fitter.Background();
@@ -53,35 +53,30 @@ namespace rfiStrategy {
 
 	void WriteFlagsAction::FlushFunction::operator()()
 	{
+		std::vector<BufferItem> &flushBuffer = _parent->_flushBuffer;
 		boost::mutex::scoped_lock lock(_parent->_mutex);
 		do {
 			while(_parent->_buffer.size() < _parent->_minBufferItemsForWriting && !_parent->_isFinishing)
 				_parent->_bufferChange.wait(lock);
 
-			std::stack<BufferItem> bufferCopy;
-			while(!_parent->_buffer.empty())
-			{
-				BufferItem item = _parent->_buffer.top();
-				_parent->_buffer.pop();
-				item._index->Reattach(*_parent->_imageSet);
-				bufferCopy.push(item);
-			}
+			flushBuffer.swap(_parent->_buffer);
 			_parent->_bufferChange.notify_all();
-			if(bufferCopy.size() >= _parent->_minBufferItemsForWriting)
+			if(flushBuffer.size() >= _parent->_minBufferItemsForWriting)
 				AOLogger::Debug << "Flag buffer has reached minimal writing size, flushing flags...\n";
 			else
 				AOLogger::Debug << "Flushing flags...\n";
 			lock.unlock();
 
+			// All items are handed to the image set in one go, so that the reader can merge the
+			// requests and write them in row order.
+			for(std::vector<BufferItem>::iterator i=flushBuffer.begin(); i!=flushBuffer.end(); ++i)
+				i->_index->Reattach(*_parent->_imageSet);
 			boost::mutex::scoped_lock ioLock(*_parent->_ioMutex);
-			while(!bufferCopy.empty())
-			{
-				BufferItem item = bufferCopy.top();
-				bufferCopy.pop();
-				_parent->_imageSet->AddWriteFlagsTask(*item._index, item._masks);
-			}
+			for(std::vector<BufferItem>::iterator i=flushBuffer.begin(); i!=flushBuffer.end(); ++i)
+				_parent->_imageSet->AddWriteFlagsTask(*i->_index, i->_masks);
 			_parent->_imageSet->PerformWriteFlagsTask();
 			ioLock.unlock();
+			flushBuffer.clear();
 
 			lock.lock();
 		} while(!_parent->_isFinishing || !_parent->_buffer.empty());
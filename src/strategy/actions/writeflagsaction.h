@@ -5,7 +5,7 @@
 
 #include "../imagesets/imageset.h"
 
-#include <stack>
+#include <vector>
 
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition.hpp>
@@ -66,7 +66,7 @@ namespace rfiStrategy {
 				boost::mutex::scoped_lock lock(_mutex);
 				while(_buffer.size() >= _maxBufferItems)
 					_bufferChange.wait(lock);
-				_buffer.push(newItem);
+				_buffer.push_back(newItem);
 				_bufferChange.notify_all();
 			}
 
@@ -79,7 +79,12 @@ namespace rfiStrategy {
 			size_t _maxBufferItems;
 			size_t _minBufferItemsForWriting;
 
-			std::stack<BufferItem> _buffer;
+			/**
+			 * Items are added to _buffer, while the flusher writes the items of _flushBuffer.
+			 * The flusher swaps the two when it starts a flush, so that workers can fill the
+			 * buffer again while the previous items are being written.
+			 */
+			std::vector<BufferItem> _buffer, _flushBuffer;
 			ImageSet *_imageSet;
 	};
 }
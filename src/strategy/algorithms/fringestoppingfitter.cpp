@@ -8,6 +8,55 @@
 #include "../algorithms/fringestoppingfitter.h"
 #include "../algorithms/sinusfitter.h"
 
+#include <cmath>
+
+namespace {
+	// Number of channels after which a phasor that is updated by a recurrence is
+	// calculated directly again, so that rounding errors do not accumulate.
+	const size_t renormalizationInterval = 64;
+
+	/**
+	 * Calculates e^{2 pi i k f} for the frequencies f of all channels. The phasors of evenly
+	 * spaced channels are found by rotating the previous phasor by a constant step.
+	 */
+	void calculateChannelRotations(numl_t turnsPerHz, const std::vector<ChannelInfo> &channels, std::vector<double> &cosines, std::vector<double> &sines)
+	{
+		const double twoPi = 2.0 * M_PI;
+		cosines.resize(channels.size());
+		sines.resize(channels.size());
+		double stepCos = 1.0, stepSin = 0.0, stepFrequency = 0.0;
+		size_t stepsSinceDirect = 0;
+		for(size_t y=0; y!=channels.size(); ++y)
+		{
+			const double frequency = channels[y].frequencyHz;
+			bool isEvenlySpaced = false;
+			if(y != 0 && stepsSinceDirect < renormalizationInterval)
+			{
+				const double delta = frequency - channels[y-1].frequencyHz;
+				isEvenlySpaced = std::fabs(delta - stepFrequency) <= 1e-12 * std::fabs(frequency);
+			}
+			if(isEvenlySpaced)
+			{
+				cosines[y] = cosines[y-1] * stepCos - sines[y-1] * stepSin;
+				sines[y] = sines[y-1] * stepCos + cosines[y-1] * stepSin;
+				++stepsSinceDirect;
+			} else {
+				const double angle = twoPi * (double) (turnsPerHz * frequency);
+				cosines[y] = cos(angle);
+				sines[y] = sin(angle);
+				if(y+1 != channels.size())
+				{
+					stepFrequency = channels[y+1].frequencyHz - frequency;
+					const double stepAngle = twoPi * (double) (turnsPerHz * stepFrequency);
+					stepCos = cos(stepAngle);
+					stepSin = sin(stepAngle);
+				}
+				stepsSinceDirect = 0;
+			}
+		}
+	}
+}
+
 FringeStoppingFitter::FringeStoppingFitter() :
 	_originalData(0), _fringesToConsider(1.0), _minWindowSize(32), _maxWindowSize(128), _returnFittedValue(false), _returnMeanValue(false), _fringeFit(true), _newPhaseCentreDec(M_PInl*0.5), _newPhaseCentreRA(0.0)
 {
@@ -82,17 +131,20 @@ void FringeStoppingFitter::PerformFringeStop()
 		real = _originalData->GetRealPart(),
 		imaginary = _originalData->GetImaginaryPart();
 
-	Baseline baseline(*_antenna1Info, *_antenna2Info);
-
+	// The number of fringes is proportional to the frequency, so the rotations of all
+	// channels of a timestep follow from a single phasor recurrence.
+	const std::vector<UVW> &uvw = _metaData->UVW();
+	std::vector<double> cosines, sines;
 	for(size_t x=0;x<real->Width();++x)
 	{
+		const numl_t turnsPerHz = -(uvw[x].w - uvw[0].w) / 299792458.0L;
+		calculateChannelRotations(turnsPerHz, _bandInfo->channels, cosines, sines);
 		for(size_t y=0;y<real->Height();++y)
 		{
 			num_t r = real->Value(x, y);
 			num_t i = imaginary->Value(x, y);
-			num_t fringeCount = UVImager::GetFringeCount(0, x, y, _metaData);
 
-			num_t cosfreq = cosn(fringeCount*2.0L*M_PIn), sinfreq = sinn(fringeCount*2.0L*M_PIn);
+			num_t cosfreq = cosines[y], sinfreq = sines[y];
 			
 			num_t newR = r * cosfreq - i * sinfreq;
 			i = r * sinfreq + i * cosfreq;
@@ -244,27 +296,43 @@ num_t FringeStoppingFitter::GetFringeFrequency(size_t x, size_t y)
 		UVImager::GetFringeStopFrequency(x, baseline, delayRA, delayDec, observeFreq, _metaData);
 }
 
-void FringeStoppingFitter::GetRFIValue(num_t &r, num_t &i, int x, int y, num_t rfiPhase, num_t rfiStrength)
+void FringeStoppingFitter::CalculateRotations(Rotations &rotations, unsigned y) const
 {
-	const numl_t earthRotation = UVImager::TimeToEarthLattitude(x, _metaData);
-	const Baseline baseline = _metaData->Baseline();
-	const numl_t newWPos =
-		 UVImager::GetWPosition(_newPhaseCentreDec, _newPhaseCentreRA, _metaData->Band().channels[y].frequencyHz, earthRotation, baseline.DeltaX(), baseline.DeltaY());
-	const num_t rotations =  
-		UVImager::GetFringeCount(0, x, y, _metaData) - newWPos;
-		
-	r = cosn(rotations * 2.0 * M_PIn + rfiPhase) * rfiStrength;
-	i = -sinn(rotations * 2.0 * M_PIn + rfiPhase) * rfiStrength;
+	const size_t width = _originalData->ImageWidth();
+	const num_t dx = _metaData->Antenna2().position.x - _metaData->Antenna1().position.x;
+	const num_t dy = _metaData->Antenna2().position.y - _metaData->Antenna1().position.y;
+	const numl_t frequency = _metaData->Band().channels[y].frequencyHz;
+	rotations.cosines.resize(width);
+	rotations.sines.resize(width);
+	for(size_t t=0;t<width;++t)
+	{
+		const num_t tRotation = UVImager::TimeToEarthLattitude(_metaData->ObservationTimes()[t]);
+		const num_t tauge = UVImager::GetFringeCount(0, t, y, _metaData);
+		const num_t taugeNew = UVImager::GetWPosition(_newPhaseCentreDec, _newPhaseCentreRA, frequency, tRotation, dx, dy);
+		const num_t phaseShift = tauge - taugeNew;
+		rotations.cosines[t] = cosn(2.0 * M_PIn * phaseShift);
+		rotations.sines[t] = sinn(2.0 * M_PIn * phaseShift);
+	}
 }
 
-void FringeStoppingFitter::GetMeanValue(num_t &rMean, num_t &iMean, num_t phase, num_t amplitude, SampleRowCPtr real, SampleRowCPtr imaginary, unsigned xStart, unsigned xEnd, unsigned y)
+void FringeStoppingFitter::GetRFIValue(num_t &r, num_t &i, const Rotations &rotations, int x, num_t rfiPhase, num_t rfiStrength) const
+{
+	// e^{i (2 pi rotations + rfiPhase)}
+	const num_t
+		phaseCos = cosn(rfiPhase),
+		phaseSin = sinn(rfiPhase);
+	r = (rotations.cosines[x] * phaseCos - rotations.sines[x] * phaseSin) * rfiStrength;
+	i = -(rotations.sines[x] * phaseCos + rotations.cosines[x] * phaseSin) * rfiStrength;
+}
+
+void FringeStoppingFitter::GetMeanValue(num_t &rMean, num_t &iMean, num_t phase, num_t amplitude, SampleRowCPtr real, SampleRowCPtr imaginary, unsigned xStart, unsigned xEnd, const Rotations &rotations) const
 {
 	rMean = 0.0;
 	iMean = 0.0;
 	for(unsigned t=xStart;t<xEnd;++t)
 	{
 		num_t r, i;
-		GetRFIValue(r, i, t, y, phase, amplitude);
+		GetRFIValue(r, i, rotations, t, phase, amplitude);
 		rMean += real->Value(t) - r;
 		iMean += imaginary->Value(t) - i;
 	}
@@ -272,7 +340,7 @@ void FringeStoppingFitter::GetMeanValue(num_t &rMean, num_t &iMean, num_t phase,
 	iMean /= (num_t) (xEnd - xStart);
 }
 
-void FringeStoppingFitter::MinimizeRFIFitError(num_t &phase, num_t &amplitude, SampleRowCPtr real, SampleRowCPtr imaginary, unsigned xStart, unsigned xEnd, unsigned y) const throw()
+void FringeStoppingFitter::MinimizeRFIFitError(num_t &phase, num_t &amplitude, SampleRowCPtr real, SampleRowCPtr imaginary, unsigned xStart, unsigned xEnd, const Rotations &rotations) const throw()
 {
 	// calculate 1/N * \sum_x v(t) e^{2 i \pi \tau_g(t)}, where \tau_g(t) is the number of phase rotations
 	// because of the geometric delay as function of time t.
@@ -280,9 +348,6 @@ void FringeStoppingFitter::MinimizeRFIFitError(num_t &phase, num_t &amplitude, S
 	num_t sumR = 0.0, sumI = 0.0;
 	size_t n = 0;
 
-	const num_t dx = _metaData->Antenna2().position.x - _metaData->Antenna1().position.x;
-	const num_t dy = _metaData->Antenna2().position.y - _metaData->Antenna1().position.y;
-		
 	for(unsigned t=xStart;t<xEnd;++t)
 	{
 		const num_t vR = real->Value(t);
@@ -290,16 +355,16 @@ void FringeStoppingFitter::MinimizeRFIFitError(num_t &phase, num_t &amplitude, S
 		
 		if(std::isfinite(vR) && std::isfinite(vI))
 		{
-			const num_t tRotation = UVImager::TimeToEarthLattitude(_metaData->ObservationTimes()[t]);
-			const num_t tauge = UVImager::GetFringeCount(0, t, y, _metaData);
-			const num_t taugeNew = UVImager::GetWPosition(_newPhaseCentreDec, _newPhaseCentreRA, _metaData->Band().channels[y].frequencyHz, tRotation, dx, dy);
-			const num_t phaseShift = tauge - taugeNew;
+			// cos(-2 pi phaseShift) and sin(-2 pi phaseShift)
+			const num_t
+				rotationCos = rotations.cosines[t],
+				rotationSin = -rotations.sines[t];
 	
-			sumR += vR * cosn(-2.0 * M_PIn * phaseShift);
-			sumR += vI * sinn(-2.0 * M_PIn * phaseShift);
+			sumR += vR * rotationCos;
+			sumR += vI * rotationSin;
 	
-			sumI += vR * sinn(-2.0 * M_PIn * phaseShift);
-			sumI -= vI * cosn(-2.0 * M_PIn * phaseShift);
+			sumI += vR * rotationSin;
+			sumI -= vI * rotationCos;
 			++n;
 		}
 	}
@@ -321,23 +386,20 @@ void FringeStoppingFitter::PerformDynamicFrequencyFitOnOneChannel(unsigned y)
 
 void FringeStoppingFitter::PerformDynamicFrequencyFitOnOneRow(SampleRowCPtr real, SampleRowCPtr imaginary, unsigned y)
 {
+	Rotations rotations;
+	CalculateRotations(rotations, y);
 	num_t phase, strength;
-	MinimizeRFIFitError(phase, strength, real, imaginary, 0, _originalData->ImageWidth(), y);
+	MinimizeRFIFitError(phase, strength, real, imaginary, 0, _originalData->ImageWidth(), rotations);
 	AOLogger::Debug << "Amplitude found: " << strength << " phase found: " << phase << '\n';
+	num_t rMean = 0.0, iMean = 0.0;
+	if(_returnFittedValue)
+		GetMeanValue(rMean, iMean, phase, strength, real, imaginary, 0, _originalData->ImageWidth(), rotations);
 	for(size_t x=0;x<_originalData->ImageWidth();++x)
 	{
 		num_t rfiR, rfiI;
-		GetRFIValue(rfiR, rfiI, x, y, phase, strength);
-		if(_returnFittedValue)
-		{
-			num_t rMean, iMean;
-			GetMeanValue(rMean, iMean, phase, strength, real, imaginary, 0, _originalData->ImageWidth(), y);
-			_realBackground->SetValue(x, y, rfiR + rMean);
-			_imaginaryBackground->SetValue(x, y, rfiI + iMean);
-		} else {
-			_realBackground->SetValue(x, y, rfiR);
-			_imaginaryBackground->SetValue(x, y, rfiI);
-		}
+		GetRFIValue(rfiR, rfiI, rotations, x, phase, strength);
+		_realBackground->SetValue(x, y, rfiR + rMean);
+		_imaginaryBackground->SetValue(x, y, rfiI + iMean);
 	}
 }
 
@@ -351,27 +413,58 @@ void FringeStoppingFitter::PerformDynamicFrequencyFitOnOneChannel(unsigned y, un
 
 void FringeStoppingFitter::PerformDynamicFrequencyFitOnOneRow(SampleRowCPtr real, SampleRowCPtr imaginary, unsigned y, unsigned windowSize)
 {
+	Rotations rotations;
+	CalculateRotations(rotations, y);
+
+	// The fit of a window only needs the sum of the rotated samples in the window, so
+	// the cumulative sums of the rotated samples are calculated once for the row.
+	const size_t size = real->Size();
+	std::vector<double> cumulativeR(size+1, 0.0), cumulativeI(size+1, 0.0);
+	std::vector<size_t> cumulativeCount(size+1, 0);
+	for(size_t t=0;t<size;++t)
+	{
+		const num_t vR = real->Value(t);
+		const num_t vI = imaginary->Value(t);
+		cumulativeR[t+1] = cumulativeR[t];
+		cumulativeI[t+1] = cumulativeI[t];
+		cumulativeCount[t+1] = cumulativeCount[t];
+		if(std::isfinite(vR) && std::isfinite(vI))
+		{
+			const num_t
+				rotationCos = rotations.cosines[t],
+				rotationSin = -rotations.sines[t];
+			cumulativeR[t+1] += vR * rotationCos + vI * rotationSin;
+			cumulativeI[t+1] += vR * rotationSin - vI * rotationCos;
+			++cumulativeCount[t+1];
+		}
+	}
+
 	unsigned halfWindowSize = windowSize / 2;
-	for(size_t x=0;x<real->Size();++x)
+	for(size_t x=0;x<size;++x)
 	{
 		size_t windowStart, windowEnd;
 		if(x > halfWindowSize)
 			windowStart = x - halfWindowSize;
 		else
 			windowStart = 0;
-		if(x + halfWindowSize < real->Size())
+		if(x + halfWindowSize < size)
 			windowEnd = x + halfWindowSize;
 		else
-			windowEnd =  real->Size();
-		num_t windowPhase, windowStrength;
-		MinimizeRFIFitError(windowPhase, windowStrength, real, imaginary, windowStart, windowEnd, y);
+			windowEnd = size;
+		const num_t
+			n = cumulativeCount[windowEnd] - cumulativeCount[windowStart],
+			sumR = (cumulativeR[windowEnd] - cumulativeR[windowStart]) / n,
+			sumI = (cumulativeI[windowEnd] - cumulativeI[windowStart]) / n;
+		const num_t
+			windowPhase = SinusFitter::Phase(sumR, sumI),
+			windowStrength = sqrtn(sumR*sumR + sumI*sumI);
 
 		num_t rfiR, rfiI;
-		GetRFIValue(rfiR, rfiI, x, y, windowPhase, windowStrength);
+		GetRFIValue(rfiR, rfiI, rotations, x, windowPhase, windowStrength);
 		if(_returnFittedValue)
 		{
 			num_t rMean, iMean;
-			GetMeanValue(rMean, iMean, windowPhase, windowStrength, real, imaginary, windowStart, windowEnd, y);
+			GetMeanValue(rMean, iMean, windowPhase, windowStrength, real, imaginary, windowStart, windowEnd, rotations);
 			_realBackground->SetValue(x, y, rfiR + rMean);
 			_imaginaryBackground->SetValue(x, y, rfiI + iMean);
 		} else {
@@ -411,7 +504,9 @@ num_t FringeStoppingFitter::GetAmplitude(unsigned yStart, unsigned yEnd)
 	SampleRowPtr
 		real = SampleRow::CreateFromRowSum(_originalData->GetRealPart(), yStart, yEnd),
 		imaginary = SampleRow::CreateFromRowSum(_originalData->GetImaginaryPart(), yStart, yEnd);
+	Rotations rotations;
+	CalculateRotations(rotations, y);
 	num_t phase, amplitude;
-	MinimizeRFIFitError(phase, amplitude, real, imaginary, 0, _originalData->ImageWidth(), y);
+	MinimizeRFIFitError(phase, amplitude, real, imaginary, 0, _originalData->ImageWidth(), rotations);
 	return amplitude;
 }
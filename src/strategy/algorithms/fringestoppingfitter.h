@@ -36,6 +36,10 @@ class FringeStoppingFitter final : public SurfaceFitMethod {
 		{
 			return _fringeFit ? _originalData->ImageHeight() : _originalData->ImageWidth();
 		}
+		/**
+		 * Each task writes its own channel (or timestep) of the background, so tasks may be
+		 * performed concurrently.
+		 */
 		virtual void PerformFit(unsigned taskNumber) final override;
 		void PerformStaticFrequencyFitOnOneChannel(unsigned y);
 		void PerformFringeStop();
@@ -85,15 +89,25 @@ class FringeStoppingFitter final : public SurfaceFitMethod {
 		void SetNewPhaseCentreDec(long double newPhaseCentreDec) { _newPhaseCentreDec = newPhaseCentreDec; }
 		
 	private:
+		/**
+		 * The phasors e^{2 pi i r(t)} of a channel, where r(t) is the number of phase rotations
+		 * relative to the new phase centre at timestep t.
+		 */
+		struct Rotations
+		{
+			std::vector<num_t> cosines, sines;
+		};
+
 		num_t CalculateFitValue(const Image2D &image, size_t y);
 		inline num_t CalculateMaskedAverage(const Image2D &image, size_t x, size_t yFrom, size_t yLength);
 		inline num_t CalculateUnmaskedAverage(const Image2D &image, size_t x, size_t yFrom, size_t yLength);
 		void CalculateFitValue(const Image2D &real, const Image2D &imaginary, size_t x, size_t yFrom, size_t yLength,num_t  &rValue, num_t &iValue);
 		num_t GetFringeFrequency(size_t x, size_t y);
 
-		void GetRFIValue(num_t &r, num_t &i, int x, int y, num_t rfiPhase, num_t rfiStrength);
-		void GetMeanValue(num_t &rMean, num_t &iMean, num_t phase, num_t amplitude, SampleRowCPtr real, SampleRowCPtr imaginary, unsigned xStart, unsigned xEnd, unsigned y);
-		void MinimizeRFIFitError(num_t &phase, num_t &amplitude, SampleRowCPtr real, SampleRowCPtr imaginary, unsigned xStart, unsigned xEnd, unsigned y) const throw();
+		void CalculateRotations(Rotations &rotations, unsigned y) const;
+		void GetRFIValue(num_t &r, num_t &i, const Rotations &rotations, int x, num_t rfiPhase, num_t rfiStrength) const;
+		void GetMeanValue(num_t &rMean, num_t &iMean, num_t phase, num_t amplitude, SampleRowCPtr real, SampleRowCPtr imaginary, unsigned xStart, unsigned xEnd, const Rotations &rotations) const;
+		void MinimizeRFIFitError(num_t &phase, num_t &amplitude, SampleRowCPtr real, SampleRowCPtr imaginary, unsigned xStart, unsigned xEnd, const Rotations &rotations) const throw();
 		
 		void PerformDynamicFrequencyFitOnOneRow(SampleRowCPtr real, SampleRowCPtr imaginary, unsigned y);
 		void PerformDynamicFrequencyFitOnOneRow(SampleRowCPtr real, SampleRowCPtr imaginary, unsigned y, unsigned windowSize);
@@ -3,12 +3,169 @@
 #include "../../structures/image2d.h"
 #include "../../msio/pngfile.h"
 
+#include "../../util/parallelfor.h"
 #include "../../util/rng.h"
 
 #include "thresholdtools.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <limits>
+
+#include <boost/bind.hpp>
+
+namespace {
+	struct AverageFilter
+	{
+		const Image2D *image;
+		const Mask2D *mask;
+		Image2D *output;
+		size_t hSquareSize, vSquareSize, stride;
+		// Summed-area tables with one extra row and column of zeros at the start
+		std::vector<double> sums;
+		std::vector<unsigned> counts;
+
+		void SumRows(size_t startY, size_t endY)
+		{
+			for(size_t y=startY; y!=endY; ++y)
+			{
+				double sum = 0.0;
+				unsigned count = 0;
+				double *sumRow = &sums[(y+1)*stride];
+				unsigned *countRow = &counts[(y+1)*stride];
+				for(size_t x=0; x!=image->Width(); ++x)
+				{
+					const num_t value = image->Value(x, y);
+					if(!mask->Value(x, y) && std::isfinite(value))
+					{
+						sum += value;
+						++count;
+					}
+					sumRow[x+1] = sum;
+					countRow[x+1] = count;
+				}
+			}
+		}
+
+		void SumColumns(size_t startX, size_t endX)
+		{
+			for(size_t y=2; y<=image->Height(); ++y)
+			{
+				for(size_t x=startX+1; x!=endX+1; ++x)
+				{
+					sums[y*stride + x] += sums[(y-1)*stride + x];
+					counts[y*stride + x] += counts[(y-1)*stride + x];
+				}
+			}
+		}
+
+		void Apply(size_t startY, size_t endY)
+		{
+			const size_t width = image->Width(), height = image->Height();
+			for(size_t y=startY; y!=endY; ++y)
+			{
+				const size_t
+					top = (y >= vSquareSize ? y - vSquareSize : 0) * stride,
+					bottom = (std::min(y + vSquareSize, height - 1) + 1) * stride;
+				for(size_t x=0; x!=width; ++x)
+				{
+					const size_t
+						left = x >= hSquareSize ? x - hSquareSize : 0,
+						right = std::min(x + hSquareSize, width - 1) + 1;
+					const unsigned count = counts[bottom + right] - counts[top + right] - counts[bottom + left] + counts[top + left];
+					if(count != 0)
+					{
+						const double sum = sums[bottom + right] - sums[top + right] - sums[bottom + left] + sums[top + left];
+						output->SetValue(x, y, sum / count);
+					}
+					else
+						output->SetValue(x, y, image->Value(x, y));
+				}
+			}
+		}
+	};
+
+	struct MinimumFilter
+	{
+		const Image2D *image;
+		const Mask2D *mask;
+		Image2D *output;
+		size_t hSquareSize, vSquareSize;
+		// Horizontal minima, with infinity where a window has no unflagged values
+		Image2DPtr rowMinima;
+
+		/**
+		 * Minimum over a window of 2 halfWindow + 1 values around each of the n input values,
+		 * clamped at the borders. The values are padded with infinity and split in blocks of
+		 * the window size; each window then covers the end of one block and the start of the
+		 * next, so its minimum is the minimum of a suffix and a prefix minimum.
+		 */
+		static void runningMinimum(const num_t *input, size_t inputStride, size_t n, size_t halfWindow, num_t *output, std::vector<num_t> &prefix, std::vector<num_t> &suffix)
+		{
+			const num_t infinity = std::numeric_limits<num_t>::infinity();
+			const size_t window = 2*halfWindow + 1, paddedSize = n + 2*halfWindow;
+			prefix.resize(paddedSize);
+			suffix.resize(paddedSize);
+			for(size_t blockStart=0; blockStart<paddedSize; blockStart+=window)
+			{
+				const size_t blockEnd = std::min(blockStart + window, paddedSize);
+				num_t minimum = infinity;
+				for(size_t i=blockStart; i!=blockEnd; ++i)
+				{
+					if(i >= halfWindow && i < n + halfWindow)
+						minimum = std::min(minimum, input[(i-halfWindow) * inputStride]);
+					prefix[i] = minimum;
+				}
+				minimum = infinity;
+				for(size_t i=blockEnd; i!=blockStart; )
+				{
+					--i;
+					if(i >= halfWindow && i < n + halfWindow)
+						minimum = std::min(minimum, input[(i-halfWindow) * inputStride]);
+					suffix[i] = minimum;
+				}
+			}
+			for(size_t i=0; i!=n; ++i)
+				output[i] = std::min(suffix[i], prefix[i + 2*halfWindow]);
+		}
+
+		void HorizontalPass(size_t startY, size_t endY)
+		{
+			const size_t width = image->Width();
+			std::vector<num_t> values(width), prefix, suffix;
+			for(size_t y=startY; y!=endY; ++y)
+			{
+				for(size_t x=0; x!=width; ++x)
+				{
+					const num_t value = image->Value(x, y);
+					if(!mask->Value(x, y) && std::isfinite(value))
+						values[x] = value;
+					else
+						values[x] = std::numeric_limits<num_t>::infinity();
+				}
+				runningMinimum(&values[0], 1, width, hSquareSize, rowMinima->ValuePtr(0, y), prefix, suffix);
+			}
+		}
+
+		void VerticalPass(size_t startX, size_t endX)
+		{
+			const size_t height = image->Height();
+			std::vector<num_t> column(height), prefix, suffix;
+			for(size_t x=startX; x!=endX; ++x)
+			{
+				runningMinimum(rowMinima->ValuePtr(x, 0), rowMinima->Stride(), height, vSquareSize, &column[0], prefix, suffix);
+				for(size_t y=0; y!=height; ++y)
+				{
+					if(std::isfinite(column[y]))
+						output->SetValue(x, y, column[y]);
+					else
+						output->SetValue(x, y, image->Value(x, y));
+				}
+			}
+		}
+	};
+}
 
 LocalFitMethod::LocalFitMethod() : _background(0), _weights(0)
 {
@@ -70,7 +227,7 @@ void LocalFitMethod::InitializeGaussianWeights()
 
 unsigned LocalFitMethod::TaskCount()
 {
-	if(_method == FastGaussianWeightedAverage)
+	if(_method == FastGaussianWeightedAverage || _method == Average || _method == Minimum)
 		return 1;
 	else
 		return _original->Height();
@@ -82,6 +239,10 @@ void LocalFitMethod::PerformFit(unsigned taskNumber)
 		throw BadUsageException("Mask has not been set!");
 	if(_method == FastGaussianWeightedAverage) {
 		CalculateWeightedAverageFast();
+	} else if(_method == Average) {
+		CalculateAverageFast();
+	} else if(_method == Minimum) {
+		CalculateMinimumFast();
 	} else {
 		unsigned y = taskNumber;
 		for(unsigned x=0;x<_original->Width();++x)
@@ -116,13 +277,11 @@ long double LocalFitMethod::CalculateBackgroundValue(unsigned x, unsigned y)
 	switch(_method) {
 		case None:
 		case FastGaussianWeightedAverage:
+		case Average:
+		case Minimum:
 			return 0.0;
 		case Median:
 			return CalculateMedian(x, y, local);
-		case Minimum:
-			return CalculateMinimum(x, y, local);
-		case Average:
-			return CalculateAverage(x, y, local);
 		case GaussianWeightedAverage:
 			return CalculateWeightedAverage(x, y, local);
 		default:
@@ -130,24 +289,6 @@ long double LocalFitMethod::CalculateBackgroundValue(unsigned x, unsigned y)
 	}
 }
 
-long double LocalFitMethod::CalculateAverage(unsigned x, unsigned y, ThreadLocal &local)
-{
-	long double sum = 0.0;
-	unsigned long count = 0;
-	for(unsigned yi=local.startY;yi<=local.endY;++yi) {
-		for(unsigned xi=local.startX;xi<=local.endX;++xi) {
-			if(!_mask->Value(xi, yi) && std::isfinite(_original->Value(xi, yi))) {
-				sum += _original->Value(xi, yi);
-				++count;
-			}
-		}
-	}
-	if(count != 0)
-		return sum / (long double) count;
-	else
-		return _original->Value(x, y);
-}
-
 long double LocalFitMethod::CalculateMedian(unsigned x, unsigned y, ThreadLocal &local)
 {
 	//unsigned maxSize = (local.endY-local.startY)*(local.endX-local.startX);
@@ -179,24 +320,6 @@ long double LocalFitMethod::CalculateMedian(unsigned x, unsigned y, ThreadLocal
 	}
 }
 
-long double LocalFitMethod::CalculateMinimum(unsigned x, unsigned y, ThreadLocal &local)
-{
-	long double minimum = 1e100;
-	unsigned long count = 0;
-	for(unsigned yi=local.startY;yi<=local.endY;++yi) {
-		for(unsigned xi=local.startX;xi<=local.endX;++xi) {
-			if(!_mask->Value(xi, yi) && std::isfinite(_original->Value(xi, yi)) && _original->Value(xi, yi) < minimum) {
-				minimum = _original->Value(xi, yi);
-				++count;
-			}
-		}
-	}
-	if(count==0)
-		return _original->Value(x, y);
-	else
-		return minimum;
-}
-
 long double LocalFitMethod::CalculateWeightedAverage(unsigned x, unsigned y, ThreadLocal &local)
 {
 	long double sum = 0.0;
@@ -251,6 +374,35 @@ void LocalFitMethod::CalculateWeightedAverageFast()
 	ElementWiseDivide(_background2D, flagWeights);
 }
 
+void LocalFitMethod::CalculateAverageFast()
+{
+	AverageFilter filter;
+	filter.image = _original.get();
+	filter.mask = _mask.get();
+	filter.output = _background2D.get();
+	filter.hSquareSize = _hSquareSize;
+	filter.vSquareSize = _vSquareSize;
+	filter.stride = _original->Width() + 1;
+	filter.sums.assign(filter.stride * (_original->Height() + 1), 0.0);
+	filter.counts.assign(filter.stride * (_original->Height() + 1), 0);
+	ParallelFor::Run(_original->Height(), boost::bind(&AverageFilter::SumRows, &filter, _1, _2));
+	ParallelFor::Run(_original->Width(), boost::bind(&AverageFilter::SumColumns, &filter, _1, _2));
+	ParallelFor::Run(_original->Height(), boost::bind(&AverageFilter::Apply, &filter, _1, _2));
+}
+
+void LocalFitMethod::CalculateMinimumFast()
+{
+	MinimumFilter filter;
+	filter.image = _original.get();
+	filter.mask = _mask.get();
+	filter.output = _background2D.get();
+	filter.hSquareSize = _hSquareSize;
+	filter.vSquareSize = _vSquareSize;
+	filter.rowMinima = Image2D::CreateUnsetImagePtr(_original->Width(), _original->Height());
+	ParallelFor::Run(_original->Height(), boost::bind(&MinimumFilter::HorizontalPass, &filter, _1, _2));
+	ParallelFor::Run(_original->Width(), boost::bind(&MinimumFilter::VerticalPass, &filter, _1, _2));
+}
+
 void LocalFitMethod::ElementWiseDivide(Image2DPtr leftHand, Image2DCPtr rightHand)
 {
 	for(unsigned y=0;y<leftHand->Height();++y) {
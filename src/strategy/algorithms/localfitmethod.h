@@ -75,14 +75,25 @@ class LocalFitMethod final : public SurfaceFitMethod {
 		};
 		long double CalculateBackgroundValue(unsigned x, unsigned y);
 		long double FitBackground(unsigned x, unsigned y, ThreadLocal &local);
-		long double CalculateAverage(unsigned x, unsigned y, ThreadLocal &local);
 		long double CalculateMedian(unsigned x, unsigned y, ThreadLocal &local);
-		long double CalculateMinimum(unsigned x, unsigned y, ThreadLocal &local);
 		long double CalculateWeightedAverage(unsigned x, unsigned y, ThreadLocal &local);
 		void ClearWeights();
 		void InitializeGaussianWeights();
 		void PerformGaussianConvolution(Image2DPtr input);
 		void CalculateWeightedAverageFast();
+		/**
+		 * Average of the unflagged values in the window around each sample, from a summed-area
+		 * table of the values and one of their counts. The cost per sample does not depend on
+		 * the window size. The table is summed in double precision, so the result matches the
+		 * direct average to well within single precision (the tests use 1e-5).
+		 */
+		void CalculateAverageFast();
+		/**
+		 * Minimum of the unflagged values in the window around each sample, calculated as a
+		 * horizontal followed by a vertical running minimum with the van Herk/Gil-Werman
+		 * algorithm, which takes three comparisons per sample for any window size.
+		 */
+		void CalculateMinimumFast();
 		Image2DPtr CreateFlagWeightsMatrix();
 		void ElementWiseDivide(Image2DPtr leftHand, Image2DCPtr rightHand);
 
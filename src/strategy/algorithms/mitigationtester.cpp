@@ -6,6 +6,7 @@
 #include <math.h>
 
 #include "../../structures/image2d.h"
+#include "../../structures/timefrequencydata.h"
 #include "../../msio/pngfile.h"
 
 #include "../../util/aologger.h"
@@ -246,6 +247,36 @@ Image2D *MitigationTester::CreateGaussianData(unsigned width, unsigned height)
 	return image; 
 }
 
+TimeFrequencyData MitigationTester::CreateLowRankData(size_t width, size_t height, const std::vector<double> &amplitudes)
+{
+	Image2DPtr
+		real(CreateGaussianData(width, height)),
+		imaginary(CreateGaussianData(width, height));
+	std::vector<double> uR(height), uI(height), vR(width), vI(width);
+	for(std::vector<double>::const_iterator a=amplitudes.begin(); a!=amplitudes.end(); ++a)
+	{
+		for(size_t y=0; y!=height; ++y)
+		{
+			uR[y] = RNG::Gaussian();
+			uI[y] = RNG::Gaussian();
+		}
+		for(size_t x=0; x!=width; ++x)
+		{
+			vR[x] = RNG::Gaussian();
+			vI[x] = RNG::Gaussian();
+		}
+		for(size_t y=0; y!=height; ++y)
+		{
+			for(size_t x=0; x!=width; ++x)
+			{
+				real->AddValue(x, y, *a * (uR[y]*vR[x] - uI[y]*vI[x]));
+				imaginary->AddValue(x, y, *a * (uR[y]*vI[x] + uI[y]*vR[x]));
+			}
+		}
+	}
+	return TimeFrequencyData(Polarization::StokesI, real, imaginary);
+}
+
 std::string MitigationTester::GetTestSetDescription(int number)
 {
 	switch(number)
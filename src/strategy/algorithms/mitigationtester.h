@@ -35,6 +35,12 @@ class MitigationTester{
 
 		static class Image2D *CreateRayleighData(unsigned width, unsigned height);
 		static class Image2D *CreateGaussianData(unsigned width, unsigned height);
+		/**
+		 * Creates complex Gaussian noise with unit variance plus a sum of rank-one components
+		 * with the given amplitudes. Each component is the product of a random complex vector
+		 * over frequency and one over time, which is what the SVD mitigater removes.
+		 */
+		static class TimeFrequencyData CreateLowRankData(size_t width, size_t height, const std::vector<double> &amplitudes);
 		static class Image2D *CreateNoise(unsigned width, unsigned height, int gaussian)
 		{
 			if(gaussian==1)
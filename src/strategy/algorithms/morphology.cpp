@@ -2,10 +2,200 @@
 #include "statisticalflagger.h"
 
 #include "../../util/aologger.h"
+#include "../../util/parallelfor.h"
 
-#include <stack>
+#include <algorithm>
 #include <iostream>
 
+#include <boost/bind.hpp>
+
+namespace {
+	/**
+	 * Labels the 4-connected components of samples with the same non-zero class. Each row
+	 * is split into runs of samples of the same class, and overlapping runs of consecutive
+	 * rows are joined with union-find. Stripes of rows are processed in parallel, after which
+	 * the stripes are joined at their seams. Components are numbered in the order of their
+	 * first sample in row-major order.
+	 */
+	class ComponentLabeller
+	{
+		public:
+			struct Run
+			{
+				unsigned y, xStart, xEnd;
+				unsigned char sampleClass;
+			};
+
+			/**
+			 * @param stripeCount Number of stripes, or zero to use one stripe per thread
+			 * with at least a minimum number of rows per stripe.
+			 */
+			ComponentLabeller(const std::vector<unsigned char> &classes, size_t width, size_t height, size_t stripeCount) :
+				_classes(classes), _width(width), _height(height)
+			{
+				const size_t minRowsPerStripe = 32;
+				if(stripeCount == 0)
+					stripeCount = ParallelFor::ThreadCount(height / minRowsPerStripe);
+				else
+					stripeCount = std::max<size_t>(1, std::min(stripeCount, height));
+				_stripes.resize(stripeCount);
+				for(size_t s=0;s<stripeCount;++s)
+				{
+					_stripes[s].yStart = height*s/stripeCount;
+					_stripes[s].yEnd = height*(s+1)/stripeCount;
+				}
+				runOnStripes(&ComponentLabeller::findRuns);
+
+				_rowStarts.resize(height + 1);
+				if(stripeCount == 1)
+				{
+					_runs.swap(_stripes[0].runs);
+					std::copy(_stripes[0].rowStarts.begin(), _stripes[0].rowStarts.end(), _rowStarts.begin());
+				} else {
+					size_t runCount = 0;
+					for(size_t s=0;s<stripeCount;++s)
+						runCount += _stripes[s].runs.size();
+					_runs.reserve(runCount);
+					for(size_t s=0;s<stripeCount;++s)
+					{
+						Stripe &stripe = _stripes[s];
+						for(size_t y=stripe.yStart;y<stripe.yEnd;++y)
+							_rowStarts[y] = _runs.size() + stripe.rowStarts[y - stripe.yStart];
+						_runs.insert(_runs.end(), stripe.runs.begin(), stripe.runs.end());
+						std::vector<Run>().swap(stripe.runs);
+					}
+				}
+				_rowStarts[height] = _runs.size();
+
+				_parents.resize(_runs.size());
+				for(size_t i=0;i<_runs.size();++i)
+					_parents[i] = i;
+				runOnStripes(&ComponentLabeller::joinStripe);
+				for(size_t s=1;s<stripeCount;++s)
+					joinRows(_stripes[s].yStart);
+
+				// Runs are always joined to the root with the lowest index, so the parent of a run
+				// has a lower index and a run that is its own root is the first run of its
+				// component. This allows replacing the parents by component numbers in one pass.
+				_componentCount = 0;
+				for(size_t i=0;i<_runs.size();++i)
+				{
+					if(_parents[i] == i)
+					{
+						_parents[i] = _componentCount;
+						++_componentCount;
+					}
+					else
+						_parents[i] = _parents[_parents[i]];
+				}
+			}
+
+			size_t ComponentCount() const { return _componentCount; }
+			const std::vector<Run> &Runs() const { return _runs; }
+			size_t Component(size_t runIndex) const { return _parents[runIndex]; }
+
+		private:
+			struct Stripe
+			{
+				size_t yStart, yEnd;
+				std::vector<Run> runs;
+				std::vector<size_t> rowStarts;
+			};
+
+			void runOnStripes(void (ComponentLabeller::*function)(size_t))
+			{
+				ParallelFor::Run(_stripes.size(), boost::bind(&ComponentLabeller::runOnStripeRange, this, function, _1, _2));
+			}
+
+			void runOnStripeRange(void (ComponentLabeller::*function)(size_t), size_t start, size_t end)
+			{
+				for(size_t s=start;s<end;++s)
+					(this->*function)(s);
+			}
+
+			void findRuns(size_t stripeIndex)
+			{
+				Stripe &stripe = _stripes[stripeIndex];
+				for(size_t y=stripe.yStart;y<stripe.yEnd;++y)
+				{
+					stripe.rowStarts.push_back(stripe.runs.size());
+					const unsigned char *row = &_classes[y*_width];
+					size_t x = 0;
+					while(x < _width)
+					{
+						if(row[x] == 0)
+							++x;
+						else {
+							Run run;
+							run.y = y;
+							run.xStart = x;
+							run.sampleClass = row[x];
+							do { ++x; } while(x < _width && row[x] == run.sampleClass);
+							run.xEnd = x;
+							stripe.runs.push_back(run);
+						}
+					}
+				}
+			}
+
+			void joinStripe(size_t stripeIndex)
+			{
+				const Stripe &stripe = _stripes[stripeIndex];
+				for(size_t y=stripe.yStart+1;y<stripe.yEnd;++y)
+					joinRows(y);
+			}
+
+			/**
+			 * Joins the runs of row y with the overlapping runs of the same class of row y-1.
+			 */
+			void joinRows(size_t y)
+			{
+				size_t
+					above = _rowStarts[y-1], aboveEnd = _rowStarts[y],
+					current = _rowStarts[y], currentEnd = _rowStarts[y+1];
+				while(above != aboveEnd && current != currentEnd)
+				{
+					const Run &a = _runs[above], &c = _runs[current];
+					if(a.xStart < c.xEnd && c.xStart < a.xEnd && a.sampleClass == c.sampleClass)
+						unite(above, current);
+					if(a.xEnd < c.xEnd)
+						++above;
+					else
+						++current;
+				}
+			}
+
+			size_t find(size_t run)
+			{
+				while(_parents[run] != run)
+				{
+					_parents[run] = _parents[_parents[run]];
+					run = _parents[run];
+				}
+				return run;
+			}
+
+			void unite(size_t a, size_t b)
+			{
+				a = find(a);
+				b = find(b);
+				if(a < b)
+					_parents[b] = a;
+				else if(b < a)
+					_parents[a] = b;
+			}
+
+			const std::vector<unsigned char> &_classes;
+			size_t _width, _height;
+			std::vector<Stripe> _stripes;
+			std::vector<Run> _runs;
+			std::vector<size_t> _rowStarts;
+			// Parent runs while joining, component numbers afterwards
+			std::vector<size_t> _parents;
+			size_t _componentCount;
+	};
+}
+
 size_t
 	Morphology::BROADBAND_SEGMENT = 1,
 	Morphology::LINE_SEGMENT = 2,
@@ -19,25 +209,40 @@ void Morphology::SegmentByMaxLength(Mask2DCPtr mask, SegmentedImagePtr output)
 	
 	calculateOpenings(mask, lengthWidthValues);
 
-	for(size_t y=0;y<mask->Height();++y)
-	{
-		for(size_t x=0;x<mask->Width();++x)
-			output->SetValue(x,y,0);
-	}
+	// Flagged samples are connected when both are longest in the same direction
+	std::vector<unsigned char> classes(mask->Width() * mask->Height());
 	for(size_t y=0;y<mask->Height();++y)
 	{
 		for(size_t x=0;x<mask->Width();++x)
 		{
-			if(mask->Value(x, y) && output->Value(x,y) == 0)
-			{
-				floodFill(mask, output, lengthWidthValues, x, y, output->NewSegmentValue());
-			}
+			if(mask->Value(x, y))
+				classes[y*mask->Width() + x] = lengthWidthValues[y][x] > 0 ? 1 : 2;
+			else
+				classes[y*mask->Width() + x] = 0;
 		}
 	}
 		
 	for(size_t y=0;y<mask->Height();++y)
 		delete[] lengthWidthValues[y];
 	delete[] lengthWidthValues;
+
+	ComponentLabeller labeller(classes, mask->Width(), mask->Height(), _labellingStripeCount);
+	std::vector<size_t> segmentValues(labeller.ComponentCount());
+	for(size_t i=0;i<segmentValues.size();++i)
+		segmentValues[i] = output->NewSegmentValue();
+
+	for(size_t y=0;y<mask->Height();++y)
+	{
+		for(size_t x=0;x<mask->Width();++x)
+			output->SetValue(x,y,0);
+	}
+	const std::vector<ComponentLabeller::Run> &runs = labeller.Runs();
+	for(size_t i=0;i<runs.size();++i)
+	{
+		const size_t value = segmentValues[labeller.Component(i)];
+		for(size_t x=runs[i].xStart;x<runs[i].xEnd;++x)
+			output->SetValue(x, runs[i].y, value);
+	}
 }
 
 void Morphology::SegmentByLengthRatio(Mask2DCPtr mask, SegmentedImagePtr output)
@@ -79,15 +284,50 @@ void Morphology::SegmentByLengthRatio(Mask2DCPtr mask, SegmentedImagePtr output)
 	calculateHorizontalCounts(matrices[0], hCounts);
 	calculateVerticalCounts(matrices[2], vCounts);
 
+	// Matrix 1 (samples with about equal counts) is currently always empty, so the horizontal
+	// and vertical segments are not connected through it.
+	std::vector<unsigned char> classes(mask->Width() * mask->Height());
 	for(size_t z=0;z<3;z+=2)
 	{
 		for(size_t y=0;y<mask->Height();++y)
 		{
 			for(size_t x=0;x<mask->Width();++x)
+				classes[y*mask->Width() + x] = matrices[z]->Value(x, y) ? 1 : 0;
+		}
+		ComponentLabeller labeller(classes, mask->Width(), mask->Height(), _labellingStripeCount);
+		const std::vector<ComponentLabeller::Run> &runs = labeller.Runs();
+
+		// Horizontal segments are all numbered. A vertical segment is only numbered when it
+		// has samples that are not yet part of a horizontal segment, in the order of its
+		// first such sample.
+		const size_t unnumbered = (size_t) -1;
+		std::vector<size_t> segmentValues(labeller.ComponentCount(), unnumbered);
+		for(size_t i=0;i<runs.size();++i)
+		{
+			size_t &value = segmentValues[labeller.Component(i)];
+			if(value == unnumbered)
+			{
+				bool hasUnsegmented = (z == 0);
+				for(size_t x=runs[i].xStart;x<runs[i].xEnd && !hasUnsegmented;++x)
+					hasUnsegmented = output->Value(x, runs[i].y) == 0;
+				if(hasUnsegmented)
+					value = output->NewSegmentValue();
+			}
+		}
+
+		for(size_t i=0;i<runs.size();++i)
+		{
+			const size_t value = segmentValues[labeller.Component(i)];
+			if(value == unnumbered)
+				continue;
+			const size_t y = runs[i].y;
+			for(size_t x=runs[i].xStart;x<runs[i].xEnd;++x)
 			{
-				if(matrices[z]->Value(x, y) && output->Value(x, y)==0)
+				if(mask->Value(x, y))
 				{
-					floodFill(mask, output, matrices, x, y, z, output->NewSegmentValue(), hCounts, vCounts);
+					// A vertical segment takes over samples with a longer vertical count
+					if(output->Value(x, y) == 0 || (z == 2 && hCounts[y][x] < vCounts[y][x]))
+						output->SetValue(x, y, value);
 				}
 			}
 		}
@@ -235,121 +475,6 @@ void Morphology::calculateOpenings(Mask2DCPtr mask, Mask2DPtr *values, int **hCo
 	}
 }
 
-struct MorphologyPoint2D { size_t x, y; };
-struct MorphologyPoint3D { size_t x, y, z; };
-
-void Morphology::floodFill(Mask2DCPtr mask, SegmentedImagePtr output, const int *const *lengthWidthValues, size_t x, size_t y, size_t value)
-{
-	std::stack<MorphologyPoint2D> points;
-	MorphologyPoint2D startPoint;
-	startPoint.x = x;
-	startPoint.y = y;
-	points.push(startPoint);
-	do {
-		MorphologyPoint2D p = points.top();
-		points.pop();
-		output->SetValue(p.x, p.y, value);
-		int z = lengthWidthValues[p.y][p.x];
-		if(p.x > 0 && output->Value(p.x-1, p.y) == 0 && mask->Value(p.x-1,p.y))
-		{
-			int zl = lengthWidthValues[p.y][p.x-1];
-			if((zl > 0 && z > 0) || (zl < 0 && z < 0))
-			{
-				MorphologyPoint2D newP;
-				newP.x = p.x-1; newP.y = p.y;
-				points.push(newP);
-			}
-		}
-		if(p.x < mask->Width()-1 && output->Value(p.x+1, p.y)==0 && mask->Value(p.x+1,p.y))
-		{
-			int zr = lengthWidthValues[p.y][p.x+1];
-			if((zr > 0 && z > 0) || (zr < 0 && z < 0))
-			{
-				MorphologyPoint2D newP;
-				newP.x = p.x+1; newP.y = p.y;
-				points.push(newP);
-			}
-		}
-		if(p.y > 0 && output->Value(p.x, p.y-1)==0 && mask->Value(p.x,p.y-1))
-		{
-			int zt = lengthWidthValues[p.y-1][p.x];
-			if((zt > 0 && z > 0) || (zt < 0 && z < 0))
-			{
-				MorphologyPoint2D newP;
-				newP.x = p.x; newP.y = p.y-1;
-				points.push(newP);
-			}
-		}
-		if(p.y < mask->Height()-1 && output->Value(p.x, p.y+1)==0 && mask->Value(p.x,p.y+1))
-		{
-			int zb = lengthWidthValues[p.y+1][p.x];
-			if((zb > 0 && z > 0) || (zb < 0 && z < 0))
-			{
-				MorphologyPoint2D newP;
-				newP.x = p.x; newP.y = p.y+1;
-				points.push(newP);
-			}
-		}
-	} while(points.size() != 0);
-}
-
-void Morphology::floodFill(Mask2DCPtr mask, SegmentedImagePtr output, Mask2DPtr *matrices, size_t x, size_t y, size_t z, size_t value, int **hCounts, int **vCounts)
-{
-	std::stack<MorphologyPoint3D> points;
-	MorphologyPoint3D startPoint;
-	startPoint.x = x;
-	startPoint.y = y;
-	startPoint.z = z;
-	points.push(startPoint);
-	do {
-		MorphologyPoint3D p = points.top();
-		points.pop();
-		if(mask->Value(p.x, p.y))
-		{
-			if(output->Value(p.x, p.y) == 0)
-			{
-				output->SetValue(p.x, p.y, value);
-			} else {
-				// now we need to decide whether to change this sample to the new segment or not
-				if(hCounts[p.y][p.x] < vCounts[p.y][p.x] && p.z == 2)
-					output->SetValue(p.x, p.y, value);
-			}
-		}
-		Mask2DPtr matrix = matrices[p.z];
-		matrix->SetValue(p.x, p.y, false);
-		if((p.z == 0 || p.z == 2) && matrices[1]->Value(p.x,p.y))
-		{
-			MorphologyPoint3D newP;
-			newP.x = p.x; newP.y = p.y; newP.z = 1;
-			points.push(newP);
-		}
-		if(p.x > 0 && matrix->Value(p.x-1,p.y))
-		{
-			MorphologyPoint3D newP;
-			newP.x = p.x-1; newP.y = p.y; newP.z = p.z;
-			points.push(newP);
-		}
-		if(p.x < mask->Width()-1 && matrix->Value(p.x+1,p.y))
-		{
-			MorphologyPoint3D newP;
-			newP.x = p.x+1; newP.y = p.y; newP.z = p.z;
-			points.push(newP);
-		}
-		if(p.y > 0 && matrix->Value(p.x,p.y-1))
-		{
-			MorphologyPoint3D newP;
-			newP.x = p.x; newP.y = p.y-1; newP.z = p.z;
-			points.push(newP);
-		}
-		if(p.y < mask->Height()-1 && matrix->Value(p.x,p.y+1))
-		{
-			MorphologyPoint3D newP;
-			newP.x = p.x; newP.y = p.y+1; newP.z = p.z;
-			points.push(newP);
-		}
-	} while(points.size() != 0);
-}
-
 void Morphology::Cluster(SegmentedImagePtr segmentedImage)
 {
 	std::map<size_t,SegmentInfo> segments = createSegmentMap(segmentedImage);
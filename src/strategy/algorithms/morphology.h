@@ -9,8 +9,14 @@
 
 class Morphology {
 	public:
-		Morphology() : _hLineEnlarging(1), _vLineEnlarging(1), _hDensityEnlargeRatio(0.5), _vDensityEnlargeRatio(0.5) { }
+		Morphology() : _hLineEnlarging(1), _vLineEnlarging(1), _hDensityEnlargeRatio(0.5), _vDensityEnlargeRatio(0.5), _labellingStripeCount(0) { }
 		~Morphology() { }
+
+		/**
+		 * Sets the number of stripes of rows that are labelled in parallel by the segmentation
+		 * methods. The default of zero selects one stripe per thread for large masks.
+		 */
+		void SetLabellingStripeCount(size_t stripeCount) { _labellingStripeCount = stripeCount; }
 		
 		void SegmentByMaxLength(Mask2DCPtr mask, SegmentedImagePtr output);
 		void SegmentByLengthRatio(Mask2DCPtr mask, SegmentedImagePtr output);
@@ -69,13 +75,12 @@ class Morphology {
 		void calculateOpenings(Mask2DCPtr mask, Mask2DPtr *values, int **hCounts, int **vCounts);
 		void calculateVerticalCounts(Mask2DCPtr mask, int **values);
 		void calculateHorizontalCounts(Mask2DCPtr mask, int **values);
-		void floodFill(Mask2DCPtr mask, SegmentedImagePtr output, const int *const *lengthWidthValues, size_t x, size_t y, size_t value);
-		void floodFill(Mask2DCPtr mask, SegmentedImagePtr output, Mask2DPtr *matrices, size_t x, size_t y, size_t z, size_t value, int **hCounts, int **vCounts);
 		std::map<size_t,SegmentInfo> createSegmentMap(SegmentedImageCPtr segmentedImage) const;
 		
 		size_t _hLineEnlarging;
 		size_t _vLineEnlarging;
 		double _hDensityEnlargeRatio, _vDensityEnlargeRatio;
+		size_t _labellingStripeCount;
 };
 
 #endif
@@ -1,9 +1,14 @@
 #ifndef SIROPERATOR_H
 #define SIROPERATOR_H
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <stdint.h>
+
 #include "../../structures/mask2d.h"
 #include "../../structures/types.h"
-#include "../../structures/xyswappedmask2d.h"
 
 /**
  * This class contains functions that implement an algorithm to dilate
@@ -124,7 +129,6 @@ class SIROperator
 		
 		/**
 		 * Performs a horizontal dilation directly on a mask. Algorithm is equal to Dilate().
-		 * This is the implementation.
 		 * 
 		 * @param [in,out] mask The input flag mask to be dilated.
 		 * @param [in] eta The η parameter that specifies the minimum number of good data
@@ -132,7 +136,7 @@ class SIROperator
 		 */
 		static void OperateHorizontally(Mask2DPtr &mask, num_t eta)
 		{
-			operateHorizontally<Mask2D>(*mask, eta);
+			operateHorizontally(*mask, eta);
 		}
 		
 		/**
@@ -144,82 +148,157 @@ class SIROperator
 		 */
 		static void OperateVertically(Mask2DPtr mask, num_t eta)
 		{
-			XYSwappedMask2D swappedMask(*mask);
-			operateHorizontally<XYSwappedMask2D>(swappedMask, eta);
+			operateVertically(*mask, eta);
 		}
 		
 	private:
 		SIROperator() { }
+		
+		/**
+		 * Number of columns that operateVertically() processes at the same time.
+		 */
+		static const size_t columnBlockSize = 64;
 
 		/**
-		 * Performs a horizontal dilation directly on a mask. Algorithm is equal to Dilate().
-		 * This is the implementation.
+		 * Counts the flags in a row of the mask. Booleans are stored as bytes that are
+		 * zero or one, so that the flags of eight samples are counted at once with a popcount.
+		 */
+		static size_t countFlags(const bool *values, size_t count)
+		{
+			size_t flagCount = 0, i = 0;
+			for(; i+8 <= count; i+=8)
+			{
+				uint64_t word;
+				memcpy(&word, values + i, 8);
+				flagCount += __builtin_popcountll(word);
+			}
+			for(; i!=count; ++i)
+				if(values[i]) ++flagCount;
+			return flagCount;
+		}
+		
+		/**
+		 * A sequence without flags is not dilated when η < 1, and a sequence that is completely
+		 * flagged stays flagged when η >= 0. Such sequences are common and are skipped.
+		 */
+		static bool isUnchanged(size_t flagCount, size_t count, num_t eta)
+		{
+			return (flagCount == 0 && eta < 1.0) || (flagCount == count && eta >= 0.0);
+		}
+
+		/**
+		 * Performs a horizontal dilation directly on a mask. Algorithm is equal to Dilate(),
+		 * but the minimum prefixes and maximum suffixes are stored as values instead of as
+		 * indices. This is the implementation.
 		 * 
 		 * @param [in,out] mask The input flag mask to be dilated.
 		 * @param [in] eta The η parameter that specifies the minimum number of good data
 		 * that any subsequence should have.
 		 */
-		template<typename MaskLike>
-		static void operateHorizontally(MaskLike &mask, num_t eta)
+		static void operateHorizontally(Mask2D &mask, num_t eta)
 		{
-			const unsigned
-				width = mask.Width(),
-				wSize = width+1;
-			num_t
-				*values = new num_t[width],
-				*w = new num_t[wSize];
-			unsigned
-				*minIndices = new unsigned[wSize],
-				*maxIndices = new unsigned[wSize];
+			const size_t width = mask.Width();
+			const num_t
+				flaggedValue = eta,
+				unflaggedValue = eta - 1.0;
+			std::vector<num_t>
+				w(width+1),
+				minW(width+1);
 			
-			for(unsigned row=0;row<mask.Height();++row)
+			for(size_t row=0;row<mask.Height();++row)
 			{
-				for(unsigned i=0 ; i<width ; ++i)
-				{
-					if(mask.Value(i, row))
-						values[i] = eta;
-					else
-						values[i] = eta - 1.0;
-				}
+				bool *values = mask.ValuePtr(0, row);
+				if(isUnchanged(countFlags(values, width), width, eta))
+					continue;
 				
 				w[0] = 0.0;
-				unsigned currentMinIndex = 0;
-				minIndices[0] = 0;
-				for(unsigned i=1 ; i!=wSize ; ++i)
+				minW[0] = 0.0;
+				for(size_t i=1 ; i!=width+1 ; ++i)
 				{
-					w[i] = w[i-1] + values[i-1];
-
-					if(w[i] < w[currentMinIndex])
-					{
-						currentMinIndex = i;
-					}
-					minIndices[i] = currentMinIndex;
+					w[i] = w[i-1] + (values[i-1] ? flaggedValue : unflaggedValue);
+					minW[i] = (w[i] < minW[i-1]) ? w[i] : minW[i-1];
 				}
 				
-				// Calculate the maximum suffixes
-				unsigned currentMaxIndex = wSize-1;
-				for(unsigned i=width-1 ; i!=0 ; --i)
+				// The maximum suffix of i is the maximum of w over i < y <= N
+				num_t maxW = w[width];
+				for(size_t i=width ; i!=0 ; --i)
 				{
-					maxIndices[i] = currentMaxIndex;
-					if(w[i] > w[currentMaxIndex])
+					const num_t sequenceW = maxW - minW[i-1];
+					values[i-1] = (sequenceW >= 0.0);
+					if(w[i-1] > maxW)
+						maxW = w[i-1];
+				}
+			}
+		}
+		
+		/**
+		 * Performs a vertical dilation directly on a mask. The columns are processed in
+		 * blocks of columnBlockSize, with the rows of the mask read consecutively, which is
+		 * faster than performing the horizontal algorithm on an XYSwappedMask2D. The arithmetic
+		 * per column is equal to that of operateHorizontally().
+		 */
+		static void operateVertically(Mask2D &mask, num_t eta)
+		{
+			const size_t width = mask.Width(), height = mask.Height();
+			const num_t
+				flaggedValue = eta,
+				unflaggedValue = eta - 1.0;
+			
+			std::vector<size_t> flagCounts(width, 0);
+			for(size_t y=0;y!=height;++y)
+			{
+				const bool *values = mask.ValuePtr(0, y);
+				for(size_t x=0;x!=width;++x)
+					flagCounts[x] += values[x];
+			}
+			std::vector<size_t> columns;
+			for(size_t x=0;x!=width;++x)
+			{
+				if(!isUnchanged(flagCounts[x], height, eta))
+					columns.push_back(x);
+			}
+			
+			const size_t blockSize = columnBlockSize;
+			std::vector<num_t>
+				w((height+1) * blockSize),
+				minW((height+1) * blockSize),
+				maxW(blockSize);
+			for(size_t blockStart=0;blockStart<columns.size();blockStart+=blockSize)
+			{
+				const size_t *blockColumns = &columns[blockStart];
+				const size_t count = std::min(blockSize, columns.size() - blockStart);
+				for(size_t c=0;c!=count;++c)
+				{
+					w[c] = 0.0;
+					minW[c] = 0.0;
+				}
+				for(size_t y=0;y!=height;++y)
+				{
+					const bool *values = mask.ValuePtr(0, y);
+					const num_t *prevW = &w[y * blockSize], *prevMinW = &minW[y * blockSize];
+					num_t *curW = &w[(y+1) * blockSize], *curMinW = &minW[(y+1) * blockSize];
+					for(size_t c=0;c!=count;++c)
 					{
-						currentMaxIndex = i;
+						curW[c] = prevW[c] + (values[blockColumns[c]] ? flaggedValue : unflaggedValue);
+						curMinW[c] = (curW[c] < prevMinW[c]) ? curW[c] : prevMinW[c];
 					}
 				}
-				maxIndices[0] = currentMaxIndex;
 				
-				// See if max sequence exceeds limit.
-				for(unsigned i=0 ; i!=width ; ++i )
+				for(size_t c=0;c!=count;++c)
+					maxW[c] = w[height * blockSize + c];
+				for(size_t y=height;y!=0;--y)
 				{
-					const num_t maxW = w[maxIndices[i]] - w[minIndices[i]];
-					mask.SetValue(i, row, (maxW >= 0.0));
+					bool *values = mask.ValuePtr(0, y-1);
+					const num_t *prevW = &w[(y-1) * blockSize], *prevMinW = &minW[(y-1) * blockSize];
+					for(size_t c=0;c!=count;++c)
+					{
+						const num_t sequenceW = maxW[c] - prevMinW[c];
+						values[blockColumns[c]] = (sequenceW >= 0.0);
+						if(prevW[c] > maxW[c])
+							maxW[c] = prevW[c];
+					}
 				}
 			}
-			// Free our temporaries
-			delete[] maxIndices;
-			delete[] minIndices;
-			delete[] w;
-			delete[] values;
 		}
 };
 
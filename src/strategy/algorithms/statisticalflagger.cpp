@@ -1,5 +1,100 @@
 #include "statisticalflagger.h"
 
+#include <algorithm>
+
+namespace {
+	/**
+	 * Sets each bit x of the words to the OR of bits x and x + shift. Bits after the end
+	 * are considered to be zero.
+	 */
+	void orShiftedDown(uint64_t *words, size_t wordCount, size_t shift)
+	{
+		const size_t wordShift = shift / 64, bitShift = shift % 64;
+		for(size_t i=0;i+wordShift<wordCount;++i)
+		{
+			uint64_t value = words[i + wordShift] >> bitShift;
+			if(bitShift != 0 && i + wordShift + 1 < wordCount)
+				value |= words[i + wordShift + 1] << (64 - bitShift);
+			words[i] |= value;
+		}
+	}
+	
+	/**
+	 * Sets each bit x of the words to the OR of bits x and x - shift. Bits before the start
+	 * are considered to be zero.
+	 */
+	void orShiftedUp(uint64_t *words, size_t wordCount, size_t shift)
+	{
+		const size_t wordShift = shift / 64, bitShift = shift % 64;
+		for(size_t i=wordCount;i>wordShift;--i)
+		{
+			const size_t source = i - 1 - wordShift;
+			uint64_t value = words[source] << bitShift;
+			if(bitShift != 0 && source != 0)
+				value |= words[source - 1] >> (64 - bitShift);
+			words[i - 1] |= value;
+		}
+	}
+}
+
+StatisticalFlagger::PackedMask::PackedMask(const Mask2D &mask) :
+	width(mask.Width()),
+	height(mask.Height()),
+	wordsPerRow((mask.Width() + 63) / 64),
+	words(wordsPerRow * mask.Height())
+{
+	for(size_t y=0;y<height;++y)
+	{
+		const bool *values = mask.ValuePtr(0, y);
+		uint64_t *row = Row(y);
+		for(size_t i=0;i!=wordsPerRow;++i)
+		{
+			const size_t count = std::min<size_t>(64, width - i*64);
+			uint64_t word = 0;
+			for(size_t bit=0;bit!=count;++bit)
+				word |= uint64_t(values[i*64 + bit]) << bit;
+			row[i] = word;
+		}
+	}
+}
+
+void StatisticalFlagger::PackedMask::Unpack(Mask2D &mask) const
+{
+	for(size_t y=0;y<height;++y)
+	{
+		bool *values = mask.ValuePtr(0, y);
+		const uint64_t *row = Row(y);
+		for(size_t i=0;i!=wordsPerRow;++i)
+		{
+			const size_t count = std::min<size_t>(64, width - i*64);
+			const uint64_t word = row[i];
+			for(size_t bit=0;bit!=count;++bit)
+				values[i*64 + bit] = (word >> bit) & 1;
+		}
+	}
+}
+
+/**
+ * Returns the position of the first flag in row y from x up to end, or end if there is none.
+ */
+size_t StatisticalFlagger::PackedMask::NextSetBit(size_t y, size_t x, size_t end) const
+{
+	if(x >= end)
+		return end;
+	const uint64_t *row = Row(y);
+	size_t wordIndex = x / 64;
+	uint64_t word = row[wordIndex] & (~uint64_t(0) << (x % 64));
+	while(word == 0)
+	{
+		++wordIndex;
+		if(wordIndex * 64 >= end)
+			return end;
+		word = row[wordIndex];
+	}
+	const size_t position = wordIndex * 64 + __builtin_ctzll(word);
+	return position < end ? position : end;
+}
+
 StatisticalFlagger::StatisticalFlagger()
 {
 }
@@ -24,114 +119,99 @@ bool StatisticalFlagger::SquareContainsFlag(Mask2DCPtr mask, size_t xLeft, size_
 
 void StatisticalFlagger::DilateFlagsHorizontally(Mask2DPtr mask, size_t timeSize)
 {
-	if(timeSize != 0)
+	if(timeSize != 0 && mask->Width() != 0)
 	{
-		Mask2DPtr destination = Mask2D::CreateUnsetMaskPtr(mask->Width(), mask->Height());
 		if(timeSize > mask->Width()) timeSize = mask->Width();
-		const int intSize = (int) timeSize;
 		
+		// A sample is flagged when a flag is within timeSize samples after (toLeft) or before
+		// (toRight) it. The window of such an OR is doubled in each step by combining the
+		// window with a shifted copy of itself.
+		PackedMask toLeft(*mask), toRight(toLeft);
 		for(size_t y=0;y<mask->Height();++y)
 		{
-			int dist = intSize + 1;
-			for(size_t x=0;x<timeSize;++x)
-			{
-				if(mask->Value(x, y))
-					dist = - intSize;
-				dist++;
-			}
-			for(size_t x=0;x<mask->Width() - timeSize;++x)
-			{
-				if(mask->Value(x + timeSize, y))
-					dist = -intSize;
-				if(dist <= intSize)
-				{
-					destination->SetValue(x, y, true);
-					dist++;
-				} else {
-					destination->SetValue(x, y, false);
-				}
-			}
-			for(size_t x=mask->Width() - timeSize;x<mask->Width();++x)
+			uint64_t
+				*left = toLeft.Row(y),
+				*right = toRight.Row(y);
+			size_t windowSize = 1;
+			while(windowSize <= timeSize)
 			{
-				if(dist <= intSize)
-				{
-					destination->SetValue(x, y, true);
-					dist++;
-				} else {
-					destination->SetValue(x, y, false);
-				}
+				const size_t shift = std::min(windowSize, timeSize + 1 - windowSize);
+				orShiftedDown(left, toLeft.wordsPerRow, shift);
+				orShiftedUp(right, toRight.wordsPerRow, shift);
+				windowSize += shift;
 			}
+			for(size_t i=0;i!=toLeft.wordsPerRow;++i)
+				left[i] |= right[i];
 		}
-		mask->Swap(destination);
+		toLeft.Unpack(*mask);
 	}
 }
 
 void StatisticalFlagger::DilateFlagsVertically(Mask2DPtr mask, size_t frequencySize)
 {
-	if(frequencySize != 0)
+	if(frequencySize != 0 && mask->Width() != 0)
 	{
-		Mask2DPtr destination = Mask2D::CreateUnsetMaskPtr(mask->Width(), mask->Height());
-		if(frequencySize > mask->Height()) frequencySize = mask->Height();
-		const int intSize = (int) frequencySize;
+		const size_t height = mask->Height();
+		if(frequencySize > height) frequencySize = height;
 		
-		for(size_t x=0;x<mask->Width();++x)
+		// Same as DilateFlagsHorizontally(), but whole rows of words are combined
+		PackedMask toTop(*mask), toBottom(toTop);
+		const size_t wordsPerRow = toTop.wordsPerRow;
+		size_t windowSize = 1;
+		while(windowSize <= frequencySize)
 		{
-			int dist = intSize + 1;
-			for(size_t y=0;y<frequencySize;++y)
-			{
-				if(mask->Value(x, y))
-					dist = - intSize;
-				dist++;
-			}
-			for(size_t y=0;y<mask->Height() - frequencySize;++y)
+			const size_t shift = std::min(windowSize, frequencySize + 1 - windowSize);
+			for(size_t y=0;y+shift<height;++y)
 			{
-				if(mask->Value(x, y + frequencySize))
-					dist = -intSize;
-				if(dist <= intSize)
-				{
-					destination->SetValue(x, y, true);
-					dist++;
-				} else {
-					destination->SetValue(x, y, false);
-				}
+				uint64_t *row = toTop.Row(y);
+				const uint64_t *source = toTop.Row(y + shift);
+				for(size_t i=0;i!=wordsPerRow;++i)
+					row[i] |= source[i];
 			}
-			for(size_t y=mask->Height() - frequencySize;y<mask->Height();++y)
+			for(size_t y=height-1;y>=shift;--y)
 			{
-				if(dist <= intSize)
-				{
-					destination->SetValue(x, y, true);
-					dist++;
-				} else {
-					destination->SetValue(x, y, false);
-				}
+				uint64_t *row = toBottom.Row(y);
+				const uint64_t *source = toBottom.Row(y - shift);
+				for(size_t i=0;i!=wordsPerRow;++i)
+					row[i] |= source[i];
 			}
+			windowSize += shift;
 		}
-		mask->Swap(destination);
+		for(size_t i=0;i!=toTop.words.size();++i)
+			toTop.words[i] |= toBottom.words[i];
+		toTop.Unpack(*mask);
 	}
 }
 
 void StatisticalFlagger::LineRemover(Mask2DPtr mask, size_t maxTimeContamination, size_t maxFreqContamination)
 {
+	if(mask->Width() == 0)
+		return;
+	const PackedMask packed(*mask);
+	std::vector<size_t> columnCounts(mask->Width(), 0);
+	for(size_t y=0;y<mask->Height();++y)
+	{
+		for(size_t x=packed.NextSetBit(y, 0, mask->Width());x!=mask->Width();x=packed.NextSetBit(y, x+1, mask->Width()))
+			++columnCounts[x];
+	}
+
+	// The rows are counted after flagging the columns
+	std::vector<uint64_t> flaggedColumns(packed.wordsPerRow, 0);
 	for(size_t x=0;x<mask->Width();++x)
 	{
-		size_t count = 0;
-		for(size_t y=0;y<mask->Height();++y)
+		if(columnCounts[x] > maxFreqContamination)
 		{
-			if(mask->Value(x,y))
-				++count;
-		}
-		if(count > maxFreqContamination)
 			FlagTime(mask, x);
+			flaggedColumns[x / 64] |= uint64_t(1) << (x % 64);
+		}
 	}
 
 	for(size_t y=0;y<mask->Height();++y)
 	{
+		const uint64_t *row = packed.Row(y);
 		size_t count = 0;
-		for(size_t x=0;x<mask->Width();++x)
-		{
-			if(mask->Value(x,y))
-				++count;
-		}
+		for(size_t i=0;i!=packed.wordsPerRow;++i)
+			count += __builtin_popcountll(row[i] | flaggedColumns[i]);
 		if(count > maxTimeContamination)
 			FlagFrequency(mask, y);
 	}
@@ -153,76 +233,71 @@ void StatisticalFlagger::FlagFrequency(Mask2DPtr mask, size_t y)
 	}
 }
 
-void StatisticalFlagger::MaskToInts(Mask2DCPtr mask, int **maskAsInt)
+void StatisticalFlagger::MaskToInts(const PackedMask &mask, int **maskAsInt, int *rowMaxima)
 {
-	for(size_t y=0;y<mask->Height();++y)
+	for(size_t y=0;y<mask.height;++y)
 	{
 		int *column = maskAsInt[y];
-		for(size_t x=0;x<mask->Width();++x)
-		{
-			column[x] = mask->Value(x, y) ? 1 : 0;
-		}
+		for(size_t x=0;x<mask.width;++x)
+			column[x] = 0;
+		for(size_t x=mask.NextSetBit(y, 0, mask.width);x!=mask.width;x=mask.NextSetBit(y, x+1, mask.width))
+			column[x] = 1;
+		rowMaxima[y] = (mask.NextSetBit(y, 0, mask.width) != mask.width) ? 1 : 0;
 	}
 }
 
-void StatisticalFlagger::SumToLeft(Mask2DCPtr mask, int **sums, size_t width, size_t step, bool reverse)
+/**
+ * Only the flagged samples add to the sums, so these are found with NextSetBit(). The
+ * maximum sum of each row is kept up to date, so that ThresholdTime() and
+ * ThresholdFrequency() can skip rows without sums above the threshold.
+ */
+void StatisticalFlagger::SumToLeft(const PackedMask &mask, int **sums, int *rowMaxima, size_t width, size_t step, bool reverse)
 {
-	if(reverse)
+	const size_t halfWidth = width/2;
+	// Sample x + halfWidth adds to sum x (or sample x - halfWidth when reverse)
+	const size_t
+		start = reverse ? width - halfWidth : halfWidth,
+		end = reverse ? mask.width - halfWidth : mask.width - width + halfWidth;
+	for(size_t y=0;y<mask.height;++y)
 	{
-		for(size_t y=0;y<mask->Height();++y)
-		{
-			int *column = sums[y];
-			for(size_t x=width;x<mask->Width();++x)
-			{
-				if(mask->Value(x - width/2, y))
-					column[x] += step;
-			}
-		}
-	} else {
-		for(size_t y=0;y<mask->Height();++y)
+		int *column = sums[y];
+		for(size_t x=mask.NextSetBit(y, start, end);x!=end;x=mask.NextSetBit(y, x+1, end))
 		{
-			int *column = sums[y];
-			for(size_t x=0;x<mask->Width() - width;++x)
-			{
-				if(mask->Value(x + width/2, y))
-					column[x] += step;
-			}
+			int &sum = reverse ? column[x + halfWidth] : column[x - halfWidth];
+			sum += step;
+			if(sum > rowMaxima[y])
+				rowMaxima[y] = sum;
 		}
 	}
 }
 
-void StatisticalFlagger::SumToTop(Mask2DCPtr mask, int **sums, size_t width, size_t step, bool reverse)
+void StatisticalFlagger::SumToTop(const PackedMask &mask, int **sums, int *rowMaxima, size_t width, size_t step, bool reverse)
 {
-	if(reverse)
+	const size_t halfWidth = width/2;
+	const size_t
+		start = reverse ? width : 0,
+		end = reverse ? mask.height : mask.height - width;
+	for(size_t y=start;y<end;++y)
 	{
-		for(size_t y=width;y<mask->Height();++y)
+		int *column = sums[y];
+		const size_t source = reverse ? y - halfWidth : y + halfWidth;
+		for(size_t x=mask.NextSetBit(source, 0, mask.width);x!=mask.width;x=mask.NextSetBit(source, x+1, mask.width))
 		{
-			int *column = sums[y];
-			for(size_t x=0;x<mask->Width();++x)
-			{
-				if(mask->Value(x, y - width/2))
-					column[x] += step;
-			}
-		}
-	} else {
-		for(size_t y=0;y<mask->Height() - width;++y)
-		{
-			int *column = sums[y];
-			for(size_t x=0;x<mask->Width();++x)
-			{
-				if(mask->Value(x, y + width/2))
-					column[x] += step;
-			}
+			column[x] += step;
+			if(column[x] > rowMaxima[y])
+				rowMaxima[y] = column[x];
 		}
 	}
 }
 
-void StatisticalFlagger::ThresholdTime(Mask2DCPtr mask, int **flagMarks, int **sums, int thresholdLevel, int width)
+void StatisticalFlagger::ThresholdTime(Mask2DCPtr mask, int **flagMarks, int **sums, const int *rowMaxima, int thresholdLevel, int width)
 {
 	int halfWidthL = (width-1) / 2;
 	int halfWidthR = (width-1) / 2;
 	for(size_t y=0;y<mask->Height();++y)
 	{
+		if(rowMaxima[y] <= thresholdLevel)
+			continue;
 		const int *column = sums[y];
 		for(size_t x=halfWidthL;x<mask->Width() - halfWidthR;++x)
 		{
@@ -237,12 +312,14 @@ void StatisticalFlagger::ThresholdTime(Mask2DCPtr mask, int **flagMarks, int **s
 	}
 }
 
-void StatisticalFlagger::ThresholdFrequency(Mask2DCPtr mask, int **flagMarks, int **sums, int thresholdLevel, int width)
+void StatisticalFlagger::ThresholdFrequency(Mask2DCPtr mask, int **flagMarks, int **sums, const int *rowMaxima, int thresholdLevel, int width)
 {
 	int halfWidthT = (width-1) / 2;
 	int halfWidthB = (width-1) / 2;
 	for(size_t y=halfWidthT;y<mask->Height() - halfWidthB;++y)
 	{
+		if(rowMaxima[y] <= thresholdLevel)
+			continue;
 		int *column = sums[y];
 		for(size_t x=0;x<mask->Width();++x)
 		{
@@ -273,13 +350,13 @@ void StatisticalFlagger::ApplyMarksInTime(Mask2DPtr mask, int **flagMarks)
 
 void StatisticalFlagger::ApplyMarksInFrequency(Mask2DPtr mask, int **flagMarks)
 {
-	for(size_t x=0;x<mask->Width();++x)
+	std::vector<int> startedCounts(mask->Width(), 0);
+	for(size_t y=0;y<mask->Height();++y)
 	{
-		int startedCount = 0;
-		for(size_t y=0;y<mask->Height();++y)
+		for(size_t x=0;x<mask->Width();++x)
 		{
-			startedCount += flagMarks[y][x];
-			if(startedCount > 0)
+			startedCounts[x] += flagMarks[y][x];
+			if(startedCounts[x] > 0)
 				mask->SetValue(x, y, true);
 		}
 	}
@@ -287,6 +364,8 @@ void StatisticalFlagger::ApplyMarksInFrequency(Mask2DPtr mask, int **flagMarks)
 
 void StatisticalFlagger::DensityTimeFlagger(Mask2DPtr mask, num_t minimumGoodDataRatio)
 {
+	if(mask->Width() == 0 || mask->Height() == 0)
+		return;
 	num_t width = 2.0;
 	size_t iterations = 0, step = 1;
 	bool reverse = false;
@@ -308,14 +387,16 @@ void StatisticalFlagger::DensityTimeFlagger(Mask2DPtr mask, num_t minimumGoodDat
 			flagMarks[y][x] = 0;
 	}
 	
-	MaskToInts(mask, sums);
+	const PackedMask packed(*mask);
+	std::vector<int> rowMaxima(mask->Height());
+	MaskToInts(packed, sums, &rowMaxima[0]);
 	
 	while(width < mask->Width())
 	{
 		++iterations;
-		SumToLeft(mask, sums, (size_t) width, step, reverse);
+		SumToLeft(packed, sums, &rowMaxima[0], (size_t) width, step, reverse);
 		const int maxFlagged = (int) floor((1.0-minimumGoodDataRatio)*(num_t)(width));
-		ThresholdTime(mask, flagMarks, sums, maxFlagged, (size_t) width);
+		ThresholdTime(mask, flagMarks, sums, &rowMaxima[0], maxFlagged, (size_t) width);
 	
 		num_t newWidth = width * 1.05;
 		if((size_t) newWidth == (size_t) width)
@@ -338,12 +419,12 @@ void StatisticalFlagger::DensityTimeFlagger(Mask2DPtr mask, num_t minimumGoodDat
 
 void StatisticalFlagger::DensityFrequencyFlagger(Mask2DPtr mask, num_t minimumGoodDataRatio)
 {
+	if(mask->Width() == 0 || mask->Height() == 0)
+		return;
 	num_t width = 2.0;
 	size_t iterations = 0, step = 1;
 	bool reverse = false;
 	
-	Mask2DPtr newMask = Mask2D::CreateCopy(mask);
-	
 	int **sums = new int*[mask->Height()];
 	int **flagMarks = new int*[mask->Height()];
 	
@@ -355,14 +436,16 @@ void StatisticalFlagger::DensityFrequencyFlagger(Mask2DPtr mask, num_t minimumGo
 			flagMarks[y][x] = 0;
 	}
 	
-	MaskToInts(mask, sums);
+	const PackedMask packed(*mask);
+	std::vector<int> rowMaxima(mask->Height());
+	MaskToInts(packed, sums, &rowMaxima[0]);
 	
 	while(width < mask->Height())
 	{
 		++iterations;
-		SumToTop(mask, sums, (size_t) width, step, reverse);
+		SumToTop(packed, sums, &rowMaxima[0], (size_t) width, step, reverse);
 		const int maxFlagged = (int) floor((1.0-minimumGoodDataRatio)*(num_t)(width));
-		ThresholdFrequency(mask, flagMarks, sums, maxFlagged, (size_t) width);
+		ThresholdFrequency(mask, flagMarks, sums, &rowMaxima[0], maxFlagged, (size_t) width);
 	
 		num_t newWidth = width * 1.05;
 		if((size_t) newWidth == (size_t) width)
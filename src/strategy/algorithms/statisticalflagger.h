@@ -2,6 +2,9 @@
 #define STATISTICALFLAGGER_H
 
 #include <string>
+#include <vector>
+
+#include <stdint.h>
 
 #include "../../structures/mask2d.h"
 
@@ -23,13 +26,30 @@ class StatisticalFlagger{
 		static void DensityFrequencyFlagger(Mask2DPtr mask, num_t minimumGoodDataRatio);
 		
 	private:
+		/**
+		 * A mask with the flags of each row packed in 64-bit words: bit i of word j of a row
+		 * holds sample 64j + i. Bits after the last sample of a row are zero. Dilations
+		 * and sums are calculated on these words, so that 64 samples are handled at once.
+		 */
+		struct PackedMask
+		{
+			PackedMask(const Mask2D &mask);
+			void Unpack(Mask2D &mask) const;
+			uint64_t *Row(size_t y) { return &words[y * wordsPerRow]; }
+			const uint64_t *Row(size_t y) const { return &words[y * wordsPerRow]; }
+			size_t NextSetBit(size_t y, size_t x, size_t end) const;
+
+			size_t width, height, wordsPerRow;
+			std::vector<uint64_t> words;
+		};
+
 		static void FlagTime(Mask2DPtr mask, size_t x);
 		static void FlagFrequency(Mask2DPtr mask, size_t y);
-		static void MaskToInts(Mask2DCPtr mask, int **maskAsInt);
-		static void SumToLeft(Mask2DCPtr mask, int **sums, size_t width, size_t step, bool reverse);
-		static void SumToTop(Mask2DCPtr mask, int **sums, size_t width, size_t step, bool reverse);
-		static void ThresholdTime(Mask2DCPtr mask, int **flagMarks, int **sums, int thresholdLevel, int width);
-		static void ThresholdFrequency(Mask2DCPtr mask, int **flagMarks, int **sums, int thresholdLevel, int width);
+		static void MaskToInts(const PackedMask &mask, int **maskAsInt, int *rowMaxima);
+		static void SumToLeft(const PackedMask &mask, int **sums, int *rowMaxima, size_t width, size_t step, bool reverse);
+		static void SumToTop(const PackedMask &mask, int **sums, int *rowMaxima, size_t width, size_t step, bool reverse);
+		static void ThresholdTime(Mask2DCPtr mask, int **flagMarks, int **sums, const int *rowMaxima, int thresholdLevel, int width);
+		static void ThresholdFrequency(Mask2DCPtr mask, int **flagMarks, int **sums, const int *rowMaxima, int thresholdLevel, int width);
 		static void ApplyMarksInTime(Mask2DPtr mask, int **flagMarks);
 		static void ApplyMarksInFrequency(Mask2DPtr mask, int **flagMarks);
 };
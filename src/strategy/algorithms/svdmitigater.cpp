@@ -2,6 +2,11 @@
 
 #include "svdmitigater.h"
 
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
 #ifdef HAVE_GTKMM
  #include "../../gui/plot/plot2d.h"
 #endif
@@ -11,9 +16,67 @@ extern "C" {
 	      doublecomplex *a, integer *lda, doublereal *s, doublecomplex *u, 
 	      integer *ldu, doublecomplex *vt, integer *ldvt, doublecomplex *work, 
 	      integer *lwork, doublereal *rwork, integer *info);
+
+  int zgeqrf_(integer *m, integer *n, doublecomplex *a, integer *lda,
+	      doublecomplex *tau, doublecomplex *work, integer *lwork, integer *info);
+
+  int zungqr_(integer *m, integer *n, integer *k, doublecomplex *a,
+	      integer *lda, doublecomplex *tau, doublecomplex *work, integer *lwork,
+	      integer *info);
+
+  int zgemm_(char *transa, char *transb, integer *m, integer *n, integer *k,
+	     doublecomplex *alpha, doublecomplex *a, integer *lda, doublecomplex *b,
+	     integer *ldb, doublecomplex *beta, doublecomplex *c, integer *ldc);
+}
+
+namespace {
+	// Number of extra samples of the range, and number of power iterations of the
+	// randomized decomposition (Halko, Martinsson & Tropp, 2011). Power iterations make
+	// the leading components accurate when the remaining singular values decay slowly,
+	// as they do for noise.
+	const long int oversampling = 10;
+	const size_t powerIterations = 2;
+
+	/**
+	 * Calculates c = op(a) * b, where all matrices are column major and op(a) is either
+	 * a (transA='N') or its conjugate transpose (transA='C').
+	 */
+	void multiply(char transA, long int m, long int n, long int k, doublecomplex *a, long int lda, doublecomplex *b, long int ldb, doublecomplex *c)
+	{
+		char transB = 'N';
+		doublecomplex one, zero;
+		one.r = 1.0; one.i = 0.0;
+		zero.r = 0.0; zero.i = 0.0;
+		long int ldc = m;
+		zgemm_(&transA, &transB, &m, &n, &k, &one, a, &lda, b, &ldb, &zero, c, &ldc);
+	}
+
+	/**
+	 * Replaces the columns of the rows x cols matrix by an orthonormal basis of their span.
+	 */
+	void orthonormalize(doublecomplex *matrix, long int rows, long int cols)
+	{
+		long int info = 0, query = -1;
+		std::vector<doublecomplex> tau(cols);
+		doublecomplex qrWorkAreaSize, qWorkAreaSize;
+		zgeqrf_(&rows, &cols, matrix, &rows, &tau[0], &qrWorkAreaSize, &query, &info);
+		if(info != 0)
+			throw std::runtime_error("Can not determine workareasize, zgeqrf returned an error.");
+		zungqr_(&rows, &cols, &cols, matrix, &rows, &tau[0], &qWorkAreaSize, &query, &info);
+		if(info != 0)
+			throw std::runtime_error("Can not determine workareasize, zungqr returned an error.");
+		long int workAreaSize = std::max<long int>(std::max(qrWorkAreaSize.r, qWorkAreaSize.r), 1);
+		std::vector<doublecomplex> workArea(workAreaSize);
+		zgeqrf_(&rows, &cols, matrix, &rows, &tau[0], &workArea[0], &workAreaSize, &info);
+		if(info != 0)
+			throw std::runtime_error("zgeqrf failed");
+		zungqr_(&rows, &cols, &cols, matrix, &rows, &tau[0], &workArea[0], &workAreaSize, &info);
+		if(info != 0)
+			throw std::runtime_error("zungqr failed");
+	}
 }
 
-SVDMitigater::SVDMitigater() : _background(0), _singularValues(0), _leftSingularVectors(0), _rightSingularVectors(0), _m(0), _n(0), _iteration(0), _removeCount(10),  _verbose(false)
+SVDMitigater::SVDMitigater() : _background(0), _singularValues(0), _originalSingularValues(0), _leftSingularVectors(0), _rightSingularVectors(0), _m(0), _n(0), _rank(0), _rightStride(0), _iteration(0), _removeCount(10), _allowTruncation(true), _verbose(false)
 {
 }
 
@@ -27,14 +90,47 @@ void SVDMitigater::Clear()
 {
 	if(IsDecomposed()) {
 		delete[] _singularValues;
+		delete[] _originalSingularValues;
 		delete[] _leftSingularVectors;
 		delete[] _rightSingularVectors;
 		_singularValues = 0;
+		_originalSingularValues = 0;
 		_leftSingularVectors = 0;
 		_rightSingularVectors = 0;
 	}
 	if(_background != 0)
+	{
 		delete _background;
+		_background = 0;
+	}
+}
+
+doublecomplex *SVDMitigater::createMatrix() const
+{
+	// Remember that the axes have to be turned; in 'a', time is along the vertical axis.
+	doublecomplex *a = new doublecomplex[_m * _n];
+	Image2DCPtr
+		real = _data.GetRealPart(),
+		imaginary = _data.GetImaginaryPart();
+	for(int t=0;t<_n;++t) {
+		for(int f=0;f<_m; ++f) {
+			a[t*_m + f].r = real->Value(t, f);
+			a[t*_m + f].i = imaginary->Value(t, f);
+		}
+	}
+	return a;
+}
+
+bool SVDMitigater::isTruncationEfficient(unsigned rank) const
+{
+	// The randomized decomposition takes about 2*(powerIterations+1) products of the
+	// matrix with (rank + oversampling) vectors, whereas the full decomposition takes
+	// several times m*n*min(m,n) operations and calculates all n right singular vectors.
+	long int
+		m = _data.ImageHeight(),
+		n = _data.ImageWidth(),
+		minmn = m<n ? m : n;
+	return rank != 0 && 2 * ((long int) rank + oversampling) <= minmn;
 }
 
 // lda = leading dimension
@@ -51,22 +147,14 @@ void SVDMitigater::Decompose()
 	watch.Start();
 	Clear();
 
-	// Remember that the axes have to be turned; in 'a', time is along the vertical axis.
 	_m = _data.ImageHeight();
 	_n = _data.ImageWidth();
 	int minmn = _m<_n ? _m : _n;
+	_rank = minmn;
+	_rightStride = _n;
 	char rowsOfU = 'A'; // all rows of u
 	char rowsOfVT = 'A'; // all rows of VT
-	doublecomplex *a = new doublecomplex[_m * _n];
-	Image2DCPtr
-		real = _data.GetRealPart(),
-		imaginary = _data.GetImaginaryPart();
-	for(int t=0;t<_n;++t) {
-		for(int f=0;f<_m; ++f) {
-			a[t*_m + f].r = real->Value(t, f);
-			a[t*_m + f].i = imaginary->Value(t, f);
-		}
-	}
+	doublecomplex *a = createMatrix();
 	long int lda = _m;
 	_singularValues = new double[minmn];
 	for(int i=0;i<minmn;++i)
@@ -110,6 +198,87 @@ void SVDMitigater::Decompose()
 	}
 }
 
+void SVDMitigater::DecomposeTruncated(unsigned rank)
+{
+	if(_verbose)
+		std::cout << "Decomposing " << rank << " components..." << std::endl;
+	Stopwatch watch;
+	watch.Start();
+	Clear();
+
+	_m = _data.ImageHeight();
+	_n = _data.ImageWidth();
+	long int minmn = _m<_n ? _m : _n;
+	_rank = std::min<long int>(rank, minmn);
+	_rightStride = _rank;
+	long int sampleCount = std::min(_rank + oversampling, minmn);
+	doublecomplex *a = createMatrix();
+
+	// Find an orthonormal basis q for the range of a with a Gaussian test matrix. A fixed
+	// seed makes the result reproducible.
+	std::mt19937 rng(1);
+	std::normal_distribution<double> gaussian;
+	std::vector<doublecomplex>
+		testMatrix(_n * sampleCount),
+		q(_m * sampleCount),
+		z(_n * sampleCount);
+	for(std::vector<doublecomplex>::iterator i=testMatrix.begin(); i!=testMatrix.end(); ++i)
+	{
+		i->r = gaussian(rng);
+		i->i = gaussian(rng);
+	}
+	multiply('N', _m, sampleCount, _n, a, _m, &testMatrix[0], _n, &q[0]);
+	orthonormalize(&q[0], _m, sampleCount);
+	for(size_t i=0; i!=powerIterations; ++i)
+	{
+		multiply('C', _n, sampleCount, _m, a, _m, &q[0], _m, &z[0]);
+		orthonormalize(&z[0], _n, sampleCount);
+		multiply('N', _m, sampleCount, _n, a, _m, &z[0], _n, &q[0]);
+		orthonormalize(&q[0], _m, sampleCount);
+	}
+
+	// Decompose the small matrix b = q^H a = ub s vt, so that a ~ (q ub) s vt
+	std::vector<doublecomplex>
+		b(sampleCount * _n),
+		ub(sampleCount * sampleCount),
+		vt(sampleCount * _n),
+		u(_m * sampleCount);
+	std::vector<double> singularValues(sampleCount), workArea2(5 * sampleCount);
+	multiply('C', sampleCount, _n, _m, &q[0], _m, a, _m, &b[0]);
+	delete[] a;
+
+	char rowsOfU = 'S', rowsOfVT = 'S';
+	long int info = 0, workAreaSize = -1;
+	doublecomplex complexWorkAreaSize;
+	zgesvd_(&rowsOfU, &rowsOfVT, &sampleCount, &_n, &b[0], &sampleCount, &singularValues[0], &ub[0], &sampleCount, &vt[0], &sampleCount, &complexWorkAreaSize, &workAreaSize, &workArea2[0], &info);
+	if(info != 0)
+		throw std::runtime_error("Can not determine workareasize, zgesvd returned an error.");
+	workAreaSize = (long int) complexWorkAreaSize.r;
+	std::vector<doublecomplex> workArea1(workAreaSize);
+	zgesvd_(&rowsOfU, &rowsOfVT, &sampleCount, &_n, &b[0], &sampleCount, &singularValues[0], &ub[0], &sampleCount, &vt[0], &sampleCount, &workArea1[0], &workAreaSize, &workArea2[0], &info);
+	if(info != 0)
+		throw std::runtime_error("zgesvd failed");
+	multiply('N', _m, sampleCount, sampleCount, &q[0], _m, &ub[0], sampleCount, &u[0]);
+
+	// Only keep the requested components; the others are not accurate
+	_singularValues = new double[_rank];
+	_originalSingularValues = new double[_rank];
+	_leftSingularVectors = new doublecomplex[_m*_rank];
+	_rightSingularVectors = new doublecomplex[_n*_rank];
+	std::copy(singularValues.begin(), singularValues.begin() + _rank, _singularValues);
+	std::copy(singularValues.begin(), singularValues.begin() + _rank, _originalSingularValues);
+	std::copy(u.begin(), u.begin() + _m*_rank, _leftSingularVectors);
+	for(long int t=0;t<_n;++t)
+		std::copy(&vt[t*sampleCount], &vt[t*sampleCount] + _rank, &_rightSingularVectors[t*_rank]);
+
+	if(_verbose) {
+		for(long int i=0;i<_rank;++i)
+			std::cout << _singularValues[i] << ",";
+		std::cout << std::endl;
+		std::cout << watch.ToString() << std::endl;
+	}
+}
+
 void SVDMitigater::Compose()
 {
 	if(_verbose)
@@ -118,7 +287,9 @@ void SVDMitigater::Compose()
 	watch.Start();
 	Image2DPtr real = Image2D::CreateUnsetImagePtr(_data.ImageWidth(), _data.ImageHeight());
 	Image2DPtr imaginary = Image2D::CreateUnsetImagePtr(_data.ImageWidth(), _data.ImageHeight());
-	int minmn = _m<_n ? _m : _n;
+	Image2DCPtr
+		dataReal = _data.GetRealPart(),
+		dataImaginary = _data.GetImaginaryPart();
 	for(int t=0;t<_n;++t) {
 		for(int f=0;f<_m; ++f) {
 			double a_tf_r = 0.0;
@@ -126,12 +297,17 @@ void SVDMitigater::Compose()
 			// A = U S V^T , so:
 			// a_tf = \sum_{g=0}^{minmn} U_{gf} S_{gg} V^T_{tg}
 			// Note that _rightSingularVectors=V^T, thus is already stored rowwise
-			for(int g=0;g<minmn;++g) {
+			// When truncated, only the changes of the leading components are applied to A.
+			if(IsTruncated()) {
+				a_tf_r = dataReal->Value(t, f);
+				a_tf_i = dataImaginary->Value(t, f);
+			}
+			for(int g=0;g<_rank;++g) {
 				double u_r = _leftSingularVectors[g*_m + f].r;
 				double u_i = _leftSingularVectors[g*_m + f].i;
-				double s = _singularValues[g];
-				double v_r = _rightSingularVectors[t*_n + g].r;
-				double v_i = _rightSingularVectors[t*_n + g].i;
+				double s = IsTruncated() ? _singularValues[g] - _originalSingularValues[g] : _singularValues[g];
+				double v_r = _rightSingularVectors[t*_rightStride + g].r;
+				double v_i = _rightSingularVectors[t*_rightStride + g].i;
 				a_tf_r += s * (u_r * v_r - u_i * v_i);
 				a_tf_i += s * (u_r * v_i + u_i * v_r);
 			}
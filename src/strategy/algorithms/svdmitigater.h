@@ -29,8 +29,13 @@ class SVDMitigater final : public SurfaceFitMethod {
 
 		void RemoveSingularValues(unsigned singularValueCount)
 		{
-			if(!IsDecomposed())
-				Decompose();
+			if(!IsDecomposed() || (IsTruncated() && singularValueCount > _rank))
+			{
+				if(_allowTruncation && isTruncationEfficient(singularValueCount))
+					DecomposeTruncated(singularValueCount);
+				else
+					Decompose();
+			}
 			for(unsigned i=0;i<singularValueCount;++i)
 				SetSingularValue(i, 0.0);
 			Compose();
@@ -47,24 +52,40 @@ class SVDMitigater final : public SurfaceFitMethod {
 		}
 
 		bool IsDecomposed() const throw() { return _singularValues != 0 ; }
+		/**
+		 * Whether only the leading singular values and vectors have been calculated. In that
+		 * case, SingularValue() is only valid for indices below the removed count.
+		 */
+		bool IsTruncated() const throw() { return _originalSingularValues != 0; }
 		double SingularValue(unsigned index) const throw() { return _singularValues[index]; }
 		void SetRemoveCount(unsigned removeCount) throw() { _removeCount = removeCount; }
 		void SetVerbose(bool verbose) throw() { _verbose = verbose; }
+		/**
+		 * When set (the default), only the removed components are calculated, with a
+		 * randomized decomposition, if that is cheaper than the full decomposition.
+		 */
+		void SetAllowTruncation(bool allowTruncation) throw() { _allowTruncation = allowTruncation; }
 		static void CreateSingularValueGraph(const TimeFrequencyData &data, class Plot2D &plot);
 	private:
 		void Clear();
 		void Decompose();
+		void DecomposeTruncated(unsigned rank);
 		void Compose();
 		void SetSingularValue(unsigned index, double newValue) throw() { _singularValues[index] = newValue; }
+		bool isTruncationEfficient(unsigned rank) const;
+		doublecomplex *createMatrix() const;
 
 		TimeFrequencyData _data;
 		TimeFrequencyData *_background;
 		double *_singularValues;
+		double *_originalSingularValues;
 		doublecomplex *_leftSingularVectors;
 		doublecomplex *_rightSingularVectors;
 		long int _m, _n;
+		long int _rank, _rightStride;
 		unsigned _iteration;
 		unsigned _removeCount;
+		bool _allowTruncation;
 		bool _verbose;
 };
 
@@ -1,4 +1,7 @@
 #include "actionblock.h"
+#include "actionprofiler.h"
+#include "artifactset.h"
+#include "executionplan.h"
 
 #include "../../util/progresslistener.h"
 
@@ -6,16 +9,24 @@ namespace rfiStrategy {
 
 	void ActionBlock::Perform(ArtifactSet &artifacts, ProgressListener &listener)
 	{
-		size_t nr = 0;
+		const ExecutionPlan *plan = artifacts.Plan();
+		if(plan != 0 && plan->performBlock(*this, artifacts, listener))
+			return;
+		size_t nr = 0, childIndex = 0;
 		unsigned totalWeight = Weight();
 		for(const_iterator i=begin();i!=end();++i)
 		{
 			Action *action = *i;
 			unsigned weight = action->Weight();
-			listener.OnStartTask(*this, nr, totalWeight, action->Description(), weight);
-			action->Perform(artifacts, listener);
+			const std::string description = action->Description();
+			listener.OnStartTask(*this, nr, totalWeight, description, weight);
+			{
+				ActionProfiler::Scope profilerScope(childIndex, description);
+				action->Perform(artifacts, listener);
+			}
 			listener.OnEndTask(*this);
 			nr += weight;
+			++childIndex;
 		}
 	}
 }
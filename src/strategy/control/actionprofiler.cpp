@@ -0,0 +1,293 @@
+#include "actionprofiler.h"
+
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+#include <time.h>
+
+#include <boost/thread/mutex.hpp>
+
+namespace rfiStrategy {
+
+	struct ProfileNode
+	{
+		ProfileNode() : parent(0), calls(0), wallTime(0.0), selfWallTime(0.0), selfCpuTime(0.0), selfAllocatedBytes(0) { }
+		~ProfileNode()
+		{
+			for(ChildMap::iterator i=children.begin(); i!=children.end(); ++i)
+				delete i->second;
+		}
+
+		ProfileNode *Child(const ActionProfiler::PathElement &element)
+		{
+			ChildMap::iterator i = children.find(element);
+			if(i == children.end())
+			{
+				ProfileNode *node = new ProfileNode();
+				node->parent = this;
+				i = children.insert(std::make_pair(element, node)).first;
+			}
+			return i->second;
+		}
+
+		void Add(const ProfileNode &source)
+		{
+			calls += source.calls;
+			wallTime += source.wallTime;
+			selfWallTime += source.selfWallTime;
+			selfCpuTime += source.selfCpuTime;
+			selfAllocatedBytes += source.selfAllocatedBytes;
+			for(ChildMap::const_iterator i=source.children.begin(); i!=source.children.end(); ++i)
+				Child(i->first)->Add(*i->second);
+		}
+
+		/**
+		 * The cpu time and allocations of a node include those of its sub-actions,
+		 * including sub-actions that ran in other threads.
+		 */
+		double CpuTime() const
+		{
+			double cpuTime = selfCpuTime;
+			for(ChildMap::const_iterator i=children.begin(); i!=children.end(); ++i)
+				cpuTime += i->second->CpuTime();
+			return cpuTime;
+		}
+
+		uint64_t AllocatedBytes() const
+		{
+			uint64_t allocatedBytes = selfAllocatedBytes;
+			for(ChildMap::const_iterator i=children.begin(); i!=children.end(); ++i)
+				allocatedBytes += i->second->AllocatedBytes();
+			return allocatedBytes;
+		}
+
+		typedef std::map<ActionProfiler::PathElement, ProfileNode*> ChildMap;
+		ProfileNode *parent;
+		ChildMap children;
+		size_t calls;
+		// The wall time includes the sub-actions; the other values are exclusive
+		double wallTime, selfWallTime, selfCpuTime;
+		uint64_t selfAllocatedBytes;
+	};
+
+	namespace {
+		/**
+		 * The trees of all threads. A thread registers its tree the first time it
+		 * opens a scope. Trees are kept after their thread has stopped, so that
+		 * they can still be reported.
+		 */
+		struct ThreadTrees
+		{
+			~ThreadTrees()
+			{
+				for(std::vector<ProfileNode*>::iterator i=roots.begin(); i!=roots.end(); ++i)
+					delete *i;
+			}
+			boost::mutex mutex;
+			std::vector<ProfileNode*> roots;
+		} threadTrees;
+
+		thread_local ProfileNode *currentNode = 0;
+		
+		// Resources used by the sub-actions of the current scope
+		thread_local double childWallTime = 0.0, childCpuTime = 0.0;
+		thread_local uint64_t childAllocatedBytes = 0;
+
+		ProfileNode *threadCurrentNode()
+		{
+			if(currentNode == 0)
+			{
+				currentNode = new ProfileNode();
+				boost::mutex::scoped_lock lock(threadTrees.mutex);
+				threadTrees.roots.push_back(currentNode);
+			}
+			return currentNode;
+		}
+
+		double clockSeconds(clockid_t clock)
+		{
+			struct timespec t;
+			clock_gettime(clock, &t);
+			return double(t.tv_sec) + double(t.tv_nsec) * 1e-9;
+		}
+
+		void mergeThreadTrees(ProfileNode &merged)
+		{
+			boost::mutex::scoped_lock lock(threadTrees.mutex);
+			for(std::vector<ProfileNode*>::const_iterator i=threadTrees.roots.begin(); i!=threadTrees.roots.end(); ++i)
+				merged.Add(**i);
+		}
+
+		std::string memToStr(uint64_t bytes)
+		{
+			std::ostringstream str;
+			str << std::fixed << std::setprecision(1);
+			if(bytes >= 1024ul*1024ul*1024ul)
+				str << double(bytes) / (1024.0*1024.0*1024.0) << " GB";
+			else if(bytes >= 1024ul*1024ul)
+				str << double(bytes) / (1024.0*1024.0) << " MB";
+			else if(bytes >= 1024ul)
+				str << double(bytes) / 1024.0 << " KB";
+			else
+				str << bytes << " B";
+			return str.str();
+		}
+
+		std::string jsonEscape(const std::string &str)
+		{
+			std::ostringstream escaped;
+			for(std::string::const_iterator i=str.begin(); i!=str.end(); ++i)
+			{
+				if(*i == '"' || *i == '\\')
+					escaped << '\\' << *i;
+				else if(*i == '\n')
+					escaped << "\\n";
+				else if((unsigned char) *i < 0x20)
+					escaped << ' ';
+				else
+					escaped << *i;
+			}
+			return escaped.str();
+		}
+
+		void writeTextNode(std::ostream &stream, const ProfileNode &node, const std::string &description, size_t depth)
+		{
+			stream
+				<< std::setw(8) << node.calls << ' '
+				<< std::setw(11) << node.wallTime << ' '
+				<< std::setw(11) << node.CpuTime() << ' '
+				<< std::setw(11) << node.selfWallTime << ' '
+				<< std::setw(10) << memToStr(node.AllocatedBytes()) << "  ";
+			for(size_t i=1; i<depth; ++i)
+				stream << "+-";
+			stream << description << '\n';
+			for(ProfileNode::ChildMap::const_iterator i=node.children.begin(); i!=node.children.end(); ++i)
+				writeTextNode(stream, *i->second, i->first.second, depth+1);
+		}
+
+		void writeJSONChildren(std::ostream &stream, const ProfileNode &node, const std::string &indent)
+		{
+			stream << '[';
+			for(ProfileNode::ChildMap::const_iterator i=node.children.begin(); i!=node.children.end(); ++i)
+			{
+				const ProfileNode &child = *i->second;
+				stream << (i==node.children.begin() ? "\n" : ",\n") << indent << "  {\n"
+					<< indent << "    \"index\": " << i->first.first << ",\n"
+					<< indent << "    \"action\": \"" << jsonEscape(i->first.second) << "\",\n"
+					<< indent << "    \"calls\": " << child.calls << ",\n"
+					<< indent << "    \"wall_seconds\": " << child.wallTime << ",\n"
+					<< indent << "    \"self_wall_seconds\": " << child.selfWallTime << ",\n"
+					<< indent << "    \"cpu_seconds\": " << child.CpuTime() << ",\n"
+					<< indent << "    \"allocated_bytes\": " << child.AllocatedBytes() << ",\n"
+					<< indent << "    \"children\": ";
+				writeJSONChildren(stream, child, indent + "    ");
+				stream << '\n' << indent << "  }";
+			}
+			if(!node.children.empty())
+				stream << '\n' << indent;
+			stream << ']';
+		}
+	}
+
+	std::atomic<bool> ActionProfiler::_enabled(false);
+	thread_local uint64_t ActionProfiler::_allocatedBytes = 0;
+
+	ActionProfiler::Scope::Scope(size_t childIndex, const std::string &description)
+	{
+		if(_enabled)
+		{
+			_node = threadCurrentNode()->Child(PathElement(childIndex, description));
+			currentNode = _node;
+			_outerChildWallTime = childWallTime;
+			_outerChildCpuTime = childCpuTime;
+			_outerChildAllocatedBytes = childAllocatedBytes;
+			childWallTime = 0.0;
+			childCpuTime = 0.0;
+			childAllocatedBytes = 0;
+			_allocatedStart = _allocatedBytes;
+			_cpuStart = clockSeconds(CLOCK_THREAD_CPUTIME_ID);
+			_wallStart = clockSeconds(CLOCK_MONOTONIC);
+		}
+		else {
+			_node = 0;
+		}
+	}
+
+	ActionProfiler::Scope::~Scope()
+	{
+		if(_node != 0)
+		{
+			const double
+				wallTime = clockSeconds(CLOCK_MONOTONIC) - _wallStart,
+				cpuTime = clockSeconds(CLOCK_THREAD_CPUTIME_ID) - _cpuStart;
+			const uint64_t allocatedBytes = _allocatedBytes - _allocatedStart;
+			_node->wallTime += wallTime;
+			_node->selfWallTime += wallTime - childWallTime;
+			_node->selfCpuTime += cpuTime - childCpuTime;
+			_node->selfAllocatedBytes += allocatedBytes - childAllocatedBytes;
+			++_node->calls;
+			childWallTime = _outerChildWallTime + wallTime;
+			childCpuTime = _outerChildCpuTime + cpuTime;
+			childAllocatedBytes = _outerChildAllocatedBytes + allocatedBytes;
+			currentNode = _node->parent;
+		}
+	}
+
+	ActionProfiler::Path ActionProfiler::CurrentPath()
+	{
+		Path path;
+		if(currentNode != 0)
+		{
+			for(ProfileNode *node=currentNode; node->parent!=0; node=node->parent)
+			{
+				const ProfileNode::ChildMap &siblings = node->parent->children;
+				for(ProfileNode::ChildMap::const_iterator i=siblings.begin(); i!=siblings.end(); ++i)
+				{
+					if(i->second == node)
+					{
+						path.insert(path.begin(), i->first);
+						break;
+					}
+				}
+			}
+		}
+		return path;
+	}
+
+	void ActionProfiler::EnterPath(const Path &path)
+	{
+		if(_enabled)
+		{
+			ProfileNode *node = threadCurrentNode();
+			while(node->parent != 0)
+				node = node->parent;
+			for(Path::const_iterator i=path.begin(); i!=path.end(); ++i)
+				node = node->Child(*i);
+			currentNode = node;
+		}
+	}
+
+	void ActionProfiler::WriteTextReport(std::ostream &stream)
+	{
+		ProfileNode merged;
+		mergeThreadTrees(merged);
+		std::ios::fmtflags flags = stream.flags();
+		stream
+			<< "Strategy profile (summed over threads; cpu and allocations include sub-actions; self is the wall time not spent in sub-actions)\n"
+			<< "   calls    wall (s)     cpu (s)    self (s)  allocated  action\n"
+			<< std::fixed << std::setprecision(3);
+		for(ProfileNode::ChildMap::const_iterator i=merged.children.begin(); i!=merged.children.end(); ++i)
+			writeTextNode(stream, *i->second, i->first.second, 1);
+		stream.flags(flags);
+	}
+
+	void ActionProfiler::WriteJSONReport(std::ostream &stream)
+	{
+		ProfileNode merged;
+		mergeThreadTrees(merged);
+		stream << "{\n  \"actions\": ";
+		writeJSONChildren(stream, merged, "  ");
+		stream << "\n}\n";
+	}
+}
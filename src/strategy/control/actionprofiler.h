@@ -0,0 +1,73 @@
+#ifndef RFISTRATEGY_ACTION_PROFILER_H
+#define RFISTRATEGY_ACTION_PROFILER_H
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+namespace rfiStrategy {
+
+	/**
+	 * Measures how much time and memory each action of a strategy uses. When enabled,
+	 * ActionBlock::Perform() opens a Scope around each child action, and the profiler
+	 * records the wall time, cpu time, number of calls and the number of bytes allocated
+	 * for images and masks.
+	 *
+	 * Actions are identified by their path in the strategy: the sequence of child
+	 * indices and descriptions from the root down to the action. Each thread collects
+	 * its own tree of measurements, so no locking is required while the strategy runs;
+	 * the trees of all threads are merged when a report is written. Reports should therefore
+	 * only be written when the strategy has finished.
+	 */
+	class ActionProfiler
+	{
+		public:
+			typedef std::pair<size_t, std::string> PathElement;
+			typedef std::vector<PathElement> Path;
+
+			class Scope
+			{
+				public:
+					Scope(size_t childIndex, const std::string &description);
+					~Scope();
+				private:
+					Scope(const Scope&) = delete;
+					void operator=(const Scope&) = delete;
+
+					struct ProfileNode *_node;
+					double _wallStart, _cpuStart, _outerChildWallTime, _outerChildCpuTime;
+					uint64_t _allocatedStart, _outerChildAllocatedBytes;
+			};
+
+			static void SetEnabled(bool enabled) { _enabled = enabled; }
+			static bool IsEnabled() { return _enabled; }
+
+			/**
+			 * Should be called by structures that allocate large buffers, such as images
+			 * and masks, so that the allocations can be attributed to the running action.
+			 */
+			static void RecordAllocation(size_t bytes) { _allocatedBytes += bytes; }
+
+			/**
+			 * Path of the action that is currently executed by the calling thread. A new
+			 * thread that continues the work of an action should call EnterPath() with
+			 * this path, such that its measurements end up at the right place in the tree.
+			 */
+			static Path CurrentPath();
+			static void EnterPath(const Path &path);
+
+			static void WriteTextReport(std::ostream &stream);
+			static void WriteJSONReport(std::ostream &stream);
+
+		private:
+			// Set by the main thread while workers may be profiling
+			static std::atomic<bool> _enabled;
+			static thread_local uint64_t _allocatedBytes;
+	};
+}
+
+#endif // RFISTRATEGY_ACTION_PROFILER_H
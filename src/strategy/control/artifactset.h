@@ -3,6 +3,8 @@
 
 #include <vector>
 
+#include <boost/function.hpp>
+
 #include "../../structures/types.h"
 #include "../../structures/timefrequencydata.h"
 #include "../../structures/timefrequencymetadata.h"
@@ -26,7 +28,8 @@ namespace rfiStrategy {
 			_frequencyPowerPlot(0), _timeFlagCountPlot(0), _iterationsPlot(0),
 			_polarizationStatistics(0), _baselineSelectionInfo(0), _observatorium(0),
 			_model(0),
-			_horizontalProfile(), _verticalProfile()
+			_horizontalProfile(), _verticalProfile(),
+			_plan(0)
 			{
 			}
 
@@ -44,7 +47,9 @@ namespace rfiStrategy {
 				_observatorium(source._observatorium),
 				_model(source._model),
 				_horizontalProfile(source._horizontalProfile),
-				_verticalProfile(source._verticalProfile)
+				_verticalProfile(source._verticalProfile),
+				_readsFinishedHandler(source._readsFinishedHandler),
+				_plan(source._plan)
 			{
 			}
 
@@ -75,6 +80,8 @@ namespace rfiStrategy {
 				_model = source._model;
 				_horizontalProfile = source._horizontalProfile;
 				_verticalProfile = source._verticalProfile;
+				_readsFinishedHandler = source._readsFinishedHandler;
+				_plan = source._plan;
 				return *this;
 			}
 
@@ -222,6 +229,24 @@ namespace rfiStrategy {
 			
 			const std::vector<num_t> &VerticalProfile() const { return _verticalProfile; }
 			std::vector<num_t> &VerticalProfile() { return _verticalProfile; }
+
+			/**
+			 * Sets the function that is called once all baselines of the image set have been
+			 * read. It is called from the reading thread, without holding the IO mutex.
+			 */
+			void SetReadsFinishedHandler(const boost::function<void()> &handler) { _readsFinishedHandler = handler; }
+			void OnReadsFinished()
+			{
+				if(_readsFinishedHandler)
+					_readsFinishedHandler();
+			}
+
+			/**
+			 * The compiled plan by which the blocks perform their children, or null to
+			 * walk the action tree. The plan is owned by the caller of the strategy.
+			 */
+			void SetPlan(const class ExecutionPlan *plan) { _plan = plan; }
+			const class ExecutionPlan *Plan() const { return _plan; }
 		private:
 			TimeFrequencyData _originalData;
 			TimeFrequencyData _contaminatedData;
@@ -246,6 +271,8 @@ namespace rfiStrategy {
 			class Observatorium *_observatorium;
 			class Model *_model;
 			std::vector<num_t> _horizontalProfile, _verticalProfile;
+			boost::function<void()> _readsFinishedHandler;
+			const class ExecutionPlan *_plan;
 	};
 }
 
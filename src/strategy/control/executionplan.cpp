@@ -0,0 +1,147 @@
+#include "executionplan.h"
+
+#include "actionblock.h"
+#include "actionprofiler.h"
+
+#include "../actions/combineflagresultsaction.h"
+#include "../actions/foreachbaselineaction.h"
+#include "../actions/iterationaction.h"
+
+#include "../../structures/imagebufferpool.h"
+
+#include "../../util/progresslistener.h"
+
+#include "../../baseexception.h"
+
+#include <algorithm>
+
+namespace rfiStrategy {
+
+	ExecutionPlan::ExecutionPlan(ActionBlock &root) : _depth(0)
+	{
+		compile(root, root.Type() == ForEachBaselineActionType, 0);
+	}
+
+	void ExecutionPlan::compile(ActionContainer &container, bool isPerBaseline, size_t depth)
+	{
+		_depth = std::max(_depth, depth);
+		// dynamic_cast is only used here, during compilation
+		ActionBlock *block = dynamic_cast<ActionBlock*>(&container);
+		const size_t rangeIndex = _ranges.size();
+		if(block != 0)
+		{
+			Range range;
+			range.begin = _steps.size();
+			range.totalWeight = block->Weight();
+			_ranges.push_back(range);
+		}
+
+		std::vector<ActionContainer*> nested;
+		unsigned taskNr = 0;
+		for(size_t childIndex=0; childIndex!=container.GetChildCount(); ++childIndex)
+		{
+			Action &action = container.GetChild(childIndex);
+			validate(action, isPerBaseline);
+			const unsigned weight = action.Weight();
+			if(!isNoOp(action))
+			{
+				if(block != 0)
+				{
+					Step step;
+					step.action = &action;
+					step.description = action.Description();
+					step.weight = weight;
+					step.taskNr = taskNr;
+					step.childIndex = childIndex;
+					_steps.push_back(step);
+				}
+				// These actions compile their own plan when they are performed
+				if(action.Type() != ForEachBaselineActionType && action.Type() != ForEachMSActionType)
+				{
+					ActionContainer *childContainer = dynamic_cast<ActionContainer*>(&action);
+					if(childContainer != 0)
+						nested.push_back(childContainer);
+				}
+			}
+			taskNr += weight;
+		}
+
+		if(block != 0)
+		{
+			_ranges[rangeIndex].end = _steps.size();
+			_rangeOfBlock[block] = rangeIndex;
+		}
+
+		// The children of a block are stored consecutively, so nested blocks are compiled afterwards
+		for(std::vector<ActionContainer*>::iterator i=nested.begin(); i!=nested.end(); ++i)
+			compile(**i, isPerBaseline, depth+1);
+	}
+
+	bool ExecutionPlan::isNoOp(const Action &action)
+	{
+		switch(action.Type())
+		{
+			case IterationBlockType:
+			{
+				const IterationBlock &iteration = static_cast<const IterationBlock&>(action);
+				return iteration.IterationCount() == 0 || iteration.GetChildCount() == 0;
+			}
+			case CombineFlagResultsType:
+				return static_cast<const CombineFlagResults&>(action).GetChildCount() == 0;
+			default:
+				return false;
+		}
+	}
+
+	void ExecutionPlan::validate(Action &action, bool isPerBaseline)
+	{
+		if(isPerBaseline)
+		{
+			bool isValid = true;
+			if(action.Type() == ForEachMSActionType)
+				isValid = false;
+			else if(action.Type() == ForEachBaselineActionType)
+				isValid = static_cast<ForEachBaselineAction&>(action).Selection() == Current;
+			if(!isValid)
+				throw BadUsageException("The action '" + action.Description() + "' can not be performed inside a 'For each baseline' action");
+		}
+	}
+
+	bool ExecutionPlan::performBlock(const ActionBlock &block, ArtifactSet &artifacts, ProgressListener &listener) const
+	{
+		std::map<const ActionBlock*, size_t>::const_iterator rangeIndex = _rangeOfBlock.find(&block);
+		if(rangeIndex == _rangeOfBlock.end())
+			return false;
+		const Range &range = _ranges[rangeIndex->second];
+		for(size_t i=range.begin; i!=range.end; ++i)
+		{
+			const Step &step = _steps[i];
+			listener.OnStartTask(block, step.taskNr, range.totalWeight, step.description, step.weight);
+			{
+				ActionProfiler::Scope profilerScope(step.childIndex, step.description);
+				step.action->Perform(artifacts, listener);
+			}
+			listener.OnEndTask(block);
+		}
+		return true;
+	}
+
+	void ExecutionPlan::ReserveScratch(size_t width, size_t height, size_t polarizationCount, size_t threadCount) const
+	{
+		if(width == 0 || height == 0)
+			return;
+		// Rounded like the allocations of Image2D and Mask2D
+		const size_t
+			stride = ((width-1)/4+1)*4,
+			allocHeight = ((height-1)/4+1)*4;
+		// A real and imaginary image for each polarization of the input, plus the
+		// original, contaminated and revised copies that each level of nesting keeps
+		const size_t
+			imageCount = (2 * polarizationCount + 3 * _depth) * threadCount,
+			maskCount = (polarizationCount + _depth) * threadCount;
+		ImageBufferPool::Reserve(stride * allocHeight * sizeof(num_t), imageCount);
+		ImageBufferPool::Reserve(allocHeight * sizeof(num_t*), imageCount);
+		ImageBufferPool::Reserve(stride * allocHeight * sizeof(bool), maskCount);
+		ImageBufferPool::Reserve(allocHeight * sizeof(bool*), maskCount);
+	}
+}
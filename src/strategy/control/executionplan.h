@@ -0,0 +1,105 @@
+#ifndef RFI_EXECUTION_PLAN_H
+#define RFI_EXECUTION_PLAN_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+class ProgressListener;
+
+namespace rfiStrategy {
+
+	/**
+	 * An action tree, compiled into a flat list of steps. When a plan is set in the
+	 * ArtifactSet (see ArtifactSet::SetPlan()), the compiled blocks perform their children
+	 * by running their range of steps, instead of walking the tree. The description, weight
+	 * and progress position of each step are determined once during compilation, instead of
+	 * for every child in every baseline and iteration, and actions that have no effect are
+	 * left out.
+	 *
+	 * Blocks that iterate over polarisations, complex components or iterations keep
+	 * their own loop, but the children inside the loop run from the plan. The children of
+	 * "for each baseline" and "for each measurement set" actions are not compiled into
+	 * a plan of their parent: these actions compile their own plan when they start.
+	 *
+	 * Compiling does not change the tree, so several plans of the same tree can exist, and
+	 * the owner of a plan keeps it next to the tree. The plan does not change during
+	 * execution, so a plan can be used by several threads at once. The tree should not be
+	 * changed while a plan of it exists.
+	 */
+	class ExecutionPlan
+	{
+		public:
+			/**
+			 * Compiles the root block and all blocks below it.
+			 * @throws BadUsageException when the tree contains an action that can not be
+			 * performed per baseline below a "for each baseline" action.
+			 */
+			explicit ExecutionPlan(class ActionBlock &root);
+
+			/**
+			 * Whether the children of @p block are performed by this plan.
+			 */
+			bool Contains(const class ActionBlock &block) const
+			{
+				return _rangeOfBlock.find(&block) != _rangeOfBlock.end();
+			}
+
+			/**
+			 * Number of steps in the plan, summed over all compiled blocks.
+			 */
+			size_t StepCount() const { return _steps.size(); }
+
+			/**
+			 * Maximum nesting depth of the compiled blocks. Each nested block normally
+			 * keeps one copy of the data.
+			 */
+			size_t Depth() const { return _depth; }
+
+			/**
+			 * Fills the image buffer pool with the buffers that the plan is expected to
+			 * need for baselines of the given shape, so that they are not allocated
+			 * from the system during the first baselines.
+			 */
+			void ReserveScratch(size_t width, size_t height, size_t polarizationCount, size_t threadCount) const;
+
+		private:
+			friend class ActionBlock;
+
+			ExecutionPlan(const ExecutionPlan&) = delete;
+			ExecutionPlan& operator=(const ExecutionPlan&) = delete;
+
+			struct Step
+			{
+				class Action *action;
+				std::string description;
+				unsigned weight, taskNr;
+				size_t childIndex;
+			};
+
+			/**
+			 * The steps of one compiled block.
+			 */
+			struct Range
+			{
+				size_t begin, end;
+				unsigned totalWeight;
+			};
+
+			void compile(class ActionContainer &container, bool isPerBaseline, size_t depth);
+			static bool isNoOp(const class Action &action);
+			static void validate(class Action &action, bool isPerBaseline);
+			/**
+			 * Performs the children of @p block from the plan.
+			 * @returns false when the block is not part of this plan.
+			 */
+			bool performBlock(const class ActionBlock &block, class ArtifactSet &artifacts, ProgressListener &listener) const;
+
+			std::vector<Step> _steps;
+			std::vector<Range> _ranges;
+			std::map<const class ActionBlock*, size_t> _rangeOfBlock;
+			size_t _depth;
+	};
+}
+
+#endif // RFI_EXECUTION_PLAN_H
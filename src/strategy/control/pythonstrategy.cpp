@@ -2,14 +2,42 @@
 
 #include "../../python/data.h"
 #include "../../python/functions.h"
+#include "../../python/scopedgil.h"
+
+#include "../../structures/system.h"
+
+#include "../../util/lane.h"
+#include "../../util/parallelfor.h"
 
 #include <boost/python.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
 
+#include <algorithm>
 #include <fstream>
 
 using namespace boost::python;
 
+/**
+ * Hands out the indices of the data to be flagged to the threads of
+ * PythonStrategy::ExecuteParallel(), and collects their errors.
+ */
+class DispatchQueue
+{
+public:
+	explicit DispatchQueue(size_t count) : indices(count)
+	{
+		for(size_t i=0; i!=count; ++i)
+			indices.write(i);
+		indices.write_end();
+	}
+
+	lane<size_t> indices;
+	boost::mutex errorMutex;
+	std::string errors;
+};
+
 PythonStrategy::PythonStrategy() : _code(
 	"import aoflagger\n"
 	"\n"
@@ -29,7 +57,7 @@ PythonStrategy::PythonStrategy() : _code(
 	"aoflagger.set_flag_function(flag)\n"
 	"\n"
 	"print \'File parsed\'\n"
-	)
+	), _isParsed(false)
 {
 	std::ifstream file("strategy.py");
 	if(file.good())
@@ -42,17 +70,32 @@ PythonStrategy::PythonStrategy() : _code(
 		_code = data.data();
 	}
 
+	initialize();
+}
+
+PythonStrategy::PythonStrategy(const std::string& code) : _code(code), _isParsed(false)
+{
+	initialize();
+}
+
+PythonStrategy::~PythonStrategy()
+{
+	PyEval_RestoreThread(_mainThreadState);
+	Py_Finalize();
+}
+
+void PythonStrategy::initialize()
+{
 	Py_Initialize();
+	PyEval_InitThreads();
 
 	// The following statement add the curr path to the Python search path
 	boost::filesystem::path workingDir = boost::filesystem::current_path().normalize();
 	PyObject* sysPath = PySys_GetObject(const_cast<char*>("path"));
 	PyList_Insert( sysPath, 0, PyString_FromString(workingDir.string().c_str()));
-}
 
-PythonStrategy::~PythonStrategy()
-{
-	Py_Finalize();
+	// Run without the GIL, so that Execute() can be called from any thread
+	_mainThreadState = PyEval_SaveThread();
 }
 
 std::string PythonStrategy::getPythonError()
@@ -64,7 +107,7 @@ std::string PythonStrategy::getPythonError()
 	object formatted_list, formatted;
 	PyErr_Fetch(&exc,&val,&tb);
 	PyErr_NormalizeException(&exc,&val,&tb);
-	handle<> hexc(exc),hval(allow_null(val)),htb(allow_null(tb)); 
+	handle<> hexc(exc),hval(allow_null(val)),htb(allow_null(tb));
 	object traceback(import("traceback"));
 	if (!tb) {
 		object format_exception_only(traceback.attr("format_exception_only"));
@@ -77,13 +120,30 @@ std::string PythonStrategy::getPythonError()
 	return extract<std::string>(formatted);
 }
 
+void PythonStrategy::parse()
+{
+	// The parse mutex is always taken before the GIL, never the other way around
+	boost::mutex::scoped_lock lock(_parseMutex);
+	if(!_isParsed)
+	{
+		aoflagger_python::ScopedGILAcquire gil;
+		try {
+			object main = import("__main__");
+			object global(main.attr("__dict__"));
+			object result = exec(_code.c_str(), global, global);
+		} catch(const error_already_set&) {
+			throw std::runtime_error(getPythonError());
+		}
+		_isParsed = true;
+	}
+}
+
 void PythonStrategy::Execute(TimeFrequencyData& tfData)
 {
-	try {
-		object main = import("__main__");
-		object global(main.attr("__dict__"));
-		object result = exec(_code.c_str(), global, global);
+	parse();
 
+	aoflagger_python::ScopedGILAcquire gil;
+	try {
 		object flagFunction = aoflagger_python::get_flag_function();
 
 		if(flagFunction.is_none())
@@ -97,3 +157,37 @@ void PythonStrategy::Execute(TimeFrequencyData& tfData)
 		throw std::runtime_error(getPythonError());
 	}
 }
+
+void PythonStrategy::ExecuteParallel(std::vector<TimeFrequencyData>& tfData, size_t threadCount)
+{
+	parse();
+
+	if(threadCount == 0)
+		threadCount = System::ProcessorCount();
+	threadCount = std::min(threadCount, tfData.size());
+
+	DispatchQueue queue(tfData.size());
+	boost::thread_group threads;
+	for(size_t i=0; i!=threadCount; ++i)
+		threads.create_thread(boost::bind(&PythonStrategy::executeThread, this, &tfData, &queue));
+	threads.join_all();
+
+	if(!queue.errors.empty())
+		throw std::runtime_error(queue.errors);
+}
+
+void PythonStrategy::executeThread(std::vector<TimeFrequencyData>* tfData, DispatchQueue* queue)
+{
+	ParallelFor::Limit limit(1);
+	size_t index;
+	while(queue->indices.read(index))
+	{
+		try {
+			Execute((*tfData)[index]);
+		} catch(std::exception& e) {
+			boost::mutex::scoped_lock lock(queue->errorMutex);
+			queue->errors += e.what();
+			queue->errors += '\n';
+		}
+	}
+}
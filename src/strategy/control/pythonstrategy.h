@@ -3,21 +3,64 @@
 
 #include "../../structures/timefrequencydata.h"
 
+#include <boost/thread/mutex.hpp>
+
 #include <string>
+#include <vector>
 
+/**
+ * Runs a flagging strategy that is written in Python. The interpreter
+ * is started on construction and runs without holding the global interpreter
+ * lock (GIL) in between calls. Execute() acquires the lock, so it may be
+ * called from several threads at once. The kernels of the aoflagger module
+ * release the lock while they process data, so the threads only serialize
+ * while they are running Python code.
+ *
+ * The object should be destructed by the thread that constructed it.
+ */
 class PythonStrategy
 {
 public:
+	/**
+	 * Uses the strategy in the file "strategy.py" of the working directory
+	 * if it exists, or a simple default strategy otherwise.
+	 */
 	PythonStrategy();
+
+	/**
+	 * Uses the given Python code as strategy. The code should call
+	 * aoflagger.set_flag_function().
+	 */
+	explicit PythonStrategy(const std::string& code);
+
 	~PythonStrategy();
-	
+
 	void Execute(TimeFrequencyData& tfData);
-	
+
+	/**
+	 * Flags all given data with a dispatch queue of threadCount threads.
+	 * Each element of tfData is replaced by its flagged result. A threadCount
+	 * of zero uses one thread per processor, and no more threads are started
+	 * than there are elements. When the strategy fails on some of the data,
+	 * the other data is still flagged, and a std::runtime_error is thrown
+	 * afterwards with the errors of all failures, one per line.
+	 */
+	void ExecuteParallel(std::vector<TimeFrequencyData>& tfData, size_t threadCount);
+
 private:
+	PythonStrategy(const PythonStrategy&) = delete;
+	PythonStrategy& operator=(const PythonStrategy&) = delete;
+
+	void initialize();
+	void parse();
+	void executeThread(std::vector<TimeFrequencyData>* tfData, class DispatchQueue* queue);
 	std::string getPythonError();
-	
+
 	std::string _code;
+	bool _isParsed;
+	boost::mutex _parseMutex;
+	// The thread state of the constructing thread, saved while the GIL is released
+	struct _ts* _mainThreadState;
 };
 
 #endif
-
@@ -1,5 +1,7 @@
 #include "fitsimageset.h"
 
+#include <algorithm>
+#include <exception>
 #include <sstream>
 #include <vector>
 
@@ -8,7 +10,167 @@
 #include "../../structures/image2d.h"
 #include "../../structures/timefrequencydata.h"
 
+#include "../../structures/system.h"
+
 #include "../../util/aologger.h"
+#include "../../util/parallelfor.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace {
+	// Default number of values that are read from the file at once
+	const size_t defaultReadBlockValues = 1<<23;
+
+	/**
+	 * Copies the visibilities of one band and polarization from a block of groups into the
+	 * images of their baselines. Each group is written to its own column, so different
+	 * ranges of groups can be decoded in parallel.
+	 */
+	struct GroupDecoder
+	{
+		const double *data;
+		size_t firstGroup, imageSize, valueOffset, frequencyStep, frequencyCount;
+		const std::vector<size_t> *groupBaseline, *groupPosition;
+		std::vector<Image2DPtr> *real, *imaginary;
+
+		/**
+		 * Decodes the groups from firstGroup+start up to firstGroup+end.
+		 */
+		void Decode(size_t start, size_t end) const
+		{
+			for(size_t i=start; i!=end; ++i)
+			{
+				const double *values = data + i*imageSize + valueOffset;
+				const size_t
+					baseline = (*groupBaseline)[firstGroup + i],
+					x = (*groupPosition)[firstGroup + i];
+				Image2D
+					&realImage = *(*real)[baseline],
+					&imaginaryImage = *(*imaginary)[baseline];
+				for(size_t f=0; f!=frequencyCount; ++f)
+				{
+					realImage.SetValue(x, f, values[f*frequencyStep]);
+					imaginaryImage.SetValue(x, f, values[f*frequencyStep + 1]);
+				}
+			}
+		}
+	};
+
+	/**
+	 * Reads a block of groups in its own thread, so that the previous block can be
+	 * decoded in the meantime.
+	 */
+	struct GroupReader
+	{
+		FitsFile *file;
+		size_t firstGroup, groupCount;
+		double *buffer;
+		std::exception_ptr error;
+
+		void Read()
+		{
+			try {
+				file->ReadGroupData(firstGroup, groupCount, buffer);
+			} catch(...) {
+				error = std::current_exception();
+			}
+		}
+	};
+
+	/**
+	 * Rows of a single-dish table that are read or written at once, with the IF ("slot") and
+	 * time index that each row of the table belongs to. The rows of different IFs are
+	 * independent, so each thread handles the rows of its own range of IFs.
+	 */
+	struct SingleDishRows
+	{
+		static const size_t NoSlot = ~size_t(0);
+		std::vector<size_t> rowSlot, rowTimeIndex;
+		int firstRow, endRow;
+		double *data;
+		bool *flags;
+		size_t dataSize, flagSize, polarizationCount, freqCount;
+		// Indexed by slot * polarizationCount + polarization
+		std::vector<Image2DPtr> images;
+		std::vector<Mask2DPtr> masks;
+		std::vector<Mask2DCPtr> storedFlags;
+
+		/**
+		 * Select the first run of at most maxRows consecutive rows from startRow on that all
+		 * belong to a selected IF, so that rows of other IFs are never read or rewritten.
+		 * Returns false if no row from startRow on does. The next run starts at endRow.
+		 */
+		bool SelectRange(int startRow, int maxRows)
+		{
+			const int rowCount = rowSlot.size();
+			while(startRow != rowCount && rowSlot[startRow] == NoSlot)
+				++startRow;
+			const int end = std::min(startRow + maxRows, rowCount);
+			int runEnd = startRow;
+			while(runEnd != end && rowSlot[runEnd] != NoSlot)
+				++runEnd;
+			firstRow = startRow;
+			endRow = runEnd;
+			return startRow != runEnd;
+		}
+
+		void Decode(size_t startSlot, size_t endSlot) const
+		{
+			for(int row=firstRow; row!=endRow; ++row)
+			{
+				const size_t slot = rowSlot[row];
+				if(slot < startSlot || slot >= endSlot)
+					continue;
+				const size_t x = rowTimeIndex[row];
+				const double *dataPtr = data + (row-firstRow) * dataSize;
+				const bool *flagPtr = flags + (row-firstRow) * flagSize;
+				for(size_t p=0; p!=polarizationCount; ++p)
+				{
+					Image2D &image = *images[slot*polarizationCount + p];
+					Mask2D &mask = *masks[slot*polarizationCount + p];
+					for(size_t f=0; f!=freqCount; ++f)
+					{
+						image.SetValue(x, f, *dataPtr);
+						mask.SetValue(x, f, *flagPtr);
+						++dataPtr;
+						++flagPtr;
+					}
+				}
+			}
+		}
+
+		void Encode(size_t startSlot, size_t endSlot) const
+		{
+			for(int row=firstRow; row!=endRow; ++row)
+			{
+				const size_t slot = rowSlot[row];
+				if(slot < startSlot || slot >= endSlot)
+					continue;
+				const size_t x = rowTimeIndex[row];
+				double *dataPtr = data + (row-firstRow) * dataSize;
+				bool *flagPtr = flags + (row-firstRow) * flagSize;
+				for(size_t p=0; p!=polarizationCount; ++p)
+				{
+					const Mask2D &mask = *storedFlags[slot*polarizationCount + p];
+					for(size_t f=0; f!=freqCount; ++f)
+					{
+						if(mask.Value(x, f))
+						{
+							*flagPtr = true;
+							*dataPtr = 1e20;
+						} else {
+							*flagPtr = false;
+						}
+						++dataPtr;
+						++flagPtr;
+					}
+				}
+			}
+		}
+	};
+	const size_t SingleDishRows::NoSlot;
+}
 
 namespace rfiStrategy {
 	
@@ -16,7 +178,10 @@ namespace rfiStrategy {
 		ImageSet(),
 		_file(new FitsFile(file)),
 		_currentBaselineIndex(0),
-		_frequencyOffset(0.0)
+		_frequencyOffset(0.0),
+		_readBlockValues(defaultReadBlockValues),
+		_cachedBand(-1), _cachedStokes(-1),
+		_indexedBand(-1), _indexedStokes(-1)
 	{
 		_file->Open(FitsFile::ReadWriteMode);
 	}
@@ -32,7 +197,11 @@ namespace rfiStrategy {
 		_currentBaselineIndex(source._currentBaselineIndex),
 		_currentBandIndex(source._currentBandIndex),
 		_frequencyOffset(source._frequencyOffset),
-		_baselineData(source._baselineData)
+		_readBlockValues(source._readBlockValues),
+		_baselineData(source._baselineData),
+		_groupIndex(source._groupIndex),
+		_cachedBand(-1), _cachedStokes(-1),
+		_indexedBand(-1), _indexedStokes(-1)
 	{
 	}
 	
@@ -55,22 +224,13 @@ namespace rfiStrategy {
 			_file->MoveToHDU(1);
 			if(_file->GetCurrentHDUType() != FitsFile::ImageHDUType)
 				throw FitsIOException("Primary table is not a grouped image");
-			long double *parameters = new long double[_file->GetParameterCount()];
-			int baselineIndex = _file->GetGroupParameterIndex("BASELINE");
-			size_t groupCount = _file->GetGroupCount();
-			std::set<std::pair<size_t,size_t> > baselineSet;
-			for(size_t g=0;g<groupCount;++g)
-			{
-				_file->ReadGroupParameters(g, parameters);
-				int a1 = (((int) parameters[baselineIndex]) & 255) - 1;
-				int a2 = (((int) parameters[baselineIndex] >> 8) & 255) - 1;
-				baselineSet.insert(std::pair<size_t,size_t>(a1,a2));
-			}
-			delete[] parameters;
-			AOLogger::Debug << "Baselines in file: " << baselineSet.size() << '\n';
-			for(std::set<std::pair<size_t,size_t> >::const_iterator i=baselineSet.begin();i!=baselineSet.end();++i)
-				_baselines.push_back(*i);
+			buildGroupIndex();
+			AOLogger::Debug << "Baselines in file: " << _baselines.size() << '\n';
 			_bandCount = _file->GetCurrentImageSize(5);
+			// The frequency table numbers the bands from zero
+			_bandIndexToNumber.clear();
+			for(size_t b=0; b!=_bandCount; ++b)
+				_bandIndexToNumber.push_back(b);
 		} else {
 			// sdfits
 			
@@ -81,13 +241,11 @@ namespace rfiStrategy {
 			_file->MoveToHDU(2);
 			int ifColumn = _file->GetTableColumnIndex("IF");
 			int rowCount = _file->GetRowCount();
+			std::vector<double> ifValues;
+			readScalarColumn(ifColumn, ifValues);
 			std::set<int> ifSet;
-			for(int i=1;i<=rowCount;++i)
-			{
-				double thisIndex;
-				_file->ReadTableCell(i, ifColumn, &thisIndex, 1);
-				ifSet.insert((int) round(thisIndex));
-			}
+			for(int i=0;i<rowCount;++i)
+				ifSet.insert((int) round(ifValues[i]));
 			_bandCount = ifSet.size();
 			if(_bandCount == 0)
 				throw std::runtime_error("Could not find any IF's in this set");
@@ -141,38 +299,20 @@ namespace rfiStrategy {
 			_currentBandIndex = fitsIndex._band;
 			int bandNumber = _bandIndexToNumber[fitsIndex._band];
 			metaData->SetBand(_bandInfos[bandNumber]);
-			AOLogger::Debug << "Loaded metadata for: " << Date::AipsMJDToString(metaData->ObservationTimes()[0]) << ", band " << bandNumber << " (" << Frequency::ToString(_bandInfos[bandNumber].channels[0].frequencyHz) << " - " << Frequency::ToString(_bandInfos[bandNumber].channels.rbegin()->frequencyHz) << ")\n";
+			if(!_bandInfos[bandNumber].channels.empty())
+				AOLogger::Debug << "Loaded metadata for: " << Date::AipsMJDToString(metaData->ObservationTimes()[0]) << ", band " << bandNumber << " (" << Frequency::ToString(_bandInfos[bandNumber].channels[0].frequencyHz) << " - " << Frequency::ToString(_bandInfos[bandNumber].channels.rbegin()->frequencyHz) << ")\n";
 
 		}
 		return BaselineData(data, metaData, index);
 	}
 
-	TimeFrequencyData FitsImageSet::ReadPrimaryGroupTable(size_t baselineIndex, int band, int stokes, TimeFrequencyMetaData &metaData)
+	void FitsImageSet::buildGroupIndex()
 	{
-		if(!_file->HasGroups() || _file->GetCurrentHDUType() != FitsFile::ImageHDUType)
-			throw FitsIOException("Primary table is not a grouped image");
-
-		std::vector<double> observationTimes;
-		std::vector<UVW> uvws;
-
-		//int keywordCount = _file->GetKeywordCount();
-		//for(int i=1;i<=keywordCount;++i)
-		//	AOLogger::Debug << "Keyword " << i << ": " << _file->GetKeyword(i) << "=" << _file->GetKeywordValue(i) << " ("  << _file->GetKeywordComment(i) << ")\n";
-
-		std::vector<long double> parameters(_file->GetParameterCount());
-		int baseline = (_baselines[baselineIndex].first+1) + ((_baselines[baselineIndex].second+1)<<8);
-		int baselineColumn = _file->GetGroupParameterIndex("BASELINE");
-		size_t
-			complexCount = _file->GetCurrentImageSize(2),
-			stokesStep = complexCount,
-			stokesCount = _file->GetCurrentImageSize(3),
-			frequencyStep = stokesCount*complexCount,
-			frequencyCount = _file->GetCurrentImageSize(4),
-			bandStep = frequencyStep*frequencyCount;
-		std::vector<std::vector<long double> > valuesR(frequencyCount);
-		std::vector<std::vector<long double> > valuesI(frequencyCount);
-		std::vector<long double> data(_file->GetImageSize());
-		size_t groupCount = _file->GetGroupCount();
+		const size_t
+			parameterCount = _file->GetParameterCount(),
+			groupCount = _file->GetGroupCount(),
+			blockSize = std::max<size_t>(1, _readBlockValues / std::max<size_t>(1, parameterCount));
+		const int baselineColumn = _file->GetGroupParameterIndex("BASELINE");
 		bool hasDate2 = _file->HasGroupParameter("DATE", 2);
 		int date2Index = 0, date1Index = _file->GetGroupParameterIndex("DATE");
 		if(hasDate2)
@@ -190,60 +330,225 @@ namespace rfiStrategy {
 			vvIndex = _file->GetGroupParameterIndex("VV---SIN");
 			wwIndex = _file->GetGroupParameterIndex("WW---SIN");
 		}
-		size_t match = 0;
-		double frequencyFactor = 1.0;
-		if(_frequencyOffset != 0.0)
-			frequencyFactor = _frequencyOffset;
-		for(size_t g=0;g<groupCount;++g)
+
+		// Read the parameters of all groups in large blocks
+		std::vector<double> parameters(std::min(blockSize, groupCount) * parameterCount);
+		std::vector<std::pair<size_t,size_t> > groupAntennas(groupCount);
+		std::vector<double> groupTimes(groupCount);
+		std::vector<UVW> groupUVWs(groupCount);
+		for(size_t firstGroup=0; firstGroup<groupCount; firstGroup+=blockSize)
 		{
-			_file->ReadGroupParameters(g, &parameters[0]);
-			if(parameters[baselineColumn] == baseline)
+			const size_t count = std::min(blockSize, groupCount-firstGroup);
+			_file->ReadGroupParameters(firstGroup, count, &parameters[0]);
+			for(size_t i=0; i!=count; ++i)
 			{
+				const double *p = &parameters[i * parameterCount];
+				const size_t g = firstGroup + i;
+				const int baseline = (int) p[baselineColumn];
+				groupAntennas[g] = std::pair<size_t,size_t>((baseline & 255) - 1, ((baseline >> 8) & 255) - 1);
 				double date;
 				if(hasDate2)
-					date = parameters[date1Index] + parameters[date2Index];
+					date = p[date1Index] + p[date2Index];
 				else
-					date = parameters[date1Index];
-				UVW uvw;
-				uvw.u = parameters[uuIndex] * frequencyFactor;
-				uvw.v = parameters[vvIndex] * frequencyFactor;
-				uvw.w = parameters[wwIndex] * frequencyFactor;
-
-				_file->ReadGroupData(g, &data[0]);
-				for(size_t f=0;f<frequencyCount;++f)
-				{
-					size_t index = stokes*stokesStep + frequencyStep*f + bandStep*band;
-					long double r = data[index];
-					long double i = data[index + 1];
-					valuesR[f].push_back(r);
-					valuesI[f].push_back(i);
-				}
-				observationTimes.push_back(Date::JDToAipsMJD(date));
-				uvws.push_back(uvw);
-				++match;
+					date = p[date1Index];
+				groupTimes[g] = Date::JDToAipsMJD(date);
+				groupUVWs[g] = UVW(p[uuIndex], p[vvIndex], p[wwIndex]);
 			}
 		}
-		AOLogger::Debug << match << " rows in table matched baseline.\n";
-		data.clear();
-		parameters.clear();
 
-		AOLogger::Debug << "Image is " << valuesR[0].size() << " x " << frequencyCount << '\n';
-		if(valuesR[0].size() == 0)
-			throw BadUsageException("Baseline not found!");
-		Image2DPtr
-			real = Image2D::CreateUnsetImagePtr(valuesR[0].size(), frequencyCount),
-			imaginary = Image2D::CreateUnsetImagePtr(valuesR[0].size(), frequencyCount);
-		for(size_t i=0;i<valuesR[0].size();++i)
+		std::set<std::pair<size_t,size_t> > baselineSet(groupAntennas.begin(), groupAntennas.end());
+		_baselines.assign(baselineSet.begin(), baselineSet.end());
+
+		boost::shared_ptr<GroupIndex> index(new GroupIndex());
+		index->baselineGroups.resize(_baselines.size());
+		index->times.resize(_baselines.size());
+		index->uvws.resize(_baselines.size());
+		index->groupBaseline.resize(groupCount);
+		index->groupPosition.resize(groupCount);
+		for(size_t g=0; g!=groupCount; ++g)
+		{
+			const size_t baseline = std::lower_bound(_baselines.begin(), _baselines.end(), groupAntennas[g]) - _baselines.begin();
+			index->groupBaseline[g] = baseline;
+			index->groupPosition[g] = index->baselineGroups[baseline].size();
+			index->baselineGroups[baseline].push_back(g);
+			index->times[baseline].push_back(groupTimes[g]);
+			index->uvws[baseline].push_back(groupUVWs[g]);
+		}
+		_groupIndex = index;
+	}
+
+	bool FitsImageSet::fitsInBandCache()
+	{
+		const size_t cacheSize = _groupIndex->groupBaseline.size() * _file->GetCurrentImageSize(4) * 2 * sizeof(num_t);
+		return cacheSize <= (size_t) System::TotalMemory() / 4;
+	}
+
+	void FitsImageSet::readBandCache(int band, int stokes)
+	{
+		const GroupIndex &index = *_groupIndex;
+		size_t
+			complexCount = _file->GetCurrentImageSize(2),
+			stokesCount = _file->GetCurrentImageSize(3),
+			frequencyStep = stokesCount*complexCount,
+			frequencyCount = _file->GetCurrentImageSize(4),
+			bandStep = frequencyStep*frequencyCount,
+			imageSize = _file->GetImageSize(),
+			groupCount = index.groupBaseline.size(),
+			blockSize = std::max<size_t>(1, _readBlockValues / imageSize);
+
+		_cachedBand = -1;
+		_cachedReal.resize(_baselines.size());
+		_cachedImaginary.resize(_baselines.size());
+		for(size_t b=0; b!=_baselines.size(); ++b)
+		{
+			_cachedReal[b] = Image2D::CreateUnsetImagePtr(index.baselineGroups[b].size(), frequencyCount);
+			_cachedImaginary[b] = Image2D::CreateUnsetImagePtr(index.baselineGroups[b].size(), frequencyCount);
+		}
+
+		// Two buffers are used, so that the next block is read while the previous block is decoded
+		std::vector<double> buffers[2];
+		GroupDecoder decoders[2];
+		for(size_t i=0; i!=2; ++i)
+		{
+			buffers[i].resize(std::min(blockSize, groupCount) * imageSize);
+			decoders[i].data = &buffers[i][0];
+			decoders[i].imageSize = imageSize;
+			decoders[i].valueOffset = stokes*complexCount + bandStep*band;
+			decoders[i].frequencyStep = frequencyStep;
+			decoders[i].frequencyCount = frequencyCount;
+			decoders[i].groupBaseline = &index.groupBaseline;
+			decoders[i].groupPosition = &index.groupPosition;
+			decoders[i].real = &_cachedReal;
+			decoders[i].imaginary = &_cachedImaginary;
+		}
+
+		if(groupCount != 0)
+			_file->ReadGroupData(0, std::min(blockSize, groupCount), &buffers[0][0]);
+		for(size_t firstGroup=0, block=0; firstGroup<groupCount; firstGroup+=blockSize, ++block)
 		{
-			for(size_t f=0;f<frequencyCount;++f)
+			const size_t
+				count = std::min(blockSize, groupCount-firstGroup),
+				nextGroup = firstGroup + count;
+			GroupDecoder &decoder = decoders[block%2];
+			decoder.firstGroup = firstGroup;
+			GroupReader reader;
+			boost::thread readThread;
+			if(nextGroup < groupCount)
 			{
-				real->SetValue(i, f, valuesR[f][i]);
-				imaginary->SetValue(i, f, valuesI[f][i]);
+				reader.file = _file.get();
+				reader.firstGroup = nextGroup;
+				reader.groupCount = std::min(blockSize, groupCount-nextGroup);
+				reader.buffer = &buffers[(block+1)%2][0];
+				readThread = boost::thread(boost::bind(&GroupReader::Read, &reader));
 			}
+			try {
+				ParallelFor::Run(count, boost::bind(&GroupDecoder::Decode, &decoder, _1, _2));
+			} catch(...) {
+				if(readThread.joinable())
+					readThread.join();
+				throw;
+			}
+			if(readThread.joinable())
+				readThread.join();
+			if(reader.error)
+				std::rethrow_exception(reader.error);
+		}
+		_cachedBand = band;
+		_cachedStokes = stokes;
+		AOLogger::Debug << "Read " << groupCount << " groups of band " << band << " for " << _baselines.size() << " baselines.\n";
+	}
+
+	void FitsImageSet::readBaselineGroups(size_t baselineIndex, int band, int stokes, Image2DPtr real, Image2DPtr imaginary)
+	{
+		const GroupIndex &index = *_groupIndex;
+		const std::vector<size_t> &groups = index.baselineGroups[baselineIndex];
+		size_t
+			complexCount = _file->GetCurrentImageSize(2),
+			stokesCount = _file->GetCurrentImageSize(3),
+			frequencyStep = stokesCount*complexCount,
+			frequencyCount = _file->GetCurrentImageSize(4),
+			bandStep = frequencyStep*frequencyCount,
+			imageSize = _file->GetImageSize(),
+			blockSize = std::max<size_t>(1, _readBlockValues / imageSize);
+
+		std::vector<Image2DPtr> realImages(_baselines.size()), imaginaryImages(_baselines.size());
+		realImages[baselineIndex] = real;
+		imaginaryImages[baselineIndex] = imaginary;
+		std::vector<double> buffer(std::min(blockSize, groups.size()) * imageSize);
+		GroupDecoder decoder;
+		decoder.data = &buffer[0];
+		decoder.imageSize = imageSize;
+		decoder.valueOffset = stokes*complexCount + bandStep*band;
+		decoder.frequencyStep = frequencyStep;
+		decoder.frequencyCount = frequencyCount;
+		decoder.groupBaseline = &index.groupBaseline;
+		decoder.groupPosition = &index.groupPosition;
+		decoder.real = &realImages;
+		decoder.imaginary = &imaginaryImages;
+
+		// Consecutive groups of the baseline are read with a single call
+		size_t i = 0;
+		while(i != groups.size())
+		{
+			size_t runEnd = i + 1;
+			while(runEnd != groups.size() && groups[runEnd] == groups[runEnd-1] + 1 && runEnd - i < blockSize)
+				++runEnd;
+			_file->ReadGroupData(groups[i], runEnd - i, &buffer[0]);
+			decoder.firstGroup = groups[i];
+			decoder.Decode(0, runEnd - i);
+			i = runEnd;
+		}
+	}
+
+	TimeFrequencyData FitsImageSet::ReadPrimaryGroupTable(size_t baselineIndex, int band, int stokes, TimeFrequencyMetaData &metaData)
+	{
+		if(!_file->HasGroups() || _file->GetCurrentHDUType() != FitsFile::ImageHDUType)
+			throw FitsIOException("Primary table is not a grouped image");
+
+		//int keywordCount = _file->GetKeywordCount();
+		//for(int i=1;i<=keywordCount;++i)
+		//	AOLogger::Debug << "Keyword " << i << ": " << _file->GetKeyword(i) << "=" << _file->GetKeywordValue(i) << " ("  << _file->GetKeywordComment(i) << ")\n";
+
+		const std::vector<size_t> &groups = _groupIndex->baselineGroups[baselineIndex];
+		AOLogger::Debug << groups.size() << " rows in table matched baseline.\n";
+		if(groups.empty())
+			throw BadUsageException("Baseline not found!");
+
+		// When several baselines of a band are requested, all baselines of the band are read in a
+		// single pass over the file. A single baseline, e.g. one selected in the gui, is read
+		// through the index.
+		Image2DPtr real, imaginary;
+		const bool isCached = _cachedBand == band && _cachedStokes == stokes;
+		if(!isCached && _indexedBand == band && _indexedStokes == stokes && fitsInBandCache())
+			readBandCache(band, stokes);
+		if(_cachedBand == band && _cachedStokes == stokes && _cachedReal[baselineIndex] != 0)
+		{
+			real = _cachedReal[baselineIndex];
+			imaginary = _cachedImaginary[baselineIndex];
+			_cachedReal[baselineIndex].reset();
+			_cachedImaginary[baselineIndex].reset();
+		} else {
+			const size_t frequencyCount = _file->GetCurrentImageSize(4);
+			real = Image2D::CreateUnsetImagePtr(groups.size(), frequencyCount);
+			imaginary = Image2D::CreateUnsetImagePtr(groups.size(), frequencyCount);
+			readBaselineGroups(baselineIndex, band, stokes, real, imaginary);
+			_indexedBand = band;
+			_indexedStokes = stokes;
+		}
+		AOLogger::Debug << "Image is " << real->Width() << " x " << real->Height() << '\n';
+
+		double frequencyFactor = 1.0;
+		if(_frequencyOffset != 0.0)
+			frequencyFactor = _frequencyOffset;
+		std::vector<UVW> uvws(_groupIndex->uvws[baselineIndex]);
+		for(std::vector<UVW>::iterator i=uvws.begin();i!=uvws.end();++i)
+		{
+			i->u = i->u * frequencyFactor;
+			i->v = i->v * frequencyFactor;
+			i->w = i->w * frequencyFactor;
 		}
-		
 		metaData.SetUVW(uvws);
-		metaData.SetObservationTimes(observationTimes);
+		metaData.SetObservationTimes(_groupIndex->times[baselineIndex]);
 		return TimeFrequencyData(Polarization::StokesI, real, imaginary);
 	}
 
@@ -349,13 +654,54 @@ namespace rfiStrategy {
 		AOLogger::Debug << "Found calibration table with " << _file->GetRowCount() << " rows.\n";
 	}
 	
+	void FitsImageSet::readScalarColumn(int column, std::vector<double> &values)
+	{
+		const int rowCount = _file->GetRowCount();
+		values.resize(rowCount);
+		if(rowCount != 0)
+			_file->ReadTableRows(1, rowCount, column, &values[0], 1);
+	}
+
 	void FitsImageSet::ReadSingleDishTable(TimeFrequencyData &data, TimeFrequencyMetaData &metaData, size_t ifIndex)
+	{
+		const int hdu = _file->GetCurrentHDU();
+		const std::pair<int,int> key(hdu, _bandIndexToNumber[ifIndex]);
+		std::map<std::pair<int,int>, SingleDishIF>::iterator cached = _singleDishCache.find(key);
+		if(cached == _singleDishCache.end())
+		{
+			readSingleDishIFs(ifIndex);
+			cached = _singleDishCache.find(key);
+		}
+		SingleDishIF ifData = cached->second;
+		// The IFs are processed in order, so IFs before this one were skipped and are not kept
+		for(size_t i=0; i<=ifIndex; ++i)
+			_singleDishCache.erase(std::pair<int,int>(hdu, _bandIndexToNumber[i]));
+
+		if(ifData.observationTimes.empty())
+		{
+			throw std::runtime_error("Couldn't find any rows in the fits image set for the requested IF");
+		}
+		if(ifData.hasBand)
+			metaData.SetBand(ifData.band);
+		metaData.SetObservationTimes(ifData.observationTimes);
+		if(ifData.images.size() == 1)
+		{
+			data = TimeFrequencyData(TimeFrequencyData::AmplitudePart, Polarization::StokesI, ifData.images[0]);
+			data.SetGlobalMask(ifData.masks[0]);
+		} else if(ifData.images.size() == 2)
+		{
+			data = TimeFrequencyData(TimeFrequencyData::AmplitudePart, Polarization::XX, ifData.images[0], Polarization::YY, ifData.images[1]);
+			data.SetIndividualPolarizationMasks(ifData.masks[0], ifData.masks[1]);
+		}
+		else throw std::runtime_error("Don't know how to convert polarizations in file");
+	}
+
+	void FitsImageSet::readSingleDishIFs(size_t requestedIFIndex)
 	{
 		const int rowCount = _file->GetRowCount();
 		AOLogger::Debug << "Found single dish table with " << rowCount << " rows.\n";
 		const int
 			timeColumn = _file->GetTableColumnIndex("TIME"),
-			dateObsColumn = _file->GetTableColumnIndex("DATE-OBS"),
 			dataColumn = _file->GetTableColumnIndex("DATA"),
 			flagColumn = _file->GetTableColumnIndex("FLAGGED"),
 			freqValColumn = _file->GetTableColumnIndex("CRVAL1"),
@@ -372,128 +718,147 @@ namespace rfiStrategy {
 			polarizationCount = _file->GetTableDimensionSize(dataColumn, 1),
 			raCount = _file->GetTableDimensionSize(dataColumn, 2),
 			decCount = _file->GetTableDimensionSize(dataColumn, 3);
-			
+
 		const std::string telescopeName = _file->GetKeywordValue("TELESCOP");
 		_antennaInfos[0].name = telescopeName;
-			
-		const int totalSize = _file->GetTableColumnArraySize(dataColumn);
+
+		const int
+			totalSize = _file->GetTableColumnArraySize(dataColumn),
+			flagSize = _file->GetTableColumnArraySize(flagColumn);
 		AOLogger::Debug << "Shape of data cells: " << freqCount << " channels x " << polarizationCount << " pols x " << raCount << " RAs x " << decCount << " decs" << "=" << totalSize << '\n';
-		std::vector<long double> cellData(totalSize);
-		bool *flagData = new bool[totalSize];
-		std::vector<Image2DPtr> images(polarizationCount);
-		std::vector<Mask2DPtr> masks(polarizationCount);
-		for(int i=0;i<polarizationCount;++i)
-		{
-			images[i] = Image2D::CreateZeroImagePtr(rowCount, freqCount);
-			masks[i] = Mask2D::CreateSetMaskPtr<true>(rowCount, freqCount);
-		}
-		std::vector<double> observationTimes(rowCount);
-		bool hasBand = false;
-		const int requestedIFNumber = _bandIndexToNumber[ifIndex];
-		size_t timeIndex = 0;
-		for(int row=1;row<=rowCount;++row)
-		{
-			long double time, date, ifNumber;
-			_file->ReadTableCell(row, ifColumn, &ifNumber, 1);
-			
-			if(ifNumber == requestedIFNumber)
+		if(flagSize < totalSize)
+			throw std::runtime_error("The cells of the flag column are smaller than those of the data column");
+
+		std::vector<double> ifValues, times;
+		readScalarColumn(ifColumn, ifValues);
+		readScalarColumn(timeColumn, times);
+
+		// The requested IF and the IFs after it are read in one pass when they fit in memory,
+		// otherwise only the requested IF
+		std::vector<int> ifNumbers;
+		const size_t tableSize = (size_t) rowCount * totalSize * (sizeof(num_t) + sizeof(bool));
+		if(tableSize <= (size_t) System::TotalMemory() / 4)
+			ifNumbers.assign(_bandIndexToNumber.begin() + requestedIFIndex, _bandIndexToNumber.end());
+		else
+			ifNumbers.push_back(_bandIndexToNumber[requestedIFIndex]);
+		std::map<int, size_t> ifSlots;
+		for(size_t i=0; i!=ifNumbers.size(); ++i)
+			ifSlots.insert(std::pair<int, size_t>(ifNumbers[i], i));
+
+		SingleDishRows rows;
+		rows.rowSlot.assign(rowCount, SingleDishRows::NoSlot);
+		rows.rowTimeIndex.resize(rowCount);
+		std::vector<size_t> slotRowCounts(ifNumbers.size(), 0);
+		for(int row=0; row!=rowCount; ++row)
+		{
+			std::map<int, size_t>::const_iterator slot = ifSlots.find((int) round(ifValues[row]));
+			if(slot != ifSlots.end())
 			{
-				_file->ReadTableCell(row, timeColumn, &time, 1);
-				_file->ReadTableCell(row, dateObsColumn, &date, 1);
-				_file->ReadTableCell(row, dataColumn, &cellData[0], totalSize);
-				_file->ReadTableCell(row, flagColumn, &flagData[0], totalSize);
-			
-				observationTimes[timeIndex] = time;
-				
-				if(!hasBand)
-				{
-					long double freqVal = 0.0, freqRefPix = 0.0, freqDelta = 0.0, freqRes = 0.0, freqBandwidth = 0.0;
-					_file->ReadTableCell(row, freqValColumn, &freqVal, 1);
-					_file->ReadTableCell(row, freqRefPixColumn, &freqRefPix, 1);
-					_file->ReadTableCell(row, freqDeltaColumn, &freqDelta, 1);
-					_file->ReadTableCell(row, freqResColumn, &freqRes, 1);
-					_file->ReadTableCell(row, freqBandwidthColumn, &freqBandwidth, 1);
-					if(freqBandwidth > 0.0)
-					{
-						AOLogger::Debug << "Frequency info: " <<freqVal << " Hz at index " << freqRefPix << ", delta " << freqDelta << "\n";
-						AOLogger::Debug << "Frequency res: " <<freqRes << " with bandwidth " << freqBandwidth << " Hz\n";
-						BandInfo bandInfo;
-						bandInfo.windowIndex = ifNumber;
-						for(int i=0;i<freqCount;++i)
-						{
-							ChannelInfo c;
-							c.frequencyIndex = i;
-							c.frequencyHz = ((double) i-freqRefPix)*freqDelta + freqVal;
-							bandInfo.channels.push_back(c);
-						}
-						_bandInfos[ifNumber] = bandInfo;
-						metaData.SetBand(bandInfo);
-						hasBand = true;
-					}
-				}
+				rows.rowSlot[row] = slot->second;
+				rows.rowTimeIndex[row] = slotRowCounts[slot->second];
+				++slotRowCounts[slot->second];
+			}
+		}
+
+		std::vector<SingleDishIF> ifs(ifNumbers.size());
+		rows.images.resize(ifNumbers.size() * polarizationCount);
+		rows.masks.resize(ifNumbers.size() * polarizationCount);
+		for(size_t slot=0; slot!=ifNumbers.size(); ++slot)
+		{
+			ifs[slot].observationTimes.resize(slotRowCounts[slot]);
+			for(int p=0; p<polarizationCount; ++p)
+			{
+				Image2DPtr image = Image2D::CreateZeroImagePtr(slotRowCounts[slot], freqCount);
+				Mask2DPtr mask = Mask2D::CreateSetMaskPtr<true>(slotRowCounts[slot], freqCount);
+				ifs[slot].images.push_back(image);
+				ifs[slot].masks.push_back(mask);
+				rows.images[slot*polarizationCount + p] = image;
+				rows.masks[slot*polarizationCount + p] = mask;
+			}
+		}
 
-				long double *dataPtr = &cellData[0];
-				bool *flagPtr = flagData;
-				for(int p=0;p<polarizationCount;++p)
+		for(int row=0; row!=rowCount; ++row)
+		{
+			const size_t slot = rows.rowSlot[row];
+			if(slot == SingleDishRows::NoSlot)
+				continue;
+			ifs[slot].observationTimes[rows.rowTimeIndex[row]] = times[row];
+			if(!ifs[slot].hasBand)
+			{
+				long double freqVal = 0.0, freqRefPix = 0.0, freqDelta = 0.0, freqRes = 0.0, freqBandwidth = 0.0;
+				_file->ReadTableCell(row+1, freqValColumn, &freqVal, 1);
+				_file->ReadTableCell(row+1, freqRefPixColumn, &freqRefPix, 1);
+				_file->ReadTableCell(row+1, freqDeltaColumn, &freqDelta, 1);
+				_file->ReadTableCell(row+1, freqResColumn, &freqRes, 1);
+				_file->ReadTableCell(row+1, freqBandwidthColumn, &freqBandwidth, 1);
+				if(freqBandwidth > 0.0)
 				{
-					for(int f=0;f<freqCount;++f)
+					AOLogger::Debug << "Frequency info: " <<freqVal << " Hz at index " << freqRefPix << ", delta " << freqDelta << "\n";
+					AOLogger::Debug << "Frequency res: " <<freqRes << " with bandwidth " << freqBandwidth << " Hz\n";
+					BandInfo bandInfo;
+					bandInfo.windowIndex = ifNumbers[slot];
+					for(int i=0;i<freqCount;++i)
 					{
-						images[p]->SetValue(timeIndex, f, *dataPtr);
-						masks[p]->SetValue(timeIndex, f, *flagPtr);
-						++dataPtr;
-						++flagPtr;
+						ChannelInfo c;
+						c.frequencyIndex = i;
+						c.frequencyHz = ((double) i-freqRefPix)*freqDelta + freqVal;
+						bandInfo.channels.push_back(c);
 					}
+					_bandInfos[ifNumbers[slot]] = bandInfo;
+					ifs[slot].band = bandInfo;
+					ifs[slot].hasBand = true;
 				}
-				++timeIndex;
 			}
 		}
-		delete[] flagData;
-		if(timeIndex == 0)
-		{
-			throw std::runtime_error("Couldn't find any rows in the fits image set for the requested IF");
-		}
-		for(int p=0;p<polarizationCount;++p)
-		{
-			images[p]->SetTrim(0, 0, timeIndex, images[p]->Height());
-			masks[p] = masks[p]->Trim(0, 0, timeIndex, images[p]->Height());
-		}
-		observationTimes.resize(timeIndex);
-		metaData.SetObservationTimes(observationTimes);
-		if(polarizationCount == 1)
-		{
-			data = TimeFrequencyData(TimeFrequencyData::AmplitudePart, Polarization::StokesI, images[0]);
-			data.SetGlobalMask(masks[0]);
-		} else if(polarizationCount == 2)
+
+		// Read the data and flag cells of many rows at once, and decode the IFs in parallel
+		const int chunkSize = _file->GetRowBufferSize();
+		std::vector<double> cellData((size_t) std::min(chunkSize, rowCount) * totalSize);
+		std::unique_ptr<bool[]> flagData(new bool[(size_t) std::min(chunkSize, rowCount) * flagSize]);
+		rows.data = &cellData[0];
+		rows.flags = flagData.get();
+		rows.dataSize = totalSize;
+		rows.flagSize = flagSize;
+		rows.polarizationCount = polarizationCount;
+		rows.freqCount = freqCount;
+		for(int firstRow=0; rows.SelectRange(firstRow, chunkSize); firstRow=rows.endRow)
 		{
-			data = TimeFrequencyData(TimeFrequencyData::AmplitudePart, Polarization::XX, images[0], Polarization::YY, images[1]);
-			data.SetIndividualPolarizationMasks(masks[0], masks[1]);
+			const int selectedCount = rows.endRow - rows.firstRow;
+			_file->ReadTableRows(rows.firstRow+1, selectedCount, dataColumn, &cellData[0], totalSize);
+			_file->ReadTableRows(rows.firstRow+1, selectedCount, flagColumn, flagData.get(), flagSize);
+			ParallelFor::Run(ifNumbers.size(), boost::bind(&SingleDishRows::Decode, &rows, _1, _2));
 		}
-		else throw std::runtime_error("Don't know how to convert polarizations in file");
+
+		const int hdu = _file->GetCurrentHDU();
+		for(size_t slot=0; slot!=ifNumbers.size(); ++slot)
+			_singleDishCache[std::pair<int,int>(hdu, ifNumbers[slot])] = ifs[slot];
 	}
-	
+
 	void FitsImageSet::AddWriteFlagsTask(const ImageSetIndex &index, std::vector<Mask2DCPtr> &flags)
 	{
 		if(_file->HasGroups())
 			throw BadUsageException("Not implemented for grouped fits files");
 		else
-			saveSingleDishFlags(flags, static_cast<const FitsImageSetIndex&>(index)._band);
+			_pendingFlags[static_cast<const FitsImageSetIndex&>(index)._band] = flags;
 	}
 
 	void FitsImageSet::PerformWriteFlagsTask()
 	{
 		if(_file->HasGroups())
 			throw BadUsageException("Not implemented for grouped fits files");
-		else {
-			// Nothing to be done; Add..Task already wrote the flags.
+		else if(!_pendingFlags.empty()) {
+			// All requested IFs are written in a single pass over the table
+			saveSingleDishFlags(_pendingFlags);
+			_pendingFlags.clear();
 		}
 	}
-	
-	void FitsImageSet::saveSingleDishFlags(std::vector<Mask2DCPtr> &flags, size_t ifIndex)
+
+	void FitsImageSet::saveSingleDishFlags(const std::map<size_t, std::vector<Mask2DCPtr> > &flags)
 	{
 		_file->Close();
 		_file->Open(FitsFile::ReadWriteMode);
 		_file->MoveToHDU(2);
-		AOLogger::Debug << "Writing single dish table for band " << ifIndex << " with " << _file->GetRowCount() << " rows.\n";
+		AOLogger::Debug << "Writing single dish table for " << flags.size() << " bands with " << _file->GetRowCount() << " rows.\n";
 		const int
 			dataColumn = _file->GetTableColumnIndex("DATA"),
 			flagColumn = _file->GetTableColumnIndex("FLAGGED"),
@@ -501,61 +866,78 @@ namespace rfiStrategy {
 		const int
 			freqCount = _file->GetTableDimensionSize(dataColumn, 0),
 			polarizationCount = _file->GetTableDimensionSize(dataColumn, 1);
-			
-		const int totalSize = _file->GetTableColumnArraySize(dataColumn);
+
+		const int
+			totalSize = _file->GetTableColumnArraySize(dataColumn),
+			flagSize = _file->GetTableColumnArraySize(flagColumn);
 		const int rowCount = _file->GetRowCount();
-		std::vector<double> cellData(totalSize);
-		std::unique_ptr<bool[]> flagData ( new bool[totalSize] );
-		std::vector<Mask2DCPtr> storedFlags = flags;
-		if(flags.size()==1)
+		if(flagSize < totalSize)
+			throw std::runtime_error("The cells of the flag column are smaller than those of the data column");
+
+		SingleDishRows rows;
+		std::map<int, size_t> ifSlots;
+		for(std::map<size_t, std::vector<Mask2DCPtr> >::const_iterator band=flags.begin(); band!=flags.end(); ++band)
 		{
-			while(storedFlags.size() < (unsigned) polarizationCount) storedFlags.push_back(flags[0]);
+			std::vector<Mask2DCPtr> storedFlags = band->second;
+			if(storedFlags.size()==1)
+			{
+				while(storedFlags.size() < (unsigned) polarizationCount) storedFlags.push_back(band->second[0]);
+			}
+			if(storedFlags.size() != (unsigned) polarizationCount)
+			{
+				std::stringstream s;
+				s << "saveSingleDishFlags() : mismatch in polarization count: the given vector contains " << band->second.size() << " polarizations, the number of polarizations in the file is " << polarizationCount;
+				throw std::runtime_error(s.str());
+			}
+			for(std::vector<Mask2DCPtr>::const_iterator i=storedFlags.begin();i!=storedFlags.end();++i)
+			{
+				if((*i)->Height() != (unsigned) freqCount)
+					throw std::runtime_error("Frequency count in given mask does not match with the file");
+			}
+			ifSlots.insert(std::pair<int, size_t>(_bandIndexToNumber[band->first], ifSlots.size()));
+			rows.storedFlags.insert(rows.storedFlags.end(), storedFlags.begin(), storedFlags.end());
 		}
-		if(storedFlags.size() != (unsigned) polarizationCount)
+
+		std::vector<double> ifValues;
+		readScalarColumn(ifColumn, ifValues);
+		rows.rowSlot.assign(rowCount, SingleDishRows::NoSlot);
+		rows.rowTimeIndex.resize(rowCount);
+		std::vector<size_t> slotRowCounts(ifSlots.size(), 0);
+		for(int row=0; row!=rowCount; ++row)
 		{
-			std::stringstream s;
-			s << "saveSingleDishFlags() : mismatch in polarization count: the given vector contains " << flags.size() << " polarizations, the number of polarizations in the file is " << polarizationCount;
-			throw std::runtime_error(s.str());
+			std::map<int, size_t>::const_iterator slot = ifSlots.find((int) round(ifValues[row]));
+			if(slot != ifSlots.end())
+			{
+				rows.rowSlot[row] = slot->second;
+				rows.rowTimeIndex[row] = slotRowCounts[slot->second];
+				++slotRowCounts[slot->second];
+			}
 		}
-		for(std::vector<Mask2DCPtr>::const_iterator i=storedFlags.begin();i!=storedFlags.end();++i)
+
+		for(std::map<int, size_t>::const_iterator slot=ifSlots.begin(); slot!=ifSlots.end(); ++slot)
 		{
-			if((*i)->Height() != (unsigned) freqCount)
-				throw std::runtime_error("Frequency count in given mask does not match with the file");
+			if(rows.storedFlags[slot->second * polarizationCount]->Width() != slotRowCounts[slot->second])
+				throw std::runtime_error("Time count in given mask does not match with the file");
 		}
-		size_t timeIndex = 0;
-		int specifiedIFNumber = _bandIndexToNumber[ifIndex];
-		for(int row=1;row<=rowCount;++row)
+
+		// Read, change and write the cells of many rows at once, and encode the IFs in parallel
+		const int chunkSize = _file->GetRowBufferSize();
+		std::vector<double> cellData((size_t) std::min(chunkSize, rowCount) * totalSize);
+		std::unique_ptr<bool[]> flagData(new bool[(size_t) std::min(chunkSize, rowCount) * flagSize]);
+		rows.data = &cellData[0];
+		rows.flags = flagData.get();
+		rows.dataSize = totalSize;
+		rows.flagSize = flagSize;
+		rows.polarizationCount = polarizationCount;
+		rows.freqCount = freqCount;
+		for(int firstRow=0; rows.SelectRange(firstRow, chunkSize); firstRow=rows.endRow)
 		{
-			long double ifNumber;
-			_file->ReadTableCell(row, ifColumn, &ifNumber, 1);
-			
-			if(ifNumber == specifiedIFNumber)
-			{
-				AOLogger::Debug << row << "\n";
-				_file->ReadTableCell(row, dataColumn, &cellData[0], totalSize);
-				double *dataPtr = &cellData[0];
-				bool *flagPtr = flagData.get();
-				
-				for(int p=0;p<polarizationCount;++p)
-				{
-					for(int f=0;f<freqCount;++f)
-					{
-						if(storedFlags[p]->Value(timeIndex, f))
-						{
-							*flagPtr = true;
-							*dataPtr = 1e20;
-						} else {
-							*flagPtr = false;
-						}
-						++dataPtr;
-						++flagPtr;
-					}
-				}
-				
-				_file->WriteTableCell(row, dataColumn, &cellData[0], totalSize);
-				_file->WriteTableCell(row, flagColumn, flagData.get(), totalSize);
-				++timeIndex;
-			}
+			const int selectedCount = rows.endRow - rows.firstRow;
+			_file->ReadTableRows(rows.firstRow+1, selectedCount, dataColumn, &cellData[0], totalSize);
+			_file->ReadTableRows(rows.firstRow+1, selectedCount, flagColumn, flagData.get(), flagSize);
+			ParallelFor::Run(ifSlots.size(), boost::bind(&SingleDishRows::Encode, &rows, _1, _2));
+			_file->WriteTableRows(rows.firstRow+1, selectedCount, dataColumn, &cellData[0], totalSize);
+			_file->WriteTableRows(rows.firstRow+1, selectedCount, flagColumn, flagData.get(), flagSize);
 		}
 	}
 	
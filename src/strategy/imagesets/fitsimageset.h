@@ -80,8 +80,42 @@ namespace rfiStrategy {
 			}
 			
 			std::string ReadTelescopeName();
+
+			/**
+			 * Sets the number of values that are read from the file at once. Must be set
+			 * before Initialize().
+			 */
+			void SetReadBlockValues(size_t readBlockValues) { _readBlockValues = readBlockValues; }
 			
 		private:
+			/**
+			 * Locations of the groups of the primary table, built in a single pass by Initialize().
+			 * Because the groups of a baseline are scattered through the file, reading a baseline
+			 * by scanning the file would read the complete file once per baseline.
+			 */
+			struct GroupIndex
+			{
+				// For each baseline: the indices of its groups, and the time and uvw of each group
+				std::vector<std::vector<size_t> > baselineGroups;
+				std::vector<std::vector<double> > times;
+				std::vector<std::vector<UVW> > uvws;
+				// For each group: the index of its baseline and its position in that baseline
+				std::vector<size_t> groupBaseline, groupPosition;
+			};
+
+			/**
+			 * Data, flags and metadata of one IF of a single-dish table.
+			 */
+			struct SingleDishIF
+			{
+				SingleDishIF() : hasBand(false) { }
+				std::vector<Image2DPtr> images;
+				std::vector<Mask2DPtr> masks;
+				std::vector<double> observationTimes;
+				BandInfo band;
+				bool hasBand;
+			};
+
 			FitsImageSet(const FitsImageSet &source);
 			BaselineData loadData(const ImageSetIndex &index);
 			
@@ -93,7 +127,14 @@ namespace rfiStrategy {
 			void ReadSingleDishTable(TimeFrequencyData &data, TimeFrequencyMetaData &metaData, size_t ifIndex);
 			TimeFrequencyData ReadPrimaryGroupTable(size_t baselineIndex, int band, int stokes, TimeFrequencyMetaData &metaData);
 			
-			void saveSingleDishFlags(std::vector<Mask2DCPtr> &flags, size_t ifIndex);
+			void buildGroupIndex();
+			bool fitsInBandCache();
+			void readBandCache(int band, int stokes);
+			void readBaselineGroups(size_t baselineIndex, int band, int stokes, Image2DPtr real, Image2DPtr imaginary);
+			
+			void readSingleDishIFs(size_t requestedIFIndex);
+			void readScalarColumn(int column, std::vector<double> &values);
+			void saveSingleDishFlags(const std::map<size_t, std::vector<Mask2DCPtr> > &flags);
 			
 			boost::shared_ptr<class FitsFile> _file;
 			std::vector<std::pair<size_t,size_t> > _baselines;
@@ -103,8 +144,30 @@ namespace rfiStrategy {
 			std::vector<int> _bandIndexToNumber;
 			size_t _currentBaselineIndex, _currentBandIndex;
 			double _frequencyOffset;
+			size_t _readBlockValues;
 			
 			std::stack<BaselineData> _baselineData;
+			
+			boost::shared_ptr<const GroupIndex> _groupIndex;
+			
+			/**
+			 * Visibilities of all baselines of one band, read in one pass over the file. A
+			 * baseline is removed once it has been returned; baselines that are requested again
+			 * are read through the group index.
+			 */
+			int _cachedBand, _cachedStokes;
+			std::vector<Image2DPtr> _cachedReal, _cachedImaginary;
+			// Band of the last baseline that was read through the index
+			int _indexedBand, _indexedStokes;
+			
+			/**
+			 * IFs of single-dish tables that have been read but not yet returned, by HDU index
+			 * and IF number. The requested IF and the IFs after it are read in one pass over the
+			 * table. An IF is removed when it or a later IF is returned.
+			 */
+			std::map<std::pair<int,int>, SingleDishIF> _singleDishCache;
+			// Flags of single-dish IFs that are written by PerformWriteFlagsTask(), by band index
+			std::map<size_t, std::vector<Mask2DCPtr> > _pendingFlags;
 	};
 
 }
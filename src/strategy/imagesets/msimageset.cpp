@@ -1,4 +1,5 @@
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <stdexcept>
 
@@ -176,23 +177,61 @@ namespace rfiStrategy {
 	
 	void MSImageSet::PerformReadRequests()
 	{
+		size_t readCount = 0;
 		for(std::vector<BaselineData>::iterator i=_baselineData.begin();i!=_baselineData.end();++i)
 		{
 			MSImageSetIndex &index = static_cast<MSImageSetIndex&>(i->Index());
-			_reader->AddReadRequest(GetAntenna1(index), GetAntenna2(index), GetBand(index), GetSequenceId(index), StartIndex(index), EndIndex(index));
+			if(_prefetchedData.count(index._sequenceIndex) == 0)
+			{
+				_reader->AddReadRequest(GetAntenna1(index), GetAntenna2(index), GetBand(index), GetSequenceId(index), StartIndex(index), EndIndex(index));
+				++readCount;
+			}
 		}
 		
-		_reader->PerformReadRequests();
+		if(readCount != 0)
+			_reader->PerformReadRequests();
 		
 		for(std::vector<BaselineData>::iterator i=_baselineData.begin();i!=_baselineData.end();++i)
 		{
 			if(!i->Data().IsEmpty())
 				throw std::runtime_error("ReadRequest() called, but a previous read request was not completely processed by calling GetNextRequested().");
-			std::vector<UVW> uvw;
-			TimeFrequencyData data = _reader->GetNextResult(uvw);
-			i->SetData(data);
-			TimeFrequencyMetaDataCPtr metaData = createMetaData(i->Index(), uvw);
-			i->SetMetaData(metaData);
+			const size_t sequenceIndex = static_cast<MSImageSetIndex&>(i->Index())._sequenceIndex;
+			std::map<size_t, BaselineData>::iterator prefetched = _prefetchedData.find(sequenceIndex);
+			if(prefetched != _prefetchedData.end())
+			{
+				i->SetData(prefetched->second.Data());
+				i->SetMetaData(prefetched->second.MetaData());
+			} else {
+				std::vector<UVW> uvw;
+				TimeFrequencyData data = _reader->GetNextResult(uvw);
+				i->SetData(data);
+				TimeFrequencyMetaDataCPtr metaData = createMetaData(i->Index(), uvw);
+				i->SetMetaData(metaData);
+			}
+			// Baselines are requested in order, so prefetched baselines up to this one are no longer needed
+			_prefetchedData.erase(_prefetchedData.begin(), _prefetchedData.upper_bound(sequenceIndex));
+		}
+	}
+	
+	void MSImageSet::PrefetchBaselines(size_t count)
+	{
+		std::unique_ptr<ImageSetIndex> index(StartIndex());
+		size_t requestCount = 0;
+		while(requestCount != count && index->IsValid())
+		{
+			AddReadRequest(*index);
+			++requestCount;
+			index->Next();
+		}
+		if(requestCount != 0)
+		{
+			PerformReadRequests();
+			for(size_t i=0; i!=requestCount; ++i)
+			{
+				std::unique_ptr<BaselineData> baseline(GetNextRequested());
+				const size_t sequenceIndex = static_cast<MSImageSetIndex&>(baseline->Index())._sequenceIndex;
+				_prefetchedData.insert(std::make_pair(sequenceIndex, *baseline));
+			}
 		}
 	}
 	
@@ -1,6 +1,7 @@
 #ifndef MSIMAGESET_H
 #define MSIMAGESET_H
 
+#include <map>
 #include <set>
 #include <string>
 #include <stdexcept>
@@ -90,6 +91,18 @@ namespace rfiStrategy {
 			virtual void PerformReadRequests();
 			virtual BaselineData *GetNextRequested();
 
+			/**
+			 * Reads the first baselines of the set before they are requested. Read requests for
+			 * these baselines are served from the prefetched data, which is released once the
+			 * requests have passed it.
+			 */
+			void PrefetchBaselines(size_t count);
+
+			/**
+			 * Releases the prefetched baselines that were not requested.
+			 */
+			void ClearPrefetchedBaselines() { _prefetchedData.clear(); }
+
 			virtual void AddWriteFlagsTask(const ImageSetIndex &index, std::vector<Mask2DCPtr> &flags);
 			virtual void PerformWriteFlagsTask();
 
@@ -127,6 +140,13 @@ namespace rfiStrategy {
 				_dataColumnName = name;
 			}
 
+			BaselineIOMode IOMode() const { return _ioMode; }
+			void SetIOMode(BaselineIOMode ioMode) {
+				if(_reader != 0)
+					throw std::runtime_error("Trying to set the IO mode after creating the reader!");
+				_ioMode = ioMode;
+			}
+
 			bool SubtractModel() const { return _subtractModel; }
 			void SetSubtractModel(bool subtractModel) {
 				if(_reader != 0)
@@ -215,6 +235,7 @@ namespace rfiStrategy {
 			bool _readFlags, _readUVW;
 			BaselineIOMode _ioMode;
 			std::vector<BaselineData> _baselineData;
+			std::map<size_t, BaselineData> _prefetchedData;
 	};
 
 }
@@ -1,7 +1,10 @@
 #include "image2d.h"
+#include "imagebufferpool.h"
 
 #include "../msio/fitsfile.h"
 
+#include "../strategy/control/actionprofiler.h"
+
 #include <algorithm>
 #include <cmath>
 #include <cstring>
@@ -23,19 +26,15 @@
 Image2D::Image2D(size_t width, size_t height) :
 	_width(width),
 	_height(height),
-	_stride((((width-1)/4)+1)*4)
+	_stride((((width-1)/4)+1)*4),
+	_ownsData(true)
 {
 	if(_width == 0) _stride=0;
 	unsigned allocHeight = ((((height-1)/4)+1)*4);
 	if(height == 0) allocHeight = 0;
-#ifdef __APPLE__
-		// OS-X has no posix_memalign, but malloc always uses 16-byte alignment.
-		_dataConsecutive = (num_t*)malloc(_stride * allocHeight * sizeof(num_t));
-#else
-		if(posix_memalign((void **) &_dataConsecutive, 16, _stride * allocHeight * sizeof(num_t)) != 0)
-			throw std::bad_alloc();
-#endif
-	_dataPtr = new num_t*[allocHeight];
+	_dataConsecutive = static_cast<num_t*>(ImageBufferPool::Allocate(_stride * allocHeight * sizeof(num_t)));
+	rfiStrategy::ActionProfiler::RecordAllocation(_stride * allocHeight * sizeof(num_t));
+	_dataPtr = static_cast<num_t**>(ImageBufferPool::Allocate(allocHeight * sizeof(num_t*)));
 	for(size_t y=0;y<height;++y)
 	{
 		_dataPtr[y] = &_dataConsecutive[_stride * y];
@@ -61,19 +60,15 @@ Image2D::Image2D(size_t width, size_t height) :
 Image2D::Image2D(size_t width, size_t height, size_t widthCapacity) :
 	_width(width),
 	_height(height),
-	_stride((((widthCapacity-1)/4)+1)*4)
+	_stride((((widthCapacity-1)/4)+1)*4),
+	_ownsData(true)
 {
 	if(widthCapacity == 0) _stride=0;
 	unsigned allocHeight = ((((height-1)/4)+1)*4);
 	if(height == 0) allocHeight = 0;
-#ifdef __APPLE__
-		// OS-X has no posix_memalign, but malloc always uses 16-byte alignment.
-		_dataConsecutive = (num_t*)malloc(_stride * allocHeight * sizeof(num_t));
-#else
-		if(posix_memalign((void **) &_dataConsecutive, 16, _stride * allocHeight * sizeof(num_t)) != 0)
-			throw std::bad_alloc();
-#endif
-	_dataPtr = new num_t*[allocHeight];
+	_dataConsecutive = static_cast<num_t*>(ImageBufferPool::Allocate(_stride * allocHeight * sizeof(num_t)));
+	rfiStrategy::ActionProfiler::RecordAllocation(_stride * allocHeight * sizeof(num_t));
+	_dataPtr = static_cast<num_t**>(ImageBufferPool::Allocate(allocHeight * sizeof(num_t*)));
 	for(size_t y=0;y<height;++y)
 	{
 		_dataPtr[y] = &_dataConsecutive[_stride * y];
@@ -96,10 +91,39 @@ Image2D::Image2D(size_t width, size_t height, size_t widthCapacity) :
 	}
 }
 
+Image2D::Image2D(num_t *data, size_t width, size_t height, size_t stride) :
+	_width(width),
+	_height(height),
+	_stride(stride),
+	_dataConsecutive(data),
+	_ownsData(false)
+{
+	if(stride < width)
+		throw IOException("Stride of wrapped image is smaller than its width");
+	// The SSE kernels process rows up to a multiple of four, like in an image that owns
+	// its data. Those rows are not part of the caller's buffer, so they point to a zeroed row
+	// that is allocated behind the row pointers and freed with them.
+	unsigned allocHeight = ((((height-1)/4)+1)*4);
+	if(height == 0) allocHeight = 0;
+	const size_t paddingRows = allocHeight - height;
+	_dataPtr = static_cast<num_t**>(ImageBufferPool::Allocate(allocHeight * sizeof(num_t*) + (paddingRows == 0 ? 0 : _stride * sizeof(num_t))));
+	for(size_t y=0;y<height;++y)
+		_dataPtr[y] = &_dataConsecutive[_stride * y];
+	if(paddingRows != 0)
+	{
+		num_t *paddingRow = reinterpret_cast<num_t*>(&_dataPtr[allocHeight]);
+		for(size_t x=0;x<_stride;++x)
+			paddingRow[x] = 0.0;
+		for(size_t y=height;y<allocHeight;++y)
+			_dataPtr[y] = paddingRow;
+	}
+}
+
 Image2D::~Image2D()
 {
-	delete[] _dataPtr;
-	free(_dataConsecutive);
+	ImageBufferPool::Free(_dataPtr);
+	if(_ownsData)
+		ImageBufferPool::Free(_dataConsecutive);
 }
 
 Image2D *Image2D::CreateSetImage(size_t width, size_t height, num_t initialValue) 
@@ -165,7 +189,13 @@ Image2D *Image2D::CreateCopy(const Image2D &image)
 {
 	const size_t width = image.Width(), height = image.Height();
 	Image2D *newImage = new Image2D(width, height);
-	memcpy(newImage->_dataConsecutive, image._dataConsecutive, image._stride * height * sizeof(num_t));
+	if(newImage->_stride == image._stride)
+		memcpy(newImage->_dataConsecutive, image._dataConsecutive, image._stride * height * sizeof(num_t));
+	else {
+		// Image was created with a larger width capacity
+		for(size_t y=0; y!=height; ++y)
+			memcpy(newImage->_dataPtr[y], image._dataPtr[y], width * sizeof(num_t));
+	}
 	return newImage;
 }
 
@@ -477,30 +507,94 @@ void Image2D::SubtractAsRHS(const Image2DCPtr &lhs)
 #endif
 }
 
+/**
+ * Averages each bin of factor samples of a row. The sums are accumulated in the same order
+ * as with a scalar loop, so that the vectorized and scalar results are equal. The last bin
+ * can be smaller than factor.
+ */
+void Image2D::shrinkRowHorizontally(const num_t *input, size_t width, size_t factor, num_t *output)
+{
+	const size_t
+		newWidth = (width + factor - 1) / factor,
+		fullBinCount = width / factor;
+	size_t x = 0;
+#ifdef USE_INTRINSICS
+	// Four bins are summed at once
+	const __m128 factor4 = _mm_set1_ps((num_t) factor);
+	for(;x+4<=fullBinCount;x+=4)
+	{
+		const num_t *binPtr = input + x*factor;
+		__m128 sum = _mm_setzero_ps();
+		for(size_t binX=0;binX<factor;++binX)
+			sum = _mm_add_ps(sum, _mm_set_ps(binPtr[binX+factor*3], binPtr[binX+factor*2], binPtr[binX+factor], binPtr[binX]));
+		_mm_storeu_ps(output + x, _mm_div_ps(sum, factor4));
+	}
+#endif
+	for(;x<newWidth;++x)
+	{
+		size_t binSize = factor;
+		if(binSize + x*factor > width)
+			binSize = width - x*factor;
+		num_t sum = 0.0;
+		for(size_t binX=0;binX<binSize;++binX)
+			sum += input[x*factor + binX];
+		output[x] = sum / (num_t) binSize;
+	}
+}
+
+/**
+ * Averages binSize rows of the image, starting at startY, into the output row.
+ */
+void Image2D::shrinkRowsVertically(const Image2D &image, size_t startY, size_t binSize, num_t *output)
+{
+	const size_t width = image._width;
+	size_t x = 0;
+#ifdef USE_INTRINSICS
+	const __m128 binSize4 = _mm_set1_ps((num_t) binSize);
+	for(;x+4<=width;x+=4)
+	{
+		__m128 sum = _mm_setzero_ps();
+		for(size_t binY=0;binY<binSize;++binY)
+			sum = _mm_add_ps(sum, _mm_loadu_ps(image._dataPtr[startY + binY] + x));
+		_mm_storeu_ps(output + x, _mm_div_ps(sum, binSize4));
+	}
+#endif
+	for(;x<width;++x)
+	{
+		num_t sum = 0.0;
+		for(size_t binY=0;binY<binSize;++binY)
+			sum += image._dataPtr[startY + binY][x];
+		output[x] = sum / (num_t) binSize;
+	}
+}
+
 Image2DPtr Image2D::ShrinkHorizontally(size_t factor) const
 {
 	size_t newWidth = (_width + factor - 1) / factor;
 
 	Image2D *newImage = new Image2D(newWidth, _height);
 
-	for(size_t x=0;x<newWidth;++x)
-	{
-		size_t binSize = factor;
-		if(binSize + x*factor > _width)
-			binSize = _width - x*factor;
+	for(size_t y=0;y<_height;++y)
+		shrinkRowHorizontally(_dataPtr[y], _width, factor, newImage->_dataPtr[y]);
+	return Image2DPtr(newImage);
+}
 
-		for(size_t y=0;y<_height;++y)
-		{
-			num_t sum = 0.0;
-			for(size_t binX=0;binX<binSize;++binX)
-			{
-				size_t curX = x*factor + binX;
-				sum += Value(curX, y);
-			}
-			newImage->SetValue(x, y, sum / (num_t) binSize);
-		}
+void Image2D::ShrinkHorizontally(size_t factor, const std::vector<Image2DCPtr> &images, std::vector<Image2DPtr> &newImages)
+{
+	newImages.clear();
+	if(images.empty())
+		return;
+	const size_t
+		width = images.front()->_width,
+		height = images.front()->_height,
+		newWidth = (width + factor - 1) / factor;
+	for(size_t i=0;i!=images.size();++i)
+		newImages.push_back(Image2DPtr(new Image2D(newWidth, height)));
+	for(size_t y=0;y<height;++y)
+	{
+		for(size_t i=0;i!=images.size();++i)
+			shrinkRowHorizontally(images[i]->_dataPtr[y], width, factor, newImages[i]->_dataPtr[y]);
 	}
-	return Image2DPtr(newImage);
 }
 
 Image2DPtr Image2D::ShrinkVertically(size_t factor) const
@@ -514,32 +608,47 @@ Image2DPtr Image2D::ShrinkVertically(size_t factor) const
 		size_t binSize = factor;
 		if(binSize + y*factor > _height)
 			binSize = _height - y*factor;
-
-		for(size_t x=0;x<_width;++x)
-		{
-			num_t sum = 0.0;
-			for(size_t binY=0;binY<binSize;++binY)
-			{
-				size_t curY = y*factor + binY;
-				sum += Value(x, curY);
-			}
-			newImage->SetValue(x, y, sum / (num_t) binSize);
-		}
+		shrinkRowsVertically(*this, y*factor, binSize, newImage->_dataPtr[y]);
 	}
 	return Image2DPtr(newImage);
 }
 
+void Image2D::ShrinkVertically(size_t factor, const std::vector<Image2DCPtr> &images, std::vector<Image2DPtr> &newImages)
+{
+	newImages.clear();
+	if(images.empty())
+		return;
+	const size_t
+		width = images.front()->_width,
+		height = images.front()->_height,
+		newHeight = (height + factor - 1) / factor;
+	for(size_t i=0;i!=images.size();++i)
+		newImages.push_back(Image2DPtr(new Image2D(width, newHeight)));
+	for(size_t y=0;y<newHeight;++y)
+	{
+		size_t binSize = factor;
+		if(binSize + y*factor > height)
+			binSize = height - y*factor;
+		for(size_t i=0;i!=images.size();++i)
+			shrinkRowsVertically(*images[i], y*factor, binSize, newImages[i]->_dataPtr[y]);
+	}
+}
+
 Image2DPtr Image2D::EnlargeHorizontally(size_t factor, size_t newWidth) const
 {
 	Image2D *newImage = new Image2D(newWidth, _height);
 
-	for(size_t x=0;x<newWidth;++x)
+	for(size_t y=0;y<_height;++y)
 	{
-		size_t xOld = x / factor;
-
-		for(size_t y=0;y<_height;++y)
+		const num_t *input = _dataPtr[y];
+		num_t *output = newImage->_dataPtr[y];
+		// Each old value is repeated factor times
+		for(size_t x=0;x<newWidth;x+=factor)
 		{
-			newImage->SetValue(x, y, Value(xOld, y));
+			const num_t value = input[x / factor];
+			const size_t binEnd = std::min(x + factor, newWidth);
+			for(size_t binX=x;binX<binEnd;++binX)
+				output[binX] = value;
 		}
 	}
 	return Image2DPtr(newImage);
@@ -549,14 +658,8 @@ Image2DPtr Image2D::EnlargeVertically(size_t factor, size_t newHeight) const
 {
 	Image2D *newImage = new Image2D(_width, newHeight);
 
-	for(size_t x=0;x<_width;++x)
-	{
-		for(size_t y=0;y<newHeight;++y)
-		{
-			size_t yOld = y / factor;
-			newImage->SetValue(x, y, Value(x, yOld));
-		}
-	}
+	for(size_t y=0;y<newHeight;++y)
+		memcpy(newImage->_dataPtr[y], _dataPtr[y / factor], _width * sizeof(num_t));
 	return Image2DPtr(newImage);
 }
 
@@ -588,6 +691,7 @@ void Image2D::SetTrim(size_t startX, size_t startY, size_t endX, size_t endY)
 	std::swap(trimmed->_height, _height);
 	std::swap(trimmed->_width, _width);
 	std::swap(trimmed->_stride, _stride);
+	std::swap(trimmed->_ownsData, _ownsData);
 }
 
 /**
@@ -12,6 +12,7 @@
 
 #include <exception>
 #include <cmath>
+#include <vector>
 
 typedef boost::shared_ptr<class Image2D> Image2DPtr;
 typedef boost::shared_ptr<const class Image2D> Image2DCPtr;
@@ -69,7 +70,26 @@ class Image2D {
 		 */
 		static Image2DPtr CreateUnsetImagePtr(size_t width, size_t height, size_t widthCapacity)
 		{
-			return Image2DPtr(CreateUnsetImage(width, height));
+			return Image2DPtr(CreateUnsetImage(width, height, widthCapacity));
+		}
+		
+		/**
+		 * Creates an image that uses the given buffer for its values, without copying them.
+		 * The buffer is not freed when the image is destructed, so it should stay valid
+		 * for as long as the image exists.
+		 * 
+		 * Algorithms that process whole rows with SSE instructions expect the rows to be
+		 * aligned on 16 bytes and the stride to be a multiple of four; such algorithms
+		 * should only receive a wrapped image when this holds.
+		 * @param data Buffer with at least stride x height values. Row y starts at data + y*stride.
+		 * @param width Width of the new image.
+		 * @param height Height of the new image.
+		 * @param stride Number of values from the start of one row to the next, at least @p width.
+		 * @return A (unique) smart pointer to the new image.
+		 */
+		static Image2DPtr CreateWrappedImagePtr(num_t *data, size_t width, size_t height, size_t stride)
+		{
+			return Image2DPtr(new Image2D(data, width, height, stride));
 		}
 		
 		static Image2D *CreateSetImage(size_t width, size_t height, num_t initialValue);
@@ -402,6 +422,20 @@ class Image2D {
 		 */
 		Image2DPtr EnlargeVertically(size_t factor, size_t newHeight) const;
 
+		/**
+		 * Resample several images of the same size horizontally by decreasing the width
+		 * with an integer factor. The images are resampled together in a single pass over
+		 * their rows. The result is equal to calling ShrinkHorizontally() on each image.
+		 */
+		static void ShrinkHorizontally(size_t factor, const std::vector<Image2DCPtr> &images, std::vector<Image2DPtr> &newImages);
+
+		/**
+		 * Resample several images of the same size vertically by decreasing the height
+		 * with an integer factor, in a single pass. The result is equal to calling
+		 * ShrinkVertically() on each image.
+		 */
+		static void ShrinkVertically(size_t factor, const std::vector<Image2DCPtr> &images, std::vector<Image2DPtr> &newImages);
+
 		Image2DPtr Trim(size_t startX, size_t startY, size_t endX, size_t endY) const;
 		
 		void SetTrim(size_t startX, size_t startY, size_t endX, size_t endY);
@@ -497,13 +531,19 @@ class Image2D {
 	private:
 		Image2D(size_t width, size_t height);
 		Image2D(size_t width, size_t height, size_t widthCapacity);
+		Image2D(num_t *data, size_t width, size_t height, size_t stride);
 		
 		Image2D(const Image2D&) = delete;
 		Image2D& operator=(const Image2D&) = delete;
 		
+		static void shrinkRowHorizontally(const num_t *input, size_t width, size_t factor, num_t *output);
+		static void shrinkRowsVertically(const Image2D &image, size_t startY, size_t binSize, num_t *output);
+		
 		size_t _width, _height;
 		size_t _stride;
 		num_t **_dataPtr, *_dataConsecutive;
+		// False when _dataConsecutive is a buffer of the caller
+		bool _ownsData;
 };
 
 #endif
@@ -0,0 +1,290 @@
+#include "imagebufferpool.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/thread/mutex.hpp>
+
+namespace {
+	const size_t
+		Alignment = 64,
+		// The header is stored in front of the buffer, and holds the size class.
+		HeaderSize = Alignment,
+		MinClassExponent = 8,
+		MaxClassExponent = 40,
+		ClassCount = (MaxClassExponent - MinClassExponent) * 4 + 1,
+		NoClass = ClassCount;
+
+	struct BufferHeader
+	{
+		size_t sizeClass;
+		size_t bytes;
+	};
+
+	/**
+	 * Rounds the size up to the next size class. Class 0 holds everything up to
+	 * 2^MinClassExponent bytes; above that, four classes are used per power of two.
+	 */
+	size_t sizeClass(size_t bytes, size_t &classBytes)
+	{
+		if(bytes <= (size_t(1) << MinClassExponent))
+		{
+			classBytes = size_t(1) << MinClassExponent;
+			return 0;
+		}
+		size_t exponent = MinClassExponent;
+		while((size_t(1) << (exponent+1)) < bytes)
+			++exponent;
+		if(exponent >= MaxClassExponent)
+		{
+			classBytes = bytes;
+			return NoClass;
+		}
+		const size_t
+			base = size_t(1) << exponent,
+			step = base / 4,
+			substep = (bytes - base + step - 1) / step;
+		classBytes = base + substep * step;
+		return (exponent - MinClassExponent) * 4 + substep;
+	}
+
+	std::atomic<size_t>
+		allocationCount(0), threadCacheHits(0), globalPoolHits(0),
+		bytesInUse(0), peakBytesInUse(0), bytesCached(0);
+	std::atomic<size_t> threadCacheLimit(64*1024*1024), globalPoolLimit(512*1024*1024);
+
+	BufferHeader *header(void *buffer)
+	{
+		return reinterpret_cast<BufferHeader*>(static_cast<char*>(buffer) - HeaderSize);
+	}
+
+	void *systemAllocate(size_t sizeClass, size_t bytes)
+	{
+		void *block;
+		if(posix_memalign(&block, Alignment, HeaderSize + bytes) != 0)
+			throw std::bad_alloc();
+		void *buffer = static_cast<char*>(block) + HeaderSize;
+		header(buffer)->sizeClass = sizeClass;
+		header(buffer)->bytes = bytes;
+		return buffer;
+	}
+
+	void systemFree(void *buffer)
+	{
+		free(header(buffer));
+	}
+
+	struct FreeLists
+	{
+		FreeLists() : bytes(0) { }
+
+		std::vector<void*> lists[ClassCount];
+		size_t bytes;
+
+		void *Pop(size_t sizeClass, size_t classBytes)
+		{
+			std::vector<void*> &list = lists[sizeClass];
+			if(list.empty())
+				return 0;
+			void *buffer = list.back();
+			list.pop_back();
+			bytes -= classBytes;
+			bytesCached -= classBytes;
+			return buffer;
+		}
+
+		void Push(void *buffer)
+		{
+			const BufferHeader &h = *header(buffer);
+			lists[h.sizeClass].push_back(buffer);
+			bytes += h.bytes;
+			bytesCached += h.bytes;
+		}
+
+		void Clear()
+		{
+			for(size_t c=0; c!=ClassCount; ++c)
+			{
+				for(std::vector<void*>::iterator i=lists[c].begin(); i!=lists[c].end(); ++i)
+				{
+					bytesCached -= header(*i)->bytes;
+					systemFree(*i);
+				}
+				lists[c].clear();
+			}
+			bytes = 0;
+		}
+	};
+
+	struct GlobalPool
+	{
+		boost::mutex mutex;
+		FreeLists freeLists;
+	};
+
+	/**
+	 * The global pool is never destructed, because images might still be
+	 * released during the destruction of static objects.
+	 */
+	GlobalPool &globalPool()
+	{
+		static GlobalPool *pool = new GlobalPool();
+		return *pool;
+	}
+
+	void releaseToGlobalPool(void *buffer)
+	{
+		GlobalPool &pool = globalPool();
+		boost::mutex::scoped_lock lock(pool.mutex);
+		if(pool.freeLists.bytes + header(buffer)->bytes <= globalPoolLimit)
+			pool.freeLists.Push(buffer);
+		else {
+			lock.unlock();
+			systemFree(buffer);
+		}
+	}
+
+	/*
+	 * The thread cache itself is a plain pointer, so that it is still accessible
+	 * while the thread-local objects of a stopping thread are destructed. The guard
+	 * moves the cache to the global pool when the thread stops.
+	 */
+	thread_local FreeLists *threadCache = 0;
+	thread_local bool isThreadStopping = false;
+
+	struct ThreadCacheGuard
+	{
+		void Touch() { }
+		~ThreadCacheGuard()
+		{
+			isThreadStopping = true;
+			if(threadCache != 0)
+			{
+				for(size_t c=0; c!=ClassCount; ++c)
+				{
+					for(std::vector<void*>::iterator i=threadCache->lists[c].begin(); i!=threadCache->lists[c].end(); ++i)
+					{
+						bytesCached -= header(*i)->bytes;
+						releaseToGlobalPool(*i);
+					}
+				}
+				delete threadCache;
+				threadCache = 0;
+			}
+		}
+	};
+	thread_local ThreadCacheGuard threadCacheGuard;
+
+	FreeLists *getThreadCache()
+	{
+		if(threadCache == 0 && !isThreadStopping)
+		{
+			threadCacheGuard.Touch();
+			threadCache = new FreeLists();
+		}
+		return threadCache;
+	}
+}
+
+void *ImageBufferPool::Allocate(size_t bytes)
+{
+	if(bytes == 0)
+		return 0;
+	size_t classBytes;
+	const size_t c = sizeClass(bytes, classBytes);
+	++allocationCount;
+	const size_t inUse = (bytesInUse += classBytes);
+	size_t peak = peakBytesInUse;
+	while(inUse > peak && !peakBytesInUse.compare_exchange_weak(peak, inUse)) { }
+
+	if(c != NoClass)
+	{
+		FreeLists *cache = getThreadCache();
+		if(cache != 0)
+		{
+			void *buffer = cache->Pop(c, classBytes);
+			if(buffer != 0)
+			{
+				++threadCacheHits;
+				return buffer;
+			}
+		}
+		GlobalPool &pool = globalPool();
+		boost::mutex::scoped_lock lock(pool.mutex);
+		void *buffer = pool.freeLists.Pop(c, classBytes);
+		lock.unlock();
+		if(buffer != 0)
+		{
+			++globalPoolHits;
+			return buffer;
+		}
+	}
+	return systemAllocate(c, classBytes);
+}
+
+void ImageBufferPool::Free(void *buffer)
+{
+	if(buffer == 0)
+		return;
+	const BufferHeader &h = *header(buffer);
+	bytesInUse -= h.bytes;
+	if(h.sizeClass == NoClass)
+		systemFree(buffer);
+	else {
+		FreeLists *cache = getThreadCache();
+		if(cache != 0 && cache->bytes + h.bytes <= threadCacheLimit)
+			cache->Push(buffer);
+		else
+			releaseToGlobalPool(buffer);
+	}
+}
+
+void ImageBufferPool::SetLimits(size_t threadCacheBytes, size_t globalPoolBytes)
+{
+	threadCacheLimit = threadCacheBytes;
+	globalPoolLimit = globalPoolBytes;
+}
+
+void ImageBufferPool::Reserve(size_t bytes, size_t count)
+{
+	if(bytes == 0)
+		return;
+	size_t classBytes;
+	const size_t c = sizeClass(bytes, classBytes);
+	if(c == NoClass)
+		return;
+	// Buffers in the cache of the calling thread count as well, so that repeated calls
+	// by the same thread do not keep growing the pool
+	FreeLists *cache = getThreadCache();
+	const size_t cached = cache == 0 ? 0 : cache->lists[c].size();
+	GlobalPool &pool = globalPool();
+	boost::mutex::scoped_lock lock(pool.mutex);
+	for(size_t i=cached + pool.freeLists.lists[c].size(); i<count && pool.freeLists.bytes + classBytes <= globalPoolLimit; ++i)
+		pool.freeLists.Push(systemAllocate(c, classBytes));
+}
+
+ImageBufferPool::Statistics ImageBufferPool::GetStatistics()
+{
+	Statistics statistics;
+	statistics.allocationCount = allocationCount;
+	statistics.threadCacheHits = threadCacheHits;
+	statistics.globalPoolHits = globalPoolHits;
+	statistics.bytesInUse = bytesInUse;
+	statistics.peakBytesInUse = peakBytesInUse;
+	statistics.bytesCached = bytesCached;
+	return statistics;
+}
+
+void ImageBufferPool::Trim()
+{
+	FreeLists *cache = getThreadCache();
+	if(cache != 0)
+		cache->Clear();
+	GlobalPool &pool = globalPool();
+	boost::mutex::scoped_lock lock(pool.mutex);
+	pool.freeLists.Clear();
+}
@@ -0,0 +1,73 @@
+#ifndef IMAGE_BUFFER_POOL_H
+#define IMAGE_BUFFER_POOL_H
+
+#include <cstddef>
+
+/**
+ * Allocator for the data buffers of Image2D and Mask2D. Strategies create and destroy
+ * many images of the same size for every baseline. Instead of returning these buffers
+ * to the system, they are kept in a pool and reused for the next image of a similar size.
+ *
+ * Buffers are rounded up to a size class: each power of two is divided in four
+ * classes, so at most 25% of a buffer is unused. Released buffers first go to a cache
+ * that is local to the releasing thread, which requires no locking. When the thread cache
+ * is full, or when the thread stops, buffers move to a global pool that is protected by a mutex.
+ * When the global pool is full as well, buffers are freed.
+ *
+ * All buffers are aligned on 64 bytes.
+ */
+class ImageBufferPool
+{
+	public:
+		struct Statistics
+		{
+			size_t allocationCount;
+			size_t threadCacheHits, globalPoolHits;
+			size_t bytesInUse, peakBytesInUse;
+			size_t bytesCached;
+
+			double HitRate() const
+			{
+				if(allocationCount == 0)
+					return 0.0;
+				else
+					return double(threadCacheHits + globalPoolHits) / double(allocationCount);
+			}
+		};
+
+		/**
+		 * Returns an aligned buffer of at least @p bytes bytes. The contents of the
+		 * buffer are not initialized.
+		 * @throws std::bad_alloc when no memory is available.
+		 */
+		static void *Allocate(size_t bytes);
+
+		/**
+		 * Return a buffer that was returned by Allocate() to the pool.
+		 * @param buffer The buffer, or null in which case nothing happens.
+		 */
+		static void Free(void *buffer);
+
+		/**
+		 * Set the maximum number of bytes that are kept in each thread cache and
+		 * in the global pool. Setting both to zero disables pooling.
+		 */
+		static void SetLimits(size_t threadCacheBytes, size_t globalPoolBytes);
+
+		/**
+		 * Makes sure that the global pool and the cache of the calling thread together
+		 * hold at least @p count buffers of the size class of @p bytes, as far as the
+		 * limit of the global pool allows. Missing buffers are allocated from the
+		 * system immediately and put in the global pool.
+		 */
+		static void Reserve(size_t bytes, size_t count);
+
+		static Statistics GetStatistics();
+
+		/**
+		 * Frees all buffers in the global pool and the cache of the calling thread.
+		 */
+		static void Trim();
+};
+
+#endif
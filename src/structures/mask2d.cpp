@@ -1,19 +1,28 @@
 #include "mask2d.h"
 #include "image2d.h"
+#include "imagebufferpool.h"
 
+#include "../strategy/control/actionprofiler.h"
+
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
+#include <stdint.h>
+
 Mask2D::Mask2D(size_t width, size_t height) :
 	_width(width),
 	_height(height),
-	_stride((((width-1)/4)+1)*4)
+	_stride((((width-1)/4)+1)*4),
+	_ownsValues(true)
 {
 	if(_width == 0) _stride=0;
 	unsigned allocHeight = ((((height-1)/4)+1)*4);
 	if(height == 0) allocHeight = 0;
-	_valuesConsecutive = new bool[_stride * allocHeight * sizeof(bool)];
+	_valuesConsecutive = static_cast<bool*>(ImageBufferPool::Allocate(_stride * allocHeight * sizeof(bool)));
+	rfiStrategy::ActionProfiler::RecordAllocation(_stride * allocHeight * sizeof(bool));
 	
-	_values = new bool*[allocHeight];
+	_values = static_cast<bool**>(ImageBufferPool::Allocate(allocHeight * sizeof(bool*)));
 	for(size_t y=0;y<height;++y)
 	{
 		_values[y] = &_valuesConsecutive[_stride * y];
@@ -36,10 +45,38 @@ Mask2D::Mask2D(size_t width, size_t height) :
 	}
 }
 
+Mask2D::Mask2D(bool *values, size_t width, size_t height, size_t stride) :
+	_width(width),
+	_height(height),
+	_stride(stride),
+	_valuesConsecutive(values),
+	_ownsValues(false)
+{
+	if(stride < width)
+		throw IOException("Stride of wrapped mask is smaller than its width");
+	// Rows up to a multiple of four point to a row behind the row pointers, see
+	// the wrapping constructor of Image2D.
+	unsigned allocHeight = ((((height-1)/4)+1)*4);
+	if(height == 0) allocHeight = 0;
+	const size_t paddingRows = allocHeight - height;
+	_values = static_cast<bool**>(ImageBufferPool::Allocate(allocHeight * sizeof(bool*) + (paddingRows == 0 ? 0 : _stride)));
+	for(size_t y=0;y<height;++y)
+		_values[y] = &_valuesConsecutive[_stride * y];
+	if(paddingRows != 0)
+	{
+		bool *paddingRow = reinterpret_cast<bool*>(&_values[allocHeight]);
+		for(size_t x=0;x<_stride;++x)
+			paddingRow[x] = true;
+		for(size_t y=height;y<allocHeight;++y)
+			_values[y] = paddingRow;
+	}
+}
+
 Mask2D::~Mask2D()
 {
-	delete[] _values;
-	delete[] _valuesConsecutive;
+	ImageBufferPool::Free(_values);
+	if(_ownsValues)
+		ImageBufferPool::Free(_valuesConsecutive);
 }
 
 Mask2D *Mask2D::CreateUnsetMask(const Image2D &templateImage)
@@ -69,7 +106,12 @@ Mask2D *Mask2D::CreateCopy(const Mask2D &source)
 		height = source.Height();
 
 	Mask2D *newMask = new Mask2D(width, height);
-	memcpy(newMask->_valuesConsecutive, source._valuesConsecutive, source._stride * height * sizeof(bool));
+	if(newMask->_stride == source._stride)
+		memcpy(newMask->_valuesConsecutive, source._valuesConsecutive, source._stride * height * sizeof(bool));
+	else {
+		for(size_t y=0; y!=height; ++y)
+			memcpy(newMask->_values[y], source._values[y], width * sizeof(bool));
+	}
 	return newMask;
 }
 
@@ -79,21 +121,17 @@ Mask2DPtr Mask2D::ShrinkHorizontally(int factor) const
 
 	Mask2D *newMask= new Mask2D(newWidth, _height);
 
-	for(size_t x=0;x<newWidth;++x)
+	for(size_t y=0;y<_height;++y)
 	{
-		size_t binSize = factor;
-		if(binSize + x*factor > _width)
-			binSize = _width - x*factor;
-
-		for(size_t y=0;y<_height;++y)
+		const bool *input = _values[y];
+		bool *output = newMask->_values[y];
+		for(size_t x=0;x<newWidth;++x)
 		{
+			const size_t binEnd = std::min((x+1)*factor, _width);
 			bool value = false;
-			for(size_t binX=0;binX<binSize;++binX)
-			{
-				size_t curX = x*factor + binX;
-				value = value | Value(curX, y);
-			}
-			newMask->SetValue(x, y, value);
+			for(size_t curX=x*factor;curX<binEnd;++curX)
+				value = value | input[curX];
+			output[x] = value;
 		}
 	}
 	return Mask2DPtr(newMask);
@@ -105,21 +143,17 @@ Mask2DPtr Mask2D::ShrinkHorizontallyForAveraging(int factor) const
 
 	Mask2D *newMask= new Mask2D(newWidth, _height);
 
-	for(size_t x=0;x<newWidth;++x)
+	for(size_t y=0;y<_height;++y)
 	{
-		size_t binSize = factor;
-		if(binSize + x*factor > _width)
-			binSize = _width - x*factor;
-
-		for(size_t y=0;y<_height;++y)
+		const bool *input = _values[y];
+		bool *output = newMask->_values[y];
+		for(size_t x=0;x<newWidth;++x)
 		{
+			const size_t binEnd = std::min((x+1)*factor, _width);
 			bool value = true;
-			for(size_t binX=0;binX<binSize;++binX)
-			{
-				size_t curX = x*factor + binX;
-				value = value & Value(curX, y);
-			}
-			newMask->SetValue(x, y, value);
+			for(size_t curX=x*factor;curX<binEnd;++curX)
+				value = value & input[curX];
+			output[x] = value;
 		}
 	}
 	return Mask2DPtr(newMask);
@@ -137,15 +171,23 @@ Mask2DPtr Mask2D::ShrinkVertically(int factor) const
 		if(binSize + y*factor > _height)
 			binSize = _height - y*factor;
 
-		for(size_t x=0;x<_width;++x)
+		// The flags are bytes that are zero or one, so eight flags are OR-ed at once
+		bool *output = newMask->_values[y];
+		memcpy(output, _values[y*factor], _width * sizeof(bool));
+		for(size_t binY=1;binY<binSize;++binY)
 		{
-			bool value = false;
-			for(size_t binY=0;binY<binSize;++binY)
+			const bool *input = _values[y*factor + binY];
+			size_t x = 0;
+			for(;x+8<=_width;x+=8)
 			{
-				size_t curY = y*factor + binY;
-				value = value | Value(x, curY);
+				uint64_t inputWord, outputWord;
+				memcpy(&inputWord, input + x, 8);
+				memcpy(&outputWord, output + x, 8);
+				outputWord |= inputWord;
+				memcpy(output + x, &outputWord, 8);
 			}
-			newMask->SetValue(x, y, value);
+			for(;x<_width;++x)
+				output[x] = output[x] | input[x];
 		}
 	}
 	return Mask2DPtr(newMask);
@@ -153,38 +195,29 @@ Mask2DPtr Mask2D::ShrinkVertically(int factor) const
 
 void Mask2D::EnlargeHorizontallyAndSet(Mask2DCPtr smallMask, int factor)
 {
-	for(size_t x=0;x<smallMask->Width();++x)
+	for(size_t y=0;y<_height;++y)
 	{
-		size_t binSize = factor;
-		if(binSize + x*factor > _width)
-			binSize = _width - x*factor;
-
-		for(size_t y=0;y<_height;++y)
+		const bool *input = smallMask->_values[y];
+		bool *output = _values[y];
+		for(size_t x=0;x<smallMask->Width() && x*factor<_width;++x)
 		{
-			for(size_t binX=0;binX<binSize;++binX)
-			{
-				size_t curX = x*factor + binX;
-				SetValue(curX, y, smallMask->Value(x, y));
-			}
+			size_t binSize = factor;
+			if(binSize + x*factor > _width)
+				binSize = _width - x*factor;
+			memset(output + x*factor, input[x], binSize * sizeof(bool));
 		}
 	}
 }
 
 void Mask2D::EnlargeVerticallyAndSet(Mask2DCPtr smallMask, int factor)
 {
-	for(size_t y=0;y<smallMask->Height();++y)
+	for(size_t y=0;y<smallMask->Height() && y*factor<_height;++y)
 	{
 		size_t binSize = factor;
 		if(binSize + y*factor > _height)
 			binSize = _height - y*factor;
 
-		for(size_t x=0;x<_width;++x)
-		{
-			for(size_t binY=0;binY<binSize;++binY)
-			{
-				size_t curY = y*factor + binY;
-				SetValue(x, curY, smallMask->Value(x, y));
-			}
-		}
+		for(size_t binY=0;binY<binSize;++binY)
+			memcpy(_values[y*factor + binY], smallMask->_values[y], _width * sizeof(bool));
 	}
 }
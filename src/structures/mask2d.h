@@ -39,6 +39,7 @@ class Mask2D {
 			std::swap(source._height, _height);
 			std::swap(source._values, _values);
 			std::swap(source._valuesConsecutive, _valuesConsecutive);
+			std::swap(source._ownsValues, _ownsValues);
 		}
 
 		/**
@@ -50,6 +51,20 @@ class Mask2D {
 			Swap(*source);
 		}
 		
+		/**
+		 * Creates a mask that uses the given buffer for its values, without copying them.
+		 * The buffer is not freed when the mask is destructed, so it should stay valid
+		 * for as long as the mask exists.
+		 * @param values Buffer with at least stride x height values. Row y starts at values + y*stride.
+		 * @param width Width of the new mask.
+		 * @param height Height of the new mask.
+		 * @param stride Number of values from the start of one row to the next, at least @p width.
+		 */
+		static Mask2DPtr CreateWrappedMaskPtr(bool *values, size_t width, size_t height, size_t stride)
+		{
+			return Mask2DPtr(new Mask2D(values, width, height, stride));
+		}
+		
 		static Mask2D *CreateUnsetMask(size_t width, size_t height)
 		{
 			return new Mask2D(width, height);
@@ -332,6 +347,7 @@ class Mask2D {
 		}
 	private:
 		Mask2D(size_t width, size_t height);
+		Mask2D(bool *values, size_t width, size_t height, size_t stride);
 		Mask2D(const Mask2D&) = delete;
 
 		size_t _width, _height;
@@ -339,6 +355,8 @@ class Mask2D {
 		
 		bool **_values;
 		bool *_valuesConsecutive;
+		// False when _valuesConsecutive is a buffer of the caller
+		bool _ownsValues;
 };
 
 #endif
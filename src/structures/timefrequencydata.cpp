@@ -3,6 +3,58 @@
 
 #include "../util/ffttools.h"
 
+#include <mutex>
+
+class TimeFrequencyData::DerivedImages
+{
+	public:
+		std::mutex mutex;
+		Image2DCPtr singleImage;
+		std::vector<Image2DCPtr> amplitudes, phases;
+		// Stokes I, Q, U and V; the second image is only used for complex data
+		std::array<Image2DCPtr, 2> stokes[4];
+};
+
+std::shared_ptr<TimeFrequencyData::DerivedImages> TimeFrequencyData::getDerived() const
+{
+	std::shared_ptr<DerivedImages> derived = std::atomic_load(&_derived);
+	if(derived == nullptr)
+	{
+		std::shared_ptr<DerivedImages> newDerived = std::make_shared<DerivedImages>();
+		// If another thread was first, derived is set to its cache
+		if(std::atomic_compare_exchange_strong(&_derived, &derived, newDerived))
+			derived = newDerived;
+	}
+	return derived;
+}
+
+Image2DCPtr TimeFrequencyData::GetSingleImage() const
+{
+	if(_complexRepresentation != ComplexParts && _data.size() == 1)
+		return _data[0]._images[0];
+	
+	std::shared_ptr<DerivedImages> derived = getDerived();
+	std::lock_guard<std::mutex> lock(derived->mutex);
+	if(derived->singleImage == nullptr)
+	{
+		switch(_complexRepresentation)
+		{
+			case PhasePart:
+			case AmplitudePart:
+			case RealPart:
+			case ImaginaryPart:
+				derived->singleImage = GetSingleImageFromSingleComplexPart();
+				break;
+			case ComplexParts:
+				derived->singleImage = GetSingleAbsoluteFromComplex();
+				break;
+		}
+		if(derived->singleImage == nullptr)
+			throw BadUsageException("Incorrect complex representation");
+	}
+	return derived->singleImage;
+}
+
 Image2DCPtr TimeFrequencyData::GetAbsoluteFromComplex(const Image2DCPtr &real, const Image2DCPtr &imag) const
 {
 	return Image2DPtr(FFTTools::CreateAbsoluteImage(*real, *imag));
@@ -54,19 +106,40 @@ Mask2DCPtr TimeFrequencyData::GetCombinedMask() const
 	}
 }
 
-TimeFrequencyData* TimeFrequencyData::CreateTFData(enum ComplexRepresentation phase) const
+TimeFrequencyData TimeFrequencyData::Make(enum ComplexRepresentation phase) const
 {
 	if(phase == _complexRepresentation)
-		return new TimeFrequencyData(*this);
+		return *this;
 	else if(_complexRepresentation == ComplexParts)
 	{
-		TimeFrequencyData* data = new TimeFrequencyData();
-		data->_complexRepresentation = phase;
-		data->_data.resize(_data.size());
+		TimeFrequencyData data;
+		data._complexRepresentation = phase;
+		data._data.resize(_data.size());
+		std::vector<Image2DCPtr> *derivedImages = nullptr;
+		std::shared_ptr<DerivedImages> derived;
+		std::unique_lock<std::mutex> lock;
+		if(phase == AmplitudePart || phase == PhasePart)
+		{
+			derived = getDerived();
+			lock = std::unique_lock<std::mutex>(derived->mutex);
+			derivedImages = (phase == AmplitudePart) ? &derived->amplitudes : &derived->phases;
+			if(derivedImages->empty())
+			{
+				derivedImages->resize(_data.size());
+				for(size_t i=0; i!=_data.size(); ++i)
+				{
+					const PolarizedTimeFrequencyData& source = _data[i];
+					if(phase == AmplitudePart)
+						(*derivedImages)[i] = GetAbsoluteFromComplex(source._images[0], source._images[1]);
+					else
+						(*derivedImages)[i] = StokesImager::CreateAvgPhase(source._images[0], source._images[1]);
+				}
+			}
+		}
 		for(size_t i=0; i!=_data.size(); ++i)
 		{
 			const PolarizedTimeFrequencyData& source = _data[i];
-			PolarizedTimeFrequencyData& dest = data->_data[i];
+			PolarizedTimeFrequencyData& dest = data._data[i];
 			dest._polarization = source._polarization;
 			dest._flagging = source._flagging;
 			switch(phase)
@@ -78,10 +151,8 @@ TimeFrequencyData* TimeFrequencyData::CreateTFData(enum ComplexRepresentation ph
 					dest._images[0] = source._images[1];
 					break;
 				case AmplitudePart:
-					dest._images[0] = GetAbsoluteFromComplex(source._images[0], source._images[1]);
-					break;
 				case PhasePart:
-					dest._images[0] = StokesImager::CreateAvgPhase(source._images[0], source._images[1]);
+					dest._images[0] = (*derivedImages)[i];
 					break;
 				case ComplexParts:
 					break; // already handled above.
@@ -91,6 +162,133 @@ TimeFrequencyData* TimeFrequencyData::CreateTFData(enum ComplexRepresentation ph
 	} else throw BadUsageException("Request for time/frequency data with a phase representation that can not be extracted from the source (source is not complex)");
 }
 
+TimeFrequencyData TimeFrequencyData::Make(PolarizationEnum polarization) const
+{
+	for(const PolarizedTimeFrequencyData& data : _data)
+	{
+		if(data._polarization == polarization)
+			return TimeFrequencyData(_complexRepresentation, data);
+	}
+	
+	TimeFrequencyData newData;
+	size_t stokesIndex;
+	switch(polarization)
+	{
+		case Polarization::StokesI: stokesIndex = 0; break;
+		case Polarization::StokesQ: stokesIndex = 1; break;
+		case Polarization::StokesU: stokesIndex = 2; break;
+		case Polarization::StokesV: stokesIndex = 3; break;
+		default: stokesIndex = 4; break;
+	}
+	if(stokesIndex < 4)
+	{
+		std::shared_ptr<DerivedImages> derived = getDerived();
+		std::lock_guard<std::mutex> lock(derived->mutex);
+		std::array<Image2DCPtr, 2>& stokes = derived->stokes[stokesIndex];
+		if(stokes[0] == nullptr)
+		{
+			newData = makeStokes(polarization);
+			if(!newData.IsEmpty())
+			{
+				stokes[0] = newData._data[0]._images[0];
+				stokes[1] = newData._data[0]._images[1];
+			}
+		}
+		else if(_complexRepresentation == ComplexParts)
+			newData = TimeFrequencyData(polarization, stokes[0], stokes[1]);
+		else
+			newData = TimeFrequencyData(_complexRepresentation, polarization, stokes[0]);
+	}
+	else
+		newData = makeStokes(polarization);
+	newData.SetGlobalMask(GetMask(polarization));
+	return newData;
+}
+
+TimeFrequencyData TimeFrequencyData::makeStokes(PolarizationEnum polarization) const
+{
+	TimeFrequencyData newData;
+	size_t
+		xxPol = GetPolarizationIndex(Polarization::XX),
+		xyPol = GetPolarizationIndex(Polarization::XY),
+		yxPol = GetPolarizationIndex(Polarization::YX),
+		yyPol = GetPolarizationIndex(Polarization::YY);
+	bool hasLinear = xxPol < _data.size() || xyPol < _data.size();
+	if(hasLinear)
+	{
+		if(_complexRepresentation == ComplexParts)
+		{
+			switch(polarization)
+			{
+			case Polarization::StokesI:
+				newData = TimeFrequencyData(Polarization::StokesI, getFirstSum(xxPol, yyPol), getSecondSum(xxPol, yyPol));
+				break;
+			case Polarization::StokesQ:
+				newData = TimeFrequencyData(Polarization::StokesQ, getFirstDiff(xxPol, yyPol), getSecondDiff(xxPol, yyPol));
+				break;
+			case Polarization::StokesU:
+				newData = TimeFrequencyData(Polarization::StokesU, getFirstSum(xyPol, yxPol), getSecondSum(xyPol, yxPol));
+				break;
+			case Polarization::StokesV:
+				newData = TimeFrequencyData(Polarization::StokesV, getNegRealPlusImag(xyPol, yxPol), getRealMinusImag(xyPol, yxPol));
+				break;
+			default:
+				throw BadUsageException("Polarization not available or not implemented");
+			}
+		}
+		else // _complexRepresentation != ComplexParts
+		{
+			// TODO should be done on real or imaginary
+			switch(polarization)
+			{
+				case Polarization::StokesI:
+					newData = TimeFrequencyData(_complexRepresentation, Polarization::StokesI, getFirstSum(xxPol, yyPol));
+					break;
+				case Polarization::StokesQ:
+					newData = TimeFrequencyData(_complexRepresentation, Polarization::StokesQ, getFirstDiff(xxPol, yyPol));
+					break;
+				default:
+					throw BadUsageException("Requested polarization type not available in time frequency data");
+			}
+		}
+	}
+	else {
+		size_t
+			rrPol = GetPolarizationIndex(Polarization::RR),
+			rlPol = GetPolarizationIndex(Polarization::RL),
+			lrPol = GetPolarizationIndex(Polarization::LR),
+			llPol = GetPolarizationIndex(Polarization::LL);
+		bool hasCircular = rrPol < _data.size() || rlPol < _data.size();
+		if(hasCircular)
+		{
+			if(_complexRepresentation == ComplexParts)
+			{
+				switch(polarization)
+				{
+				case Polarization::StokesI:
+					newData = TimeFrequencyData(Polarization::StokesI, getFirstSum(rrPol, llPol), getSecondSum(rrPol, llPol));
+					break;
+				case Polarization::StokesQ: // Q = RL + LR
+					newData = TimeFrequencyData(Polarization::StokesQ, getFirstSum(rlPol, rlPol), getSecondSum(rlPol, lrPol));
+					break;
+				case Polarization::StokesU: // U_r = RL_i - LR_i, U_i = -RL_r + LR_r
+					newData = TimeFrequencyData(Polarization::StokesU, getSecondDiff(rlPol, lrPol), getFirstDiff(lrPol, rlPol));
+					break;
+				case Polarization::StokesV: // V = RR - LL
+					newData = TimeFrequencyData(Polarization::StokesV, getFirstDiff(rrPol, llPol), getSecondDiff(rrPol, llPol));
+					break;
+				default:
+					throw BadUsageException("Requested polarization type not available in time frequency data");
+					break;
+				}
+			}
+		}
+		else
+			throw BadUsageException("Trying to convert the polarization in time frequency data in an invalid way");
+	}
+	return newData;
+}
+
 TimeFrequencyData *TimeFrequencyData::CreateTFDataFromComplexCombination(const TimeFrequencyData &real, const TimeFrequencyData &imaginary)
 {
 	if(real.ComplexRepresentation() == ComplexParts ||
@@ -160,6 +358,7 @@ void TimeFrequencyData::SetImagesToZero()
 				data._images[1] = zeroImage;
 			data._flagging = mask;
 		}
+		invalidateDerived();
 	}
 }
 
@@ -168,18 +367,11 @@ void TimeFrequencyData::MultiplyImages(long double factor)
 	for(PolarizedTimeFrequencyData& data : _data)
 	{
 		if(data._images[0])
-		{
-			Image2DPtr newImage = Image2D::CreateCopy(data._images[0]);
-			newImage->MultiplyValues(factor);
-			data._images[0] = newImage;
-		}
+			makeWritable(data._images[0])->MultiplyValues(factor);
 		if(data._images[1])
-		{
-			Image2DPtr newImage = Image2D::CreateCopy(data._images[1]);
-			newImage->MultiplyValues(factor);
-			data._images[1] = newImage;
-		}
+			makeWritable(data._images[1])->MultiplyValues(factor);
 	}
+	invalidateDerived();
 }
 
 void TimeFrequencyData::JoinMask(const TimeFrequencyData &other)
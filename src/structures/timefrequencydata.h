@@ -2,6 +2,7 @@
 #define TIMEFREQUENCYDATA_H
 
 #include <array>
+#include <memory>
 #include <string>
 #include <vector>
 #include <utility>
@@ -14,6 +15,19 @@
 
 #include "../baseexception.h"
 
+/**
+ * Holds the visibilities of one baseline, possibly for several polarizations, together
+ * with their flags.
+ *
+ * Images are shared between copies of TimeFrequencyData: they are held by const pointers
+ * and are never changed while they are shared. Methods that change the images replace
+ * them by new images, or change them in place when no other object holds them.
+ * Representations that are derived from the images, such as the amplitude returned by
+ * GetSingleImage() and Stokes parameters created by Make(PolarizationEnum), are calculated
+ * once and remembered until the images are changed. Copies of a TimeFrequencyData share
+ * these derived images. Images in a TimeFrequencyData should therefore not be changed through
+ * other (non-const) pointers; set the changed image with e.g. SetImage() instead.
+ */
 class TimeFrequencyData
 {
 	public:
@@ -23,6 +37,24 @@ class TimeFrequencyData
 			_complexRepresentation(AmplitudePart),
 			_data()
 		{ }
+		
+		TimeFrequencyData(const TimeFrequencyData& source) :
+			_complexRepresentation(source._complexRepresentation),
+			_data(source._data),
+			_derived(std::atomic_load(&source._derived))
+		{ }
+		
+		TimeFrequencyData(TimeFrequencyData&& source) = default;
+		
+		TimeFrequencyData& operator=(const TimeFrequencyData& source)
+		{
+			_complexRepresentation = source._complexRepresentation;
+			_data = source._data;
+			_derived = std::atomic_load(&source._derived);
+			return *this;
+		}
+		
+		TimeFrequencyData& operator=(TimeFrequencyData&& source) = default;
 
 		TimeFrequencyData(ComplexRepresentation complexRepresentation,
 				PolarizationEnum polarizationType, const Image2DCPtr& image) :
@@ -186,20 +218,7 @@ class TimeFrequencyData
 		 * may be converted in order to do so.
 		 * @return A new image containing the TF-data.
 		 */
-		Image2DCPtr GetSingleImage() const
-		{
-			switch(_complexRepresentation)
-			{
-				case PhasePart:
-				case AmplitudePart:
-				case RealPart:
-				case ImaginaryPart:
-					return GetSingleImageFromSingleComplexPart();
-				case ComplexParts:
-					return GetSingleAbsoluteFromComplex();
-			}
-			throw BadUsageException("Incorrect complex representation");
-		}
+		Image2DCPtr GetSingleImage() const;
 
 		Mask2DCPtr GetSingleMask() const
 		{
@@ -224,6 +243,7 @@ class TimeFrequencyData
 			     _complexRepresentation = ComplexParts;
 			_data.clear();
 			_data.emplace_back(polarizationType, real, imaginary);
+			invalidateDerived();
 		}
 
 		void SetNoMask()
@@ -284,107 +304,14 @@ class TimeFrequencyData
 			_data[3]._flagging = maskD;
 		}
 
-		TimeFrequencyData Make(ComplexRepresentation representation) const
-		{
-			// TODO this should be more efficient
-			TimeFrequencyData* data = CreateTFData(representation);
-			TimeFrequencyData data2(*data);
-			delete data;
-			return data2;
-		}
+		TimeFrequencyData Make(ComplexRepresentation representation) const;
 		
-		TimeFrequencyData *CreateTFData(ComplexRepresentation complexRepresentation) const;
-		
-		TimeFrequencyData Make(PolarizationEnum polarization) const
+		TimeFrequencyData *CreateTFData(ComplexRepresentation complexRepresentation) const
 		{
-			for(const PolarizedTimeFrequencyData& data : _data)
-			{
-				if(data._polarization == polarization)
-					return TimeFrequencyData(_complexRepresentation, data);
-			}
-			
-			TimeFrequencyData newData;
-			size_t
-				xxPol = GetPolarizationIndex(Polarization::XX),
-				xyPol = GetPolarizationIndex(Polarization::XY),
-				yxPol = GetPolarizationIndex(Polarization::YX),
-				yyPol = GetPolarizationIndex(Polarization::YY);
-			bool hasLinear = xxPol < _data.size() || xyPol < _data.size();
-			if(hasLinear)
-			{
-				if(_complexRepresentation == ComplexParts)
-				{
-					switch(polarization)
-					{
-					case Polarization::StokesI:
-						newData = TimeFrequencyData(Polarization::StokesI, getFirstSum(xxPol, yyPol), getSecondSum(xxPol, yyPol));
-						break;
-					case Polarization::StokesQ:
-						newData = TimeFrequencyData(Polarization::StokesQ, getFirstDiff(xxPol, yyPol), getSecondDiff(xxPol, yyPol));
-						break;
-					case Polarization::StokesU:
-						newData = TimeFrequencyData(Polarization::StokesU, getFirstSum(xyPol, yxPol), getSecondSum(xyPol, yxPol));
-						break;
-					case Polarization::StokesV:
-						newData = TimeFrequencyData(Polarization::StokesV, getNegRealPlusImag(xyPol, yxPol), getRealMinusImag(xyPol, yxPol));
-						break;
-					default:
-						throw BadUsageException("Polarization not available or not implemented");
-					}
-				}
-				else // _complexRepresentation != ComplexParts
-				{
-					// TODO should be done on real or imaginary
-					switch(polarization)
-					{
-						case Polarization::StokesI:
-							newData = TimeFrequencyData(_complexRepresentation, Polarization::StokesI, getFirstSum(xxPol, yyPol));
-							break;
-						case Polarization::StokesQ:
-							newData = TimeFrequencyData(_complexRepresentation, Polarization::StokesQ, getFirstDiff(xxPol, yyPol));
-							break;
-						default:
-							throw BadUsageException("Requested polarization type not available in time frequency data");
-					}
-				}
-			}
-			else {
-				size_t
-					rrPol = GetPolarizationIndex(Polarization::RR),
-					rlPol = GetPolarizationIndex(Polarization::RL),
-					lrPol = GetPolarizationIndex(Polarization::LR),
-					llPol = GetPolarizationIndex(Polarization::LL);
-				bool hasCircular = rrPol < _data.size() || rlPol < _data.size();
-				if(hasCircular)
-				{
-					if(_complexRepresentation == ComplexParts)
-					{
-						switch(polarization)
-						{
-						case Polarization::StokesI:
-							newData = TimeFrequencyData(Polarization::StokesI, getFirstSum(rrPol, llPol), getSecondSum(rrPol, llPol));
-							break;
-						case Polarization::StokesQ: // Q = RL + LR
-							newData = TimeFrequencyData(Polarization::StokesQ, getFirstSum(rlPol, rlPol), getSecondSum(rlPol, lrPol));
-							break;
-						case Polarization::StokesU: // U_r = RL_i - LR_i, U_i = -RL_r + LR_r
-							newData = TimeFrequencyData(Polarization::StokesU, getSecondDiff(rlPol, lrPol), getFirstDiff(lrPol, rlPol));
-							break;
-						case Polarization::StokesV: // V = RR - LL
-							newData = TimeFrequencyData(Polarization::StokesV, getFirstDiff(rrPol, llPol), getSecondDiff(rrPol, llPol));
-							break;
-						default:
-							throw BadUsageException("Requested polarization type not available in time frequency data");
-							break;
-						}
-					}
-				}
-				else
-					throw BadUsageException("Trying to convert the polarization in time frequency data in an invalid way");
-			}
-			newData.SetGlobalMask(GetMask(polarization));
-			return newData;
+			return new TimeFrequencyData(Make(complexRepresentation));
 		}
+		
+		TimeFrequencyData Make(PolarizationEnum polarization) const;
 
 		TimeFrequencyData *CreateTFData(PolarizationEnum polarization) const
 		{
@@ -463,6 +390,7 @@ class TimeFrequencyData
 				if(_data[i]._images[1])
 					_data[i]._images[1] = Image2D::CreateFromDiff(_data[i]._images[1], rhs._data[i]._images[1]);
 			}
+			invalidateDerived();
 		}
 
 		void SubtractAsRHS(const TimeFrequencyData &lhs)
@@ -482,6 +410,7 @@ class TimeFrequencyData
 				if(_data[i]._images[1])
 					_data[i]._images[1] = Image2D::CreateFromDiff(lhs._data[i]._images[1], _data[i]._images[1]);
 			}
+			invalidateDerived();
 		}
 
 		static TimeFrequencyData *CreateTFDataFromDiff(const TimeFrequencyData &lhs, const TimeFrequencyData &rhs)
@@ -494,6 +423,7 @@ class TimeFrequencyData
 				throw BadUsageException(s.str());
 			}
 			TimeFrequencyData *data = new TimeFrequencyData(lhs);
+			data->invalidateDerived();
 			for(size_t i=0;i<lhs._data.size();++i)
 			{
 				if(lhs._data[i]._images[0] == nullptr)
@@ -515,6 +445,7 @@ class TimeFrequencyData
 				throw BadUsageException(s.str());
 			}
 			TimeFrequencyData *data = new TimeFrequencyData(lhs);
+			data->invalidateDerived();
 			for(size_t i=0;i<lhs._data.size();++i)
 			{
 				if(lhs._data[i]._images[0] == nullptr)
@@ -589,6 +520,7 @@ class TimeFrequencyData
 					if(index == imageIndex)
 					{
 						data._images[0] = image;
+						invalidateDerived();
 						return;
 					}
 					++index;
@@ -598,6 +530,7 @@ class TimeFrequencyData
 					if(index == imageIndex)
 					{
 						data._images[1] = image;
+						invalidateDerived();
 						return;
 					}
 					++index;
@@ -661,6 +594,7 @@ class TimeFrequencyData
 				if(data._flagging)
 					data._flagging = data._flagging->Trim(timeStart, freqStart, timeEnd, freqEnd);
 			}
+			invalidateDerived();
 		}
 		
 		std::string Description() const
@@ -703,8 +637,10 @@ class TimeFrequencyData
 				throw BadUsageException("Trying to set multiple polarizations by single polarization index");
 			else if(data.ComplexRepresentation() != ComplexRepresentation())
 				throw BadUsageException("Trying to combine TFData's with different complex representations");
-			else
+			else {
 				_data[polarizationIndex] = data._data[0];
+				invalidateDerived();
+			}
 		}
 
 		void SetImageSize(size_t width, size_t height)
@@ -718,6 +654,7 @@ class TimeFrequencyData
 				if(_data[i]._flagging)
 					_data[i]._flagging = Mask2D::CreateUnsetMaskPtr(width, height);
 			}
+			invalidateDerived();
 		}
 
 		void CopyFrom(const TimeFrequencyData &source, size_t destX, size_t destY)
@@ -727,24 +664,13 @@ class TimeFrequencyData
 			for(size_t i=0;i<_data.size();++i)
 			{
 				if(_data[i]._images[0])
-				{
-					Image2DPtr image = Image2D::CreateCopy(_data[i]._images[0]);
-					image->CopyFrom(source._data[i]._images[0], destX, destY);
-					_data[i]._images[0] = image;
-				}
+					makeWritable(_data[i]._images[0])->CopyFrom(source._data[i]._images[0], destX, destY);
 				if(_data[i]._images[1])
-				{
-					Image2DPtr image = Image2D::CreateCopy(_data[i]._images[1]);
-					image->CopyFrom(source._data[i]._images[1], destX, destY);
-					_data[i]._images[1] = image;
-				}
+					makeWritable(_data[i]._images[1])->CopyFrom(source._data[i]._images[1], destX, destY);
 				if(_data[i]._flagging)
-				{
-					Mask2DPtr mask = Mask2D::CreateCopy(_data[i]._flagging);
-					mask->CopyFrom(source._data[i]._flagging, destX, destY);
-					_data[i]._flagging = mask;
-				}
+					makeWritable(_data[i]._flagging)->CopyFrom(source._data[i]._flagging, destX, destY);
 			}
+			invalidateDerived();
 		}
 		
 		/**
@@ -774,6 +700,43 @@ class TimeFrequencyData
 		}
 
 	private:
+		/**
+		 * Images that have been derived from the images of this object. The
+		 * class is defined in the source file.
+		 */
+		class DerivedImages;
+		
+		std::shared_ptr<DerivedImages> getDerived() const;
+		
+		/**
+		 * Should be called when an image is changed. The derived images of other
+		 * copies remain valid, as their images have not changed.
+		 */
+		void invalidateDerived()
+		{
+			_derived.reset();
+		}
+		
+		/**
+		 * Returns a pointer through which the image can be changed. If the image is shared
+		 * with another object, it is copied first.
+		 */
+		static Image2DPtr makeWritable(Image2DCPtr &image)
+		{
+			if(!image.unique())
+				image = Image2D::CreateCopy(image);
+			return boost::const_pointer_cast<Image2D>(image);
+		}
+		
+		static Mask2DPtr makeWritable(Mask2DCPtr &mask)
+		{
+			if(!mask.unique())
+				mask = Mask2D::CreateCopy(mask);
+			return boost::const_pointer_cast<Mask2D>(mask);
+		}
+		
+		TimeFrequencyData makeStokes(PolarizationEnum polarization) const;
+		
 		Image2DCPtr GetSingleAbsoluteFromComplex() const
 		{
 			if(_data.size() == 4)
@@ -930,6 +893,9 @@ class TimeFrequencyData
 		enum ComplexRepresentation _complexRepresentation;
 		
 		std::vector<PolarizedTimeFrequencyData> _data;
+		
+		// Access to this pointer from const methods should use std::atomic_load() / _store()
+		mutable std::shared_ptr<DerivedImages> _derived;
 };
 
 #endif
@@ -0,0 +1,18 @@
+#ifndef AOFLAGGER_IMAGINGTESTGROUP_H
+#define AOFLAGGER_IMAGINGTESTGROUP_H
+
+#include "../testingtools/testgroup.h"
+
+#include "uvimagertest.h"
+
+class ImagingTestGroup : public TestGroup {
+	public:
+		ImagingTestGroup() : TestGroup("Imaging") { }
+		
+		virtual void Initialize()
+		{
+			Add(new UVImagerTest());
+		}
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef AOFLAGGER_UVIMAGERTEST_H
+#define AOFLAGGER_UVIMAGERTEST_H
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/unittest.h"
+
+#include "../../imaging/uvimager.h"
+
+#include "../../structures/image2d.h"
+
+#include <cmath>
+#include <complex>
+
+class UVImagerTest : public UnitTest {
+	public:
+		UVImagerTest() : UnitTest("UV imager")
+		{
+			AddTest(TestGriddingAgainstDirectFT(), "Gridding against direct FT");
+		}
+		
+	private:
+		struct TestGriddingAgainstDirectFT : public Asserter
+		{
+			void operator()();
+		};
+		
+		/**
+		 * Adds the visibilities of two point sources to the imager, on positions that
+		 * fill the inner part of the uv grid.
+		 */
+		static void addSources(UVImager &imager, size_t resolution, num_t scale)
+		{
+			const double
+				maxUV = (resolution/2 - 5) / (scale * resolution),
+				l0 = 5.0*scale, m0 = -8.0*scale,
+				l1 = -11.3*scale, m1 = 3.6*scale;
+			for(size_t k=0; k!=2000; ++k)
+			{
+				// Irrational steps give positions that do not fall on the grid
+				const double
+					u = (fmod(k * 0.6180339887, 1.0) * 2.0 - 1.0) * maxUV,
+					v = (fmod(k * 0.7548776662 + 0.1, 1.0) * 2.0 - 1.0) * maxUV;
+				const std::complex<double> value =
+					std::polar(1.0, -2.0*M_PI*(u*l0 + v*m0)) + std::polar(0.5, -2.0*M_PI*(u*l1 + v*m1));
+				imager.SetUVValue(u, v, value.real(), value.imag(), 1.0);
+				imager.SetUVValue(-u, -v, value.real(), -value.imag(), 1.0);
+			}
+			imager.PerformFFT();
+		}
+		
+		/**
+		 * Largest difference between the images in the inner half of the field,
+		 * relative to the largest value of the peak image.
+		 */
+		static num_t innerDifference(const Image2D &image, const Image2D &reference, const Image2D &peakImage)
+		{
+			num_t peak = 0.0, difference = 0.0;
+			const size_t width = image.Width(), height = image.Height();
+			for(size_t y=height/4; y!=height*3/4; ++y)
+			{
+				for(size_t x=width/4; x!=width*3/4; ++x)
+				{
+					peak = std::max(peak, std::fabs(peakImage.Value(x, y)));
+					difference = std::max(difference, std::fabs(image.Value(x, y) - reference.Value(x, y)));
+				}
+			}
+			return difference / peak;
+		}
+};
+
+inline void UVImagerTest::TestGriddingAgainstDirectFT::operator()()
+{
+	const size_t resolution = 64;
+	const num_t scale = 0.004;
+	UVImager kaiserBessel(resolution, resolution), nearest(resolution, resolution), direct(resolution, resolution);
+	kaiserBessel.SetUVScaling(scale);
+	nearest.SetUVScaling(scale);
+	nearest.SetGridding(UVImager::NearestNeighbourGridding);
+	direct.SetUVScaling(scale);
+	direct.SetDirectFT(true);
+	addSources(kaiserBessel, resolution, scale);
+	addSources(nearest, resolution, scale);
+	addSources(direct, resolution, scale);
+	
+	// 4000 visibilities of unit amplitude, with the normalization of the FFT
+	AssertLessThan(std::fabs(direct.FTReal().Value(resolution/2 + 5, resolution/2 - 8) - 4000.0/resolution), 2.0, "Peak of direct FT");
+	AssertLessThan(innerDifference(kaiserBessel.FTReal(), direct.FTReal(), direct.FTReal()), 0.001, "Kaiser-Bessel gridding matches direct FT");
+	AssertLessThan(innerDifference(kaiserBessel.FTImaginary(), direct.FTImaginary(), direct.FTReal()), 0.001, "Imaginary part matches direct FT");
+	AssertLessThan(innerDifference(nearest.FTReal(), direct.FTReal(), direct.FTReal()), 0.1, "Nearest neighbour gridding roughly matches direct FT");
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef AOFLAGGER_FITSIMAGESETTEST_H
+#define AOFLAGGER_FITSIMAGESETTEST_H
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/imageasserter.h"
+#include "../testingtools/unittest.h"
+
+#include "../../strategy/imagesets/fitsimageset.h"
+
+#include "../../structures/image2d.h"
+
+#include <fitsio.h>
+
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+class FitsImageSetTest : public UnitTest {
+	public:
+		FitsImageSetTest() : UnitTest("FITS image set")
+		{
+			AddTest(TestUVFitsBaselines(), "Reading UVFITS baselines in several blocks");
+		}
+
+	private:
+		struct TestUVFitsBaselines : public Asserter
+		{
+			void operator()();
+		};
+
+		enum { AntennaCount = 3, BaselineCount = 3, TimestepCount = 10, ChannelCount = 4, ComplexCount = 3 };
+
+		static num_t realValue(size_t baseline, size_t timestep, size_t channel)
+		{
+			return baseline * 1000 + timestep * 10 + channel;
+		}
+
+		static num_t imaginaryValue(size_t baseline, size_t timestep, size_t channel)
+		{
+			return -realValue(baseline, timestep, channel) - 0.5;
+		}
+
+		/**
+		 * Writes a random-groups UVFITS file in which the groups are ordered by baseline,
+		 * so that each baseline consists of a single run of consecutive groups.
+		 */
+		static void writeUVFits(const std::string &filename)
+		{
+			const char *parameterNames[] = { "UU", "VV", "WW", "BASELINE", "DATE" };
+			const size_t parameterCount = 5;
+			long axes[7] = { 0, ComplexCount, 1, ChannelCount, 1, 1, 1 };
+			int status = 0;
+			fitsfile *fptr;
+			fits_create_file(&fptr, ("!" + filename).c_str(), &status);
+			fits_write_grphdr(fptr, 1, FLOAT_IMG, 7, axes, parameterCount, BaselineCount * TimestepCount, 1, &status);
+			for(size_t p=0; p!=parameterCount; ++p)
+			{
+				std::ostringstream name;
+				name << "PTYPE" << (p+1);
+				fits_write_key_str(fptr, name.str().c_str(), parameterNames[p], "", &status);
+			}
+
+			std::vector<double> parameters(parameterCount), data(ComplexCount * ChannelCount);
+			size_t group = 0, baseline = 0;
+			for(size_t a1=0; a1!=AntennaCount; ++a1)
+			{
+				for(size_t a2=a1+1; a2!=AntennaCount; ++a2)
+				{
+					for(size_t t=0; t!=TimestepCount; ++t)
+					{
+						parameters[0] = 1e-6 * (a2 - a1);
+						parameters[1] = 1e-6 * t;
+						parameters[2] = 0.0;
+						parameters[3] = (a1+1) + ((a2+1) << 8);
+						parameters[4] = 2456000.5 + t / 86400.0;
+						for(size_t ch=0; ch!=ChannelCount; ++ch)
+						{
+							data[ch*ComplexCount] = realValue(baseline, t, ch);
+							data[ch*ComplexCount+1] = imaginaryValue(baseline, t, ch);
+							data[ch*ComplexCount+2] = 1.0;
+						}
+						++group;
+						fits_write_grppar_dbl(fptr, group, 1, parameterCount, &parameters[0], &status);
+						fits_write_img_dbl(fptr, group, 1, data.size(), &data[0], &status);
+					}
+					++baseline;
+				}
+			}
+			fits_close_file(fptr, &status);
+			if(status != 0)
+			{
+				char message[FLEN_STATUS];
+				fits_get_errstatus(status, message);
+				throw std::runtime_error(std::string("Could not write UVFITS test file: ") + message);
+			}
+		}
+
+		static void expectedImages(size_t baseline, Image2DPtr &real, Image2DPtr &imaginary)
+		{
+			real = Image2D::CreateUnsetImagePtr(TimestepCount, ChannelCount);
+			imaginary = Image2D::CreateUnsetImagePtr(TimestepCount, ChannelCount);
+			for(size_t t=0; t!=TimestepCount; ++t)
+			{
+				for(size_t ch=0; ch!=ChannelCount; ++ch)
+				{
+					real->SetValue(t, ch, realValue(baseline, t, ch));
+					imaginary->SetValue(t, ch, imaginaryValue(baseline, t, ch));
+				}
+			}
+		}
+
+		static void assertBaseline(rfiStrategy::ImageSet &set, const rfiStrategy::ImageSetIndex &index, size_t baseline)
+		{
+			set.AddReadRequest(index);
+			set.PerformReadRequests();
+			std::unique_ptr<rfiStrategy::BaselineData> data(set.GetNextRequested());
+			Image2DPtr real, imaginary;
+			expectedImages(baseline, real, imaginary);
+			std::ostringstream str;
+			str << "baseline " << baseline;
+			ImageAsserter::AssertEqual(data->Data().GetRealPart(), real, "Real part of " + str.str());
+			ImageAsserter::AssertEqual(data->Data().GetImaginaryPart(), imaginary, "Imaginary part of " + str.str());
+		}
+};
+
+inline void FitsImageSetTest::TestUVFitsBaselines::operator()()
+{
+	const std::string filename("fitsimagesettest.uvfits");
+	writeUVFits(filename);
+	{
+		rfiStrategy::FitsImageSet set(filename);
+		// Blocks of four groups, so that every baseline is read in several blocks
+		set.SetReadBlockValues(4 * ComplexCount * ChannelCount);
+		set.Initialize();
+		AssertEquals(set.Baselines().size(), (size_t) BaselineCount, "Baseline count");
+
+		std::unique_ptr<rfiStrategy::ImageSetIndex> index(set.StartIndex());
+		index->Next();
+		// A single baseline that does not start at the first group is read through the group index
+		assertBaseline(set, *index, 1);
+		// Reading a second baseline of the same band reads the whole band at once
+		index.reset(set.StartIndex());
+		assertBaseline(set, *index, 0);
+		index->Next();
+		index->Next();
+		assertBaseline(set, *index, 2);
+	}
+	boost::filesystem::remove(filename);
+}
+
+#endif
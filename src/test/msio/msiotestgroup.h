@@ -3,12 +3,15 @@
 
 #include "../testingtools/testgroup.h"
 
+#include "fitsimagesettest.h"
+
 class MSIOTestGroup : public TestGroup {
 	public:
 		MSIOTestGroup() : TestGroup("Measurement set input/output") { }
 		
 		virtual void Initialize()
 		{
+			Add(new FitsImageSetTest());
 		}
 };
 
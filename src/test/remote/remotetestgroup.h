@@ -0,0 +1,18 @@
+#ifndef AOFLAGGER_REMOTETESTGROUP_H
+#define AOFLAGGER_REMOTETESTGROUP_H
+
+#include "../testingtools/testgroup.h"
+
+#include "rowblockcodectest.h"
+
+class RemoteTestGroup : public TestGroup {
+	public:
+		RemoteTestGroup() : TestGroup("Remote access") { }
+		
+		virtual void Initialize()
+		{
+			Add(new RowBlockCodecTest());
+		}
+};
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef AOFLAGGER_ROWBLOCKCODECTEST_H
+#define AOFLAGGER_ROWBLOCKCODECTEST_H
+
+#include <sstream>
+#include <vector>
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/unittest.h"
+
+#include "../../remote/rowblockcodec.h"
+
+#include "../../structures/msrowdataext.h"
+
+#include "../../util/aologger.h"
+#include "../../util/rng.h"
+#include "../../util/stopwatch.h"
+
+class RowBlockCodecTest : public UnitTest {
+	public:
+		RowBlockCodecTest() : UnitTest("Row block codec")
+		{
+			AddTest(TestCompression(), "Run-length compression");
+			AddTest(TestRoundTrip(), "Round trip of uncompressed row block");
+			AddTest(TestCompressedRoundTrip(), "Round trip of compressed row block");
+			AddTest(TestThroughput(), "Loopback throughput compared to protocol version 1");
+		}
+		
+	private:
+		struct TestCompression : public Asserter
+		{
+			void operator()();
+		};
+		struct TestRoundTrip : public Asserter
+		{
+			void operator()();
+		};
+		struct TestCompressedRoundTrip : public Asserter
+		{
+			void operator()();
+		};
+		struct TestThroughput : public Asserter
+		{
+			void operator()();
+		};
+		
+		static void createRows(std::vector<MSRowDataExt> &rows, size_t rowCount, unsigned polarizationCount, unsigned channelCount)
+		{
+			rows.resize(rowCount);
+			for(size_t r=0; r!=rowCount; ++r)
+			{
+				MSRowDataExt &row = rows[r];
+				row = MSRowDataExt(polarizationCount, channelCount);
+				row.SetAntenna1(r % 7);
+				row.SetAntenna2(r % 7 + 1);
+				row.SetTimeOffsetIndex(r / 7);
+				row.SetU(r * 0.5);
+				row.SetV(-1.0 * r);
+				row.SetW(0.25);
+				row.SetTime(4.8e9 + r / 7);
+				for(size_t i=0; i!=polarizationCount*channelCount; ++i)
+				{
+					row.Data().RealPtr()[i] = RNG::Gaussian();
+					row.Data().ImagPtr()[i] = RNG::Gaussian();
+				}
+			}
+		}
+		
+		static void assertRowsEqual(Asserter &asserter, const std::vector<MSRowDataExt> &input, const std::vector<MSRowDataExt> &output)
+		{
+			asserter.AssertEquals(output.size(), input.size(), "Row count");
+			for(size_t r=0; r!=input.size(); ++r)
+			{
+				const size_t valueCount = input[r].Data().PolarizationCount() * input[r].Data().ChannelCount();
+				asserter.AssertEquals(output[r].Data().PolarizationCount(), input[r].Data().PolarizationCount(), "Polarization count");
+				asserter.AssertEquals(output[r].Data().ChannelCount(), input[r].Data().ChannelCount(), "Channel count");
+				asserter.AssertEquals(output[r].Antenna1(), input[r].Antenna1(), "Antenna1");
+				asserter.AssertEquals(output[r].Antenna2(), input[r].Antenna2(), "Antenna2");
+				asserter.AssertEquals(output[r].TimeOffsetIndex(), input[r].TimeOffsetIndex(), "Time offset index");
+				asserter.AssertEquals(output[r].U(), input[r].U(), "U");
+				asserter.AssertEquals(output[r].V(), input[r].V(), "V");
+				asserter.AssertEquals(output[r].W(), input[r].W(), "W");
+				asserter.AssertEquals(output[r].Time(), input[r].Time(), "Time");
+				for(size_t i=0; i!=valueCount; ++i)
+				{
+					asserter.AssertEquals(output[r].Data().RealPtr()[i], input[r].Data().RealPtr()[i], "Real value");
+					asserter.AssertEquals(output[r].Data().ImagPtr()[i], input[r].Data().ImagPtr()[i], "Imaginary value");
+				}
+			}
+		}
+		
+		static void roundTrip(Asserter &asserter, bool compress)
+		{
+			std::vector<MSRowDataExt> input, output(5);
+			createRows(input, 5, 4, 16);
+			std::stringstream stream;
+			aoRemote::RowBlockCodec::Encode(stream, &input[0], input.size(), compress);
+			asserter.AssertEquals(aoRemote::RowBlockCodec::Decode(stream, &output[0], output.size()), size_t(5), "Row count");
+			assertRowsEqual(asserter, input, output);
+		}
+};
+
+inline void RowBlockCodecTest::TestCompression::operator()()
+{
+	std::vector<char> input, compressed, output;
+	for(size_t i=0; i!=1000; ++i)
+		input.push_back(0);
+	for(size_t i=0; i!=300; ++i)
+		input.push_back(char(i));
+	input.push_back(5);
+	input.push_back(5);
+	input.push_back(6);
+	aoRemote::RowBlockCodec::Compress(input, compressed);
+	AssertTrue(compressed.size() < input.size(), "Compressed size is smaller");
+	output.resize(input.size());
+	aoRemote::RowBlockCodec::Decompress(&compressed[0], compressed.size(), output);
+	for(size_t i=0; i!=input.size(); ++i)
+		AssertEquals<int>(output[i], input[i], "Decompressed value");
+	
+	std::vector<char> shuffled(16), unshuffled(16);
+	const char elements[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+	aoRemote::RowBlockCodec::Shuffle(elements, 4, 4, &shuffled[0]);
+	AssertEquals<int>(shuffled[1], 4, "Shuffled value");
+	AssertEquals<int>(shuffled[4], 1, "Shuffled value");
+	aoRemote::RowBlockCodec::Unshuffle(&shuffled[0], 4, 4, &unshuffled[0]);
+	for(size_t i=0; i!=16; ++i)
+		AssertEquals<int>(unshuffled[i], elements[i], "Unshuffled value");
+}
+
+inline void RowBlockCodecTest::TestRoundTrip::operator()()
+{
+	roundTrip(*this, false);
+}
+
+inline void RowBlockCodecTest::TestCompressedRoundTrip::operator()()
+{
+	roundTrip(*this, true);
+}
+
+inline void RowBlockCodecTest::TestThroughput::operator()()
+{
+	const size_t rowCount = 128, polarizationCount = 4, channelCount = 256, repeatCount = 10;
+	std::vector<MSRowDataExt> input;
+	createRows(input, rowCount, polarizationCount, channelCount);
+	const double megabytes = double(rowCount * polarizationCount * channelCount * 2 * sizeof(float) * repeatCount) / (1024.0 * 1024.0);
+	
+	// Protocol version 1: each row is serialized separately. The watch is paused while
+	// the received rows are checked.
+	Stopwatch watch(true);
+	size_t size = 0;
+	for(size_t repeat=0; repeat!=repeatCount; ++repeat)
+	{
+		std::vector<MSRowDataExt> output(rowCount);
+		std::stringstream stream;
+		for(size_t r=0; r!=rowCount; ++r)
+			input[r].Serialize(stream);
+		size = stream.str().size();
+		for(size_t r=0; r!=rowCount; ++r)
+			output[r].Unserialize(stream);
+		watch.Pause();
+		AssertEquals<int>(stream.peek(), std::char_traits<char>::eof(), "Whole block was read in protocol 1");
+		assertRowsEqual(*this, input, output);
+		watch.Start();
+	}
+	watch.Pause();
+	AOLogger::Info << "Protocol 1: " << size << " bytes per block, " << (megabytes / watch.Seconds()) << " MB/s.\n";
+	
+	for(size_t compress=0; compress!=2; ++compress)
+	{
+		watch.Reset();
+		watch.Start();
+		for(size_t repeat=0; repeat!=repeatCount; ++repeat)
+		{
+			std::vector<MSRowDataExt> output(rowCount);
+			std::stringstream stream;
+			aoRemote::RowBlockCodec::Encode(stream, &input[0], rowCount, compress != 0);
+			size = stream.str().size();
+			const size_t decodedCount = aoRemote::RowBlockCodec::Decode(stream, &output[0], rowCount);
+			watch.Pause();
+			AssertEquals(decodedCount, rowCount, "Decoded row count in protocol 2");
+			AssertEquals<int>(stream.peek(), std::char_traits<char>::eof(), "Whole block was read in protocol 2");
+			assertRowsEqual(*this, input, output);
+			watch.Start();
+		}
+		watch.Pause();
+		AOLogger::Info << "Protocol 2 (" << (compress ? "compressed" : "uncompressed") << "): " << size << " bytes per block, " << (megabytes / watch.Seconds()) << " MB/s.\n";
+	}
+}
+
+#endif
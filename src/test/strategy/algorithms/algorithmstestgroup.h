@@ -6,11 +6,15 @@
 #include "convolutionstest.h"
 #include "dilationtest.h"
 #include "eigenvaluetest.h"
+#include "fringestoppingfittertest.h"
 #include "highpassfiltertest.h"
+#include "localfitmethodtest.h"
+#include "morphologytest.h"
 #include "noisestatisticstest.h"
 #include "siroperatortest.h"
 #include "statisticalflaggertest.h"
 #include "sumthresholdtest.h"
+#include "svdmitigatertest.h"
 #include "thresholdtoolstest.h"
 
 class AlgorithmsTestGroup : public TestGroup {
@@ -22,11 +26,15 @@ class AlgorithmsTestGroup : public TestGroup {
 			Add(new ConvolutionsTest());
 			Add(new DilationTest());
 			Add(new EigenvalueTest());
+			Add(new FringeStoppingFitterTest());
 			Add(new HighPassFilterTest());
+			Add(new LocalFitMethodTest());
+			Add(new MorphologyTest());
 			Add(new NoiseStatisticsTest());
 			Add(new SIROperatorTest());
 			Add(new StatisticalFlaggerTest());
 			Add(new SumThresholdTest());
+			Add(new SVDMitigaterTest());
 			Add(new ThresholdToolsTest());
 		}
 };
@@ -8,12 +8,15 @@
 
 #include "../../../strategy/algorithms/statisticalflagger.h"
 
+#include <algorithm>
+
 class DilationTest : public UnitTest {
 	public:
 		DilationTest() : UnitTest("Dilation algorithm")
 		{
 			AddTest(TestHorizontalDilation(), "Horizontal dilation");
 			AddTest(TestVerticalDilation(), "Vertical dilation");
+			AddTest(TestWordBoundaries(), "Dilation over word boundaries");
 		}
 		
 	private:
@@ -30,6 +33,31 @@ class DilationTest : public UnitTest {
 		{
 			void operator()();
 		};
+		struct TestWordBoundaries : public Asserter
+		{
+			void operator()();
+		};
+		
+		/**
+		 * Whether a flag is within the given distances of a sample.
+		 */
+		static bool hasFlagNearby(Mask2DCPtr mask, size_t x, size_t y, size_t timeSize, size_t frequencySize)
+		{
+			const size_t
+				xStart = x > timeSize ? x - timeSize : 0,
+				xEnd = std::min(x + timeSize + 1, mask->Width()),
+				yStart = y > frequencySize ? y - frequencySize : 0,
+				yEnd = std::min(y + frequencySize + 1, mask->Height());
+			for(size_t yi=yStart;yi!=yEnd;++yi)
+			{
+				for(size_t xi=xStart;xi!=xEnd;++xi)
+				{
+					if(mask->Value(xi, yi))
+						return true;
+				}
+			}
+			return false;
+		}
 		
 		static std::string maskToString(Mask2DCPtr mask, bool flip)
 		{
@@ -93,6 +121,37 @@ inline void DilationTest::TestVerticalDilation::operator()()
 	TestSingleDilation::testDilation<true>(StatisticalFlagger::DilateFlagsVertically);
 }
 
+inline void DilationTest::TestWordBoundaries::operator()()
+{
+	// The flags are stored in 64-bit words during dilation
+	srand(1);
+	const size_t width = 200, height = 150;
+	Mask2DPtr input = Mask2D::CreateSetMaskPtr<false>(width, height);
+	for(size_t i=0;i!=40;++i)
+		input->SetValue(rand()%width, rand()%height, true);
+	input->SetValue(63, 64, true);
+	input->SetValue(128, 127, true);
+	
+	const size_t sizes[] = { 1, 2, 63, 64, 65, 130 };
+	for(size_t i=0;i!=6;++i)
+	{
+		Mask2DPtr horizontal = Mask2D::CreateCopy(input), vertical = Mask2D::CreateCopy(input);
+		StatisticalFlagger::DilateFlagsHorizontally(horizontal, sizes[i]);
+		StatisticalFlagger::DilateFlagsVertically(vertical, sizes[i]);
+		bool horizontalEqual = true, verticalEqual = true;
+		for(size_t y=0;y!=height;++y)
+		{
+			for(size_t x=0;x!=width;++x)
+			{
+				horizontalEqual = horizontalEqual && horizontal->Value(x, y) == hasFlagNearby(input, x, y, sizes[i], 0);
+				verticalEqual = verticalEqual && vertical->Value(x, y) == hasFlagNearby(input, x, y, 0, sizes[i]);
+			}
+		}
+		AssertTrue(horizontalEqual, "Horizontal dilation over word boundaries");
+		AssertTrue(verticalEqual, "Vertical dilation over word boundaries");
+	}
+}
+
 template<bool Flip, typename DilateFunction>
 inline void DilationTest::TestSingleDilation::testDilation(DilateFunction dilate)
 {
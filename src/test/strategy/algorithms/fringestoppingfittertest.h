@@ -0,0 +1,211 @@
+#ifndef AOFLAGGER_FRINGESTOPPINGFITTERTEST_H
+#define AOFLAGGER_FRINGESTOPPINGFITTERTEST_H
+
+#include "../../testingtools/asserter.h"
+#include "../../testingtools/imageasserter.h"
+#include "../../testingtools/unittest.h"
+
+#include "../../../structures/antennainfo.h"
+#include "../../../structures/image2d.h"
+#include "../../../structures/mask2d.h"
+#include "../../../structures/timefrequencydata.h"
+#include "../../../structures/timefrequencymetadata.h"
+
+#include "../../../strategy/algorithms/fringestoppingfitter.h"
+#include "../../../strategy/algorithms/mitigationtester.h"
+#include "../../../strategy/algorithms/sinusfitter.h"
+
+#include "../../../imaging/uvimager.h"
+
+#include <cmath>
+#include <cstdlib>
+
+class FringeStoppingFitterTest : public UnitTest {
+	public:
+		FringeStoppingFitterTest() : UnitTest("Fringe stopping fitter")
+		{
+			AddTest(TestFringeStop(), "Fringe stop");
+			AddTest(TestDynamicFit(), "Dynamic frequency fit");
+		}
+
+	private:
+		struct TestFringeStop : public Asserter
+		{
+			void operator()();
+		};
+		struct TestDynamicFit : public Asserter
+		{
+			void operator()();
+		};
+
+		/**
+		 * Meta data of a 100 x 50 m baseline with a w-term that changes non-linearly with time.
+		 * A gap in the band tests the recurrence over channels that are not evenly spaced.
+		 */
+		static TimeFrequencyMetaDataPtr createMetaData(size_t width, size_t height)
+		{
+			TimeFrequencyMetaDataPtr metaData(new TimeFrequencyMetaData());
+			AntennaInfo antenna1, antenna2;
+			antenna1.position.x = 0.0; antenna1.position.y = 0.0; antenna1.position.z = 0.0;
+			antenna2.position.x = 100.0; antenna2.position.y = 50.0; antenna2.position.z = 0.0;
+			metaData->SetAntenna1(antenna1);
+			metaData->SetAntenna2(antenna2);
+			BandInfo band;
+			for(size_t y=0; y!=height; ++y)
+			{
+				ChannelInfo channel;
+				channel.frequencyIndex = y;
+				channel.frequencyHz = 150e6 + 0.1e6 * y + (y >= height/2 ? 2e6 : 0.0);
+				channel.channelWidthHz = 0.1e6;
+				channel.effectiveBandWidthHz = 0.1e6;
+				channel.resolutionHz = 0.1e6;
+				band.channels.push_back(channel);
+			}
+			metaData->SetBand(band);
+			std::vector<double> times(width);
+			std::vector<UVW> uvws(width);
+			for(size_t x=0; x!=width; ++x)
+			{
+				times[x] = 4.8e9 + 10.0 * x;
+				uvws[x] = UVW(100.0, 50.0, 80.0 * sin(x * 0.01) + 20.0);
+			}
+			metaData->SetObservationTimes(times);
+			metaData->SetUVW(uvws);
+			return metaData;
+		}
+
+		/**
+		 * A fringe on noise, with some flagged samples.
+		 */
+		static TimeFrequencyData createData(size_t width, size_t height)
+		{
+			srand(1);
+			Mask2DPtr mask = Mask2D::CreateSetMaskPtr<false>(width, height);
+			Image2DPtr
+				real = MitigationTester::CreateTestSet(2, mask, width, height),
+				imaginary = MitigationTester::CreateTestSet(2, mask, width, height);
+			for(size_t y=0; y!=height; ++y)
+			{
+				for(size_t x=0; x!=width; ++x)
+				{
+					real->AddValue(x, y, 5.0 * cos(x * 0.3 + y * 0.1));
+					imaginary->AddValue(x, y, -5.0 * sin(x * 0.3 + y * 0.1));
+					if(rand() % 20 == 0)
+						mask->SetValue(x, y, true);
+				}
+			}
+			TimeFrequencyData data(Polarization::StokesI, real, imaginary);
+			data.SetGlobalMask(mask);
+			return data;
+		}
+
+		/**
+		 * The number of phase rotations relative to the new phase centre, as calculated per
+		 * sample before the rotations were tabulated.
+		 */
+		static num_t directRotations(TimeFrequencyMetaDataCPtr metaData, size_t x, size_t y, numl_t newPhaseCentreDec, numl_t newPhaseCentreRA)
+		{
+			const numl_t earthRotation = UVImager::TimeToEarthLattitude(x, metaData);
+			const Baseline baseline = metaData->Baseline();
+			const numl_t newWPos =
+				UVImager::GetWPosition(newPhaseCentreDec, newPhaseCentreRA, metaData->Band().channels[y].frequencyHz, earthRotation, baseline.DeltaX(), baseline.DeltaY());
+			return UVImager::GetFringeCount(0, x, y, metaData) - newWPos;
+		}
+
+		/**
+		 * Windowed fit of one channel with trigonometric functions evaluated per sample and
+		 * per window.
+		 */
+		static void directDynamicFit(const TimeFrequencyData &data, TimeFrequencyMetaDataCPtr metaData, size_t y, unsigned windowSize, Image2D &real, Image2D &imaginary)
+		{
+			const numl_t newDec = M_PInl*0.5, newRA = 0.0;
+			const Mask2DCPtr mask = data.GetSingleMask();
+			const size_t width = data.ImageWidth();
+			const unsigned halfWindowSize = windowSize / 2;
+			for(size_t x=0; x<width; ++x)
+			{
+				const size_t
+					windowStart = x > halfWindowSize ? x - halfWindowSize : 0,
+					windowEnd = x + halfWindowSize < width ? x + halfWindowSize : width;
+				double sumR = 0.0, sumI = 0.0;
+				size_t n = 0;
+				for(size_t t=windowStart; t<windowEnd; ++t)
+				{
+					if(!mask->Value(t, y))
+					{
+						const double
+							vR = data.GetRealPart()->Value(t, y),
+							vI = data.GetImaginaryPart()->Value(t, y),
+							angle = -2.0 * M_PI * directRotations(metaData, t, y, newDec, newRA);
+						sumR += vR * cos(angle) + vI * sin(angle);
+						sumI += vR * sin(angle) - vI * cos(angle);
+						++n;
+					}
+				}
+				sumR /= n;
+				sumI /= n;
+				const double
+					phase = SinusFitter::Phase((num_t) sumR, (num_t) sumI),
+					amplitude = sqrt(sumR*sumR + sumI*sumI),
+					angle = directRotations(metaData, x, y, newDec, newRA) * 2.0 * M_PI + phase;
+				real.SetValue(x, y, cos(angle) * amplitude);
+				imaginary.SetValue(x, y, -sin(angle) * amplitude);
+			}
+		}
+};
+
+inline void FringeStoppingFitterTest::TestFringeStop::operator()()
+{
+	const size_t width = 300, height = 200;
+	const TimeFrequencyData data = createData(width, height);
+	const TimeFrequencyMetaDataPtr metaData = createMetaData(width, height);
+	FringeStoppingFitter fitter;
+	fitter.SetMetaData(metaData);
+	fitter.Initialize(data);
+	fitter.PerformFringeStop();
+	const TimeFrequencyData result = fitter.Background();
+
+	Image2DPtr
+		expectedReal = Image2D::CreateUnsetImagePtr(width, height),
+		expectedImaginary = Image2D::CreateUnsetImagePtr(width, height);
+	for(size_t y=0; y!=height; ++y)
+	{
+		for(size_t x=0; x!=width; ++x)
+		{
+			const double
+				r = data.GetRealPart()->Value(x, y),
+				i = data.GetImaginaryPart()->Value(x, y),
+				angle = UVImager::GetFringeCount(0, x, y, metaData) * 2.0 * M_PI;
+			expectedReal->SetValue(x, y, r * cos(angle) - i * sin(angle));
+			expectedImaginary->SetValue(x, y, r * sin(angle) + i * cos(angle));
+		}
+	}
+	// The values are of order 5; the per-sample calculation rounds the fringe count to num_t
+	ImageAsserter::AssertEqual(result.GetRealPart(), expectedReal, 1e-3, "Real part of fringe stopped data");
+	ImageAsserter::AssertEqual(result.GetImaginaryPart(), expectedImaginary, 1e-3, "Imaginary part of fringe stopped data");
+}
+
+inline void FringeStoppingFitterTest::TestDynamicFit::operator()()
+{
+	const size_t width = 300, height = 20;
+	const unsigned windowSize = 64;
+	const TimeFrequencyData data = createData(width, height);
+	const TimeFrequencyMetaDataPtr metaData = createMetaData(width, height);
+	FringeStoppingFitter fitter;
+	fitter.SetMetaData(metaData);
+	fitter.SetMaxWindowSize(windowSize);
+	fitter.Initialize(data);
+	for(size_t i=0; i!=fitter.TaskCount(); ++i)
+		fitter.PerformFit(i);
+	const TimeFrequencyData result = fitter.Background();
+
+	Image2DPtr
+		expectedReal = Image2D::CreateUnsetImagePtr(width, height),
+		expectedImaginary = Image2D::CreateUnsetImagePtr(width, height);
+	for(size_t y=0; y!=height; ++y)
+		directDynamicFit(data, metaData, y, windowSize, *expectedReal, *expectedImaginary);
+	ImageAsserter::AssertEqual(result.GetRealPart(), expectedReal, 1e-3, "Real part of fit");
+	ImageAsserter::AssertEqual(result.GetImaginaryPart(), expectedImaginary, 1e-3, "Imaginary part of fit");
+}
+
+#endif
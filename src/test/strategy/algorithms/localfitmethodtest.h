@@ -0,0 +1,142 @@
+#ifndef AOFLAGGER_LOCALFITMETHODTEST_H
+#define AOFLAGGER_LOCALFITMETHODTEST_H
+
+#include "../../testingtools/asserter.h"
+#include "../../testingtools/imageasserter.h"
+#include "../../testingtools/unittest.h"
+
+#include "../../../structures/image2d.h"
+#include "../../../structures/mask2d.h"
+#include "../../../structures/timefrequencydata.h"
+
+#include "../../../strategy/algorithms/localfitmethod.h"
+#include "../../../strategy/algorithms/mitigationtester.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+class LocalFitMethodTest : public UnitTest {
+	public:
+		LocalFitMethodTest() : UnitTest("Local fit method")
+		{
+			AddTest(TestAverage(), "Average filter");
+			AddTest(TestMinimum(), "Minimum filter");
+		}
+
+	private:
+		struct TestAverage : public Asserter
+		{
+			void operator()();
+		};
+		struct TestMinimum : public Asserter
+		{
+			void operator()();
+		};
+
+		/**
+		 * Noise with some flagged samples, a flagged area that is larger than the
+		 * smallest windows and some NaNs.
+		 */
+		static TimeFrequencyData createTestData(size_t width, size_t height)
+		{
+			srand(1);
+			Mask2DPtr mask = Mask2D::CreateSetMaskPtr<false>(width, height);
+			Image2DPtr image = MitigationTester::CreateTestSet(2, mask, width, height);
+			for(size_t y=0; y!=height; ++y)
+			{
+				for(size_t x=0; x!=width; ++x)
+				{
+					if(rand() % 10 == 0)
+						mask->SetValue(x, y, true);
+				}
+			}
+			for(size_t y=30; y!=40; ++y)
+			{
+				for(size_t x=40; x!=55; ++x)
+					mask->SetValue(x, y, true);
+			}
+			image->SetValue(3, 4, std::numeric_limits<num_t>::quiet_NaN());
+			image->SetValue(20, 10, std::numeric_limits<num_t>::quiet_NaN());
+			TimeFrequencyData data(TimeFrequencyData::AmplitudePart, Polarization::StokesI, image);
+			data.SetGlobalMask(mask);
+			return data;
+		}
+
+		/**
+		 * Direct calculation of the average or minimum of the unflagged values in the window
+		 * around each sample, as the filters are defined. Samples without unflagged values
+		 * in their window keep their value.
+		 */
+		static Image2DPtr directFit(const TimeFrequencyData &data, size_t hSquareSize, size_t vSquareSize, bool minimum)
+		{
+			const Image2DCPtr image = data.GetSingleImage();
+			const Mask2DCPtr mask = data.GetSingleMask();
+			Image2DPtr fit = Image2D::CreateUnsetImagePtr(image->Width(), image->Height());
+			for(size_t y=0; y!=image->Height(); ++y)
+			{
+				for(size_t x=0; x!=image->Width(); ++x)
+				{
+					const size_t
+						startX = x >= hSquareSize ? x - hSquareSize : 0,
+						endX = std::min(x + hSquareSize, image->Width() - 1),
+						startY = y >= vSquareSize ? y - vSquareSize : 0,
+						endY = std::min(y + vSquareSize, image->Height() - 1);
+					long double sum = 0.0, lowest = std::numeric_limits<long double>::infinity();
+					size_t count = 0;
+					for(size_t yi=startY; yi<=endY; ++yi)
+					{
+						for(size_t xi=startX; xi<=endX; ++xi)
+						{
+							if(!mask->Value(xi, yi) && std::isfinite(image->Value(xi, yi)))
+							{
+								sum += image->Value(xi, yi);
+								lowest = std::min<long double>(lowest, image->Value(xi, yi));
+								++count;
+							}
+						}
+					}
+					if(count == 0)
+						fit->SetValue(x, y, image->Value(x, y));
+					else if(minimum)
+						fit->SetValue(x, y, lowest);
+					else
+						fit->SetValue(x, y, sum / count);
+				}
+			}
+			return fit;
+		}
+};
+
+inline void LocalFitMethodTest::TestAverage::operator()()
+{
+	const TimeFrequencyData data = createTestData(100, 60);
+	const size_t windows[][2] = { { 0, 0 }, { 1, 2 }, { 7, 12 }, { 50, 30 } };
+	for(size_t i=0; i!=4; ++i)
+	{
+		LocalFitMethod fitMethod;
+		fitMethod.SetToAverage(windows[i][0], windows[i][1]);
+		fitMethod.Initialize(data);
+		for(size_t t=0; t!=fitMethod.TaskCount(); ++t)
+			fitMethod.PerformFit(t);
+		ImageAsserter::AssertEqual(fitMethod.Background().GetSingleImage(), directFit(data, windows[i][0], windows[i][1], false), 1e-5, "Average matches direct calculation");
+	}
+}
+
+inline void LocalFitMethodTest::TestMinimum::operator()()
+{
+	const TimeFrequencyData data = createTestData(100, 60);
+	const size_t windows[][2] = { { 0, 0 }, { 1, 2 }, { 7, 12 }, { 50, 30 } };
+	for(size_t i=0; i!=4; ++i)
+	{
+		LocalFitMethod fitMethod;
+		fitMethod.SetToMinimumFilter(windows[i][0], windows[i][1]);
+		fitMethod.Initialize(data);
+		for(size_t t=0; t!=fitMethod.TaskCount(); ++t)
+			fitMethod.PerformFit(t);
+		ImageAsserter::AssertEqual(fitMethod.Background().GetSingleImage(), directFit(data, windows[i][0], windows[i][1], true), 0.0, "Minimum equals direct calculation");
+	}
+}
+
+#endif
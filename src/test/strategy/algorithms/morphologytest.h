@@ -0,0 +1,225 @@
+#ifndef AOFLAGGER_MORPHOLOGYTEST_H
+#define AOFLAGGER_MORPHOLOGYTEST_H
+
+#include "../../testingtools/asserter.h"
+#include "../../testingtools/unittest.h"
+
+#include "../../../structures/mask2d.h"
+#include "../../../structures/segmentedimage.h"
+
+#include "../../../strategy/algorithms/morphology.h"
+
+#include "../../../util/parallelfor.h"
+
+#include <cstdlib>
+#include <sstream>
+#include <stack>
+#include <vector>
+
+class MorphologyTest : public UnitTest {
+	public:
+		MorphologyTest() : UnitTest("Morphology")
+		{
+			AddTest(TestSegmentByMaxLength(), "Segment by max length");
+			AddTest(TestSegmentByLengthRatio(), "Segment by length ratio");
+			AddTest(TestStripes(), "Labelling in stripes");
+		}
+
+	private:
+		struct TestSegmentByMaxLength : public Asserter
+		{
+			void operator()();
+		};
+		struct TestSegmentByLengthRatio : public Asserter
+		{
+			void operator()();
+		};
+		struct TestStripes : public Asserter
+		{
+			void operator()();
+		};
+
+		/**
+		 * Random flags with some full lines, so that there are both small segments and
+		 * segments that span the image.
+		 */
+		static Mask2DPtr createMask(size_t width, size_t height, int density)
+		{
+			Mask2DPtr mask = Mask2D::CreateSetMaskPtr<false>(width, height);
+			for(size_t y=0; y!=height; ++y)
+			{
+				for(size_t x=0; x!=width; ++x)
+				{
+					if(rand() % 100 < density)
+						mask->SetValue(x, y, true);
+				}
+			}
+			for(size_t i=0; i!=3; ++i)
+			{
+				const size_t y = rand() % height, x = rand() % width;
+				for(size_t xi=0; xi!=width; ++xi)
+					mask->SetValue(xi, y, true);
+				for(size_t yi=0; yi!=height; ++yi)
+					mask->SetValue(x, yi, true);
+			}
+			return mask;
+		}
+
+		/**
+		 * Segments with a flood fill: flagged samples are connected when their horizontal and
+		 * vertical runs are longest in the same direction. Segments are numbered in the order of
+		 * their first sample.
+		 */
+		static SegmentedImagePtr floodFillByMaxLength(const Mask2D &mask)
+		{
+			const size_t width = mask.Width(), height = mask.Height();
+			std::vector<size_t> hLengths(width*height, 0), vLengths(width*height, 0);
+			for(size_t y=0; y!=height; ++y)
+			{
+				for(size_t x=0; x!=width;)
+				{
+					size_t end = x;
+					while(end != width && mask.Value(end, y)) ++end;
+					for(size_t i=x; i!=end; ++i) hLengths[y*width + i] = end - x;
+					x = (end == x) ? x+1 : end;
+				}
+			}
+			for(size_t x=0; x!=width; ++x)
+			{
+				for(size_t y=0; y!=height;)
+				{
+					size_t end = y;
+					while(end != height && mask.Value(x, end)) ++end;
+					for(size_t i=y; i!=end; ++i) vLengths[i*width + x] = end - y;
+					y = (end == y) ? y+1 : end;
+				}
+			}
+
+			SegmentedImagePtr output = SegmentedImage::CreatePtr(width, height);
+			for(size_t y=0; y!=height; ++y)
+			{
+				for(size_t x=0; x!=width; ++x)
+				{
+					if(!mask.Value(x, y) || output->Value(x, y) != 0)
+						continue;
+					const size_t value = output->NewSegmentValue();
+					const bool isHorizontal = hLengths[y*width + x] >= vLengths[y*width + x];
+					std::stack<std::pair<size_t,size_t> > points;
+					points.push(std::make_pair(x, y));
+					output->SetValue(x, y, value);
+					while(!points.empty())
+					{
+						const size_t px = points.top().first, py = points.top().second;
+						points.pop();
+						const int dx[4] = { -1, 1, 0, 0 }, dy[4] = { 0, 0, -1, 1 };
+						for(size_t d=0; d!=4; ++d)
+						{
+							const size_t nx = px + dx[d], ny = py + dy[d];
+							if(nx < width && ny < height && mask.Value(nx, ny) && output->Value(nx, ny) == 0 &&
+								(hLengths[ny*width + nx] >= vLengths[ny*width + nx]) == isHorizontal)
+							{
+								output->SetValue(nx, ny, value);
+								points.push(std::make_pair(nx, ny));
+							}
+						}
+					}
+				}
+			}
+			return output;
+		}
+
+		static bool isEqual(const SegmentedImage &a, const SegmentedImage &b)
+		{
+			for(size_t y=0; y!=a.Height(); ++y)
+			{
+				for(size_t x=0; x!=a.Width(); ++x)
+				{
+					if(a.Value(x, y) != b.Value(x, y))
+						return false;
+				}
+			}
+			return true;
+		}
+};
+
+inline void MorphologyTest::TestSegmentByMaxLength::operator()()
+{
+	srand(1);
+	const size_t sizes[][2] = { { 1, 1 }, { 1, 50 }, { 50, 1 }, { 37, 23 }, { 200, 300 }, { 500, 257 } };
+	const int densities[] = { 0, 10, 50, 90, 100 };
+	for(size_t s=0; s!=6; ++s)
+	{
+		for(size_t d=0; d!=5; ++d)
+		{
+			Mask2DPtr mask = createMask(sizes[s][0], sizes[s][1], densities[d]);
+			SegmentedImagePtr segmented = SegmentedImage::CreatePtr(mask->Width(), mask->Height());
+			Morphology morphology;
+			morphology.SegmentByMaxLength(mask, segmented);
+			SegmentedImagePtr expected = floodFillByMaxLength(*mask);
+			AssertEquals(segmented->SegmentCount(), expected->SegmentCount(), "Segment count");
+			AssertTrue(isEqual(*segmented, *expected), "Segments equal flood fill");
+		}
+	}
+}
+
+inline void MorphologyTest::TestSegmentByLengthRatio::operator()()
+{
+	// A horizontal line and a vertical line that do not touch
+	const size_t width = 100, height = 80;
+	Mask2DPtr mask = Mask2D::CreateSetMaskPtr<false>(width, height);
+	for(size_t x=10; x!=60; ++x)
+		mask->SetValue(x, 20, true);
+	for(size_t y=30; y!=70; ++y)
+		mask->SetValue(80, y, true);
+	SegmentedImagePtr segmented = SegmentedImage::CreatePtr(width, height);
+	Morphology morphology;
+	morphology.SegmentByLengthRatio(mask, segmented);
+
+	const size_t horizontal = segmented->Value(10, 20), vertical = segmented->Value(80, 30);
+	AssertNotEqual(horizontal, (size_t) 0, "Horizontal line is segmented");
+	AssertNotEqual(vertical, (size_t) 0, "Vertical line is segmented");
+	AssertNotEqual(horizontal, vertical, "Lines are different segments");
+	bool isConsistent = true;
+	for(size_t y=0; y!=height; ++y)
+	{
+		for(size_t x=0; x!=width; ++x)
+		{
+			const size_t value = segmented->Value(x, y);
+			if(!mask->Value(x, y))
+				isConsistent = isConsistent && value == 0;
+			else if(y == 20)
+				isConsistent = isConsistent && value == horizontal;
+			else
+				isConsistent = isConsistent && value == vertical;
+		}
+	}
+	AssertTrue(isConsistent, "Samples are in the segment of their line");
+}
+
+inline void MorphologyTest::TestStripes::operator()()
+{
+	srand(2);
+	// Run the stripes on several threads, also when there is only one core
+	ParallelFor::Limit limit(4);
+	// Includes images with fewer rows than stripes
+	const size_t sizes[][2] = { { 50, 1 }, { 37, 5 }, { 200, 300 }, { 500, 257 } };
+	const size_t stripeCounts[] = { 1, 2, 7, 64 };
+	for(size_t s=0; s!=4; ++s)
+	{
+		Mask2DPtr mask = createMask(sizes[s][0], sizes[s][1], 50);
+		SegmentedImagePtr expected = floodFillByMaxLength(*mask);
+		for(size_t c=0; c!=4; ++c)
+		{
+			SegmentedImagePtr segmented = SegmentedImage::CreatePtr(mask->Width(), mask->Height());
+			Morphology morphology;
+			morphology.SetLabellingStripeCount(stripeCounts[c]);
+			morphology.SegmentByMaxLength(mask, segmented);
+			std::ostringstream description;
+			description << "Segments equal flood fill with " << stripeCounts[c] << " stripes";
+			AssertEquals(segmented->SegmentCount(), expected->SegmentCount(), "Segment count");
+			AssertTrue(isEqual(*segmented, *expected), description.str());
+		}
+	}
+}
+
+#endif
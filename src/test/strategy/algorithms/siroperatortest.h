@@ -10,6 +10,8 @@
 
 #include "../../../util/rng.h"
 
+#include <cstdlib>
+
 class SIROperatorTest : public UnitTest {
 	public:
 		SIROperatorTest() : UnitTest("Scale-invariant rank operator")
@@ -19,6 +21,7 @@ class SIROperatorTest : public UnitTest {
 			AddTest(TestTimeApplication(), "Time application");
 			AddTest(TestFrequencyApplication(), "Frequency application");
 			AddTest(TestTimeApplicationSpeed(), "Time application speed");
+			AddTest(TestMaskApplication(), "Mask application equals reference");
 		}
 		
 	private:
@@ -47,6 +50,10 @@ class SIROperatorTest : public UnitTest {
 		{
 			void operator()();
 		};
+		struct TestMaskApplication : public Asserter
+		{
+			void operator()();
+		};
 		
 		static std::string flagsToString(const bool *flags, unsigned size)
 		{
@@ -337,4 +344,56 @@ inline void SIROperatorTest::TestTimeApplicationSpeed::operator()()
 	SIROperator::OperateHorizontally(mask, 0.1);
 }
 
+inline void SIROperatorTest::TestMaskApplication::operator()()
+{
+	// Includes empty and fully flagged rows and columns, which are skipped, and more columns
+	// than are processed in one block
+	const unsigned width = 150, height = 70;
+	const num_t etas[] = { -0.1, 0.0, 0.2, 0.5, 1.0, 1.5 };
+	for(unsigned density=0;density<=100;density+=25)
+	{
+		srand(density);
+		Mask2DPtr input = Mask2D::CreateSetMaskPtr<false>(width, height);
+		for(unsigned y=0;y<height;++y)
+		{
+			for(unsigned x=0;x<width;++x)
+				input->SetValue(x, y, (unsigned) (rand()%100) < density);
+		}
+		for(unsigned x=0;x<width;++x)
+			input->SetValue(x, 3, true);
+		for(unsigned y=0;y<height;++y)
+			input->SetValue(7, y, true);
+		
+		for(unsigned e=0;e!=sizeof(etas)/sizeof(num_t);++e)
+		{
+			Mask2DPtr mask = Mask2D::CreateCopy(input);
+			SIROperator::OperateHorizontally(mask, etas[e]);
+			bool isEqual = true;
+			bool flags[width];
+			for(unsigned y=0;y<height;++y)
+			{
+				for(unsigned x=0;x<width;++x)
+					flags[x] = input->Value(x, y);
+				SIROperator::Operate(flags, width, etas[e]);
+				for(unsigned x=0;x<width;++x)
+					isEqual = isEqual && (flags[x] == mask->Value(x, y));
+			}
+			AssertTrue(isEqual, "Horizontal application equals Operate()");
+			
+			mask = Mask2D::CreateCopy(input);
+			SIROperator::OperateVertically(mask, etas[e]);
+			isEqual = true;
+			for(unsigned x=0;x<width;++x)
+			{
+				for(unsigned y=0;y<height;++y)
+					flags[y] = input->Value(x, y);
+				SIROperator::Operate(flags, height, etas[e]);
+				for(unsigned y=0;y<height;++y)
+					isEqual = isEqual && (flags[y] == mask->Value(x, y));
+			}
+			AssertTrue(isEqual, "Vertical application equals Operate()");
+		}
+	}
+}
+
 #endif
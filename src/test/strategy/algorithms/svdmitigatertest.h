@@ -0,0 +1,84 @@
+#ifndef AOFLAGGER_SVDMITIGATERTEST_H
+#define AOFLAGGER_SVDMITIGATERTEST_H
+
+#include "../../testingtools/asserter.h"
+#include "../../testingtools/imageasserter.h"
+#include "../../testingtools/unittest.h"
+
+#include "../../../structures/image2d.h"
+#include "../../../structures/timefrequencydata.h"
+
+#include "../../../strategy/algorithms/mitigationtester.h"
+#include "../../../strategy/algorithms/svdmitigater.h"
+
+#include <cstdlib>
+#include <vector>
+
+class SVDMitigaterTest : public UnitTest {
+	public:
+		SVDMitigaterTest() : UnitTest("SVD mitigater")
+		{
+			AddTest(TestTruncated(), "Truncated decomposition");
+			AddTest(TestFallback(), "Fallback to full decomposition");
+		}
+
+	private:
+		struct TestTruncated : public Asserter
+		{
+			void operator()();
+		};
+		struct TestFallback : public Asserter
+		{
+			void operator()();
+		};
+
+		static TimeFrequencyData removeComponents(const TimeFrequencyData &data, unsigned count, bool allowTruncation, bool &isTruncated)
+		{
+			SVDMitigater svd;
+			svd.SetRemoveCount(count);
+			svd.SetAllowTruncation(allowTruncation);
+			svd.Initialize(data);
+			svd.PerformFit(0);
+			isTruncated = svd.IsTruncated();
+			return svd.Background();
+		}
+};
+
+inline void SVDMitigaterTest::TestTruncated::operator()()
+{
+	std::vector<double> amplitudes;
+	amplitudes.push_back(10.0);
+	amplitudes.push_back(5.0);
+	amplitudes.push_back(3.0);
+	srand(1);
+	const TimeFrequencyData data = MitigationTester::CreateLowRankData(400, 64, amplitudes);
+
+	bool isTruncated;
+	const TimeFrequencyData full = removeComponents(data, 3, false, isTruncated);
+	AssertFalse(isTruncated, "Full decomposition when truncation is not allowed");
+	const TimeFrequencyData truncated = removeComponents(data, 3, true, isTruncated);
+	AssertTrue(isTruncated, "Truncated decomposition");
+
+	// The residual is noise with unit variance, so the difference should be small compared to one
+	ImageAsserter::AssertEqual(truncated.GetRealPart(), full.GetRealPart(), 1e-3, "Real part of truncated background");
+	ImageAsserter::AssertEqual(truncated.GetImaginaryPart(), full.GetImaginaryPart(), 1e-3, "Imaginary part of truncated background");
+	// ...while the removed components are large
+	const Image2DCPtr removed = Image2D::CreateFromDiff(data.GetRealPart(), truncated.GetRealPart());
+	AssertGreaterThan(removed->GetRMS(), 1.0, "Components were removed");
+}
+
+inline void SVDMitigaterTest::TestFallback::operator()()
+{
+	std::vector<double> amplitudes(1, 10.0);
+	srand(1);
+	const TimeFrequencyData data = MitigationTester::CreateLowRankData(100, 40, amplitudes);
+
+	bool isTruncated;
+	const TimeFrequencyData full = removeComponents(data, 20, false, isTruncated);
+	const TimeFrequencyData fallback = removeComponents(data, 20, true, isTruncated);
+	AssertFalse(isTruncated, "Full decomposition when many components are removed");
+	ImageAsserter::AssertEqual(fallback.GetRealPart(), full.GetRealPart(), "Real part same as full decomposition");
+	ImageAsserter::AssertEqual(fallback.GetImaginaryPart(), full.GetImaginaryPart(), "Imaginary part same as full decomposition");
+}
+
+#endif
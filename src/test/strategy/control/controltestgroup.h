@@ -0,0 +1,20 @@
+#ifndef AOFLAGGER_CONTROLTESTGROUP_H
+#define AOFLAGGER_CONTROLTESTGROUP_H
+
+#include "../../testingtools/testgroup.h"
+
+#include "executionplantest.h"
+#include "pythonstrategytest.h"
+
+class ControlTestGroup : public TestGroup {
+	public:
+		ControlTestGroup() : TestGroup("Strategy control") { }
+		
+		virtual void Initialize()
+		{
+			Add(new ExecutionPlanTest());
+			Add(new PythonStrategyTest());
+		}
+};
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef AOFLAGGER_EXECUTIONPLANTEST_H
+#define AOFLAGGER_EXECUTIONPLANTEST_H
+
+#include "../../testingtools/asserter.h"
+#include "../../testingtools/unittest.h"
+
+#include "../../../strategy/actions/foreachbaselineaction.h"
+#include "../../../strategy/actions/foreachmsaction.h"
+#include "../../../strategy/actions/iterationaction.h"
+
+#include "../../../strategy/control/actionblock.h"
+#include "../../../strategy/control/artifactset.h"
+#include "../../../strategy/control/executionplan.h"
+
+#include "../../../util/progresslistener.h"
+
+#include "../../../baseexception.h"
+
+#include <string>
+#include <vector>
+
+class ExecutionPlanTest : public UnitTest {
+	public:
+		ExecutionPlanTest() : UnitTest("Execution plan")
+		{
+			AddTest(TestNestedTree(), "Compiling a nested tree");
+			AddTest(TestSeveralPlans(), "Several plans of one tree");
+			AddTest(TestForEachBaseline(), "For each baseline inside a compiled tree");
+		}
+
+	private:
+		struct TestNestedTree : public Asserter
+		{
+			void operator()();
+		};
+		struct TestSeveralPlans : public Asserter
+		{
+			void operator()();
+		};
+		struct TestForEachBaseline : public Asserter
+		{
+			void operator()();
+		};
+
+		class TestBlock : public rfiStrategy::ActionBlock
+		{
+			public:
+				virtual rfiStrategy::ActionType Type() const { return rfiStrategy::ActionBlockType; }
+		};
+
+		/**
+		 * Appends its name to a log when it is performed.
+		 */
+		class LogAction : public rfiStrategy::Action
+		{
+			public:
+				LogAction(const std::string &name, std::string &log) : _name(name), _log(&log) { }
+				virtual std::string Description() { return _name; }
+				virtual void Perform(rfiStrategy::ArtifactSet &, ProgressListener &) { (*_log) += _name; }
+				// Any type that the plan does not treat specially
+				virtual rfiStrategy::ActionType Type() const { return rfiStrategy::SetFlaggingActionType; }
+			private:
+				std::string _name;
+				std::string *_log;
+		};
+
+		static std::string perform(rfiStrategy::ActionBlock &block, std::string &log, const rfiStrategy::ExecutionPlan *plan = 0)
+		{
+			log.clear();
+			rfiStrategy::ArtifactSet artifacts(0);
+			artifacts.SetPlan(plan);
+			DummyProgressListener listener;
+			block.Perform(artifacts, listener);
+			return log;
+		}
+};
+
+inline void ExecutionPlanTest::TestNestedTree::operator()()
+{
+	std::string log;
+	TestBlock root;
+	root.Add(new LogAction("a", log));
+	rfiStrategy::IterationBlock *iteration = new rfiStrategy::IterationBlock();
+	iteration->SetIterationCount(2);
+	iteration->Add(new LogAction("b", log));
+	TestBlock *inner = new TestBlock();
+	inner->Add(new LogAction("c", log));
+	iteration->Add(inner);
+	root.Add(iteration);
+	// Does nothing, so it is left out of the plan
+	rfiStrategy::IterationBlock *emptyIteration = new rfiStrategy::IterationBlock();
+	emptyIteration->SetIterationCount(0);
+	emptyIteration->Add(new LogAction("x", log));
+	root.Add(emptyIteration);
+	root.Add(new LogAction("d", log));
+
+	const std::string uncompiledLog = perform(root, log);
+	AssertEquals(uncompiledLog, "abcbcd", "Order without plan");
+	{
+		rfiStrategy::ExecutionPlan plan(root);
+		// a, iteration and d in the root; b and inner in the iteration; c in inner
+		AssertEquals(plan.StepCount(), (size_t) 6, "Step count");
+		AssertEquals(plan.Depth(), (size_t) 2, "Depth");
+		AssertTrue(plan.Contains(root), "Root is compiled");
+		AssertTrue(plan.Contains(*iteration), "Iteration is compiled");
+		AssertTrue(plan.Contains(*inner), "Inner block is compiled");
+		AssertFalse(plan.Contains(*emptyIteration), "Empty iteration is not compiled");
+		AssertEquals(perform(root, log, &plan), uncompiledLog, "Order with plan");
+		AssertEquals(perform(root, log), uncompiledLog, "Order without plan while a plan exists");
+	}
+	AssertEquals(perform(root, log), uncompiledLog, "Order after destructing the plan");
+}
+
+inline void ExecutionPlanTest::TestSeveralPlans::operator()()
+{
+	std::string log;
+	TestBlock root;
+	root.Add(new LogAction("a", log));
+	TestBlock *inner = new TestBlock();
+	inner->Add(new LogAction("b", log));
+	root.Add(inner);
+
+	// Compiling does not change the tree, so plans of the same tree are independent
+	rfiStrategy::ExecutionPlan plan(root);
+	{
+		rfiStrategy::ExecutionPlan secondPlan(root);
+		rfiStrategy::ExecutionPlan innerPlan(*inner);
+		AssertEquals(secondPlan.StepCount(), plan.StepCount(), "Step count of second plan");
+		AssertTrue(innerPlan.Contains(*inner), "Inner plan contains the inner block");
+		AssertFalse(innerPlan.Contains(root), "Inner plan does not contain the root");
+		AssertEquals(perform(root, log, &secondPlan), "ab", "Order with second plan");
+		// The root is not part of the inner plan, so it walks the tree until the inner block
+		AssertEquals(perform(root, log, &innerPlan), "ab", "Order with plan of the inner block");
+	}
+	AssertEquals(perform(root, log, &plan), "ab", "First plan after destructing the others");
+}
+
+inline void ExecutionPlanTest::TestForEachBaseline::operator()()
+{
+	std::string log;
+	TestBlock root;
+	root.Add(new LogAction("a", log));
+	rfiStrategy::ForEachBaselineAction *forEachBaseline = new rfiStrategy::ForEachBaselineAction();
+	forEachBaseline->SetSelection(rfiStrategy::All);
+	forEachBaseline->Add(new LogAction("b", log));
+	rfiStrategy::ForEachBaselineAction *current = new rfiStrategy::ForEachBaselineAction();
+	current->SetSelection(rfiStrategy::Current);
+	current->Add(new LogAction("c", log));
+	forEachBaseline->Add(current);
+	root.Add(forEachBaseline);
+
+	rfiStrategy::ExecutionPlan plan(root);
+	// The children of the for each baseline action are compiled when it starts
+	AssertEquals(plan.StepCount(), (size_t) 2, "Step count of root");
+	AssertTrue(plan.Contains(root), "Root is compiled");
+	AssertFalse(plan.Contains(*forEachBaseline), "For each baseline is not compiled with the root");
+	{
+		rfiStrategy::ExecutionPlan baselinePlan(*forEachBaseline);
+		AssertEquals(baselinePlan.StepCount(), (size_t) 2, "Step count per baseline");
+		AssertTrue(baselinePlan.Contains(*forEachBaseline), "For each baseline has its own plan");
+		AssertFalse(baselinePlan.Contains(*current), "Nested for each baseline is not compiled");
+	}
+
+	// Selecting other baselines or measurement sets is not possible per baseline
+	current->SetSelection(rfiStrategy::All);
+	bool isSelectionThrown = false;
+	try {
+		rfiStrategy::ExecutionPlan baselinePlan(*forEachBaseline);
+	} catch(BadUsageException &) {
+		isSelectionThrown = true;
+	}
+	AssertTrue(isSelectionThrown, "Selecting all baselines per baseline throws");
+
+	// The error is found in a nested block, after the for each baseline action was compiled
+	current->SetSelection(rfiStrategy::Current);
+	TestBlock *inner = new TestBlock();
+	inner->Add(new rfiStrategy::ForEachMSAction());
+	forEachBaseline->Add(inner);
+	bool isMSThrown = false;
+	try {
+		rfiStrategy::ExecutionPlan baselinePlan(*forEachBaseline);
+	} catch(BadUsageException &) {
+		isMSThrown = true;
+	}
+	AssertTrue(isMSThrown, "For each measurement set per baseline throws");
+}
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef AOFLAGGER_PYTHONSTRATEGYTEST_H
+#define AOFLAGGER_PYTHONSTRATEGYTEST_H
+
+#include "../../testingtools/asserter.h"
+#include "../../testingtools/unittest.h"
+
+#include "../../../structures/image2d.h"
+#include "../../../structures/mask2d.h"
+#include "../../../structures/timefrequencydata.h"
+
+#include "../../../strategy/control/pythonstrategy.h"
+
+#include "../../../python/scopedgil.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class PythonStrategyTest : public UnitTest {
+	public:
+		/**
+		 * The interpreter can only be started once per process, so all tests share one strategy.
+		 * The strategy fails on data with a width of one. On data with a height of two, it sets
+		 * two flags, each through its own view on the mask. Otherwise, it removes the mask, so
+		 * that it is visible which data was flagged.
+		 */
+		PythonStrategyTest() : UnitTest("Python strategy"), _strategy(
+			"import aoflagger\n"
+			"import numpy\n"
+			"\n"
+			"def flag(data):\n"
+			"  if data.width() == 1:\n"
+			"    raise RuntimeError('Baseline is too short')\n"
+			"  elif data.height() == 2:\n"
+			"    first = numpy.asarray(data.get_mask(0))\n"
+			"    second = numpy.asarray(data.get_mask(0))\n"
+			"    first[0, 1] = True\n"
+			"    second[1, 2] = True\n"
+			"    if not (first[1, 2] and second[0, 1]):\n"
+			"      raise RuntimeError('Views on the same mask differ')\n"
+			"  else:\n"
+			"    data.clear_mask()\n"
+			"\n"
+			"aoflagger.set_flag_function(flag)\n")
+		{
+			if(isNumpyAvailable())
+			{
+				AddTest(TestThreadCount(_strategy), "Flagging with different thread counts");
+				AddTest(TestErrorCollection(_strategy), "Collecting the errors of all threads");
+				AddTest(TestMaskViews(_strategy), "Writing through two views on a mask");
+			} else {
+				std::cout << "Skipping the Python strategy tests, because numpy is not installed.\n";
+			}
+		}
+		
+	private:
+		struct TestThreadCount : public Asserter
+		{
+			explicit TestThreadCount(PythonStrategy &strategy) : _strategy(&strategy) { }
+			void operator()();
+			PythonStrategy *_strategy;
+		};
+		struct TestErrorCollection : public Asserter
+		{
+			explicit TestErrorCollection(PythonStrategy &strategy) : _strategy(&strategy) { }
+			void operator()();
+			PythonStrategy *_strategy;
+		};
+		struct TestMaskViews : public Asserter
+		{
+			explicit TestMaskViews(PythonStrategy &strategy) : _strategy(&strategy) { }
+			void operator()();
+			PythonStrategy *_strategy;
+		};
+		
+		static bool isNumpyAvailable()
+		{
+			aoflagger_python::ScopedGILAcquire gil;
+			PyObject *numpy = PyImport_ImportModule("numpy");
+			if(numpy == 0)
+			{
+				PyErr_Clear();
+				return false;
+			}
+			Py_DECREF(numpy);
+			return true;
+		}
+		
+		static TimeFrequencyData createData(size_t width, size_t height)
+		{
+			TimeFrequencyData data(TimeFrequencyData::AmplitudePart, Polarization::StokesI, Image2D::CreateZeroImagePtr(width, height));
+			data.SetGlobalMask(Mask2D::CreateSetMaskPtr<false>(width, height));
+			return data;
+		}
+		
+		PythonStrategy _strategy;
+};
+
+inline void PythonStrategyTest::TestThreadCount::operator()()
+{
+	// Zero selects one thread per processor; more threads than data are not started
+	const size_t threadCounts[] = { 0, 1, 3, 16 };
+	for(size_t t=0; t!=4; ++t)
+	{
+		std::vector<TimeFrequencyData> data;
+		for(size_t i=0; i!=5; ++i)
+			data.push_back(createData(10, 4));
+		_strategy->ExecuteParallel(data, threadCounts[t]);
+		for(size_t i=0; i!=data.size(); ++i)
+			AssertEquals(data[i].MaskCount(), (size_t) 0, "Data was flagged");
+	}
+	
+	std::vector<TimeFrequencyData> empty;
+	_strategy->ExecuteParallel(empty, 4);
+}
+
+inline void PythonStrategyTest::TestErrorCollection::operator()()
+{
+	std::vector<TimeFrequencyData> data;
+	for(size_t i=0; i!=7; ++i)
+		data.push_back(createData((i == 1 || i == 4 || i == 5) ? 1 : 10, 4));
+	
+	std::string errors;
+	try {
+		_strategy->ExecuteParallel(data, 3);
+	} catch(std::runtime_error &e) {
+		errors = e.what();
+	}
+	size_t errorCount = 0;
+	const std::string message = "RuntimeError: Baseline is too short";
+	for(size_t pos = errors.find(message); pos != std::string::npos; pos = errors.find(message, pos+1))
+		++errorCount;
+	AssertEquals(errorCount, (size_t) 3, "Each failure is reported");
+	
+	for(size_t i=0; i!=data.size(); ++i)
+	{
+		const bool hasFailed = data[i].ImageWidth() == 1;
+		AssertEquals(data[i].MaskCount(), hasFailed ? (size_t) 1 : (size_t) 0, "Other data is flagged after a failure");
+	}
+}
+
+inline void PythonStrategyTest::TestMaskViews::operator()()
+{
+	// The mask is shared with the original, which should not change
+	TimeFrequencyData data = createData(5, 2);
+	const TimeFrequencyData original(data);
+	_strategy->Execute(data);
+	
+	AssertEquals(data.MaskCount(), (size_t) 1, "Mask count");
+	const Mask2DCPtr mask = data.GetSingleMask();
+	AssertTrue(mask->Value(1, 0), "Flag set through first view");
+	AssertTrue(mask->Value(2, 1), "Flag set through second view");
+	AssertEquals(mask->GetCount<true>(), (size_t) 2, "Flag count");
+	AssertEquals(original.GetSingleMask()->GetCount<true>(), (size_t) 0, "Flags of the original");
+}
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef AOFLAGGER_RESAMPLINGTEST_H
+#define AOFLAGGER_RESAMPLINGTEST_H
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/unittest.h"
+
+#include "../../structures/image2d.h"
+#include "../../structures/mask2d.h"
+
+#include "../../util/rng.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+class ResamplingTest : public UnitTest {
+	public:
+		ResamplingTest() : UnitTest("Resampling")
+		{
+			AddTest(TestImageShrinking(), "Shrinking images");
+			AddTest(TestImageEnlarging(), "Enlarging images");
+			AddTest(TestMaskResampling(), "Resampling masks");
+		}
+		
+	private:
+		struct TestImageShrinking : public Asserter
+		{
+			void operator()();
+		};
+		struct TestImageEnlarging : public Asserter
+		{
+			void operator()();
+		};
+		struct TestMaskResampling : public Asserter
+		{
+			void operator()();
+		};
+		
+		static Image2DPtr createImage(size_t width, size_t height)
+		{
+			Image2DPtr image = Image2D::CreateUnsetImagePtr(width, height);
+			for(size_t y=0;y<height;++y)
+			{
+				for(size_t x=0;x<width;++x)
+					image->SetValue(x, y, RNG::Gaussian() * 100.0);
+			}
+			return image;
+		}
+		
+		static bool areEqual(const Image2D &a, const Image2D &b)
+		{
+			if(a.Width() != b.Width() || a.Height() != b.Height())
+				return false;
+			for(size_t y=0;y<a.Height();++y)
+			{
+				for(size_t x=0;x<a.Width();++x)
+				{
+					if(a.Value(x, y) != b.Value(x, y))
+						return false;
+				}
+			}
+			return true;
+		}
+		
+		/**
+		 * The average of a bin, summed in the same order as the resampling functions do, so
+		 * that the result should be exactly equal.
+		 */
+		static num_t binAverage(const Image2D &image, size_t xStart, size_t xEnd, size_t yStart, size_t yEnd)
+		{
+			num_t sum = 0.0;
+			for(size_t y=yStart;y<yEnd;++y)
+			{
+				for(size_t x=xStart;x<xEnd;++x)
+					sum += image.Value(x, y);
+			}
+			return sum / (num_t) ((xEnd-xStart) * (yEnd-yStart));
+		}
+};
+
+inline void ResamplingTest::TestImageShrinking::operator()()
+{
+	// Sizes that are and are not divisible by the factors, to test the vectorized and the
+	// remaining bins
+	const size_t sizes[][2] = { { 1, 1 }, { 7, 5 }, { 40, 30 }, { 103, 21 } };
+	const size_t factors[] = { 1, 2, 3, 10 };
+	for(size_t s=0;s!=4;++s)
+	{
+		const size_t width = sizes[s][0], height = sizes[s][1];
+		std::vector<Image2DCPtr> images;
+		images.push_back(createImage(width, height));
+		images.push_back(createImage(width, height));
+		for(size_t f=0;f!=4;++f)
+		{
+			const size_t factor = factors[f];
+			Image2DPtr horizontal = images[0]->ShrinkHorizontally(factor);
+			Image2DPtr vertical = images[0]->ShrinkVertically(factor);
+			AssertEquals(horizontal->Width(), (width + factor - 1) / factor, "Width of horizontally shrunk image");
+			AssertEquals(vertical->Height(), (height + factor - 1) / factor, "Height of vertically shrunk image");
+			bool isEqual = true;
+			for(size_t y=0;y<height;++y)
+			{
+				for(size_t x=0;x<horizontal->Width();++x)
+					isEqual = isEqual && horizontal->Value(x, y) == binAverage(*images[0], x*factor, std::min((x+1)*factor, width), y, y+1);
+			}
+			for(size_t y=0;y<vertical->Height();++y)
+			{
+				for(size_t x=0;x<width;++x)
+					isEqual = isEqual && vertical->Value(x, y) == binAverage(*images[0], x, x+1, y*factor, std::min((y+1)*factor, height));
+			}
+			AssertTrue(isEqual, "Shrunk images equal bin averages");
+			
+			std::vector<Image2DPtr> newImages;
+			Image2D::ShrinkHorizontally(factor, images, newImages);
+			AssertEquals(newImages.size(), (size_t) 2, "Number of horizontally shrunk images");
+			AssertTrue(areEqual(*newImages[0], *horizontal) && areEqual(*newImages[1], *images[1]->ShrinkHorizontally(factor)), "Shrinking several images horizontally");
+			Image2D::ShrinkVertically(factor, images, newImages);
+			AssertTrue(areEqual(*newImages[0], *vertical) && areEqual(*newImages[1], *images[1]->ShrinkVertically(factor)), "Shrinking several images vertically");
+		}
+	}
+}
+
+inline void ResamplingTest::TestImageEnlarging::operator()()
+{
+	Image2DPtr image = createImage(13, 7);
+	Image2DPtr horizontal = image->EnlargeHorizontally(3, 38);
+	Image2DPtr vertical = image->EnlargeVertically(3, 20);
+	AssertEquals(horizontal->Width(), (size_t) 38, "Width of enlarged image");
+	AssertEquals(vertical->Height(), (size_t) 20, "Height of enlarged image");
+	bool isEqual = true;
+	for(size_t y=0;y<7;++y)
+	{
+		for(size_t x=0;x<38;++x)
+			isEqual = isEqual && horizontal->Value(x, y) == image->Value(x/3, y);
+	}
+	for(size_t y=0;y<20;++y)
+	{
+		for(size_t x=0;x<13;++x)
+			isEqual = isEqual && vertical->Value(x, y) == image->Value(x, y/3);
+	}
+	AssertTrue(isEqual, "Enlarged images repeat the samples");
+}
+
+inline void ResamplingTest::TestMaskResampling::operator()()
+{
+	srand(1);
+	const size_t width = 103, height = 21, factor = 3;
+	Mask2DPtr mask = Mask2D::CreateSetMaskPtr<false>(width, height);
+	for(size_t y=0;y<height;++y)
+	{
+		for(size_t x=0;x<width;++x)
+			mask->SetValue(x, y, rand()%3 == 0);
+	}
+	Mask2DPtr
+		horizontal = mask->ShrinkHorizontally(factor),
+		horizontalForAveraging = mask->ShrinkHorizontallyForAveraging(factor),
+		vertical = mask->ShrinkVertically(factor);
+	bool isEqual = true;
+	for(size_t y=0;y<height;++y)
+	{
+		for(size_t x=0;x<horizontal->Width();++x)
+		{
+			bool anyFlagged = false, allFlagged = true;
+			for(size_t binX=x*factor;binX<std::min((x+1)*factor, width);++binX)
+			{
+				anyFlagged = anyFlagged || mask->Value(binX, y);
+				allFlagged = allFlagged && mask->Value(binX, y);
+			}
+			isEqual = isEqual && horizontal->Value(x, y) == anyFlagged && horizontalForAveraging->Value(x, y) == allFlagged;
+		}
+	}
+	for(size_t y=0;y<vertical->Height();++y)
+	{
+		for(size_t x=0;x<width;++x)
+		{
+			bool anyFlagged = false;
+			for(size_t binY=y*factor;binY<std::min((y+1)*factor, height);++binY)
+				anyFlagged = anyFlagged || mask->Value(x, binY);
+			isEqual = isEqual && vertical->Value(x, y) == anyFlagged;
+		}
+	}
+	AssertTrue(isEqual, "Shrunk masks");
+	
+	Mask2DPtr enlarged = Mask2D::CreateUnsetMaskPtr(width, height);
+	enlarged->EnlargeHorizontallyAndSet(horizontal, factor);
+	isEqual = true;
+	for(size_t y=0;y<height;++y)
+	{
+		for(size_t x=0;x<width;++x)
+			isEqual = isEqual && enlarged->Value(x, y) == horizontal->Value(x/factor, y);
+	}
+	enlarged->EnlargeVerticallyAndSet(vertical, factor);
+	for(size_t y=0;y<height;++y)
+	{
+		for(size_t x=0;x<width;++x)
+			isEqual = isEqual && enlarged->Value(x, y) == vertical->Value(x, y/factor);
+	}
+	AssertTrue(isEqual, "Enlarged masks repeat the flags");
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef AOFLAGGER_STRUCTURESTESTGROUP_H
+#define AOFLAGGER_STRUCTURESTESTGROUP_H
+
+#include "../testingtools/testgroup.h"
+
+#include "resamplingtest.h"
+#include "timefrequencydatatest.h"
+
+class StructuresTestGroup : public TestGroup {
+	public:
+		StructuresTestGroup() : TestGroup("Data structures") { }
+		
+		virtual void Initialize()
+		{
+			Add(new ResamplingTest());
+			Add(new TimeFrequencyDataTest());
+		}
+};
+
+#endif
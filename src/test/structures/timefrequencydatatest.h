@@ -0,0 +1,103 @@
+#ifndef AOFLAGGER_TIMEFREQUENCYDATATEST_H
+#define AOFLAGGER_TIMEFREQUENCYDATATEST_H
+
+#include "../testingtools/asserter.h"
+#include "../testingtools/unittest.h"
+
+#include "../../structures/timefrequencydata.h"
+
+class TimeFrequencyDataTest : public UnitTest {
+	public:
+		TimeFrequencyDataTest() : UnitTest("Time-frequency data")
+		{
+			AddTest(TestDerivedImages(), "Reusing derived images");
+			AddTest(TestInvalidation(), "Invalidating derived images");
+			AddTest(TestCopyOnWrite(), "Copy on write");
+		}
+		
+	private:
+		struct TestDerivedImages : public Asserter
+		{
+			void operator()();
+		};
+		struct TestInvalidation : public Asserter
+		{
+			void operator()();
+		};
+		struct TestCopyOnWrite : public Asserter
+		{
+			void operator()();
+		};
+		
+		static TimeFrequencyData createData(num_t xxReal, num_t xxImag, num_t yyReal, num_t yyImag)
+		{
+			return TimeFrequencyData(
+				Polarization::XX, Image2D::CreateSetImagePtr(4, 3, xxReal), Image2D::CreateSetImagePtr(4, 3, xxImag),
+				Polarization::YY, Image2D::CreateSetImagePtr(4, 3, yyReal), Image2D::CreateSetImagePtr(4, 3, yyImag));
+		}
+};
+
+inline void TimeFrequencyDataTest::TestDerivedImages::operator()()
+{
+	TimeFrequencyData data = createData(1.0, 2.0, 2.0, 2.0);
+	Image2DCPtr single = data.GetSingleImage();
+	AssertAlmostEqual(single->Value(1, 1), 5.0, "Amplitude of Stokes I sum");
+	AssertTrue(data.GetSingleImage() == single, "Single image is reused");
+	
+	TimeFrequencyData copy(data);
+	AssertTrue(copy.GetSingleImage() == single, "Copies share derived images");
+	
+	TimeFrequencyData stokesI = data.Make(Polarization::StokesI);
+	AssertAlmostEqual(stokesI.GetRealPart()->Value(0, 0), 3.0, "Real part of Stokes I");
+	AssertAlmostEqual(stokesI.GetImaginaryPart()->Value(0, 0), 4.0, "Imaginary part of Stokes I");
+	TimeFrequencyData stokesIAgain = data.Make(Polarization::StokesI);
+	AssertTrue(stokesIAgain.GetRealPart() == stokesI.GetRealPart(), "Stokes I is reused");
+	TimeFrequencyData stokesQ = data.Make(Polarization::StokesQ);
+	AssertAlmostEqual(stokesQ.GetRealPart()->Value(0, 0), -1.0, "Real part of Stokes Q");
+	
+	TimeFrequencyData amplitude = data.Make(TimeFrequencyData::AmplitudePart);
+	AssertAlmostEqual(amplitude.GetImage(0)->Value(2, 2), sqrtn(5.0), "Amplitude of XX");
+	AssertTrue(data.Make(TimeFrequencyData::AmplitudePart).GetImage(1) == amplitude.GetImage(1), "Amplitude is reused");
+}
+
+inline void TimeFrequencyDataTest::TestInvalidation::operator()()
+{
+	TimeFrequencyData data = createData(1.0, 0.0, 1.0, 0.0);
+	Image2DCPtr single = data.GetSingleImage();
+	AssertAlmostEqual(single->Value(0, 0), 2.0);
+	TimeFrequencyData copy(data);
+	
+	data.SetImage(0, Image2D::CreateSetImagePtr(4, 3, 3.0));
+	AssertAlmostEqual(data.GetSingleImage()->Value(0, 0), 4.0, "Single image after SetImage()");
+	AssertAlmostEqual(data.Make(Polarization::StokesI).GetRealPart()->Value(0, 0), 4.0, "Stokes I after SetImage()");
+	AssertTrue(copy.GetSingleImage() == single, "Copy keeps its derived image");
+	
+	data.MultiplyImages(2.0);
+	AssertAlmostEqual(data.GetSingleImage()->Value(0, 0), 8.0, "Single image after MultiplyImages()");
+	
+	data.Subtract(copy);
+	AssertAlmostEqual(data.GetSingleImage()->Value(0, 0), 6.0, "Single image after Subtract()");
+}
+
+inline void TimeFrequencyDataTest::TestCopyOnWrite::operator()()
+{
+	TimeFrequencyData data = createData(1.0, 0.0, 1.0, 0.0);
+	TimeFrequencyData copy(data);
+	data.MultiplyImages(3.0);
+	AssertAlmostEqual(data.GetImage(0)->Value(0, 0), 3.0, "Changed data");
+	AssertAlmostEqual(copy.GetImage(0)->Value(0, 0), 1.0, "Copy is unchanged");
+	
+	// Images are no longer shared with the copy, so they are changed in place
+	const Image2D *image = data.GetImage(0).get();
+	data.MultiplyImages(2.0);
+	AssertTrue(data.GetImage(0).get() == image, "Unshared image is changed in place");
+	AssertAlmostEqual(data.GetImage(0)->Value(0, 0), 6.0);
+	
+	TimeFrequencyData source = createData(5.0, 5.0, 5.0, 5.0);
+	source.Trim(0, 0, 2, 2);
+	copy.CopyFrom(source, 1, 1);
+	AssertAlmostEqual(copy.GetImage(0)->Value(1, 1), 5.0, "Copied value");
+	AssertAlmostEqual(copy.GetImage(0)->Value(0, 0), 1.0, "Value outside of copied area");
+}
+
+#endif
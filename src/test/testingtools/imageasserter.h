@@ -1,6 +1,7 @@
 #ifndef AOFLAGGER_IMAGE_ASSERTER_H
 #define AOFLAGGER_IMAGE_ASSERTER_H
 
+#include <cmath>
 #include <string>
 #include <stdexcept>
 #include <sstream>
@@ -48,6 +49,50 @@ class ImageAsserter {
 			}
 		}
 		
+		/**
+		 * Like AssertEqual(), but allows an absolute difference of at most tolerance.
+		 * Samples that are NaN in both images are equal.
+		 */
+		static void AssertEqual(const Image2DCPtr &actual, const Image2DCPtr &expected, num_t tolerance, const std::string &str)
+		{
+			if(actual->Width() != expected->Width())
+				throw std::runtime_error("Width of images do not match");
+			if(actual->Height() != expected->Height())
+				throw std::runtime_error("Height of images do not match");
+
+			std::stringstream s;
+			s << "ImageAsserter::AssertEqual failed for test '" << str << "' with tolerance " << tolerance << ": ";
+
+			size_t errCount = 0;
+			for(size_t y=0;y<actual->Height();++y)
+			{
+				for(size_t x=0;x<actual->Width();++x)
+				{
+					const num_t a = actual->Value(x, y), e = expected->Value(x, y);
+					const bool bothNaN = std::isnan(a) && std::isnan(e);
+					if(!bothNaN && !(std::fabs(a - e) <= tolerance))
+					{
+						if(errCount < 25)
+						{
+							if(errCount != 0) s << ", ";
+							s
+							<< "sample (" << x << ',' << y << "), expected " << e
+							<< ", actual " << a;
+						} else if(errCount == 25)
+						{
+							s << ", ...";
+						}
+						++errCount;
+					}
+				}
+			}
+			if(errCount != 0)
+			{
+				s << ". " << errCount << " errors.";
+				throw std::runtime_error(s.str());
+			}
+		}
+
 		static void AssertConstant(const Image2DCPtr &actual, const num_t &expected, const std::string &str)
 		{
 			std::stringstream s;
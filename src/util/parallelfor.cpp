@@ -0,0 +1,109 @@
+#include "parallelfor.h"
+
+#include "../structures/system.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace {
+	// Zero means that no limit was set for the thread, in which case all processors are used
+	thread_local size_t maxThreadCount = 0;
+
+	void runPart(const boost::function<void(size_t, size_t)> *function, size_t start, size_t end, std::exception_ptr *error)
+	{
+		ParallelFor::Limit limit(1);
+		try {
+			(*function)(start, end);
+		} catch(...) {
+			*error = std::current_exception();
+		}
+	}
+
+	struct DynamicLoop
+	{
+		const boost::function<void(size_t)> *function;
+		std::atomic<size_t> next;
+		size_t n;
+
+		void Run(std::exception_ptr *error)
+		{
+			ParallelFor::Limit limit(1);
+			try {
+				for(size_t i=next++; i<n; i=next++)
+					(*function)(i);
+			} catch(...) {
+				*error = std::current_exception();
+				next = n;
+			}
+		}
+	};
+}
+
+ParallelFor::Limit::Limit(size_t maxThreadCount) :
+	_previousMaxThreadCount(::maxThreadCount)
+{
+	::maxThreadCount = maxThreadCount;
+}
+
+ParallelFor::Limit::~Limit()
+{
+	::maxThreadCount = _previousMaxThreadCount;
+}
+
+size_t ParallelFor::ThreadCount(size_t n)
+{
+	const size_t limit = maxThreadCount == 0 ? System::ProcessorCount() : maxThreadCount;
+	return std::max<size_t>(1, std::min(limit, n));
+}
+
+void ParallelFor::Run(size_t n, const boost::function<void(size_t, size_t)> &function)
+{
+	const size_t threadCount = ThreadCount(n);
+	if(threadCount == 1)
+	{
+		if(n != 0)
+			function(0, n);
+	} else {
+		std::vector<std::exception_ptr> errors(threadCount);
+		boost::thread_group threads;
+		for(size_t t=0; t!=threadCount; ++t)
+			threads.create_thread(boost::bind(&runPart, &function, n*t/threadCount, n*(t+1)/threadCount, &errors[t]));
+		threads.join_all();
+		for(size_t t=0; t!=threadCount; ++t)
+		{
+			if(errors[t])
+				std::rethrow_exception(errors[t]);
+		}
+	}
+}
+
+void ParallelFor::RunDynamic(size_t n, const boost::function<void(size_t)> &function)
+{
+	const size_t threadCount = ThreadCount(n);
+	if(threadCount == 1)
+	{
+		for(size_t i=0; i!=n; ++i)
+			function(i);
+	} else {
+		DynamicLoop loop;
+		loop.function = &function;
+		loop.next = 0;
+		loop.n = n;
+		std::vector<std::exception_ptr> errors(threadCount);
+		boost::thread_group threads;
+		for(size_t t=1; t!=threadCount; ++t)
+			threads.create_thread(boost::bind(&DynamicLoop::Run, &loop, &errors[t]));
+		loop.Run(&errors[0]);
+		threads.join_all();
+		for(size_t t=0; t!=threadCount; ++t)
+		{
+			if(errors[t])
+				std::rethrow_exception(errors[t]);
+		}
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <boost/function.hpp>
+
+#include <cstddef>
+
+/**
+ * Splits loops over several threads. The number of threads is limited per calling
+ * thread: the for each baseline action sets the limit to the thread count of the
+ * strategy, and loops inside its per-baseline workers and inside the threads of
+ * Run() itself run single threaded, because all threads are already in use there.
+ */
+class ParallelFor
+{
+	public:
+		/**
+		 * Limits the number of threads of the loops that are run by the current thread,
+		 * for as long as the object exists.
+		 */
+		class Limit
+		{
+			public:
+				/**
+				 * @param maxThreadCount Maximum number of threads, or zero to use all processors.
+				 */
+				explicit Limit(size_t maxThreadCount);
+				~Limit();
+			private:
+				Limit(const Limit &source);
+				void operator=(const Limit &source);
+
+				size_t _previousMaxThreadCount;
+		};
+
+		/**
+		 * Number of threads that Run() uses for a loop of n iterations: at most n,
+		 * at most the limit of the current thread and at least one.
+		 */
+		static size_t ThreadCount(size_t n);
+
+		/**
+		 * Splits the range [0, n) in ThreadCount(n) consecutive parts, and calls
+		 * function(start, end) for each part in its own thread. When there is only
+		 * one part, the function is called in the current thread. An exception
+		 * thrown by the function is rethrown once all threads have finished.
+		 */
+		static void Run(size_t n, const boost::function<void(size_t, size_t)> &function);
+
+		/**
+		 * Calls function(i) for each i in [0, n) on ThreadCount(n) threads, of which the
+		 * current thread is one. Each thread takes the next iteration when it finishes
+		 * one, which balances iterations that do not take equally long. An exception
+		 * thrown by the function stops the loop and is rethrown once all threads have
+		 * finished.
+		 */
+		static void RunDynamic(size_t n, const boost::function<void(size_t)> &function);
+	private:
+		ParallelFor();
+};
+
+#endif